@@ -32,7 +32,16 @@
   O(BIT_COR, bitcor, 3, ".T!float32!float64!void T, T, wT", "bitwise \"or\" booleans", true) S \
   O(BIT_XOR, bitxor, 3, ".T!float32!float64!void T, T, wT", "bitwise \"xor\" booleans", true) S \
   O(BIT_NOT, bitnot, 2, ".T!float32!float64!void T, wT", "bitwise negate boolean", true) S \
-  O(EFF, eff, 2, ".T any, wT", "perform side effect", false)
+  O(EFF, eff, 2, ".T any, wT", "perform side effect", false) S \
+  O(LBL, lbl, 1, " label", "start a basic block", false) S \
+  O(JMP, jmp, 1, " label", "jump to a block, must be last in block", false) S \
+  O(BR, br, 3, " bool, label, label", "branch to the first block if true, else to the second, must be last in block", false) S \
+  O(PHI, phi, 3, ".T!void T, T, wT", "value from the first or second predecessor, must be at the start of a block with two", false) S \
+  O(SHL, shl, 3, ".T!float32!float64!bool!void T, T, wT", "shift left, by less than the bit width", true) S \
+  O(SHR, shr, 3, ".T!float32!float64!bool!void T, T, wT", "shift right, arithmetic for signed types, by less than the bit width", true) S \
+  O(ARG, arg, 1, ".T!void T", "pass an argument to the next call, only followed by more arguments or the call", false) S \
+  O(CALL, call, 2, ".T!void func, wT", "call a function with the arguments right before it", false) S \
+  O(PAR, par, 2, ".T!void uint32, wT", "read a parameter of the function, by index", false)
 
 typedef uint8_t AcirOpcode;
 
@@ -48,6 +57,16 @@ int AcirOpcode_OperandCount(AcirOpcode opcode);
 const char *AcirOpcode_Signature(AcirOpcode opcode);
 const char *AcirOpcode_Description(AcirOpcode opcode);
 bool AcirOpcode_ConstEval(AcirOpcode opcode);
+/** Whether swapping the two inputs of OPCODE gives the same result. */
+bool AcirOpcode_IsCommutative(AcirOpcode opcode);
+
+/** Final mix of a 64-bit hash, shared by the hash tables: every input bit affects every output bit. */
+static inline uint64_t AcirHash_Mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDu;
+  h ^= h >> 33;
+  return h;
+}
 
 // O(NAME, MNEMONIC, DESCRIPTION)
 #define ACIR_BASIC_VALUE_TYPES_ENUM(O, S) \
@@ -79,9 +98,9 @@ const char *AcirBasicValueType_Description(AcirBasicValueType type);
 typedef struct AcirValueType AcirValueType;
 
 typedef struct {
-  AcirValueType *returnType;
+  const AcirValueType *returnType;
   size_t argumentCount;
-  AcirValueType *argumentTypes[];
+  const AcirValueType *argumentTypes[];
 } AcirFunctionValueType;
 
 struct AcirValueType {
@@ -97,12 +116,42 @@ struct AcirValueType {
   };
 };
 
-bool AcirBasicValueType_Equals(const AcirValueType *self, const AcirValueType *other);
+/** Canonical instance of a basic type, shared by every type table. */
+const AcirValueType *AcirValueType_Basic(AcirBasicValueType type);
+
+/**
+ * Interns pointer and function types, so that every type exists exactly once and equal
+ * types have equal pointers. Basic types are the shared \ref AcirValueType_Basic instances.
+ * Lookups (`Find*`) don't modify the table and may run concurrently.
+ */
+typedef struct {
+  AnchAllocator *allocator;
+  size_t count;
+  size_t capacity; // power of two.
+  const AcirValueType **slots;
+} AcirTypeTable;
+
+void AcirTypeTable_Init(AcirTypeTable *self, AnchAllocator *allocator);
+void AcirTypeTable_Free(AcirTypeTable *self);
+const AcirValueType *AcirTypeTable_Pointer(AcirTypeTable *self, const AcirValueType *pointee);
+const AcirValueType *AcirTypeTable_Function(AcirTypeTable *self,
+  const AcirValueType *returnType, size_t argumentCount, const AcirValueType *const *argumentTypes);
+/** Canonical instance of a (possibly hand-built) type, interning its parts as needed. */
+const AcirValueType *AcirTypeTable_Intern(AcirTypeTable *self, const AcirValueType *type);
+/** Interned pointer type to POINTEE, or NULL if nothing interned it yet. */
+const AcirValueType *AcirTypeTable_FindPointer(const AcirTypeTable *self, const AcirValueType *pointee);
+
+static inline const AcirValueType *AcirTypeTable_Basic(const AcirTypeTable *self, AcirBasicValueType type) {
+  (void)self;
+  return AcirValueType_Basic(type);
+}
 
 typedef uint8_t AcirOperandType;
 enum AcirOperandTypes {
   ACIR_OPERAND_TYPE_IMMEDIATE,
   ACIR_OPERAND_TYPE_BINDING,
+  ACIR_OPERAND_TYPE_LABEL, // `idx` names the block started by `lbl` with the same label.
+  ACIR_OPERAND_TYPE_FUNCTION, // `idx` is the index of a function in its module.
 };
 
 typedef enum {
@@ -138,6 +187,8 @@ typedef struct {
 } AcirOperand;
 
 const char *AcirOperandType_Name(AcirOperandType type);
+/** Payload of IMM as 64 bits, with unused bytes of narrower types cleared. */
+uint64_t AcirImmediateValue_Bits(const AcirImmediateValue *imm);
 
 #define ACIR_INSTR_NULL_INDEX ((size_t)-1)
 
@@ -160,26 +211,487 @@ void AcirOperand_Print(AnchCharWriteStream *out, const AcirOperand *self);
 void AcirValueType_Print(AnchCharWriteStream *out, const AcirValueType *self);
 
 typedef struct {
-  const AcirValueType *type;
+  const AcirValueType *type; // function type giving the parameters `par` reads, or NULL if it takes none.
   size_t code;
   const char *name;
   size_t instrCount;
   const AcirInstr *instrs;
 } AcirFunction;
 
-int AcirFunction_Validate(AcirFunction *self, AnchAllocator *allocator);
+/** Check types and bindings. Types of SELF must come from TYPES, which gets the pointer types it needs. Returns the number of errors. */
+int AcirFunction_Validate(AcirFunction *self, AcirTypeTable *types, AnchAllocator *allocator);
+/** Intern the pointer types validating SELF needs into TYPES, so \ref AcirFunction_ValidateTo only reads it. */
+void AcirFunction_PrepareValidation(const AcirFunction *self, AcirTypeTable *types);
+/** Like \ref AcirFunction_Validate after \ref AcirFunction_PrepareValidation, with errors written to OUT. Safe to run concurrently on a shared TYPES. */
+int AcirFunction_ValidateTo(const AcirFunction *self, const AcirTypeTable *types, AnchAllocator *allocator,
+  AnchCharWriteStream *out);
 void AcirFunction_Print(const AcirFunction *self, AnchCharWriteStream *out);
 
+/**
+ * Owns the instructions of `target`. Storage grows geometrically; pass an \ref AnchRegionAllocator
+ * as `allocator` to carve it out of a region when building many functions.
+ */
 typedef struct {
   AcirFunction *target;
   AnchAllocator *allocator;
   AcirInstr *instrs;
+  size_t capacity;
 } AcirBuilder;
 
 void AcirBuilder_Init(AcirBuilder *self, AcirFunction *target, AnchAllocator *allocator);
 void AcirBuilder_Free(AcirBuilder *self);
+/** Make room for at least COUNT instructions without changing the instruction count. */
+void AcirBuilder_Reserve(AcirBuilder *self, size_t count);
+/** Instruction at INDEX, zero-initialized if it is past the end (so are the ones in between). */
 AcirInstr *AcirBuilder_Add(AcirBuilder *self, size_t index);
+/**
+ * Append COUNT instructions at the end. Their `index` and `next` (unless ACIR_INSTR_NULL_INDEX)
+ * are relative to INSTRS and get shifted to where they land. Returns the first appended instruction.
+ */
+AcirInstr *AcirBuilder_Append(AcirBuilder *self, const AcirInstr *instrs, size_t count);
+/** Copy the instructions reachable from `code` of SELF to TARGET, in order and renumbered from 0. */
 void AcirBuilder_BuildNormalized(const AcirBuilder *self, AcirBuilder *target);
+/** Drop every instruction, keeping the storage for the next ones. */
+void AcirBuilder_Clear(AcirBuilder *self);
+/** Number the bindings of the code densely from 0, in order of first appearance. Returns how many there are. */
+size_t AcirBuilder_RenumberBindings(AcirBuilder *self);
+
+// Control flow graph. A block is a contiguous range of the function's instructions in
+// execution order: it starts at the entry, at `lbl` or after a `ret`/`jmp`/`br`. Successor and
+// predecessor lists are stored CSR-style: the edges of block B are
+// `succs[succOffsets[B]]...succs[succOffsets[B + 1] - 1]` (same for preds). Predecessors are
+// ordered by block index, which is the order `phi` operands refer to; a block with a `phi` has
+// exactly two. Nothing enters the first block, even when it is labeled.
+
+#define ACIR_BLOCK_NULL_INDEX UINT32_MAX
+
+typedef struct {
+  uint32_t first; // index into `order`.
+  uint32_t count;
+  uint32_t label; // ACIR_BLOCK_NULL_INDEX if the block has no `lbl`.
+} AcirBlock;
+
+typedef struct {
+  const AcirFunction *function;
+  AnchAllocator *allocator;
+  uint32_t instrCount;
+  uint32_t *order; // instruction indices in execution order.
+  uint32_t *instrBlocks; // block of every instruction (by instruction index), ACIR_BLOCK_NULL_INDEX if unlinked.
+  uint32_t blockCount;
+  AcirBlock *blocks;
+  uint32_t *succOffsets, *succs;
+  uint32_t *predOffsets, *preds;
+  uint32_t rpoCount; // blocks reachable from the entry.
+  uint32_t *rpo; // reverse postorder of the reachable blocks.
+} AcirCfg;
+
+void AcirCfg_Build(AcirCfg *self, const AcirFunction *function, AnchAllocator *allocator);
+void AcirCfg_Free(AcirCfg *self);
+void AcirCfg_Print(const AcirCfg *self, AnchCharWriteStream *out);
+
+static inline const uint32_t *AcirCfg_Succs(const AcirCfg *self, uint32_t block, uint32_t *count) {
+  *count = self->succOffsets[block + 1] - self->succOffsets[block];
+  return self->succs + self->succOffsets[block];
+}
+
+static inline const uint32_t *AcirCfg_Preds(const AcirCfg *self, uint32_t block, uint32_t *count) {
+  *count = self->predOffsets[block + 1] - self->predOffsets[block];
+  return self->preds + self->predOffsets[block];
+}
+
+static inline const AcirInstr *AcirCfg_Instr(const AcirCfg *self, uint32_t block, uint32_t i) {
+  return &self->function->instrs[self->order[self->blocks[block].first + i]];
+}
+
+static inline bool AcirOpcode_IsTerminator(AcirOpcode opcode) {
+  return opcode == ACIR_OPCODE_RET || opcode == ACIR_OPCODE_JMP || opcode == ACIR_OPCODE_BR;
+}
+
+// Dominator tree of the reachable blocks of a CFG, built with the iterative algorithm of
+// Cooper, Harvey and Kennedy. Children are stored CSR-style like the CFG edges, and every block
+// is numbered in preorder along with the last preorder number of its subtree, so dominance is
+// two comparisons.
+
+typedef struct {
+  const AcirCfg *cfg;
+  AnchAllocator *allocator;
+  uint32_t *idoms; // immediate dominator by block, ACIR_BLOCK_NULL_INDEX for the entry and unreachable blocks.
+  uint32_t *childOffsets, *children;
+  uint32_t *preorder; // by block, ACIR_BLOCK_NULL_INDEX if unreachable.
+  uint32_t *subtreeEnds; // by block, the largest preorder number of its subtree.
+} AcirDomTree;
+
+void AcirDomTree_Build(AcirDomTree *self, const AcirCfg *cfg, AnchAllocator *allocator);
+void AcirDomTree_Free(AcirDomTree *self);
+
+/** Whether every path from the entry to block B goes through block A. Blocks dominate themselves. */
+static inline bool AcirDomTree_Dominates(const AcirDomTree *self, uint32_t a, uint32_t b) {
+  return self->preorder[b] != ACIR_BLOCK_NULL_INDEX
+    && self->preorder[a] <= self->preorder[b] && self->preorder[b] <= self->subtreeEnds[a];
+}
+
+static inline const uint32_t *AcirDomTree_Children(const AcirDomTree *self, uint32_t block, uint32_t *count) {
+  *count = self->childOffsets[block + 1] - self->childOffsets[block];
+  return self->children + self->childOffsets[block];
+}
+
+// Natural loops. An edge to a block that dominates its source is a back edge, and the blocks
+// that reach the source without passing the header form the loop; back edges to the same header
+// make one loop. Loops are either disjoint or nested, outer loops are stored first.
+
+typedef struct {
+  uint32_t header;
+  uint32_t parent; // innermost enclosing loop, ACIR_BLOCK_NULL_INDEX if outermost.
+  uint32_t depth; // 1 for outermost loops.
+} AcirLoop;
+
+typedef struct {
+  AnchAllocator *allocator;
+  uint32_t loopCount;
+  AcirLoop *loops;
+  uint32_t *blockLoops; // innermost loop of every block, ACIR_BLOCK_NULL_INDEX outside of loops.
+} AcirLoopForest;
+
+void AcirLoopForest_Build(AcirLoopForest *self, const AcirCfg *cfg, const AcirDomTree *doms, AnchAllocator *allocator);
+void AcirLoopForest_Free(AcirLoopForest *self);
+
+/** Whether LOOP is INNER or encloses it. INNER may be ACIR_BLOCK_NULL_INDEX, for code outside of loops. */
+static inline bool AcirLoopForest_Contains(const AcirLoopForest *self, uint32_t loop, uint32_t inner) {
+  if(inner == ACIR_BLOCK_NULL_INDEX) return false;
+  while(self->loops[inner].depth > self->loops[loop].depth) inner = self->loops[inner].parent;
+  return inner == loop;
+}
+
+/** Number of loops around BLOCK, 0 outside of loops. */
+static inline uint32_t AcirLoopForest_Depth(const AcirLoopForest *self, uint32_t block) {
+  uint32_t loop = self->blockLoops[block];
+  return loop == ACIR_BLOCK_NULL_INDEX ? 0 : self->loops[loop].depth;
+}
+
+// Compact struct-of-arrays encoding of a function, in normalized (execution) order.
+// Operands are 32-bit references: binding indices, or indices into a deduplicated
+// immediate pool when ACIR_PACKED_REF_IMMEDIATE_BIT is set, or labels when ACIR_PACKED_REF_LABEL_BIT is set,
+// or functions when ACIR_PACKED_REF_FUNCTION_BIT is set along with it.
+
+typedef uint32_t AcirPackedRef;
+#define ACIR_PACKED_REF_NONE ((AcirPackedRef)UINT32_MAX)
+#define ACIR_PACKED_REF_IMMEDIATE_BIT ((AcirPackedRef)1 << 31)
+#define ACIR_PACKED_REF_LABEL_BIT ((AcirPackedRef)1 << 30) // only if the immediate bit is clear.
+#define ACIR_PACKED_REF_IS_IMMEDIATE(REF) (((REF) & ACIR_PACKED_REF_IMMEDIATE_BIT) != 0)
+#define ACIR_PACKED_REF_FUNCTION_BIT ((AcirPackedRef)1 << 29) // only if the label bit is set.
+#define ACIR_PACKED_REF_KIND_(REF) \
+  ((REF) & (ACIR_PACKED_REF_IMMEDIATE_BIT | ACIR_PACKED_REF_LABEL_BIT | ACIR_PACKED_REF_FUNCTION_BIT))
+#define ACIR_PACKED_REF_IS_LABEL(REF) (ACIR_PACKED_REF_KIND_(REF) == ACIR_PACKED_REF_LABEL_BIT)
+#define ACIR_PACKED_REF_IS_FUNCTION(REF) \
+  (ACIR_PACKED_REF_KIND_(REF) == (ACIR_PACKED_REF_LABEL_BIT | ACIR_PACKED_REF_FUNCTION_BIT))
+#define ACIR_PACKED_REF_INDEX(REF) ((REF) & (ACIR_PACKED_REF_IS_IMMEDIATE(REF) ? ~ACIR_PACKED_REF_IMMEDIATE_BIT \
+  : ~(ACIR_PACKED_REF_LABEL_BIT | ACIR_PACKED_REF_FUNCTION_BIT)))
+
+// operand columns: VAL (also LHS), RHS and OUT, same meaning as in AcirInstr.
+enum AcirPackedSlots {
+  ACIR_PACKED_SLOT_VAL,
+  ACIR_PACKED_SLOT_RHS,
+  ACIR_PACKED_SLOT_OUT,
+  ACIR_PACKED_SLOT_MAX_,
+};
+
+typedef struct {
+  const char *name;
+  uint32_t instrCount;
+  uint32_t typeCount;
+  uint32_t immCount;
+  AcirOpcode *opcodes;
+  uint32_t *types; // indices into `typePool`.
+  AcirPackedRef *operands[ACIR_PACKED_SLOT_MAX_];
+  const AcirValueType **typePool;
+  AcirImmediateValue *imms;
+  AnchAllocator *allocator;
+} AcirPackedFunction;
+
+void AcirPackedFunction_Pack(AcirPackedFunction *self, const AcirFunction *source, AnchAllocator *allocator);
+void AcirPackedFunction_Free(AcirPackedFunction *self);
+void AcirPackedFunction_Unpack(const AcirPackedFunction *self, AcirBuilder *target);
+size_t AcirPackedFunction_ByteSize(const AcirPackedFunction *self);
+
+static inline AcirPackedRef AcirPackedFunction_Operand(const AcirPackedFunction *self, uint32_t instr, int slot) {
+  return self->operands[slot][instr];
+}
+
+static inline const AcirImmediateValue *AcirPackedFunction_Imm(const AcirPackedFunction *self, AcirPackedRef ref) {
+  return &self->imms[ACIR_PACKED_REF_INDEX(ref)];
+}
+
+// A module owns a set of functions sharing one type table, constant pool and symbol table.
+// Every function builds into its own arena, so it can be built, optimized and freed without
+// touching the others. Freeing a function keeps its symbol, as a declaration without code.
+// Adding functions, constants or types is not thread-safe; building different functions at once
+// is, as long as the types they need are interned beforehand and the module allocator is thread-safe.
+
+#define ACIR_MODULE_NULL_INDEX UINT32_MAX
+
+typedef struct {
+  AcirFunction function;
+  AcirBuilder builder; // targets `function`.
+  AnchRegionAllocator arena; // backs `builder`.
+} AcirModuleFunction;
+
+typedef struct {
+  AnchAllocator *allocator;
+  AcirTypeTable types;
+  uint32_t functionCount, functionCapacity;
+  AcirModuleFunction **functions; // individually allocated, builders point into them.
+  uint32_t symbolCapacity; // power of two.
+  uint32_t *symbols; // function indices hashed by name, ACIR_MODULE_NULL_INDEX if empty.
+  uint32_t constantCount, constantCapacity; // capacity is a power of two.
+  AcirImmediateValue *constants;
+  uint32_t *constantSlots; // `2 * constantCapacity` constant indices hashed by value.
+} AcirModule;
+
+void AcirModule_Init(AcirModule *self, AnchAllocator *allocator);
+void AcirModule_Free(AcirModule *self);
+/** Add an empty function, NAME is copied. Returns its index, or ACIR_MODULE_NULL_INDEX if NAME is taken. */
+uint32_t AcirModule_AddFunction(AcirModule *self, const char *name, const AcirValueType *type);
+/** Index of the function named NAME, or ACIR_MODULE_NULL_INDEX. */
+uint32_t AcirModule_FindFunction(const AcirModule *self, const char *name);
+/** Release the code of function INDEX. Its builder stays usable, to build it again. */
+void AcirModule_FreeFunction(AcirModule *self, uint32_t index);
+/** Index of IMM in the constant pool, added if not there yet. Its type must come from `types`. */
+uint32_t AcirModule_Constant(AcirModule *self, const AcirImmediateValue *imm);
+/**
+ * Validate every function that has code, on up to THREADCOUNT threads (0 for one per processor).
+ * Calls are checked against their callee: a callee with a function type takes arguments and
+ * returns the value it declares, one without takes no arguments. ALLOCATOR must be thread-safe
+ * unless THREADCOUNT is 1. Errors are written to `wsStderr` in function order. Returns the number of errors.
+ */
+int AcirModule_Validate(AcirModule *self, AnchAllocator *allocator, size_t threadCount);
+void AcirModule_Print(const AcirModule *self, AnchCharWriteStream *out);
+
+static inline AcirModuleFunction *AcirModule_Function(const AcirModule *self, uint32_t index) {
+  return self->functions[index];
+}
+
+static inline const AcirImmediateValue *AcirModule_GetConstant(const AcirModule *self, uint32_t index) {
+  return &self->constants[index];
+}
+
+// Binary format, for caching and shipping IR. A file is a header followed by sections; every
+// offset is relative to the start of the file and every record has a fixed size and alignment,
+// so a file loaded or mapped anywhere (8-byte aligned) is used in place by \ref AcirBinaryReader.
+// Types, immediates and names are shared by all functions of a file. Operands use the
+// \ref AcirPackedRef encoding. Multi-byte fields are in host byte order; a file from a host with
+// the other order fails the magic check.
+
+#define ACIR_BINARY_MAGIC 0x52494341u // "ACIR" when read little-endian.
+#define ACIR_BINARY_VERSION 2
+#define ACIR_BINARY_NULL_INDEX UINT32_MAX
+
+enum AcirBinarySections {
+  ACIR_BINARY_SECTION_TYPES, // AcirBinaryType[]
+  ACIR_BINARY_SECTION_TYPE_ARGUMENTS, // uint32_t[] type indices of function arguments.
+  ACIR_BINARY_SECTION_IMMS, // AcirBinaryImm[]
+  ACIR_BINARY_SECTION_NAMES, // NUL-terminated strings.
+  ACIR_BINARY_SECTION_FUNCTIONS, // AcirBinaryFunction[]
+  ACIR_BINARY_SECTION_INSTRS, // AcirBinaryInstr[], every function's instructions in execution order.
+  ACIR_BINARY_SECTION_MAX_,
+};
+
+typedef struct {
+  uint32_t offset, size; // in bytes.
+} AcirBinarySection;
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t headerSize;
+  uint32_t size; // of the whole file.
+  uint32_t checksum; // of everything after the header.
+  AcirBinarySection sections[ACIR_BINARY_SECTION_MAX_];
+} AcirBinaryHeader;
+
+typedef struct {
+  uint8_t type; // ACIR_VALUE_TYPE_*
+  uint8_t basic;
+  uint16_t reserved;
+  uint32_t target; // pointee or return type, only earlier types are referenced.
+  uint32_t argumentCount;
+  uint32_t arguments; // first index in the type arguments section.
+} AcirBinaryType;
+
+typedef struct {
+  uint32_t type; // ACIR_BINARY_NULL_INDEX if untyped.
+  uint32_t reserved;
+  uint64_t bits; // \ref AcirImmediateValue_Bits
+} AcirBinaryImm;
+
+typedef struct {
+  uint32_t name; // offset into the names section.
+  uint32_t type; // ACIR_BINARY_NULL_INDEX if none.
+  uint32_t firstInstr;
+  uint32_t instrCount;
+} AcirBinaryFunction;
+
+typedef struct {
+  uint8_t opcode;
+  uint8_t reserved[3];
+  uint32_t type;
+  AcirPackedRef operands[ACIR_PACKED_SLOT_MAX_];
+} AcirBinaryInstr;
+
+typedef enum {
+  ACIR_BINARY_OK,
+  ACIR_BINARY_ERROR_TRUNCATED,
+  ACIR_BINARY_ERROR_MAGIC,
+  ACIR_BINARY_ERROR_VERSION,
+  ACIR_BINARY_ERROR_CHECKSUM,
+  ACIR_BINARY_ERROR_MALFORMED,
+} AcirBinaryError;
+
+const char *AcirBinaryError_Message(AcirBinaryError error);
+
+/** Collects functions, then lays them out in one buffer. Types and immediates are deduplicated. */
+typedef struct {
+  AnchAllocator *allocator;
+  AnchDynArray sections[ACIR_BINARY_SECTION_MAX_]; // contents so far.
+  AnchDynArray typeKeys; // `const AcirValueType*` of every written type, by index.
+  uint32_t typeSlotCapacity, immSlotCapacity; // powers of two.
+  uint32_t *typeSlots, *immSlots; // type and immediate indices hashed by value, ACIR_BINARY_NULL_INDEX if empty.
+} AcirBinaryWriter;
+
+void AcirBinaryWriter_Init(AcirBinaryWriter *self, AnchAllocator *allocator);
+void AcirBinaryWriter_Free(AcirBinaryWriter *self);
+void AcirBinaryWriter_AddFunction(AcirBinaryWriter *self, const AcirFunction *function);
+void AcirBinaryWriter_AddModule(AcirBinaryWriter *self, const AcirModule *module);
+/** The file, allocated with the writer's allocator. The writer can't be used afterwards, except to free it. */
+void *AcirBinaryWriter_Finish(AcirBinaryWriter *self, size_t *size);
+
+/** Read-only view of a file. Types are resolved lazily and in order into `types`, everything else is used in place. */
+typedef struct {
+  const uint8_t *data;
+  const AcirBinaryHeader *header;
+  AcirTypeTable *types;
+  AnchAllocator *allocator;
+  const AcirValueType **resolvedTypes; // by type index.
+  uint32_t resolvedTypeCount; // types below it are resolved, the others not yet.
+} AcirBinaryReader;
+
+/** Check the header, checksum and section bounds of the SIZE bytes at DATA, which must stay alive and unchanged. */
+AcirBinaryError AcirBinaryReader_Init(AcirBinaryReader *self, const void *data, size_t size,
+  AcirTypeTable *types, AnchAllocator *allocator);
+void AcirBinaryReader_Free(AcirBinaryReader *self);
+/** Interned type at INDEX, NULL for ACIR_BINARY_NULL_INDEX. */
+const AcirValueType *AcirBinaryReader_Type(AcirBinaryReader *self, uint32_t index);
+/** Append function INDEX to TARGET (usually empty). Function operands stay indices into the file. Fails on out-of-range operands or types. */
+AcirBinaryError AcirBinaryReader_ReadFunction(AcirBinaryReader *self, uint32_t index, AcirBuilder *target);
+/**
+ * Add every function to MODULE, which must use the reader's type table. Functions whose name is
+ * taken are skipped, and calls to them go to the function of MODULE with that name.
+ */
+AcirBinaryError AcirBinaryReader_ReadModule(AcirBinaryReader *self, AcirModule *module);
+
+static inline const void *AcirBinaryReader_Section(const AcirBinaryReader *self, int section, uint32_t *count, size_t recordSize) {
+  const AcirBinarySection *s = &self->header->sections[section];
+  if(count) *count = s->size / recordSize;
+  return self->data + s->offset;
+}
+
+static inline uint32_t AcirBinaryReader_FunctionCount(const AcirBinaryReader *self) {
+  return self->header->sections[ACIR_BINARY_SECTION_FUNCTIONS].size / sizeof(AcirBinaryFunction);
+}
+
+static inline const AcirBinaryFunction *AcirBinaryReader_Function(const AcirBinaryReader *self, uint32_t index) {
+  return (const AcirBinaryFunction*)AcirBinaryReader_Section(self, ACIR_BINARY_SECTION_FUNCTIONS, NULL, 1) + index;
+}
+
+static inline const char *AcirBinaryReader_Name(const AcirBinaryReader *self, const AcirBinaryFunction *function) {
+  return (const char*)AcirBinaryReader_Section(self, ACIR_BINARY_SECTION_NAMES, NULL, 1) + function->name;
+}
+
+static inline const AcirBinaryInstr *AcirBinaryReader_Instrs(const AcirBinaryReader *self, const AcirBinaryFunction *function) {
+  return (const AcirBinaryInstr*)AcirBinaryReader_Section(self, ACIR_BINARY_SECTION_INSTRS, NULL, 1) + function->firstInstr;
+}
+
+// Assembler for the syntax printed by \ref AcirFunction_Print and \ref AcirModule_Print:
+//
+//     0 | $0.uint64 = uint64#64
+//     1 | add.uint64 $0, uint64#12, $1 -> 3
+//
+// Instruction indices (`N |`) are optional and default to the previous one plus one; `-> N` and
+// `-> end` set `next`, which otherwise is the following index (or the end, for the last one).
+// ANSI escapes are skipped, so colored output reads back too, and `//` starts a comment.
+// In a module, a function starts with `NAME:` or `NAME: fn(TYPE, ...) TYPE`, and `call` names
+// its callee by index, as `&N`.
+// Errors are reported as `FILENAME:LINE:COLUMN: error: ...` and parsing resumes on the next line.
+
+typedef struct {
+  AcirTypeTable *types;
+  AnchCharWriteStream *diagnostics; // NULL to only count errors.
+  const char *filename;
+  int errorCount;
+  const uint8_t *cursor, *end, *lineStart;
+  size_t line, lineCount;
+  uint64_t opcodeKeys[ACIR_OPCODE_MAX_]; // mnemonics packed into 8 bytes, for comparing as integers.
+  uint64_t typeKeys[ACIR_BASIC_VALUE_TYPE_MAX_];
+} AcirParser;
+
+void AcirParser_Init(AcirParser *self, AcirTypeTable *types, AnchCharWriteStream *diagnostics, const char *filename);
+/** Parse instructions from the SIZE bytes at TEXT into TARGET, which must be empty. Returns the number of errors. */
+int AcirParser_ParseFunction(AcirParser *self, const char *text, size_t size, AcirBuilder *target);
+/** Parse `NAME:` headed functions and `const` lines into MODULE, which must use the parser's type table. */
+int AcirParser_ParseModule(AcirParser *self, const char *text, size_t size, AcirModule *module);
+
+// Def-use chains over the instructions of a builder. Every binding knows its defining
+// instruction and its uses; a use is an operand slot, numbered `instr * ACIR_PACKED_SLOT_MAX_
+// + slot` with the slots of \ref AcirPackedSlots, and the uses of a binding form an
+// intrusive doubly-linked list, so adding and removing one is O(1) and listing them is O(uses).
+// The chains follow changes made through `Link`/`Unlink`/`SetOperand`; editing instructions
+// directly in between makes them stale.
+
+#define ACIR_DEFUSE_NULL_INDEX UINT32_MAX
+
+typedef struct {
+  AcirBuilder *builder;
+  AnchAllocator *allocator;
+  uint32_t bindingCapacity;
+  uint32_t *defs; // defining instruction by binding.
+  uint32_t *firstUses; // by binding.
+  uint32_t *useCounts; // by binding.
+  uint32_t useCapacity; // in uses, a multiple of ACIR_PACKED_SLOT_MAX_.
+  uint32_t *prevUses, *nextUses; // by use, ACIR_DEFUSE_NULL_INDEX at the ends (and for unlinked slots).
+} AcirDefUse;
+
+/** Chains for the instructions reachable from `code` of the builder's function. */
+void AcirDefUse_Build(AcirDefUse *self, AcirBuilder *builder, AnchAllocator *allocator);
+void AcirDefUse_Free(AcirDefUse *self);
+/** Record the definition and uses of instruction INSTR, after it was added or changed. */
+void AcirDefUse_Link(AcirDefUse *self, size_t instr);
+/** Forget the definition and uses of instruction INSTR, before it is removed or changed. */
+void AcirDefUse_Unlink(AcirDefUse *self, size_t instr);
+/** Replace operand SLOT of instruction INSTR, keeping the chains up to date. */
+void AcirDefUse_SetOperand(AcirDefUse *self, size_t instr, int slot, const AcirOperand *operand);
+/** Make every use of BINDING use WITH instead. */
+void AcirDefUse_ReplaceAllUses(AcirDefUse *self, size_t binding, const AcirOperand *with);
+
+/** Operand SLOT of INSTR, slots as in \ref AcirPackedSlots. NULL if the opcode has no such operand. */
+AcirOperand *AcirInstr_Operand(AcirInstr *self, int slot);
+
+static inline uint32_t AcirDefUse_Def(const AcirDefUse *self, size_t binding) {
+  return binding < self->bindingCapacity ? self->defs[binding] : ACIR_DEFUSE_NULL_INDEX;
+}
+
+static inline uint32_t AcirDefUse_UseCount(const AcirDefUse *self, size_t binding) {
+  return binding < self->bindingCapacity ? self->useCounts[binding] : 0;
+}
+
+static inline uint32_t AcirDefUse_FirstUse(const AcirDefUse *self, size_t binding) {
+  return binding < self->bindingCapacity ? self->firstUses[binding] : ACIR_DEFUSE_NULL_INDEX;
+}
+
+static inline uint32_t AcirDefUse_NextUse(const AcirDefUse *self, uint32_t use) {
+  return self->nextUses[use];
+}
+
+static inline uint32_t AcirDefUse_UseInstr(uint32_t use) { return use / ACIR_PACKED_SLOT_MAX_; }
+static inline int AcirDefUse_UseSlot(uint32_t use) { return use % ACIR_PACKED_SLOT_MAX_; }
 
 // TODO: move these to a local header file? maybe just impl file?
 
@@ -191,9 +703,10 @@ enum AcirOptimizerBindingFlags {
 };
 
 typedef struct {
-  bool exists, used;
+  bool exists;
   AcirOptimizerBindingFlags flags;
   AcirImmediateValue constant;
+  size_t def; // defining instruction, only kept by AcirOptimizer_ConstantFold.
 } AcirOptimizer_Binding;
 
 typedef struct {
@@ -225,5 +738,170 @@ void AcirOptimizer_Free(AcirOptimizer *self);
 void AcirOptimizer_Analyze(AcirOptimizer *self);
 void AcirOptimizer_ConstantFold(AcirOptimizer *self);
 void AcirOptimizer_DeadCode(AcirOptimizer *self);
+/** Evaluate the consteval INSTR with constant operands LHS and RHS (LHS only for unary opcodes). */
+void AcirInstr_ConstEval(const AcirInstr *instr, AcirImmediateValue *result,
+  const AcirImmediateValue *lhs, const AcirImmediateValue *rhs);
+/**
+ * Whether evaluating INSTR with LHS and RHS is undefined: integer division by zero, signed division of
+ * the smallest value by -1, or a shift by the bit width or more. LHS is NULL when it isn't known.
+ */
+bool AcirInstr_ConstEvalTraps(const AcirInstr *instr, const AcirImmediateValue *lhs, const AcirImmediateValue *rhs);
+/** Fold constant operands of INSTR or apply the first matching peephole rule, in place. Returns whether it changed. */
+bool AcirInstr_Peephole(AcirInstr *instr);
+
+// Memo of optimized functions. A function's key is a canonical encoding of its code: the
+// function type, then the opcode, type and operands of every instruction in execution order,
+// with bindings and labels numbered by first appearance, immediates by type and value and
+// callees by name, so copies of the same code under other numbers or in another module share
+// it. Keys are compared whole, the hash only finds them. A result is kept as a binary file
+// (see \ref AcirBinaryWriter) holding the optimized function, then a declaration for each of
+// its callees, so it can be read into any module that has functions of those names.
+
+#define ACIR_MEMO_NULL_INDEX UINT32_MAX
+
+typedef struct {
+  uint64_t hash;
+  uint32_t keyCount; // in words.
+  uint32_t size; // of `data`, in bytes.
+  uint64_t *key;
+  void *data;
+} AcirMemoEntry;
+
+typedef struct {
+  AnchAllocator *allocator;
+  uint32_t entryCount, entryCapacity;
+  AcirMemoEntry *entries;
+  uint32_t slotCapacity; // power of two.
+  uint32_t *slots; // entry indices hashed by key, ACIR_MEMO_NULL_INDEX if empty.
+  uint32_t hits, misses; // by \ref AcirPassManager_RunModule.
+} AcirMemo;
+
+void AcirMemo_Init(AcirMemo *self, AnchAllocator *allocator);
+void AcirMemo_Free(AcirMemo *self);
+/** Append the key words (uint64_t) of FUNCTION to KEY. Callees are named through MODULE. */
+void AcirMemo_Key(AnchDynArray *key, const AcirModule *module, const AcirFunction *function);
+/** Append STRING to KEY, for what else a result depends on, like the passes that made it. */
+void AcirMemo_KeyString(AnchDynArray *key, const char *string);
+/** Structural hash of the COUNT words of KEY. */
+uint64_t AcirMemo_Hash(const uint64_t *key, uint32_t count);
+/** The entry stored under KEY, or NULL. */
+const AcirMemoEntry *AcirMemo_Find(const AcirMemo *self, const uint64_t *key, uint32_t count);
+/** Store the code of function INDEX of MODULE under KEY, unless something is stored there already. */
+void AcirMemo_Store(AcirMemo *self, const uint64_t *key, uint32_t count, AcirModule *module, uint32_t index);
+/** Replace the code of function INDEX of MODULE by the result of ENTRY. On failure the code is left as it was. */
+AcirBinaryError AcirMemo_Restore(const AcirMemoEntry *entry, AcirModule *module, uint32_t index, AnchAllocator *allocator);
+/** Write every entry to FILENAME. Returns false if it can't be written. */
+bool AcirMemo_Save(const AcirMemo *self, const char *filename);
+/** Add the entries of a file written by \ref AcirMemo_Save. Returns false if it can't be read or is malformed, keeping the entries read before. */
+bool AcirMemo_Load(AcirMemo *self, const char *filename);
+
+// Pass manager. Passes rewrite a function through its builder and declare the analyses they
+// need and the ones they break; analyses are built on demand and kept until a pass invalidates
+// them. Each pass has the lowest optimization level it runs at, so `-O0` runs nothing.
+
+typedef uint32_t AcirAnalysisSet;
+enum AcirAnalysisSets {
+  ACIR_ANALYSIS_NONE = 0,
+  ACIR_ANALYSIS_CFG = 1 << 0,
+  ACIR_ANALYSIS_DEFUSE = 1 << 1,
+  ACIR_ANALYSIS_DOMINATORS = 1 << 2, // needs the CFG, and is dropped with it.
+  ACIR_ANALYSIS_LOOPS = 1 << 3, // needs the dominators, and is dropped with them.
+  ACIR_ANALYSIS_ALL = ACIR_ANALYSIS_CFG | ACIR_ANALYSIS_DEFUSE | ACIR_ANALYSIS_DOMINATORS | ACIR_ANALYSIS_LOOPS,
+};
+
+typedef struct AcirPassManager AcirPassManager;
+typedef void AcirPassFunc(AcirPassManager *manager, AcirBuilder *builder);
+
+typedef struct {
+  const char *name;
+  AcirPassFunc *run;
+  int level; // lowest optimization level the pass runs at.
+  AcirAnalysisSet requires;
+  AcirAnalysisSet invalidates;
+} AcirPass;
+
+typedef struct {
+  uint32_t runs;
+  double seconds; // wall time of all runs.
+  int64_t instrDelta; // change in reachable instructions over all runs.
+} AcirPassStats;
+
+struct AcirPassManager {
+  AnchAllocator *allocator;
+  int level;
+  uint32_t passCount;
+  uint32_t passCapacity;
+  AcirPass *passes;
+  AcirPassStats *stats; // by pass.
+  AcirBuilder *builder; // function being run, whose analyses are cached.
+  AcirAnalysisSet valid;
+  AcirCfg cfg;
+  AcirDefUse defUse;
+  AcirDomTree dominators;
+  AcirLoopForest loops;
+  uint32_t inlinedCalls; // by \ref AcirPassManager_RunModule.
+  AcirMemo *memo; // results \ref AcirPassManager_RunModule reuses and adds to, or NULL.
+};
+
+void AcirPassManager_Init(AcirPassManager *self, AnchAllocator *allocator, int level);
+void AcirPassManager_Free(AcirPassManager *self);
+/** Add PASS to the end of the pipeline. Returns its index. */
+uint32_t AcirPassManager_AddPass(AcirPassManager *self, const AcirPass *pass);
+/** Add the built-in passes, in their usual order. */
+void AcirPassManager_AddDefaultPasses(AcirPassManager *self);
+/** Run the passes of the current level over the function of BUILDER. */
+void AcirPassManager_Run(AcirPassManager *self, AcirBuilder *builder);
+/**
+ * Run over every function of MODULE that has code, callees before their callers. From `-O1` on,
+ * calls are inlined first, see \ref AcirInliner. With a `memo`, a function whose code and
+ * pipeline were seen before gets the stored result instead of running the passes.
+ */
+void AcirPassManager_RunModule(AcirPassManager *self, AcirModule *module);
+/** The CFG of the function being run. Only valid in passes that require it. */
+const AcirCfg *AcirPassManager_Cfg(AcirPassManager *self);
+/** The def-use chains of the function being run. Only valid in passes that require them. */
+AcirDefUse *AcirPassManager_DefUse(AcirPassManager *self);
+/** The dominator tree of the function being run. Only valid in passes that require it. */
+const AcirDomTree *AcirPassManager_Dominators(AcirPassManager *self);
+/** The loops of the function being run. Only valid in passes that require them. */
+const AcirLoopForest *AcirPassManager_Loops(AcirPassManager *self);
+/** Write the time and instruction delta of each pass. */
+void AcirPassManager_PrintStats(const AcirPassManager *self, AnchCharWriteStream *out);
+
+// Built-in passes, see \ref AcirPassManager_AddDefaultPasses for what they need.
+
+/** Sparse conditional constant propagation: folds constants through bindings and drops branches never taken. */
+void AcirPass_Sccp(AcirPassManager *manager, AcirBuilder *builder);
+/** Copy propagation: uses of `set` copies read the original binding, then bindings are renumbered densely. */
+void AcirPass_CopyProp(AcirPassManager *manager, AcirBuilder *builder);
+/** Global value numbering: removes expressions already computed in a dominating block of the same tree. */
+void AcirPass_Gvn(AcirPassManager *manager, AcirBuilder *builder);
+/** Peephole rules applied until nothing changes, passing new constants on to their uses. */
+void AcirPass_Peephole(AcirPassManager *manager, AcirBuilder *builder);
+/** Loop-invariant code motion: moves pure instructions that don't depend on a loop into its preheader. */
+void AcirPass_Licm(AcirPassManager *manager, AcirBuilder *builder);
+
+// Inliner. A call is replaced by a copy of its callee when that is cheap enough: the callee's
+// size, less a bonus for each constant argument and for the call sequence itself, has to stay
+// within `threshold`. Functions are visited in bottom-up call graph order, so a callee has had
+// its own calls inlined by the time it is copied. Calls within a cycle of recursive functions
+// are kept, and so are calls to functions with more than one `ret` or a labeled entry.
+
+#define ACIR_INLINER_DEFAULT_THRESHOLD 24
+
+typedef struct {
+  AcirModule *module;
+  AnchAllocator *allocator;
+  uint32_t threshold;
+  uint32_t *order; // function indices, callees before callers.
+  uint32_t *components; // strongly connected component of every function, numbered along `order`.
+  AnchDynArray scratch; // the callee copy being built.
+} AcirInliner;
+
+/** Build the call graph of MODULE. Functions added to the module afterwards are not part of it. */
+void AcirInliner_Init(AcirInliner *self, AcirModule *module, AnchAllocator *allocator, uint32_t threshold);
+void AcirInliner_Free(AcirInliner *self);
+/** Inline the calls of function INDEX that are worth it, then renumber its bindings. Returns how many were inlined. */
+uint32_t AcirInliner_Run(AcirInliner *self, uint32_t index);
 
 #endif
@@ -1,6 +1,7 @@
 #ifndef ANNEC_LEXER_H
 #define ANNEC_LEXER_H
 #include <annec_anchor.h>
+#include <annec/symbols.h>
 
 typedef struct AncfStringView {
 	size_t length;
@@ -148,6 +149,7 @@ typedef enum AncTokenType {
 } AncTokenType;
 
 AncTokenType AncTokenType_FromKeyword(const char *keyword);
+AncTokenType AncTokenType_FromKeywordN(const uint8_t *keyword, size_t length);
 
 typedef struct AncSourcePosition {
 	unsigned int line;
@@ -172,27 +174,52 @@ static inline bool AncSourceSpan_Equal(AncSourceSpan *self, AncSourceSpan *other
 
 typedef struct AncToken {
 	AncTokenType type;
+	/**
+	 * Token spelling, not NUL-terminated. If `materialized` it is stored in the lexer's
+	 * `tokenValues` (e.g. strings with escapes, number literals), otherwise it is an absolute
+	 * byte range of the input file. Use \ref AncLexer_TokenValue to access it.
+	 */
 	AncArenaStringView value;
+	bool materialized;
 	AncSourceSpan span;
+	AncSymbol symbol; // for identifiers, if the lexer has a symbol table. ANC_SYMBOL_NULL if it is full.
 } AncToken;
 
+/**
+ * Source file reader. Bytes are pulled from `stream` into `buffer` and decoded from there.
+ *
+ * By default the whole file is retained and `lineStarts` indexes every line for diagnostics.
+ * In streaming mode (\ref AncInputFile_InitStreaming) the buffer is refilled in windows of
+ * `windowSize` bytes, bytes before the current line are discarded, and only the current line
+ * can be shown in diagnostics, so memory use does not depend on the size of the input.
+ */
 typedef struct AncInputFile {
 	AnchAllocator *allocator;
 	AnchUtf8ReadStream *stream;
 	AncSourcePosition position;
-	AnchDynArray_Type(AncString) lines;
-	char32_t peek;
+	AnchDynArray_Type(uint8_t) buffer;
+	size_t bufferStart; // absolute offset of the first byte in `buffer`.
+	size_t offset; // absolute offset of the next byte to decode.
+	size_t lineStart; // absolute offset of the first byte of the current line.
+	size_t charOffset; // absolute offset of the character last returned by \ref AncInputFile_Get.
+	size_t windowSize; // 0 if the whole file is retained.
+	size_t pin; // absolute offset of the first byte that must stay buffered in streaming mode, SIZE_MAX if none.
+	AnchDynArray_Type(size_t) lineStarts; // absolute offset of every line, empty in streaming mode.
+	bool eof;
 	const char *filename;
+	AnchCharWriteStream *diagnostics; // where errors are reported, `wsStderr` by default.
 } AncInputFile;
 
 void AncInputFile_Init(AncInputFile *self, AnchAllocator *allocator, AnchUtf8ReadStream *input, const char *filename);
+void AncInputFile_InitStreaming(AncInputFile *self, AnchAllocator *allocator, AnchUtf8ReadStream *input, const char *filename, size_t windowSize);
 void AncInputFile_ReadLines(AncInputFile *self);
 void AncInputFile_Free(AncInputFile *self);
 void AncInputFile_ReportError(AncInputFile *self, bool show, const AncSourceSpan *span, const char *fmt, ...)
 	__attribute__((format(printf, 4, 5)));
 char32_t AncInputFile_Get(AncInputFile *self);
 char32_t AncInputFile_Peek(AncInputFile *self);
-AncString *AncInputFile_GetLine(AncInputFile *self, unsigned int lineIndex);
+/** Line LINEINDEX without its terminator. Empty (NULL bytes) if the line is no longer retained. */
+AncStringView AncInputFile_GetLine(AncInputFile *self, unsigned int lineIndex);
 	
 #define ANC_INPUT_FILE_EOF ANCH_UTF8_STREAM_EOF
 
@@ -202,10 +229,20 @@ typedef struct AncLexer {
 	AnchArena tokenValues;
 	AnchDynArray_Type(AncToken) tokens;
 	AnchDynArray_Type(intptr_t) tokenPeekBuf;
+	ANCH_NULLABLE(AncSymbolTable *) symbols; // identifiers are interned here if set.
 } AncLexer;
 
 void AncLexer_Init(AncLexer *self, AnchAllocator *allocator, AncInputFile *input);
 void AncLexer_Free(AncLexer *self);
 AncToken *AncLexer_Read(AncLexer *self);
+/** Spelling of TOKEN. Stays valid until the token is acknowledged (or the lexer freed). */
+AncStringView AncLexer_TokenValue(const AncLexer *self, const AncToken *token);
+
+/**
+ * Acknowledge every token returned by \ref AncLexer_Read so far. Their slots and values are
+ * reused by the next read, so the tokens (and pointers to them) must not be used afterwards.
+ * Calling this regularly keeps the lexer's memory use bounded when streaming.
+ */
+void AncLexer_Acknowledge(AncLexer *self);
 
 #endif
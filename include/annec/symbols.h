@@ -0,0 +1,50 @@
+#ifndef ANNEC_SYMBOLS_H
+#define ANNEC_SYMBOLS_H
+#include <annec_anchor.h>
+#include <threads.h>
+
+/** Interned string handle. Equal spellings always get the same symbol from the same table. */
+typedef uint32_t AncSymbol;
+
+#define ANC_SYMBOL_NULL ((AncSymbol)0)
+
+#define ANC_SYMBOL_TABLE_SHARD_BITS 6
+#define ANC_SYMBOL_TABLE_SHARD_COUNT (1 << ANC_SYMBOL_TABLE_SHARD_BITS)
+
+typedef struct AncSymbolTable_Entry {
+	uint64_t hash;
+	size_t length;
+	const uint8_t *bytes; // NUL-terminated, never moves.
+} AncSymbolTable_Entry;
+
+typedef struct AncSymbolTable_Shard {
+	_Alignas(64) mtx_t lock; // aligned so that shards don't share cache lines.
+	size_t capacity; // power of two.
+	uint32_t *slots; // 0 if empty, else entry index + 1.
+	AnchDynArray_Type(AncSymbolTable_Entry) entries;
+	AnchDynArray_Type(uint8_t *) blocks;
+	size_t blockUsed;
+} AncSymbolTable_Shard;
+
+/**
+ * String interning table that can be shared between threads. Strings are distributed over
+ * independently locked shards by hash, so threads interning different strings rarely contend.
+ * The allocator has to be thread-safe (e.g. \ref AnchDefaultAllocator).
+ *
+ * Symbol values depend on the order strings were first interned in, so they are only stable
+ * within one table and are not deterministic when several threads intern at once.
+ */
+typedef struct AncSymbolTable {
+	AnchAllocator *allocator;
+	AncSymbolTable_Shard shards[ANC_SYMBOL_TABLE_SHARD_COUNT];
+} AncSymbolTable;
+
+void AncSymbolTable_Init(AncSymbolTable *self, AnchAllocator *allocator);
+void AncSymbolTable_Free(AncSymbolTable *self);
+/** Symbol for the spelling, or \ref ANC_SYMBOL_NULL when its shard has no indices left. */
+AncSymbol AncSymbolTable_Intern(AncSymbolTable *self, const uint8_t *bytes, size_t length);
+/** Spelling of SYMBOL, NUL-terminated. Stays valid until the table is freed. */
+const uint8_t *AncSymbolTable_Get(AncSymbolTable *self, AncSymbol symbol, size_t *length);
+size_t AncSymbolTable_Count(AncSymbolTable *self);
+
+#endif
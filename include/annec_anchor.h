@@ -119,6 +119,29 @@ extern AnchAllocator_AllocZeroFunc AnchStatsAllocator_AllocZero;
 extern AnchAllocator_ReallocFunc AnchStatsAllocator_Realloc;
 extern AnchAllocator_FreeFunc AnchStatsAllocator_Free;
 
+typedef struct AnchRegionBlock_ AnchRegionBlock_;
+
+/**
+ * Bump allocator carving allocations out of big blocks from `allocator`. Freeing is a no-op
+ * (unless it's the last allocation) and everything is released by \ref AnchRegionAllocator_Free.
+ * Reallocating the last allocation grows it in place while its block has room. Like `allocator`,
+ * it returns NULL when out of memory, and a failed reallocation leaves the old one as it was.
+ */
+typedef struct {
+  AnchAllocator base;
+  AnchAllocator *allocator;
+  size_t blockSize;
+  AnchRegionBlock_ *blocks; // current block first.
+  void *last; // last allocation, NULL if it was freed.
+} AnchRegionAllocator;
+
+/** BLOCKSIZE = 0 means 64 KiB. */
+void AnchRegionAllocator_Init(AnchRegionAllocator *self, AnchAllocator *allocator, size_t blockSize);
+void AnchRegionAllocator_Free(AnchRegionAllocator *self);
+extern AnchAllocator_AllocFunc AnchRegionAllocator_Alloc;
+extern AnchAllocator_ReallocFunc AnchRegionAllocator_Realloc;
+extern AnchAllocator_FreeFunc AnchRegionAllocator_Free_;
+
 //////////////////////////////////////////////////////////////////////////////////////////
 
 /** Arena allocator. Or stack allocator. */
@@ -214,6 +237,16 @@ typedef AnchByteWriteStream AnchUtf8WriteStream;
 char32_t AnchUtf8ReadStream_Read(AnchUtf8ReadStream *self);
 void AnchUtf8WriteStream_Write(AnchUtf8WriteStream *self, char32_t value);
 
+/**
+ * Decode one UTF-8 sequence from the first SIZE bytes of BYTES into OUT.
+ * Returns the sequence length (1...4), or 0 if it is malformed or truncated.
+ * Does not depend on the current locale.
+ */
+int AnchUtf8Decode(const uint8_t *bytes, size_t size, char32_t *out);
+
+/** Encode VALUE as UTF-8 into OUT. Returns the sequence length (1...4), or 0 if VALUE is not a scalar value. */
+int AnchUtf8Encode(char32_t value, uint8_t out[4]);
+
 //////////////////////////////////////////////////////////////////////////////////////////
 
 typedef struct {
@@ -300,6 +333,18 @@ void AnchFileReadStream_Open(AnchFileReadStream *self, const char *filename);
 void AnchFileReadStream_Close(AnchFileReadStream *self);
 void AnchFileReadStream_Rewind(AnchFileReadStream *self);
 
+/** Character write stream collecting everything into a growable buffer. Not NUL-terminated. */
+typedef struct {
+  AnchCharWriteStream stream;
+  AnchDynArray_Type(char) buffer;
+} AnchBufferWriteStream;
+
+extern AnchCharWriteStream_WriteFunc AnchBufferWriteStream_Write;
+void AnchBufferWriteStream_Init(AnchBufferWriteStream *self, AnchAllocator *allocator);
+void AnchBufferWriteStream_Free(AnchBufferWriteStream *self);
+/** Write the collected characters to OUT. */
+void AnchBufferWriteStream_WriteTo(const AnchBufferWriteStream *self, AnchCharWriteStream *out);
+
 typedef struct {
   AnchByteWriteStream stream;
   FILE *handle;
@@ -329,4 +374,31 @@ void AnchByteFileReadStream_Open(AnchByteFileReadStream *self, const char *filen
 void AnchByteFileReadStream_Close(AnchByteFileReadStream *self);
 void AnchByteFileReadStream_Rewind(AnchByteFileReadStream *self);
 
+/** Byte read stream over a caller-owned memory buffer. Returns `(uint8_t)EOF` past the end, like the file streams. */
+typedef struct {
+  AnchByteReadStream stream;
+  const uint8_t *data;
+  size_t size;
+  size_t offset;
+} AnchMemoryByteReadStream;
+
+extern AnchByteReadStream_ReadFunc AnchMemoryByteReadStream_Read;
+void AnchMemoryByteReadStream_Init(AnchMemoryByteReadStream *self, const uint8_t *data, size_t size);
+void AnchMemoryByteReadStream_Rewind(AnchMemoryByteReadStream *self);
+
+//////////////////////////////////////////////////////////////////////////////////////////
+
+/** Number of online processors, at least 1. */
+size_t AnchProcessorCount(void);
+
+typedef void AnchParallelForFunc(void *context, size_t index, size_t worker);
+
+/**
+ * Call FUNC(CONTEXT, index, worker) for every index in [0, COUNT) on up to THREADCOUNT threads
+ * (0 means \ref AnchProcessorCount). Indices are handed out dynamically, so the order in which
+ * they run is unspecified; `worker` is in [0, THREADCOUNT) and unique among concurrently running
+ * calls, for indexing per-thread state. Returns once every call has finished.
+ */
+void AnchParallelFor(size_t count, size_t threadCount, AnchParallelForFunc *func, void *context);
+
 #endif
@@ -0,0 +1,458 @@
+#include <acir/acir.h>
+#include <annec_anchor.h>
+#include <assert.h>
+#include "../cli.h"
+
+#define ACIR_BINARY_ALIGNMENT_ 8
+
+static const size_t AcirBinary_RecordSizes_[ACIR_BINARY_SECTION_MAX_] = {
+  [ACIR_BINARY_SECTION_TYPES] = sizeof(AcirBinaryType),
+  [ACIR_BINARY_SECTION_TYPE_ARGUMENTS] = sizeof(uint32_t),
+  [ACIR_BINARY_SECTION_IMMS] = sizeof(AcirBinaryImm),
+  [ACIR_BINARY_SECTION_NAMES] = 1,
+  [ACIR_BINARY_SECTION_FUNCTIONS] = sizeof(AcirBinaryFunction),
+  [ACIR_BINARY_SECTION_INSTRS] = sizeof(AcirBinaryInstr),
+};
+
+const char *AcirBinaryError_Message(AcirBinaryError error) {
+  switch(error) {
+    case ACIR_BINARY_OK: return "no error";
+    case ACIR_BINARY_ERROR_TRUNCATED: return "file is truncated";
+    case ACIR_BINARY_ERROR_MAGIC: return "not an ACIR file, or from a host with another byte order";
+    case ACIR_BINARY_ERROR_VERSION: return "unsupported format version";
+    case ACIR_BINARY_ERROR_CHECKSUM: return "checksum mismatch";
+    case ACIR_BINARY_ERROR_MALFORMED: return "malformed file";
+    default: return NULL;
+  }
+}
+
+/** 8 bytes at a time, the tail zero-padded. */
+static uint32_t AcirBinary_Checksum_(const uint8_t *bytes, size_t size) {
+  uint64_t h = 0x9E3779B97F4A7C15u ^ size;
+  size_t i = 0;
+  for(; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, bytes + i, 8);
+    h = (h ^ word) * 0x100000001B3u;
+    h ^= h >> 29;
+  }
+  if(i < size) {
+    uint64_t word = 0;
+    memcpy(&word, bytes + i, size - i);
+    h = (h ^ word) * 0x100000001B3u;
+  }
+  h = AcirHash_Mix(h);
+  return (uint32_t)(h ^ (h >> 32));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////// Writer
+
+void AcirBinaryWriter_Init(AcirBinaryWriter *self, AnchAllocator *allocator) {
+  assert(self != NULL);
+  *self = (AcirBinaryWriter){ .allocator = allocator };
+  for(int i = 0; i < ACIR_BINARY_SECTION_MAX_; ++i)
+    AnchDynArray_Init(&self->sections[i], allocator, 4096);
+  AnchDynArray_Init(&self->typeKeys, allocator, 256);
+
+  self->typeSlotCapacity = 64;
+  self->typeSlots = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * self->typeSlotCapacity);
+  memset(self->typeSlots, 0xFF, sizeof(uint32_t) * self->typeSlotCapacity);
+  self->immSlotCapacity = 256;
+  self->immSlots = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * self->immSlotCapacity);
+  memset(self->immSlots, 0xFF, sizeof(uint32_t) * self->immSlotCapacity);
+}
+
+void AcirBinaryWriter_Free(AcirBinaryWriter *self) {
+  assert(self != NULL);
+  for(int i = 0; i < ACIR_BINARY_SECTION_MAX_; ++i)
+    AnchDynArray_Free(&self->sections[i]);
+  AnchDynArray_Free(&self->typeKeys);
+  AnchAllocator_Free(self->allocator, self->typeSlots);
+  AnchAllocator_Free(self->allocator, self->immSlots);
+  *self = (AcirBinaryWriter){0};
+}
+
+static uint32_t AcirBinaryWriter_Count_(const AcirBinaryWriter *self, int section) {
+  return self->sections[section].size / AcirBinary_RecordSizes_[section];
+}
+
+static uint32_t AcirBinaryWriter_TypeSlot_(const AcirBinaryWriter *self, const AcirValueType *type) {
+  const AcirValueType **keys = (const AcirValueType**)self->typeKeys.data;
+  uint32_t mask = self->typeSlotCapacity - 1;
+  for(uint32_t i = AcirHash_Mix((uintptr_t)type) & mask; ; i = (i + 1) & mask) {
+    if(self->typeSlots[i] == ACIR_BINARY_NULL_INDEX || keys[self->typeSlots[i]] == type) return i;
+  }
+}
+
+static uint32_t AcirBinaryWriter_ImmSlot_(const AcirBinaryWriter *self, const AcirBinaryImm *imm) {
+  const AcirBinaryImm *imms = (const AcirBinaryImm*)self->sections[ACIR_BINARY_SECTION_IMMS].data;
+  uint32_t mask = self->immSlotCapacity - 1;
+  for(uint32_t i = AcirHash_Mix(imm->bits ^ AcirHash_Mix(imm->type)) & mask; ; i = (i + 1) & mask) {
+    uint32_t index = self->immSlots[i];
+    if(index == ACIR_BINARY_NULL_INDEX || (imms[index].type == imm->type && imms[index].bits == imm->bits)) return i;
+  }
+}
+
+/** Double the slot table at *SLOTS once COUNT fills half of it, reinserting with SLOTFUNC. */
+#define ACIR_BINARY_WRITER_GROW_(SELF, SLOTS, CAPACITY, COUNT, KEY, SLOTFUNC) do { \
+  if((COUNT) * 2 <= (SELF)->CAPACITY) break; \
+  AnchAllocator_Free((SELF)->allocator, (SELF)->SLOTS); \
+  (SELF)->CAPACITY *= 2; \
+  (SELF)->SLOTS = AnchAllocator_Alloc((SELF)->allocator, sizeof(uint32_t) * (SELF)->CAPACITY); \
+  memset((SELF)->SLOTS, 0xFF, sizeof(uint32_t) * (SELF)->CAPACITY); \
+  for(uint32_t i_ = 0; i_ < (COUNT); ++i_) (SELF)->SLOTS[SLOTFUNC((SELF), (KEY))] = i_; \
+} while(0)
+
+/** Index of TYPE, written (after its parts) if new. Types are compared by pointer, so they must be interned. */
+static uint32_t AcirBinaryWriter_Type_(AcirBinaryWriter *self, const AcirValueType *type) {
+  if(type == NULL) return ACIR_BINARY_NULL_INDEX;
+  uint32_t slot = AcirBinaryWriter_TypeSlot_(self, type);
+  if(self->typeSlots[slot] != ACIR_BINARY_NULL_INDEX) return self->typeSlots[slot];
+
+  AcirBinaryType record = { .type = type->type, .target = ACIR_BINARY_NULL_INDEX };
+  switch(type->type) {
+    case ACIR_VALUE_TYPE_BASIC: record.basic = type->basic; break;
+    case ACIR_VALUE_TYPE_POINTER: record.target = AcirBinaryWriter_Type_(self, type->pointer); break;
+    case ACIR_VALUE_TYPE_FUNCTION: {
+      const AcirFunctionValueType *function = type->function;
+      uint32_t arguments[function->argumentCount + 1];
+      record.target = AcirBinaryWriter_Type_(self, function->returnType);
+      for(size_t i = 0; i < function->argumentCount; ++i)
+        arguments[i] = AcirBinaryWriter_Type_(self, function->argumentTypes[i]);
+      record.argumentCount = function->argumentCount;
+      record.arguments = AcirBinaryWriter_Count_(self, ACIR_BINARY_SECTION_TYPE_ARGUMENTS);
+      memcpy(AnchDynArray_Push(&self->sections[ACIR_BINARY_SECTION_TYPE_ARGUMENTS],
+        sizeof(uint32_t) * function->argumentCount), arguments, sizeof(uint32_t) * function->argumentCount);
+    } break;
+    default: assert(false && "bad value type");
+  }
+
+  // writing the parts may have moved things around.
+  uint32_t index = AcirBinaryWriter_Count_(self, ACIR_BINARY_SECTION_TYPES);
+  ANCH_DYNARRAY_PUSH(&self->sections[ACIR_BINARY_SECTION_TYPES], AcirBinaryType, record);
+  ANCH_DYNARRAY_PUSH(&self->typeKeys, const AcirValueType*, type);
+  self->typeSlots[AcirBinaryWriter_TypeSlot_(self, type)] = index;
+  ACIR_BINARY_WRITER_GROW_(self, typeSlots, typeSlotCapacity, index + 1,
+    ((const AcirValueType**)self->typeKeys.data)[i_], AcirBinaryWriter_TypeSlot_);
+  return index;
+}
+
+static uint32_t AcirBinaryWriter_Imm_(AcirBinaryWriter *self, const AcirImmediateValue *imm) {
+  AcirBinaryImm record = { .type = AcirBinaryWriter_Type_(self, imm->type), .bits = AcirImmediateValue_Bits(imm) };
+  uint32_t slot = AcirBinaryWriter_ImmSlot_(self, &record);
+  if(self->immSlots[slot] != ACIR_BINARY_NULL_INDEX) return self->immSlots[slot];
+
+  uint32_t index = AcirBinaryWriter_Count_(self, ACIR_BINARY_SECTION_IMMS);
+  assert(index < ACIR_PACKED_REF_IMMEDIATE_BIT);
+  ANCH_DYNARRAY_PUSH(&self->sections[ACIR_BINARY_SECTION_IMMS], AcirBinaryImm, record);
+  self->immSlots[slot] = index;
+  ACIR_BINARY_WRITER_GROW_(self, immSlots, immSlotCapacity, index + 1,
+    &((const AcirBinaryImm*)self->sections[ACIR_BINARY_SECTION_IMMS].data)[i_], AcirBinaryWriter_ImmSlot_);
+  return index;
+}
+
+static AcirPackedRef AcirBinaryWriter_Operand_(AcirBinaryWriter *self, const AcirOperand *op) {
+  switch(op->type) {
+    case ACIR_OPERAND_TYPE_BINDING:
+      assert(op->idx < ACIR_PACKED_REF_LABEL_BIT);
+      return op->idx;
+    case ACIR_OPERAND_TYPE_LABEL:
+      assert(op->idx < ACIR_PACKED_REF_FUNCTION_BIT);
+      return ACIR_PACKED_REF_LABEL_BIT | op->idx;
+    case ACIR_OPERAND_TYPE_FUNCTION:
+      assert(op->idx < ACIR_PACKED_REF_FUNCTION_BIT);
+      return ACIR_PACKED_REF_LABEL_BIT | ACIR_PACKED_REF_FUNCTION_BIT | op->idx;
+    case ACIR_OPERAND_TYPE_IMMEDIATE:
+      return ACIR_PACKED_REF_IMMEDIATE_BIT | AcirBinaryWriter_Imm_(self, &op->imm);
+    default:
+      assert(false && "bad operand type");
+      return ACIR_PACKED_REF_NONE;
+  }
+}
+
+void AcirBinaryWriter_AddFunction(AcirBinaryWriter *self, const AcirFunction *function) {
+  assert(self != NULL);
+  assert(function != NULL);
+
+  AnchDynArray *names = &self->sections[ACIR_BINARY_SECTION_NAMES];
+  AcirBinaryFunction record = {
+    .name = names->size,
+    .type = AcirBinaryWriter_Type_(self, function->type),
+    .firstInstr = AcirBinaryWriter_Count_(self, ACIR_BINARY_SECTION_INSTRS),
+  };
+  const char *name = function->name ? function->name : "";
+  size_t nameLength = strlen(name) + 1;
+  memcpy(AnchDynArray_Push(names, nameLength), name, nameLength);
+
+  for(size_t i = function->code; i != ACIR_INSTR_NULL_INDEX; i = function->instrs[i].next) ++record.instrCount;
+  AcirBinaryInstr *instrs = AnchDynArray_Push(&self->sections[ACIR_BINARY_SECTION_INSTRS],
+    sizeof(AcirBinaryInstr) * record.instrCount);
+
+  uint32_t index = 0;
+  for(size_t i = function->code; i != ACIR_INSTR_NULL_INDEX; i = function->instrs[i].next, ++index) {
+    const AcirInstr *instr = &function->instrs[i];
+    AcirBinaryInstr out = { .opcode = instr->opcode, .type = AcirBinaryWriter_Type_(self, instr->type) };
+    const AcirOperand *ops[ACIR_PACKED_SLOT_MAX_] = {0};
+    switch(AcirOpcode_OperandCount(instr->opcode)) {
+      case 1: ops[ACIR_PACKED_SLOT_VAL] = &instr->val; break;
+      case 3: ops[ACIR_PACKED_SLOT_RHS] = &instr->rhs; // fallthrough
+      case 2: ops[ACIR_PACKED_SLOT_VAL] = &instr->val; ops[ACIR_PACKED_SLOT_OUT] = &instr->out; break;
+      default: assert(false && "bad operand count");
+    }
+    for(int slot = 0; slot < ACIR_PACKED_SLOT_MAX_; ++slot)
+      out.operands[slot] = ops[slot] ? AcirBinaryWriter_Operand_(self, ops[slot]) : ACIR_PACKED_REF_NONE;
+    // `instrs` is not moved by the writes above, they don't touch the instruction section.
+    instrs[index] = out;
+  }
+
+  ANCH_DYNARRAY_PUSH(&self->sections[ACIR_BINARY_SECTION_FUNCTIONS], AcirBinaryFunction, record);
+}
+
+void AcirBinaryWriter_AddModule(AcirBinaryWriter *self, const AcirModule *module) {
+  assert(self != NULL);
+  assert(module != NULL);
+  for(uint32_t i = 0; i < module->functionCount; ++i)
+    AcirBinaryWriter_AddFunction(self, &AcirModule_Function(module, i)->function);
+}
+
+void *AcirBinaryWriter_Finish(AcirBinaryWriter *self, size_t *size) {
+  assert(self != NULL);
+  assert(size != NULL);
+
+  AcirBinaryHeader header = {
+    .magic = ACIR_BINARY_MAGIC,
+    .version = ACIR_BINARY_VERSION,
+    .headerSize = sizeof(AcirBinaryHeader),
+  };
+  size_t offset = ANCH_ROUNDUP_POWEROF2(sizeof(AcirBinaryHeader), ACIR_BINARY_ALIGNMENT_);
+  for(int i = 0; i < ACIR_BINARY_SECTION_MAX_; ++i) {
+    header.sections[i] = (AcirBinarySection){ .offset = offset, .size = self->sections[i].size };
+    offset = ANCH_ROUNDUP_POWEROF2(offset + self->sections[i].size, ACIR_BINARY_ALIGNMENT_);
+  }
+  assert(offset <= UINT32_MAX);
+  header.size = offset;
+
+  uint8_t *data = AnchAllocator_AllocZero(self->allocator, offset);
+  for(int i = 0; i < ACIR_BINARY_SECTION_MAX_; ++i) {
+    if(self->sections[i].size > 0)
+      memcpy(data + header.sections[i].offset, self->sections[i].data, self->sections[i].size);
+  }
+  header.checksum = AcirBinary_Checksum_(data + header.headerSize, offset - header.headerSize);
+  memcpy(data, &header, sizeof(header));
+
+  *size = offset;
+  return data;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////// Reader
+
+/** Everything referenced from the tables is checked once here, so resolving and reading can trust it. */
+static AcirBinaryError AcirBinaryReader_Check_(const AcirBinaryReader *self) {
+  const AcirBinaryHeader *header = self->header;
+  for(int i = 0; i < ACIR_BINARY_SECTION_MAX_; ++i) {
+    const AcirBinarySection *section = &header->sections[i];
+    if(section->offset < header->headerSize || section->offset % ACIR_BINARY_ALIGNMENT_ != 0
+      || section->offset > header->size || section->size > header->size - section->offset
+      || section->size % AcirBinary_RecordSizes_[i] != 0) return ACIR_BINARY_ERROR_MALFORMED;
+  }
+
+  uint32_t typeCount, argumentCount, immCount, nameSize, functionCount, instrCount;
+  const AcirBinaryType *types = AcirBinaryReader_Section(self, ACIR_BINARY_SECTION_TYPES, &typeCount, sizeof(AcirBinaryType));
+  const uint32_t *arguments = AcirBinaryReader_Section(self, ACIR_BINARY_SECTION_TYPE_ARGUMENTS, &argumentCount, sizeof(uint32_t));
+  const AcirBinaryImm *imms = AcirBinaryReader_Section(self, ACIR_BINARY_SECTION_IMMS, &immCount, sizeof(AcirBinaryImm));
+  const char *names = AcirBinaryReader_Section(self, ACIR_BINARY_SECTION_NAMES, &nameSize, 1);
+  const AcirBinaryFunction *functions = AcirBinaryReader_Section(self, ACIR_BINARY_SECTION_FUNCTIONS, &functionCount, sizeof(AcirBinaryFunction));
+  (void)AcirBinaryReader_Section(self, ACIR_BINARY_SECTION_INSTRS, &instrCount, sizeof(AcirBinaryInstr));
+
+  // types only reference earlier ones, which rules out cycles.
+  for(uint32_t i = 0; i < typeCount; ++i) {
+    const AcirBinaryType *type = &types[i];
+    switch(type->type) {
+      case ACIR_VALUE_TYPE_BASIC:
+        if(type->basic >= ACIR_BASIC_VALUE_TYPE_MAX_) return ACIR_BINARY_ERROR_MALFORMED;
+        break;
+      case ACIR_VALUE_TYPE_POINTER:
+        if(type->target >= i) return ACIR_BINARY_ERROR_MALFORMED;
+        break;
+      case ACIR_VALUE_TYPE_FUNCTION:
+        if(type->target >= i || type->arguments > argumentCount || type->argumentCount > argumentCount - type->arguments)
+          return ACIR_BINARY_ERROR_MALFORMED;
+        for(uint32_t j = 0; j < type->argumentCount; ++j)
+          if(arguments[type->arguments + j] >= i) return ACIR_BINARY_ERROR_MALFORMED;
+        break;
+      default: return ACIR_BINARY_ERROR_MALFORMED;
+    }
+  }
+  for(uint32_t i = 0; i < immCount; ++i) {
+    if(imms[i].type != ACIR_BINARY_NULL_INDEX && imms[i].type >= typeCount) return ACIR_BINARY_ERROR_MALFORMED;
+  }
+  if(nameSize > 0 && names[nameSize - 1] != '\0') return ACIR_BINARY_ERROR_MALFORMED;
+  for(uint32_t i = 0; i < functionCount; ++i) {
+    const AcirBinaryFunction *function = &functions[i];
+    if(function->name >= nameSize || (function->type != ACIR_BINARY_NULL_INDEX && function->type >= typeCount)
+      || function->firstInstr > instrCount || function->instrCount > instrCount - function->firstInstr)
+      return ACIR_BINARY_ERROR_MALFORMED;
+  }
+  return ACIR_BINARY_OK;
+}
+
+AcirBinaryError AcirBinaryReader_Init(AcirBinaryReader *self, const void *data, size_t size,
+  AcirTypeTable *types, AnchAllocator *allocator
+) {
+  assert(self != NULL);
+  assert(data != NULL);
+  assert(types != NULL);
+  assert((uintptr_t)data % ACIR_BINARY_ALIGNMENT_ == 0);
+
+  *self = (AcirBinaryReader){ .data = data, .header = data, .types = types, .allocator = allocator };
+  const AcirBinaryHeader *header = self->header;
+  if(size < sizeof(AcirBinaryHeader)) return ACIR_BINARY_ERROR_TRUNCATED;
+  if(header->magic != ACIR_BINARY_MAGIC) return ACIR_BINARY_ERROR_MAGIC;
+  if(header->version != ACIR_BINARY_VERSION || header->headerSize != sizeof(AcirBinaryHeader))
+    return ACIR_BINARY_ERROR_VERSION;
+  if(header->size > size) return ACIR_BINARY_ERROR_TRUNCATED;
+  if(header->size < header->headerSize) return ACIR_BINARY_ERROR_MALFORMED;
+  if(AcirBinary_Checksum_(self->data + header->headerSize, header->size - header->headerSize) != header->checksum)
+    return ACIR_BINARY_ERROR_CHECKSUM;
+
+  AcirBinaryError error = AcirBinaryReader_Check_(self);
+  if(error != ACIR_BINARY_OK) return error;
+
+  uint32_t typeCount;
+  AcirBinaryReader_Section(self, ACIR_BINARY_SECTION_TYPES, &typeCount, sizeof(AcirBinaryType));
+  if(typeCount > 0)
+    self->resolvedTypes = AnchAllocator_AllocZero(allocator, sizeof(const AcirValueType*) * typeCount);
+  return ACIR_BINARY_OK;
+}
+
+void AcirBinaryReader_Free(AcirBinaryReader *self) {
+  assert(self != NULL);
+  if(self->resolvedTypes != NULL)
+    AnchAllocator_Free(self->allocator, self->resolvedTypes);
+  *self = (AcirBinaryReader){0};
+}
+
+const AcirValueType *AcirBinaryReader_Type(AcirBinaryReader *self, uint32_t index) {
+  assert(self != NULL);
+  if(index == ACIR_BINARY_NULL_INDEX) return NULL;
+  if(index < self->resolvedTypeCount) return self->resolvedTypes[index];
+
+  // types only reference earlier ones, so resolving in order finds those already there.
+  const AcirBinaryType *types = AcirBinaryReader_Section(self, ACIR_BINARY_SECTION_TYPES, NULL, 1);
+  const uint32_t *arguments = AcirBinaryReader_Section(self, ACIR_BINARY_SECTION_TYPE_ARGUMENTS, NULL, 1);
+  const AcirValueType **resolved = self->resolvedTypes;
+  for(; self->resolvedTypeCount <= index; ++self->resolvedTypeCount) {
+    const AcirBinaryType *type = &types[self->resolvedTypeCount];
+    switch(type->type) {
+      case ACIR_VALUE_TYPE_BASIC: resolved[self->resolvedTypeCount] = AcirValueType_Basic(type->basic); break;
+      case ACIR_VALUE_TYPE_POINTER:
+        resolved[self->resolvedTypeCount] = AcirTypeTable_Pointer(self->types, resolved[type->target]);
+        break;
+      case ACIR_VALUE_TYPE_FUNCTION: {
+        // the count comes from the file, so the array isn't put on the stack.
+        const AcirValueType **argumentTypes = AnchAllocator_Alloc(self->allocator, sizeof(const AcirValueType*) * (type->argumentCount + 1));
+        for(uint32_t i = 0; i < type->argumentCount; ++i)
+          argumentTypes[i] = resolved[arguments[type->arguments + i]];
+        resolved[self->resolvedTypeCount] = AcirTypeTable_Function(self->types, resolved[type->target],
+          type->argumentCount, argumentTypes);
+        AnchAllocator_Free(self->allocator, argumentTypes);
+      } break;
+    }
+  }
+  return resolved[index];
+}
+
+static bool AcirBinaryReader_Operand_(AcirBinaryReader *self, AcirPackedRef ref, AcirOperand *out) {
+  if(ref == ACIR_PACKED_REF_NONE) {
+    *out = (AcirOperand){0};
+  } else if(ACIR_PACKED_REF_IS_IMMEDIATE(ref)) {
+    uint32_t immCount;
+    const AcirBinaryImm *imms = AcirBinaryReader_Section(self, ACIR_BINARY_SECTION_IMMS, &immCount, sizeof(AcirBinaryImm));
+    if(ACIR_PACKED_REF_INDEX(ref) >= immCount) return false;
+    const AcirBinaryImm *imm = &imms[ACIR_PACKED_REF_INDEX(ref)];
+    // narrower fields of the value union sit at its start, like the low bytes of `bits`.
+    *out = (AcirOperand){ ACIR_OPERAND_TYPE_IMMEDIATE,
+      .imm = { .type = AcirBinaryReader_Type(self, imm->type), .uint64 = imm->bits } };
+  } else if(ACIR_PACKED_REF_IS_LABEL(ref)) {
+    *out = (AcirOperand){ ACIR_OPERAND_TYPE_LABEL, .idx = ACIR_PACKED_REF_INDEX(ref) };
+  } else if(ACIR_PACKED_REF_IS_FUNCTION(ref)) {
+    if(ACIR_PACKED_REF_INDEX(ref) >= AcirBinaryReader_FunctionCount(self)) return false;
+    *out = (AcirOperand){ ACIR_OPERAND_TYPE_FUNCTION, .idx = ACIR_PACKED_REF_INDEX(ref) };
+  } else {
+    *out = (AcirOperand){ ACIR_OPERAND_TYPE_BINDING, .idx = ref };
+  }
+  return true;
+}
+
+AcirBinaryError AcirBinaryReader_ReadFunction(AcirBinaryReader *self, uint32_t index, AcirBuilder *target) {
+  assert(self != NULL);
+  assert(target != NULL);
+  assert(target->target->instrCount == 0);
+  assert(index < AcirBinaryReader_FunctionCount(self));
+
+  uint32_t typeCount;
+  AcirBinaryReader_Section(self, ACIR_BINARY_SECTION_TYPES, &typeCount, sizeof(AcirBinaryType));
+  const AcirBinaryFunction *function = AcirBinaryReader_Function(self, index);
+  const AcirBinaryInstr *instrs = AcirBinaryReader_Instrs(self, function);
+
+  AcirBuilder_Reserve(target, function->instrCount);
+  for(uint32_t i = 0; i < function->instrCount; ++i) {
+    const AcirBinaryInstr *in = &instrs[i];
+    if(in->opcode >= ACIR_OPCODE_MAX_ || in->type == ACIR_BINARY_NULL_INDEX || in->type >= typeCount)
+      return ACIR_BINARY_ERROR_MALFORMED;
+
+    AcirInstr *instr = AcirBuilder_Add(target, i);
+    instr->index = i;
+    instr->opcode = in->opcode;
+    instr->type = AcirBinaryReader_Type(self, in->type);
+    instr->next = i + 1 < function->instrCount ? i + 1 : ACIR_INSTR_NULL_INDEX;
+
+    AcirOperand val, rhs;
+    if(!AcirBinaryReader_Operand_(self, in->operands[ACIR_PACKED_SLOT_VAL], &val)
+      || !AcirBinaryReader_Operand_(self, in->operands[ACIR_PACKED_SLOT_RHS], &rhs)
+      || !AcirBinaryReader_Operand_(self, in->operands[ACIR_PACKED_SLOT_OUT], &instr->out))
+      return ACIR_BINARY_ERROR_MALFORMED;
+    if(in->operands[ACIR_PACKED_SLOT_RHS] != ACIR_PACKED_REF_NONE) {
+      instr->lhs = val;
+      instr->rhs = rhs;
+    } else {
+      instr->val = val;
+    }
+  }
+  return ACIR_BINARY_OK;
+}
+
+AcirBinaryError AcirBinaryReader_ReadModule(AcirBinaryReader *self, AcirModule *module) {
+  assert(self != NULL);
+  assert(module != NULL);
+  assert(&module->types == self->types);
+
+  // function operands index the file, so every name is resolved before any code is read.
+  uint32_t functionCount = AcirBinaryReader_FunctionCount(self);
+  uint32_t *indices = functionCount > 0 ? AnchAllocator_Alloc(self->allocator, sizeof(uint32_t) * functionCount) : NULL;
+  bool *added = functionCount > 0 ? AnchAllocator_AllocZero(self->allocator, sizeof(bool) * functionCount) : NULL;
+  for(uint32_t i = 0; i < functionCount; ++i) {
+    const AcirBinaryFunction *function = AcirBinaryReader_Function(self, i);
+    const char *name = AcirBinaryReader_Name(self, function);
+    indices[i] = AcirModule_AddFunction(module, name, AcirBinaryReader_Type(self, function->type));
+    added[i] = indices[i] != ACIR_MODULE_NULL_INDEX;
+    if(!added[i]) indices[i] = AcirModule_FindFunction(module, name);
+  }
+
+  AcirBinaryError error = ACIR_BINARY_OK;
+  for(uint32_t i = 0; i < functionCount && error == ACIR_BINARY_OK; ++i) {
+    if(!added[i]) continue;
+    AcirBuilder *builder = &AcirModule_Function(module, indices[i])->builder;
+    error = AcirBinaryReader_ReadFunction(self, i, builder);
+    for(size_t j = 0; j < builder->target->instrCount && error == ACIR_BINARY_OK; ++j) {
+      AcirInstr *instr = &builder->instrs[j];
+      if(instr->opcode == ACIR_OPCODE_CALL && instr->val.type == ACIR_OPERAND_TYPE_FUNCTION)
+        instr->val.idx = indices[instr->val.idx];
+    }
+  }
+  if(functionCount > 0) {
+    AnchAllocator_Free(self->allocator, indices);
+    AnchAllocator_Free(self->allocator, added);
+  }
+  return error;
+}
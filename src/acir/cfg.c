@@ -0,0 +1,181 @@
+#include <acir/acir.h>
+#include <annec_anchor.h>
+#include <assert.h>
+#include "../cli.h"
+
+/** Targets of the terminator INSTR, as labels. Returns their count. */
+static int AcirCfg_JumpLabels_(const AcirInstr *instr, size_t labels[2]) {
+  switch(instr->opcode) {
+    case ACIR_OPCODE_JMP:
+      assert(instr->val.type == ACIR_OPERAND_TYPE_LABEL);
+      labels[0] = instr->val.idx;
+      return 1;
+    case ACIR_OPCODE_BR:
+      assert(instr->rhs.type == ACIR_OPERAND_TYPE_LABEL);
+      assert(instr->out.type == ACIR_OPERAND_TYPE_LABEL);
+      labels[0] = instr->rhs.idx;
+      labels[1] = instr->out.idx;
+      return labels[0] == labels[1] ? 1 : 2;
+    default: return 0;
+  }
+}
+
+void AcirCfg_Build(AcirCfg *self, const AcirFunction *function, AnchAllocator *allocator) {
+  assert(self != NULL);
+  assert(function != NULL);
+  assert(function->instrCount < ACIR_BLOCK_NULL_INDEX);
+
+  *self = (AcirCfg){ .function = function, .allocator = allocator };
+  self->instrBlocks = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * (function->instrCount + 1));
+  memset(self->instrBlocks, 0xFF, sizeof(uint32_t) * function->instrCount);
+  self->order = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * (function->instrCount + 1));
+
+  // pass 1: linearize, split into blocks and find the largest label.
+  size_t maxLabel = 0;
+  bool startsBlock = true;
+  for(size_t i = function->code; i != ACIR_INSTR_NULL_INDEX; i = function->instrs[i].next) {
+    const AcirInstr *instr = &function->instrs[i];
+    if(instr->opcode == ACIR_OPCODE_LBL) {
+      assert(instr->val.type == ACIR_OPERAND_TYPE_LABEL);
+      if(instr->val.idx + 1 > maxLabel) maxLabel = instr->val.idx + 1;
+      startsBlock = true;
+    }
+    if(startsBlock) ++self->blockCount;
+    self->instrBlocks[i] = self->blockCount - 1;
+    self->order[self->instrCount++] = i;
+    startsBlock = AcirOpcode_IsTerminator(instr->opcode);
+  }
+
+  self->blocks = AnchAllocator_Alloc(allocator, sizeof(AcirBlock) * (self->blockCount + 1));
+  uint32_t *labelBlocks = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * (maxLabel + 1));
+  memset(labelBlocks, 0xFF, sizeof(uint32_t) * maxLabel);
+  for(uint32_t i = 0; i < self->instrCount; ++i) {
+    const AcirInstr *instr = &function->instrs[self->order[i]];
+    uint32_t block = self->instrBlocks[self->order[i]];
+    if(i == 0 || block != self->instrBlocks[self->order[i - 1]])
+      self->blocks[block] = (AcirBlock){ .first = i, .count = 0, .label = ACIR_BLOCK_NULL_INDEX };
+    self->blocks[block].count += 1;
+    if(instr->opcode == ACIR_OPCODE_LBL) {
+      assert(labelBlocks[instr->val.idx] == ACIR_BLOCK_NULL_INDEX && "label defined twice");
+      labelBlocks[instr->val.idx] = block;
+      self->blocks[block].label = instr->val.idx;
+    }
+  }
+
+  // pass 2: count edges, then fill the CSR arrays.
+  self->succOffsets = AnchAllocator_AllocZero(allocator, sizeof(uint32_t) * (self->blockCount + 1));
+  self->predOffsets = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * (self->blockCount + 1));
+  size_t edgeCount = 0;
+  for(uint32_t b = 0; b < self->blockCount; ++b) {
+    const AcirInstr *last = AcirCfg_Instr(self, b, self->blocks[b].count - 1);
+    size_t labels[2];
+    int count = AcirCfg_JumpLabels_(last, labels);
+    // a block not ending in a terminator falls through into the next one.
+    if(!AcirOpcode_IsTerminator(last->opcode) && b + 1 < self->blockCount) self->succOffsets[b + 1] += 1;
+    for(int i = 0; i < count; ++i) {
+      assert(labels[i] < maxLabel && labelBlocks[labels[i]] != ACIR_BLOCK_NULL_INDEX && "undefined label");
+      self->succOffsets[b + 1] += 1;
+    }
+    edgeCount += self->succOffsets[b + 1];
+  }
+  for(uint32_t b = 0; b < self->blockCount; ++b) self->succOffsets[b + 1] += self->succOffsets[b];
+
+  self->succs = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * (edgeCount + 1));
+  self->preds = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * (edgeCount + 1));
+  uint32_t *predCounts = AnchAllocator_AllocZero(allocator, sizeof(uint32_t) * (self->blockCount + 1));
+  uint32_t *succFill = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * (self->blockCount + 1));
+  for(uint32_t b = 0; b < self->blockCount; ++b) succFill[b] = self->succOffsets[b];
+
+  for(uint32_t b = 0; b < self->blockCount; ++b) {
+    const AcirInstr *last = AcirCfg_Instr(self, b, self->blocks[b].count - 1);
+    size_t labels[2];
+    int count = AcirCfg_JumpLabels_(last, labels);
+    if(!AcirOpcode_IsTerminator(last->opcode) && b + 1 < self->blockCount) {
+      self->succs[succFill[b]++] = b + 1;
+      predCounts[b + 1] += 1;
+    }
+    for(int i = 0; i < count; ++i) {
+      self->succs[succFill[b]++] = labelBlocks[labels[i]];
+      predCounts[labelBlocks[labels[i]]] += 1;
+    }
+  }
+
+  self->predOffsets[0] = 0;
+  for(uint32_t b = 0; b < self->blockCount; ++b) self->predOffsets[b + 1] = self->predOffsets[b] + predCounts[b];
+  // visiting sources in block order keeps every predecessor list sorted.
+  for(uint32_t b = 0; b < self->blockCount; ++b) predCounts[b] = self->predOffsets[b];
+  for(uint32_t b = 0; b < self->blockCount; ++b) {
+    for(uint32_t e = self->succOffsets[b]; e < self->succOffsets[b + 1]; ++e)
+      self->preds[predCounts[self->succs[e]]++] = b;
+  }
+
+  AnchAllocator_Free(allocator, succFill);
+  AnchAllocator_Free(allocator, predCounts);
+  AnchAllocator_Free(allocator, labelBlocks);
+
+  // reverse postorder: iterative depth-first search, `next` is the next successor edge to try.
+  self->rpo = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * (self->blockCount + 1));
+  if(self->blockCount == 0) return;
+  uint32_t *stack = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * self->blockCount);
+  uint32_t *next = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * self->blockCount);
+  memset(next, 0xFF, sizeof(uint32_t) * self->blockCount);
+  uint32_t postCount = self->blockCount;
+  size_t depth = 0;
+  stack[depth++] = 0;
+  next[0] = self->succOffsets[0];
+  while(depth > 0) {
+    uint32_t b = stack[depth - 1];
+    if(next[b] < self->succOffsets[b + 1]) {
+      uint32_t s = self->succs[next[b]++];
+      if(next[s] == ACIR_BLOCK_NULL_INDEX) {
+        next[s] = self->succOffsets[s];
+        stack[depth++] = s;
+      }
+    } else {
+      // fill from the back, so the blocks end up in reverse postorder.
+      self->rpo[--postCount] = b;
+      --depth;
+    }
+  }
+  self->rpoCount = self->blockCount - postCount;
+  memmove(self->rpo, self->rpo + postCount, sizeof(uint32_t) * self->rpoCount);
+  AnchAllocator_Free(allocator, stack);
+  AnchAllocator_Free(allocator, next);
+}
+
+void AcirCfg_Free(AcirCfg *self) {
+  assert(self != NULL);
+  if(self->allocator == NULL) return;
+  AnchAllocator_Free(self->allocator, self->order);
+  AnchAllocator_Free(self->allocator, self->instrBlocks);
+  AnchAllocator_Free(self->allocator, self->blocks);
+  AnchAllocator_Free(self->allocator, self->succOffsets);
+  AnchAllocator_Free(self->allocator, self->succs);
+  AnchAllocator_Free(self->allocator, self->predOffsets);
+  AnchAllocator_Free(self->allocator, self->preds);
+  AnchAllocator_Free(self->allocator, self->rpo);
+  *self = (AcirCfg){0};
+}
+
+void AcirCfg_Print(const AcirCfg *self, AnchCharWriteStream *out) {
+  assert(self != NULL);
+  for(uint32_t i = 0; i < self->rpoCount; ++i) {
+    uint32_t b = self->rpo[i];
+    const AcirBlock *block = &self->blocks[b];
+    AnchWriteFormat(out, ANSI_MAGENTA "block %u" ANSI_RESET, b);
+    if(block->label != ACIR_BLOCK_NULL_INDEX) AnchWriteFormat(out, " (@" ANSI_CYAN "%u" ANSI_RESET ")", block->label);
+    AnchWriteString(out, ANSI_GRAY " <-" ANSI_RESET);
+    uint32_t count;
+    const uint32_t *edges = AcirCfg_Preds(self, b, &count);
+    for(uint32_t e = 0; e < count; ++e) AnchWriteFormat(out, " %u", edges[e]);
+    AnchWriteString(out, ANSI_GRAY " ->" ANSI_RESET);
+    edges = AcirCfg_Succs(self, b, &count);
+    for(uint32_t e = 0; e < count; ++e) AnchWriteFormat(out, " %u", edges[e]);
+    AnchWriteString(out, "\n");
+    for(uint32_t j = 0; j < block->count; ++j) {
+      AnchWriteString(out, "  ");
+      AcirInstr_Print(out, AcirCfg_Instr(self, b, j));
+      AnchWriteString(out, "\n");
+    }
+  }
+}
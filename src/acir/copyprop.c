@@ -0,0 +1,45 @@
+#include <acir/acir.h>
+#include <annec_anchor.h>
+#include <assert.h>
+#include "../cli.h"
+
+// Copy propagation. A `set` from a binding only renames a value, so its uses can read the
+// source directly: the source is defined before the copy, and so before every use of it.
+// Chains resolve in any order, since each copy hands its uses to its source, uses it got
+// from earlier copies included. A copy whose address is taken keeps its own binding.
+// Afterwards the bindings are renumbered densely, so tables indexed by binding stay small.
+
+/** Whether some use of BINDING is a `ref`. */
+static bool AcirCopyProp_IsReferenced_(const AcirDefUse *defUse, const AcirBuilder *builder, size_t binding) {
+  for(uint32_t use = AcirDefUse_FirstUse(defUse, binding); use != ACIR_DEFUSE_NULL_INDEX; use = AcirDefUse_NextUse(defUse, use))
+    if(builder->instrs[AcirDefUse_UseInstr(use)].opcode == ACIR_OPCODE_REF) return true;
+  return false;
+}
+
+void AcirPass_CopyProp(AcirPassManager *manager, AcirBuilder *builder) {
+  AcirDefUse *defUse = AcirPassManager_DefUse(manager);
+  AcirFunction *function = builder->target;
+
+  size_t last = ACIR_INSTR_NULL_INDEX;
+  for(size_t i = function->code; i != ACIR_INSTR_NULL_INDEX; i = builder->instrs[i].next) {
+    const AcirInstr *instr = &builder->instrs[i];
+    // a `phi` with the same binding on both edges is a copy too, and `val` is its first input.
+    bool copy = (instr->opcode == ACIR_OPCODE_SET || (instr->opcode == ACIR_OPCODE_PHI
+      && instr->rhs.type == ACIR_OPERAND_TYPE_BINDING && instr->rhs.idx == instr->lhs.idx))
+      && instr->val.type == ACIR_OPERAND_TYPE_BINDING && instr->out.type == ACIR_OPERAND_TYPE_BINDING
+      && instr->val.idx != instr->out.idx;
+    if(copy && !AcirCopyProp_IsReferenced_(defUse, builder, instr->out.idx)) {
+      AcirDefUse_ReplaceAllUses(defUse, instr->out.idx, &instr->val);
+      AcirDefUse_Unlink(defUse, i);
+      continue;
+    }
+    if(last == ACIR_INSTR_NULL_INDEX) function->code = i;
+    else builder->instrs[last].next = i;
+    last = i;
+  }
+  // the copies are gone, a terminator is left.
+  assert(last != ACIR_INSTR_NULL_INDEX);
+  builder->instrs[last].next = ACIR_INSTR_NULL_INDEX;
+
+  AcirBuilder_RenumberBindings(builder);
+}
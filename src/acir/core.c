@@ -32,6 +32,8 @@ const char *AcirOperandType_Name(AcirOperandType type) {
   switch(type) {
   case ACIR_OPERAND_TYPE_BINDING: return "binding";
   case ACIR_OPERAND_TYPE_IMMEDIATE: return "immediate";
+  case ACIR_OPERAND_TYPE_LABEL: return "label";
+  case ACIR_OPERAND_TYPE_FUNCTION: return "function";
   default: return NULL;
   }
 }
@@ -66,6 +68,15 @@ bool AcirOpcode_ConstEval(AcirOpcode opcode) {
   return AcirOpcode_Info[opcode].consteval;
 }
 
+bool AcirOpcode_IsCommutative(AcirOpcode opcode) {
+  switch(opcode) {
+    case ACIR_OPCODE_ADD: case ACIR_OPCODE_MUL: case ACIR_OPCODE_EQL: case ACIR_OPCODE_NEQ:
+    case ACIR_OPCODE_AND: case ACIR_OPCODE_COR: case ACIR_OPCODE_XOR:
+    case ACIR_OPCODE_BIT_AND: case ACIR_OPCODE_BIT_COR: case ACIR_OPCODE_BIT_XOR: return true;
+    default: return false;
+  }
+}
+
 
 const char *AcirBasicValueType_Name(AcirBasicValueType type) {
   if(type >= ACIR_BASIC_VALUE_TYPE_MAX_) NULL; // return ANSI_RED "<bad value type>" ANSI_RESET;
@@ -134,7 +145,7 @@ void AcirOperand_Print(AnchCharWriteStream *out, const AcirOperand *self) {
       AnchWriteFormat(out, ANSI_RED "<not basic type (%d)>", self->imm.type->type);
       AnchWriteFormat(out, ANSI_RED "0x%016zx", *(size_t*)&self->imm);
     } else switch(self->imm.type->basic) {
-    case ACIR_BASIC_VALUE_TYPE_SINT64: AnchWriteFormat(out, "%zu", self->imm.sint64); break;
+    case ACIR_BASIC_VALUE_TYPE_SINT64: AnchWriteFormat(out, "%lld", (long long)self->imm.sint64); break;
     case ACIR_BASIC_VALUE_TYPE_UINT64: AnchWriteFormat(out, "%zu", self->imm.uint64); break;
     case ACIR_BASIC_VALUE_TYPE_SINT32: AnchWriteFormat(out, "%d", self->imm.sint32); break;
     case ACIR_BASIC_VALUE_TYPE_UINT32: AnchWriteFormat(out, "%u", self->imm.uint32); break;
@@ -153,6 +164,10 @@ void AcirOperand_Print(AnchCharWriteStream *out, const AcirOperand *self) {
     AnchWriteString(out, ANSI_RESET);
   } else if(self->type == ACIR_OPERAND_TYPE_BINDING) {
     AnchWriteFormat(out, "$" ANSI_YELLOW "%zu" ANSI_RESET, self->idx);
+  } else if(self->type == ACIR_OPERAND_TYPE_LABEL) {
+    AnchWriteFormat(out, "@" ANSI_CYAN "%zu" ANSI_RESET, self->idx);
+  } else if(self->type == ACIR_OPERAND_TYPE_FUNCTION) {
+    AnchWriteFormat(out, "&" ANSI_MAGENTA "%zu" ANSI_RESET, self->idx);
   } else {
     AnchWriteFormat(out, ANSI_RED "<bad operand type (%d)>" ANSI_RESET, self->type);
   }
@@ -165,88 +180,111 @@ void AcirValueType_Print(AnchCharWriteStream *out, const AcirValueType *self) {
   } else if(self->type == ACIR_VALUE_TYPE_POINTER) {
     AnchWriteFormat(out, ANSI_GRAY "*" ANSI_RESET);
     AcirValueType_Print(out, self->pointer);
+  } else if(self->type == ACIR_VALUE_TYPE_FUNCTION) {
+    AnchWriteString(out, ANSI_GRAY "fn(" ANSI_RESET);
+    for(size_t i = 0; i < self->function->argumentCount; ++i) {
+      if(i > 0) AnchWriteString(out, ", ");
+      AcirValueType_Print(out, self->function->argumentTypes[i]);
+    }
+    AnchWriteString(out, ANSI_GRAY ") " ANSI_RESET);
+    AcirValueType_Print(out, self->function->returnType);
   } else {
     AnchWriteFormat(out, ANSI_RED "<bad value type (%d)>" ANSI_RESET, self->type);
   }
 }
 
 void AcirFunction_Print(const AcirFunction *self, AnchCharWriteStream *out) {
+  if(self->code == ACIR_INSTR_NULL_INDEX) return;
   for(const AcirInstr *instr = &self->instrs[self->code]; ; instr = &self->instrs[instr->next]) {
-    AcirInstr_Print(wsStdout, instr);
-    AnchWriteString(wsStdout, "\n");
+    AcirInstr_Print(out, instr);
+    AnchWriteString(out, "\n");
     if(instr->next == ACIR_INSTR_NULL_INDEX) break;
   }
 }
 
-bool AcirBasicValueType_Equals(const AcirValueType *self, const AcirValueType *other) {
+AcirOperand *AcirInstr_Operand(AcirInstr *self, int slot) {
   assert(self != NULL);
-  assert(other != NULL);
-  if(self == other) return true;
-  if(self->type != other->type) return false;
-  if(self->type == ACIR_VALUE_TYPE_BASIC) return self->basic == other->basic;
-  if(self->type == ACIR_VALUE_TYPE_POINTER) return AcirBasicValueType_Equals(self->pointer, other->pointer);
-  if(self->type == ACIR_VALUE_TYPE_FUNCTION) {
-    if(self->function->argumentCount != other->function->argumentCount) return false;
-    if(!AcirBasicValueType_Equals(self->function->returnType, other->function->returnType)) return false;
-    for(size_t i = 0; i < self->function->argumentCount; ++i) {
-      if(!AcirBasicValueType_Equals(self->function->argumentTypes[i], other->function->argumentTypes[i]))
-        return false;
-    }
-    return true;
+  int operandCount = AcirOpcode_OperandCount(self->opcode);
+  switch(slot) {
+    case ACIR_PACKED_SLOT_VAL: return operandCount >= 1 ? &self->val : NULL;
+    case ACIR_PACKED_SLOT_RHS: return operandCount == 3 ? &self->rhs : NULL;
+    case ACIR_PACKED_SLOT_OUT: return operandCount >= 2 ? &self->out : NULL;
+    default: return NULL;
   }
-  return false;
 }
 
-static bool strprefix(const char *str, const char *pre) {
-  return strncmp(pre, str, strlen(pre)) == 0;
+uint64_t AcirImmediateValue_Bits(const AcirImmediateValue *imm) {
+  if(imm->type == NULL || imm->type->type != ACIR_VALUE_TYPE_BASIC) return imm->uint64;
+  switch(imm->type->basic) {
+    case ACIR_BASIC_VALUE_TYPE_SINT32: case ACIR_BASIC_VALUE_TYPE_UINT32: return imm->uint32;
+    case ACIR_BASIC_VALUE_TYPE_SINT16: case ACIR_BASIC_VALUE_TYPE_UINT16: return imm->uint16;
+    case ACIR_BASIC_VALUE_TYPE_SINT8: case ACIR_BASIC_VALUE_TYPE_UINT8: return imm->uint8;
+    case ACIR_BASIC_VALUE_TYPE_FLOAT32: { uint32_t bits; memcpy(&bits, &imm->float32, 4); return bits; }
+    case ACIR_BASIC_VALUE_TYPE_BOOL: return imm->boolean;
+    case ACIR_BASIC_VALUE_TYPE_VOID: return 0;
+    default: return imm->uint64;
+  }
 }
 
+enum {
+  ACIR_SIGNATURE_OPERAND_WRITABLE_ = 1 << 0,
+  ACIR_SIGNATURE_OPERAND_LVALUE_ = 1 << 1,
+  ACIR_SIGNATURE_OPERAND_POINTER_ = 1 << 2,
+  ACIR_SIGNATURE_OPERAND_LABEL_ = 1 << 3,
+  ACIR_SIGNATURE_OPERAND_GENERIC_ = 1 << 4, // of the instruction's type.
+  ACIR_SIGNATURE_OPERAND_BASIC_ = 1 << 5, // of the basic type `basic`.
+  ACIR_SIGNATURE_OPERAND_FUNCTION_ = 1 << 6, // resolved against the module, see \ref AcirModule_Validate.
+};
+
+/** An opcode signature, compiled from its string in \ref ACIR_OPCODES_ENUM. Untyped operands are `any`. */
 typedef struct {
-  bool exists;
-  AcirValueType type;
-} ValidationContext_Binding_;
+  uint16_t allowedBasics; // bit per basic type the instruction's type can be, pointers are always allowed.
+  uint8_t operandCount;
+  struct {
+    uint8_t flags;
+    uint8_t slot; // \ref AcirPackedSlots
+    AcirBasicValueType basic;
+    const char *name;
+  } operands[ACIR_PACKED_SLOT_MAX_];
+} AcirOpcodeSignature_;
+
+static_assert(ACIR_BASIC_VALUE_TYPE_MAX_ <= 16, "basic types must fit `allowedBasics`");
 
 typedef struct {
+  const AcirTypeTable *types; // pointer types were interned up front.
   size_t bindingCount;
-  ValidationContext_Binding_ *bindings;
+  uint64_t *bindingExists; // bitset, sized by a scan for the largest binding.
+  const AcirValueType **bindingTypes;
+  size_t labelCount;
+  bool *labels; // whether a `lbl` defines the label.
+  uint32_t *labelPreds; // edges into the label's block, counted like \ref AcirCfg_Build does.
+  const AcirOpcodeSignature_ *signatures;
   AnchAllocator *allocator;
+  AnchCharWriteStream *out;
   int errorCount;
 } ValidationContext_;
 
-static ValidationContext_Binding_ *ValidationContext_GetBinding(const ValidationContext_ *self, size_t index) {
-  assert(self != NULL);
-  if(index >= self->bindingCount) return NULL;
-  return &self->bindings[index];
+static bool ValidationContext_Exists_(const ValidationContext_ *self, size_t index) {
+  return index < self->bindingCount && (self->bindingExists[index / 64] >> (index % 64) & 1);
 }
 
-static ValidationContext_Binding_ *ValidationContext_GetOrCreateBinding(ValidationContext_ *self, size_t index) {
-  assert(self != NULL);
-  if(index < self->bindingCount) return &self->bindings[index];
-
-  size_t oldBindingCount = self->bindingCount;
-  self->bindingCount = index + 1;
+static void ValidationContext_Define_(ValidationContext_ *self, size_t index, const AcirValueType *type) {
+  assert(index < self->bindingCount);
+  self->bindingExists[index / 64] |= (uint64_t)1 << (index % 64);
+  self->bindingTypes[index] = type;
+}
 
-  if(self->bindings == NULL) {
-    self->bindings = AnchAllocator_AllocZero(self->allocator,
-      sizeof(ValidationContext_Binding_) * self->bindingCount);
-  } else {
-    self->bindings = AnchAllocator_Realloc(self->allocator,
-      self->bindings, sizeof(ValidationContext_Binding_) * self->bindingCount);
-    memset(self->bindings + oldBindingCount, 0, sizeof(ValidationContext_Binding_) * (self->bindingCount - oldBindingCount));
-  }
-  
-  return &self->bindings[index];
+/** Count an edge into the block of label operand OP, if it is one. */
+static void ValidationContext_AddPred_(ValidationContext_ *self, const AcirOperand *op) {
+  if(op->type == ACIR_OPERAND_TYPE_LABEL && op->idx < self->labelCount) self->labelPreds[op->idx] += 1;
 }
 
 static const AcirValueType *ValidationContext_TypeOf(const ValidationContext_ *self, const AcirOperand *op) {
   assert(self != NULL);
   assert(op != NULL);
   switch(op->type) {
-    case ACIR_OPERAND_TYPE_BINDING: {
-      ValidationContext_Binding_ *binding = ValidationContext_GetBinding(self, op->idx);
-      if(binding == NULL) return NULL;
-      return &binding->type;
-    } break;
+    case ACIR_OPERAND_TYPE_BINDING:
+      return ValidationContext_Exists_(self, op->idx) ? self->bindingTypes[op->idx] : NULL;
     case ACIR_OPERAND_TYPE_IMMEDIATE: return op->imm.type;
     default: return NULL;
   }
@@ -266,60 +304,71 @@ static void ValidationContext_Error_(ValidationContext_ *self, const AcirInstr *
     ++format;
   }
 
-  AnchWriteString(wsStderr, ANSI_RED "\nError: " ANSI_RESET);
-  AnchWriteFormatV(wsStderr, format, va);
-  AnchWriteString(wsStderr, "\n");
-  AcirInstr_Print(wsStderr, instr);
-  AnchWriteString(wsStderr, "\n");
-  if(notes) AnchWriteString(wsStderr, "\n");
+  AnchWriteString(self->out, ANSI_RED "\nError: " ANSI_RESET);
+  AnchWriteFormatV(self->out, format, va);
+  AnchWriteString(self->out, "\n");
+  AcirInstr_Print(self->out, instr);
+  AnchWriteString(self->out, "\n");
+  if(notes) AnchWriteString(self->out, "\n");
   while(notes && *notes != ';') {
-    AnchWriteString(wsStderr, ANSI_GRAY "Note: " ANSI_RESET);
+    AnchWriteString(self->out, ANSI_GRAY "Note: " ANSI_RESET);
     switch(*notes) {
       case 'E':
-        AnchWriteString(wsStderr, "expected `");
-        AcirValueType_Print(wsStderr, va_arg(va, const AcirValueType *));
-        AnchWriteString(wsStderr, "`, but got `");
-        AcirValueType_Print(wsStderr, va_arg(va, const AcirValueType *));
-        AnchWriteString(wsStderr, "` instead.");
+        AnchWriteString(self->out, "expected `");
+        AcirValueType_Print(self->out, va_arg(va, const AcirValueType *));
+        AnchWriteString(self->out, "`, but got `");
+        AcirValueType_Print(self->out, va_arg(va, const AcirValueType *));
+        AnchWriteString(self->out, "` instead.");
         break;
       case 'G':
-        AnchWriteString(wsStderr, "got `");
-        AcirValueType_Print(wsStderr, va_arg(va, const AcirValueType *));
-        AnchWriteString(wsStderr, "`");
+        AnchWriteString(self->out, "got `");
+        AcirValueType_Print(self->out, va_arg(va, const AcirValueType *));
+        AnchWriteString(self->out, "`");
         break;
       case 'A':
-        AnchWriteString(wsStderr, "`");
-        AcirValueType_Print(wsStderr, va_arg(va, const AcirValueType *));
-        AnchWriteString(wsStderr, "` is not allowed.");
+        AnchWriteString(self->out, "`");
+        AcirValueType_Print(self->out, va_arg(va, const AcirValueType *));
+        AnchWriteString(self->out, "` is not allowed.");
         break;
       case 'I':
-        AnchWriteFormat(wsStderr, "Instruction count is %zu", va_arg(va, size_t));
+        AnchWriteFormat(self->out, "Instruction count is %zu", va_arg(va, size_t));
         break;
       case 'O': {
         const AcirOperand *op = va_arg(va, const AcirOperand *);
-        AnchWriteFormat(wsStderr, "got %s `", AcirOperandType_Name(op->type));
-        AcirValueType_Print(wsStderr, ValidationContext_TypeOf(self, op));
-        AnchWriteString(wsStderr, "`");
+        AnchWriteFormat(self->out, "got %s `", AcirOperandType_Name(op->type));
+        AcirValueType_Print(self->out, ValidationContext_TypeOf(self, op));
+        AnchWriteString(self->out, "`");
       } break;
       case 's':
-        AnchWriteFormat(wsStderr, "instruction signature: `" ANSI_GRAY "%s" ANSI_RESET "`",
+        AnchWriteFormat(self->out, "instruction signature: `" ANSI_GRAY "%s" ANSI_RESET "`",
           AcirOpcode_Signature(instr->opcode));
         break;
       default:
-        AnchWriteFormat(wsStderr, ANSI_RED "<bad note type ('%c' %d)>" ANSI_RESET, *notes, *notes);
+        AnchWriteFormat(self->out, ANSI_RED "<bad note type ('%c' %d)>" ANSI_RESET, *notes, *notes);
     }
-    AnchWriteString(wsStderr, "\n");
+    AnchWriteString(self->out, "\n");
     ++notes;
   }
 
-  if(notes) AnchWriteString(wsStderr, "\n");
+  if(notes) AnchWriteString(self->out, "\n");
   va_end(va);
 }
 
-static void ValidationContext_CheckInstr_(ValidationContext_ *self, const AcirInstr *instr) {
-  const char *sig = AcirOpcode_Signature(instr->opcode);
-  assert(sig != NULL);
+static AcirOpcodeSignature_ AcirOpcode_Signatures_[ACIR_OPCODE_MAX_];
+static bool AcirOpcode_SignaturesCompiled_ = false;
+
+/** Basic type named by the LENGTH characters at NAME, ACIR_BASIC_VALUE_TYPE_MAX_ if none is. */
+static AcirBasicValueType AcirOpcode_FindBasic_(const char *name, size_t length) {
+  for(size_t i = 0; i < ACIR_BASIC_VALUE_TYPE_MAX_; ++i) {
+    const char *mnemonic = AcirBasicValueType_Mnemonic(i);
+    assert(mnemonic != NULL);
+    if(length == strlen(mnemonic) && strncmp(mnemonic, name, length) == 0) return i;
+  }
+  return ACIR_BASIC_VALUE_TYPE_MAX_;
+}
 
+static void AcirOpcode_CompileSignature_(AcirOpcodeSignature_ *self, const char *sig) {
+  *self = (AcirOpcodeSignature_){ .allowedBasics = (1u << ACIR_BASIC_VALUE_TYPE_MAX_) - 1 };
   while(isspace(*sig)) ++sig;
 
   char generic = 0;
@@ -333,95 +382,134 @@ static void ValidationContext_CheckInstr_(ValidationContext_ *self, const AcirIn
 
       size_t length = 0;
       const char *start = sig;
-      while(isalpha(*sig)) { ++sig; ++length; }
+      while(isalnum(*sig)) { ++sig; ++length; }
       while(isspace(*sig)) ++sig;
 
-      for(size_t i = 0; i < ACIR_BASIC_VALUE_TYPE_MAX_; ++i) {
-        const char *mnemonic = AcirBasicValueType_Mnemonic(i);
-        assert(mnemonic != NULL);
-        if(length == strlen(mnemonic) && strncmp(mnemonic, start, length) == 0) {
-          AcirValueType type = { ACIR_VALUE_TYPE_BASIC, .basic = i };
-          if(AcirBasicValueType_Equals(instr->type, &type)) {
-            ValidationContext_Error_(self, instr, "!A;generic instruction does not allow provided type.", &type);
-          }
-
-          break;
-        }
-      }
+      AcirBasicValueType basic = AcirOpcode_FindBasic_(start, length);
+      assert(basic < ACIR_BASIC_VALUE_TYPE_MAX_);
+      self->allowedBasics &= ~(1u << basic);
     }
   }
-  
+
   while(isspace(*sig)) ++sig;
-  
+
   int index = 0;
   while(*sig) {
+    assert(index < ACIR_PACKED_SLOT_MAX_);
     while(isspace(*sig)) ++sig;
 
-    bool writable = false;
-    bool lvalue = false;
-    bool pointer = false;
-    
-    if(*sig == 'w') { writable = true; ++sig; }
-    if(*sig == 'l') { lvalue = true; ++sig; }
-    if(*sig == '*') { pointer = true; ++sig; }
-    
+    uint8_t flags = 0;
+    if(strncmp("label", sig, 5) == 0 && !isalpha(sig[5])) flags |= ACIR_SIGNATURE_OPERAND_LABEL_;
+    if(strncmp("func", sig, 4) == 0 && !isalpha(sig[4])) flags |= ACIR_SIGNATURE_OPERAND_FUNCTION_;
+    if(!flags && *sig == 'w') { flags |= ACIR_SIGNATURE_OPERAND_WRITABLE_; ++sig; }
+    if(!flags && *sig == 'l') { flags |= ACIR_SIGNATURE_OPERAND_LVALUE_; ++sig; }
+    if(*sig == '*') { flags |= ACIR_SIGNATURE_OPERAND_POINTER_; ++sig; }
+
     size_t length = 0;
     const char *start = sig;
-    while(isalpha(*sig)) { ++sig; ++length; }
+    while(isalnum(*sig)) { ++sig; ++length; }
     while(isspace(*sig)) ++sig;
     bool last = *sig != ',';
     ++sig;
 
-    const AcirValueType *typeRef;
-    AcirValueType typeValue;
-    AcirValueType pointerTypeValue;
-    
-    if(length == 1 && generic && *start == generic) {
-      typeRef = instr->type;
+    AcirBasicValueType basic = 0;
+    if(flags & (ACIR_SIGNATURE_OPERAND_LABEL_ | ACIR_SIGNATURE_OPERAND_FUNCTION_)) {
+    } else if(length == 1 && generic && *start == generic) {
+      flags |= ACIR_SIGNATURE_OPERAND_GENERIC_;
     } else if(strncmp("any", start, 3) != 0) {
-      for(size_t i = 0; i < ACIR_BASIC_VALUE_TYPE_MAX_; ++i) {
-        const char *mnemonic = AcirBasicValueType_Mnemonic(i);
-        assert(mnemonic != NULL);
-        if(length == strlen(mnemonic) && strncmp(mnemonic, start, length) == 0) {
-          typeValue = (AcirValueType){ ACIR_VALUE_TYPE_BASIC, .basic = i };
-          typeRef = &typeValue;
-          break;
-        }
-      }
+      basic = AcirOpcode_FindBasic_(start, length);
+      if(basic < ACIR_BASIC_VALUE_TYPE_MAX_) flags |= ACIR_SIGNATURE_OPERAND_BASIC_;
+      else basic = 0;
     }
 
-    if(pointer) {
-      pointerTypeValue = (AcirValueType){ ACIR_VALUE_TYPE_POINTER, .pointer = typeRef };
-      typeRef = &pointerTypeValue;
+    uint8_t slot = ACIR_PACKED_SLOT_VAL;
+    const char *name = "Value";
+    if(index == 1 && last) { slot = ACIR_PACKED_SLOT_OUT; name = "Output"; }
+    if(index == 1 && !last) { slot = ACIR_PACKED_SLOT_RHS; name = "Second value"; }
+    if(index == 2) { slot = ACIR_PACKED_SLOT_OUT; name = "Output"; }
+
+    self->operands[index].flags = flags;
+    self->operands[index].slot = slot;
+    self->operands[index].basic = basic;
+    self->operands[index].name = name;
+    ++index;
+    if(last) break;
+  }
+  self->operandCount = index;
+}
+
+/** Signatures are parsed once, on the first validation. */
+static const AcirOpcodeSignature_ *AcirOpcode_CompiledSignatures_() {
+  if(!AcirOpcode_SignaturesCompiled_) {
+    for(size_t i = 0; i < ACIR_OPCODE_MAX_; ++i)
+      AcirOpcode_CompileSignature_(&AcirOpcode_Signatures_[i], AcirOpcode_Signature(i));
+    AcirOpcode_SignaturesCompiled_ = true;
+  }
+  return AcirOpcode_Signatures_;
+}
+
+static void ValidationContext_CheckInstr_(ValidationContext_ *self, const AcirInstr *instr) {
+  assert(instr->opcode < ACIR_OPCODE_MAX_);
+  const AcirOpcodeSignature_ *sig = &self->signatures[instr->opcode];
+
+  if(instr->type != NULL && instr->type->type == ACIR_VALUE_TYPE_BASIC
+    && !(sig->allowedBasics & (1u << instr->type->basic))) {
+    ValidationContext_Error_(self, instr, "!A;generic instruction does not allow provided type.", instr->type);
+  }
+
+  for(int index = 0; index < sig->operandCount; ++index) {
+    uint8_t flags = sig->operands[index].flags;
+    const char *opname = sig->operands[index].name;
+    const AcirOperand *op = AcirInstr_Operand((AcirInstr*)instr, sig->operands[index].slot);
+
+    if(flags & ACIR_SIGNATURE_OPERAND_LABEL_) {
+      if(op->type != ACIR_OPERAND_TYPE_LABEL)
+        ValidationContext_Error_(self, instr, "!Os;%s argument (#%d) must be a label.", opname, index + 1, op);
+      else if(instr->opcode != ACIR_OPCODE_LBL && (op->idx >= self->labelCount || !self->labels[op->idx]))
+        ValidationContext_Error_(self, instr, "label @%zu is not defined.", op->idx);
+      continue;
+    }
+    if(flags & ACIR_SIGNATURE_OPERAND_FUNCTION_) {
+      if(op->type != ACIR_OPERAND_TYPE_FUNCTION)
+        ValidationContext_Error_(self, instr, "!Os;%s argument (#%d) must be a function.", opname, index + 1, op);
+      continue;
+    }
+    if(op->type == ACIR_OPERAND_TYPE_LABEL || op->type == ACIR_OPERAND_TYPE_FUNCTION) {
+      ValidationContext_Error_(self, instr, "!s;%s argument (#%d) can't be a %s.",
+        opname, index + 1, AcirOperandType_Name(op->type));
+      continue;
     }
 
-    const AcirOperand *op = NULL;
-    const char *opname = "<unknown>";
-    if(index == 0) { op = &instr->val; opname = "Value"; }
-    if(index == 1 && last) { op = &instr->out; opname = "Output"; }
-    if(index == 1 && !last) { op = &instr->rhs; opname = "Second value"; }
-    if(index == 2) { op = &instr->out; opname = "Output"; }
+    // NULL for `any`. Types are interned, so they are compared by pointer.
+    const AcirValueType *typeRef = NULL;
+    if(flags & ACIR_SIGNATURE_OPERAND_GENERIC_) typeRef = instr->type;
+    else if(flags & ACIR_SIGNATURE_OPERAND_BASIC_) typeRef = AcirValueType_Basic(sig->operands[index].basic);
+    if((flags & ACIR_SIGNATURE_OPERAND_POINTER_) && typeRef != NULL) typeRef = AcirTypeTable_FindPointer(self->types, typeRef);
 
-    ValidationContext_Binding_ *binding = op->type == ACIR_OPERAND_TYPE_BINDING
-      ? ValidationContext_GetBinding(self, op->idx) : NULL;
+    bool exists = op->type == ACIR_OPERAND_TYPE_BINDING && ValidationContext_Exists_(self, op->idx);
     
-    if(writable || lvalue) {
+    if(flags & (ACIR_SIGNATURE_OPERAND_WRITABLE_ | ACIR_SIGNATURE_OPERAND_LVALUE_)) {
       if(op->type != ACIR_OPERAND_TYPE_BINDING) {
         ValidationContext_Error_(self, instr, "!Os;%s argument (#%d) must be either writable or an lvalue.",
           opname, index + 1, op);
+      } else if(flags & ACIR_SIGNATURE_OPERAND_LVALUE_) {
+        if(!exists)
+          ValidationContext_Error_(self, instr, "binding $%d doesn't exist.", op->idx);
       } else {
-        if(binding != NULL && binding->exists)
+        if(exists)
             ValidationContext_Error_(self, instr,
               ANSI_RESET "binding $"
               ANSI_YELLOW "%d"
               ANSI_RESET " might be set multiple times.", op->idx);
         
-        binding = ValidationContext_GetOrCreateBinding(self, op->idx);
-        binding->exists = true;
-        binding->type = *typeRef;
+        ValidationContext_Define_(self, op->idx, typeRef);
       }
+    } else if(instr->opcode == ACIR_OPCODE_PHI && op->type == ACIR_OPERAND_TYPE_BINDING
+      && !exists) {
+      // may come in over a back edge, checked once the whole function is seen.
+      continue;
     } else {
-      if(op->type == ACIR_OPERAND_TYPE_BINDING && (binding == NULL || !binding->exists))
+      if(op->type == ACIR_OPERAND_TYPE_BINDING && !exists)
           ValidationContext_Error_(self, instr, "binding $%d doesn't exist.", op->idx);
     }
 
@@ -429,28 +517,132 @@ static void ValidationContext_CheckInstr_(ValidationContext_ *self, const AcirIn
     if(opType == NULL) {
       ValidationContext_Error_(self, instr, "%s argument (#%d) doesn't have a type.",
         opname, index + 1);
-    } else if(!AcirBasicValueType_Equals(typeRef, opType)) {
+    } else if(typeRef != NULL && typeRef != opType) {
       ValidationContext_Error_(self, instr, "!Es;%s argument (#%d) did not match type.",
         opname, index + 1, typeRef, opType);
     }
+  }
+}
 
-    if(instr->opcode == ACIR_OPCODE_RET && instr->next != ACIR_INSTR_NULL_INDEX) {
-      ValidationContext_Error_(self, instr, "the `" ANSI_BLUE "ret" ANSI_RESET "` instruction has to be last.");
-    }
+/** `par` and `ret` against the function's type: parameters by a constant index, values of the declared types. */
+static void ValidationContext_CheckSignature_(ValidationContext_ *self, const AcirFunction *function, const AcirInstr *instr) {
+  const AcirFunctionValueType *type = function->type != NULL && function->type->type == ACIR_VALUE_TYPE_FUNCTION
+    ? function->type->function : NULL;
+  if(instr->opcode == ACIR_OPCODE_RET) {
+    if(type != NULL && instr->type != type->returnType)
+      ValidationContext_Error_(self, instr, "!E;the return type does not match the function's.", type->returnType, instr->type);
+    return;
+  }
 
-    ++index;
-    if(last) break;
+  assert(instr->opcode == ACIR_OPCODE_PAR);
+  if(instr->val.type != ACIR_OPERAND_TYPE_IMMEDIATE) {
+    ValidationContext_Error_(self, instr, "the parameter index has to be an immediate.");
+    return;
   }
+  uint32_t index = instr->val.imm.uint32;
+  size_t count = type != NULL ? type->argumentCount : 0;
+  if(index >= count)
+    ValidationContext_Error_(self, instr, "parameter %u doesn't exist, the function takes %zu.", index, count);
+  else if(type->argumentTypes[index] != instr->type)
+    ValidationContext_Error_(self, instr, "!E;parameter %u did not match type.", index, type->argumentTypes[index], instr->type);
+}
+
+void AcirFunction_PrepareValidation(const AcirFunction *self, AcirTypeTable *types) {
+  assert(self != NULL);
+  assert(types != NULL);
+  const AcirOpcodeSignature_ *signatures = AcirOpcode_CompiledSignatures_();
+  for(size_t i = 0; i < self->instrCount; ++i) {
+    const AcirInstr *instr = &self->instrs[i];
+    if(instr->opcode >= ACIR_OPCODE_MAX_) continue;
+    const AcirOpcodeSignature_ *sig = &signatures[instr->opcode];
+    for(int j = 0; j < sig->operandCount; ++j) {
+      uint8_t flags = sig->operands[j].flags;
+      if(!(flags & ACIR_SIGNATURE_OPERAND_POINTER_)) continue;
+      if(flags & ACIR_SIGNATURE_OPERAND_GENERIC_ && instr->type != NULL) AcirTypeTable_Pointer(types, instr->type);
+      if(flags & ACIR_SIGNATURE_OPERAND_BASIC_) AcirTypeTable_Pointer(types, AcirValueType_Basic(sig->operands[j].basic));
+    }
+  }
+}
+
+int AcirFunction_Validate(AcirFunction *self, AcirTypeTable *types, AnchAllocator *allocator) {
+  AcirFunction_PrepareValidation(self, types);
+  return AcirFunction_ValidateTo(self, types, allocator, wsStderr);
 }
 
-int AcirFunction_Validate(AcirFunction *self, AnchAllocator *allocator) {
+int AcirFunction_ValidateTo(const AcirFunction *self, const AcirTypeTable *types, AnchAllocator *allocator,
+  AnchCharWriteStream *out) {
   assert(self != NULL);
+  assert(types != NULL);
   
   ValidationContext_ context = {0};
+  context.types = types;
   context.allocator = allocator;
+  context.out = out;
+  context.signatures = AcirOpcode_CompiledSignatures_();
+
+  // one pass sizes the binding state, so defining a binding never reallocates.
+  for(size_t i = 0; i < self->instrCount; ++i) {
+    const AcirInstr *instr = &self->instrs[i];
+    for(int slot = 0; slot < ACIR_PACKED_SLOT_MAX_; ++slot) {
+      const AcirOperand *op = AcirInstr_Operand((AcirInstr*)instr, slot);
+      if(op != NULL && op->type == ACIR_OPERAND_TYPE_BINDING && op->idx + 1 > context.bindingCount) context.bindingCount = op->idx + 1;
+    }
+  }
+  if(context.bindingCount > 0) {
+    context.bindingExists = AnchAllocator_AllocZero(allocator, sizeof(uint64_t) * ((context.bindingCount + 63) / 64));
+    context.bindingTypes = AnchAllocator_Alloc(allocator, sizeof(const AcirValueType*) * context.bindingCount);
+  }
+
+  // labels can be jumped to before they are defined, so collect them first.
+  for(size_t i = 0; i < self->instrCount; ++i) {
+    const AcirInstr *instr = &self->instrs[i];
+    if(instr->opcode == ACIR_OPCODE_LBL && instr->val.type == ACIR_OPERAND_TYPE_LABEL
+      && instr->val.idx + 1 > context.labelCount) context.labelCount = instr->val.idx + 1;
+  }
+  if(context.labelCount > 0) {
+    context.labels = AnchAllocator_AllocZero(allocator, sizeof(bool) * context.labelCount);
+    context.labelPreds = AnchAllocator_AllocZero(allocator, sizeof(uint32_t) * context.labelCount);
+  }
+  for(size_t i = 0; i < self->instrCount; ++i) {
+    const AcirInstr *instr = &self->instrs[i];
+    if(instr->opcode != ACIR_OPCODE_LBL || instr->val.type != ACIR_OPERAND_TYPE_LABEL) continue;
+    if(context.labels[instr->val.idx])
+      ValidationContext_Error_(&context, instr, "label @%zu is defined multiple times.", instr->val.idx);
+    context.labels[instr->val.idx] = true;
+  }
 
+  const AcirInstr *previous = NULL;
   for(const AcirInstr *instr = &self->instrs[self->code]; instr != NULL;) {
     ValidationContext_CheckInstr_(&context, instr);
+    if(instr->opcode == ACIR_OPCODE_RET || instr->opcode == ACIR_OPCODE_PAR)
+      ValidationContext_CheckSignature_(&context, self, instr);
+
+    if(AcirOpcode_IsTerminator(instr->opcode) && instr->next != ACIR_INSTR_NULL_INDEX
+      && instr->next < self->instrCount && self->instrs[instr->next].opcode != ACIR_OPCODE_LBL) {
+      ValidationContext_Error_(&context, instr, "the `" ANSI_BLUE "%s" ANSI_RESET "` instruction has to be "
+        "last in its block, followed by `" ANSI_BLUE "lbl" ANSI_RESET "` or nothing.", AcirOpcode_Mnemonic(instr->opcode));
+    }
+    if(instr->opcode == ACIR_OPCODE_ARG && (instr->next >= self->instrCount
+      || (self->instrs[instr->next].opcode != ACIR_OPCODE_ARG && self->instrs[instr->next].opcode != ACIR_OPCODE_CALL))) {
+      ValidationContext_Error_(&context, instr, "the `" ANSI_BLUE "arg" ANSI_RESET "` instruction has to be "
+        "followed by another `" ANSI_BLUE "arg" ANSI_RESET "` or a `" ANSI_BLUE "call" ANSI_RESET "`.");
+    }
+    if(instr->opcode == ACIR_OPCODE_PHI && (previous == NULL
+      || (previous->opcode != ACIR_OPCODE_LBL && previous->opcode != ACIR_OPCODE_PHI))) {
+      ValidationContext_Error_(&context, instr, "the `" ANSI_BLUE "phi" ANSI_RESET "` instruction has to be "
+        "at the start of a labeled block.");
+    }
+
+    // nothing enters the first block, a label there only counts the jumps to it.
+    if(instr->opcode == ACIR_OPCODE_LBL && previous != NULL && !AcirOpcode_IsTerminator(previous->opcode))
+      ValidationContext_AddPred_(&context, &instr->val);
+    if(instr->opcode == ACIR_OPCODE_JMP) ValidationContext_AddPred_(&context, &instr->val);
+    if(instr->opcode == ACIR_OPCODE_BR) {
+      ValidationContext_AddPred_(&context, &instr->rhs);
+      if(instr->out.type != instr->rhs.type || instr->out.idx != instr->rhs.idx) ValidationContext_AddPred_(&context, &instr->out);
+    }
+
+    previous = instr;
     if(instr->next == ACIR_INSTR_NULL_INDEX) break;
     if(instr->next >= self->instrCount)
       ValidationContext_Error_(&context, instr,
@@ -458,8 +650,41 @@ int AcirFunction_Validate(AcirFunction *self, AnchAllocator *allocator) {
     instr = &self->instrs[instr->next];
   }
 
-  if(context.bindingCount > 0)
-    AnchAllocator_Free(context.allocator, context.bindings);
+  // `phi` inputs skipped above must be defined somewhere in the function, and there have to be two
+  // predecessors for them to come from.
+  size_t label = ACIR_INSTR_NULL_INDEX;
+  for(const AcirInstr *instr = &self->instrs[self->code]; instr != NULL;) {
+    if(instr->opcode == ACIR_OPCODE_LBL) {
+      label = instr->val.type == ACIR_OPERAND_TYPE_LABEL ? instr->val.idx : ACIR_INSTR_NULL_INDEX;
+    } else if(instr->opcode != ACIR_OPCODE_PHI) {
+      label = ACIR_INSTR_NULL_INDEX;
+    } else if(label != ACIR_INSTR_NULL_INDEX && context.labelPreds[label] != 2) {
+      ValidationContext_Error_(&context, instr, "the `" ANSI_BLUE "phi" ANSI_RESET "` instruction's block has %u "
+        "predecessors, it needs exactly 2.", context.labelPreds[label]);
+    }
+    if(instr->opcode == ACIR_OPCODE_PHI) {
+      const AcirOperand *inputs[] = { &instr->lhs, &instr->rhs };
+      for(int i = 0; i < 2; ++i) {
+        if(inputs[i]->type != ACIR_OPERAND_TYPE_BINDING) continue;
+        if(!ValidationContext_Exists_(&context, inputs[i]->idx))
+          ValidationContext_Error_(&context, instr, "binding $%zu doesn't exist.", inputs[i]->idx);
+        else if(context.bindingTypes[inputs[i]->idx] != instr->type)
+          ValidationContext_Error_(&context, instr, "!Es;%s argument (#%d) did not match type.",
+            i == 0 ? "Value" : "Second value", i + 1, instr->type, context.bindingTypes[inputs[i]->idx]);
+      }
+    }
+    if(instr->next == ACIR_INSTR_NULL_INDEX || instr->next >= self->instrCount) break;
+    instr = &self->instrs[instr->next];
+  }
+
+  if(context.bindingCount > 0) {
+    AnchAllocator_Free(context.allocator, context.bindingExists);
+    AnchAllocator_Free(context.allocator, context.bindingTypes);
+  }
+  if(context.labelCount > 0) {
+    AnchAllocator_Free(context.allocator, context.labels);
+    AnchAllocator_Free(context.allocator, context.labelPreds);
+  }
   
   return context.errorCount;
 }
@@ -471,12 +696,14 @@ void AcirBuilder_Init(AcirBuilder *self, AcirFunction *target, AnchAllocator *al
   self->allocator = allocator;
   self->target->instrCount = 0;
   self->target->instrs = NULL;
+  self->target->code = ACIR_INSTR_NULL_INDEX;
   self->instrs = NULL;
+  self->capacity = 0;
 }
 
 void AcirBuilder_Free(AcirBuilder *self) {
   assert(self != NULL);
-  if(self->target->instrCount > 0)
+  if(self->capacity > 0)
     AnchAllocator_Free(self->allocator, self->instrs);
   self->target->instrCount = 0;
   self->target->instrs = NULL;
@@ -484,6 +711,23 @@ void AcirBuilder_Free(AcirBuilder *self) {
   self->allocator = NULL;
   self->target = NULL;
   self->instrs = NULL;
+  self->capacity = 0;
+}
+
+void AcirBuilder_Reserve(AcirBuilder *self, size_t count) {
+  assert(self != NULL);
+  if(count <= self->capacity) return;
+
+  size_t capacity = self->capacity < 16 ? 16 : self->capacity * 2;
+  if(capacity < count) capacity = count;
+
+  if(self->capacity == 0) {
+    self->instrs = AnchAllocator_Alloc(self->allocator, sizeof(AcirInstr) * capacity);
+  } else {
+    self->instrs = AnchAllocator_Realloc(self->allocator, self->instrs, sizeof(AcirInstr) * capacity);
+  }
+  self->target->instrs = self->instrs;
+  self->capacity = capacity;
 }
 
 AcirInstr *AcirBuilder_Add(AcirBuilder *self, size_t index) {
@@ -492,32 +736,85 @@ AcirInstr *AcirBuilder_Add(AcirBuilder *self, size_t index) {
   if(index < self->target->instrCount) return &self->instrs[index];
 
   size_t oldInstrCount = self->target->instrCount;
+  AcirBuilder_Reserve(self, index + 1);
+  memset(self->instrs + oldInstrCount, 0, sizeof(AcirInstr) * (index + 1 - oldInstrCount));
   self->target->instrCount = index + 1;
-
-  if(oldInstrCount == 0) {
-    self->target->instrs = self->instrs =
-      AnchAllocator_AllocZero(self->allocator, sizeof(AcirInstr));
-    
-    self->target->code = index;
-  } else {
-    self->target->instrs = self->instrs =
-      AnchAllocator_Realloc(self->allocator, self->instrs,
-        sizeof(AcirInstr) * self->target->instrCount);
-    
-    memset(self->instrs + oldInstrCount, 0,
-      sizeof(AcirInstr) * (self->target->instrCount - oldInstrCount));
-  }
+  if(oldInstrCount == 0) self->target->code = index;
   
   return &self->instrs[index];
 }
 
+AcirInstr *AcirBuilder_Append(AcirBuilder *self, const AcirInstr *instrs, size_t count) {
+  assert(self != NULL);
+  assert(count == 0 || instrs != NULL);
+
+  size_t base = self->target->instrCount;
+  AcirBuilder_Reserve(self, base + count);
+  AcirInstr *dest = self->instrs + base;
+  memcpy(dest, instrs, sizeof(AcirInstr) * count);
+  for(size_t i = 0; i < count; ++i) {
+    dest[i].index += base;
+    if(dest[i].next != ACIR_INSTR_NULL_INDEX) dest[i].next += base;
+  }
+
+  self->target->instrCount = base + count;
+  if(base == 0 && count > 0) self->target->code = 0;
+  return dest;
+}
+
 void AcirBuilder_BuildNormalized(const AcirBuilder *self, AcirBuilder *target) {
+  assert(self != NULL);
+  assert(target != NULL);
+  assert(target->target->instrCount == 0);
+
+  const AcirFunction *source = self->target;
+  if(source->code == ACIR_INSTR_NULL_INDEX) return;
+
+  // an upper bound, so the loop below only copies.
+  AcirBuilder_Reserve(target, source->instrCount);
+  AcirInstr *out = target->instrs;
   size_t index = 0;
-  for(AcirInstr *instr = &self->instrs[self->target->code]; ; instr = &self->instrs[instr->next]) {
-    AcirInstr *tinstr = AcirBuilder_Add(target, index);
-    *tinstr = *instr;
-    tinstr->index = index;
-    if(instr->next == ACIR_INSTR_NULL_INDEX) break;
-    tinstr->next = ++index;
+  for(size_t i = source->code; i != ACIR_INSTR_NULL_INDEX; i = source->instrs[i].next, ++index) {
+    out[index] = source->instrs[i];
+    out[index].index = index;
+    out[index].next = index + 1;
+  }
+  out[index - 1].next = ACIR_INSTR_NULL_INDEX;
+
+  target->target->instrCount = index;
+  target->target->code = 0;
+}
+
+void AcirBuilder_Clear(AcirBuilder *self) {
+  assert(self != NULL);
+  self->target->instrCount = 0;
+  self->target->code = ACIR_INSTR_NULL_INDEX;
+}
+
+size_t AcirBuilder_RenumberBindings(AcirBuilder *self) {
+  assert(self != NULL);
+  AcirFunction *function = self->target;
+  size_t maxBinding = 0;
+  for(size_t i = function->code; i != ACIR_INSTR_NULL_INDEX; i = self->instrs[i].next) {
+    for(int slot = 0; slot < ACIR_PACKED_SLOT_MAX_; ++slot) {
+      const AcirOperand *op = AcirInstr_Operand(&self->instrs[i], slot);
+      if(op != NULL && op->type == ACIR_OPERAND_TYPE_BINDING && op->idx + 1 > maxBinding) maxBinding = op->idx + 1;
+    }
+  }
+  if(maxBinding == 0) return 0;
+
+  // new numbers go out in order of first appearance, so a `phi` reading ahead is fine.
+  size_t *numbers = AnchAllocator_Alloc(self->allocator, sizeof(size_t) * maxBinding);
+  memset(numbers, 0xFF, sizeof(size_t) * maxBinding);
+  size_t count = 0;
+  for(size_t i = function->code; i != ACIR_INSTR_NULL_INDEX; i = self->instrs[i].next) {
+    for(int slot = 0; slot < ACIR_PACKED_SLOT_MAX_; ++slot) {
+      AcirOperand *op = AcirInstr_Operand(&self->instrs[i], slot);
+      if(op == NULL || op->type != ACIR_OPERAND_TYPE_BINDING) continue;
+      if(numbers[op->idx] == (size_t)-1) numbers[op->idx] = count++;
+      op->idx = numbers[op->idx];
+    }
   }
+  AnchAllocator_Free(self->allocator, numbers);
+  return count;
 }
@@ -0,0 +1,171 @@
+#include <acir/acir.h>
+#include <annec_anchor.h>
+#include <assert.h>
+#include "../cli.h"
+
+static uint32_t *AcirDefUse_Grow_(AcirDefUse *self, uint32_t *array, size_t oldCount, size_t newCount, int fill) {
+  uint32_t *grown = AnchAllocator_Alloc(self->allocator, sizeof(uint32_t) * newCount);
+  if(oldCount > 0) memcpy(grown, array, sizeof(uint32_t) * oldCount);
+  memset(grown + oldCount, fill, sizeof(uint32_t) * (newCount - oldCount));
+  if(array != NULL) AnchAllocator_Free(self->allocator, array);
+  return grown;
+}
+
+static void AcirDefUse_ReserveBinding_(AcirDefUse *self, size_t binding) {
+  if(binding < self->bindingCapacity) return;
+  assert(binding < ACIR_DEFUSE_NULL_INDEX / 2);
+  size_t capacity = self->bindingCapacity ? self->bindingCapacity : 16;
+  while(capacity <= binding) capacity *= 2;
+  self->defs = AcirDefUse_Grow_(self, self->defs, self->bindingCapacity, capacity, 0xFF);
+  self->firstUses = AcirDefUse_Grow_(self, self->firstUses, self->bindingCapacity, capacity, 0xFF);
+  self->useCounts = AcirDefUse_Grow_(self, self->useCounts, self->bindingCapacity, capacity, 0);
+  self->bindingCapacity = capacity;
+}
+
+static void AcirDefUse_ReserveInstr_(AcirDefUse *self, size_t instr) {
+  size_t uses = (instr + 1) * ACIR_PACKED_SLOT_MAX_;
+  if(uses <= self->useCapacity) return;
+  assert(uses < ACIR_DEFUSE_NULL_INDEX / 2);
+  size_t capacity = self->useCapacity ? self->useCapacity : 16 * ACIR_PACKED_SLOT_MAX_;
+  while(capacity < uses) capacity *= 2;
+  self->prevUses = AcirDefUse_Grow_(self, self->prevUses, self->useCapacity, capacity, 0xFF);
+  self->nextUses = AcirDefUse_Grow_(self, self->nextUses, self->useCapacity, capacity, 0xFF);
+  self->useCapacity = capacity;
+}
+
+/** The binding read by SLOT of INSTR, or ACIR_DEFUSE_NULL_INDEX if it doesn't read one. */
+static size_t AcirDefUse_ReadBinding_(AcirInstr *instr, int slot) {
+  if(slot == ACIR_PACKED_SLOT_OUT) return ACIR_DEFUSE_NULL_INDEX;
+  const AcirOperand *op = AcirInstr_Operand(instr, slot);
+  return op != NULL && op->type == ACIR_OPERAND_TYPE_BINDING ? op->idx : ACIR_DEFUSE_NULL_INDEX;
+}
+
+static size_t AcirDefUse_DefBinding_(AcirInstr *instr) {
+  const AcirOperand *op = AcirInstr_Operand(instr, ACIR_PACKED_SLOT_OUT);
+  return op != NULL && op->type == ACIR_OPERAND_TYPE_BINDING ? op->idx : ACIR_DEFUSE_NULL_INDEX;
+}
+
+static void AcirDefUse_AddUse_(AcirDefUse *self, size_t binding, uint32_t use) {
+  AcirDefUse_ReserveBinding_(self, binding);
+  uint32_t first = self->firstUses[binding];
+  self->prevUses[use] = ACIR_DEFUSE_NULL_INDEX;
+  self->nextUses[use] = first;
+  if(first != ACIR_DEFUSE_NULL_INDEX) self->prevUses[first] = use;
+  self->firstUses[binding] = use;
+  self->useCounts[binding] += 1;
+}
+
+static void AcirDefUse_RemoveUse_(AcirDefUse *self, size_t binding, uint32_t use) {
+  if(binding >= self->bindingCapacity) return;
+  uint32_t prev = self->prevUses[use], next = self->nextUses[use];
+  // a slot that isn't in the list has no neighbours and isn't its head.
+  if(prev == ACIR_DEFUSE_NULL_INDEX && self->firstUses[binding] != use) return;
+  if(prev != ACIR_DEFUSE_NULL_INDEX) self->nextUses[prev] = next;
+  else self->firstUses[binding] = next;
+  if(next != ACIR_DEFUSE_NULL_INDEX) self->prevUses[next] = prev;
+  self->prevUses[use] = self->nextUses[use] = ACIR_DEFUSE_NULL_INDEX;
+  self->useCounts[binding] -= 1;
+}
+
+void AcirDefUse_Build(AcirDefUse *self, AcirBuilder *builder, AnchAllocator *allocator) {
+  assert(self != NULL);
+  assert(builder != NULL);
+  *self = (AcirDefUse){ .builder = builder, .allocator = allocator };
+
+  // size everything up front from the largest binding and instruction.
+  const AcirFunction *function = builder->target;
+  size_t maxBinding = 0;
+  for(size_t i = function->code; i != ACIR_INSTR_NULL_INDEX; i = builder->instrs[i].next) {
+    for(int slot = 0; slot < ACIR_PACKED_SLOT_MAX_; ++slot) {
+      const AcirOperand *op = AcirInstr_Operand(&builder->instrs[i], slot);
+      if(op != NULL && op->type == ACIR_OPERAND_TYPE_BINDING && op->idx > maxBinding) maxBinding = op->idx;
+    }
+  }
+  AcirDefUse_ReserveBinding_(self, maxBinding);
+  AcirDefUse_ReserveInstr_(self, function->instrCount ? function->instrCount - 1 : 0);
+
+  for(size_t i = function->code; i != ACIR_INSTR_NULL_INDEX; i = builder->instrs[i].next)
+    AcirDefUse_Link(self, i);
+}
+
+void AcirDefUse_Free(AcirDefUse *self) {
+  assert(self != NULL);
+  if(self->bindingCapacity > 0) {
+    AnchAllocator_Free(self->allocator, self->defs);
+    AnchAllocator_Free(self->allocator, self->firstUses);
+    AnchAllocator_Free(self->allocator, self->useCounts);
+  }
+  if(self->useCapacity > 0) {
+    AnchAllocator_Free(self->allocator, self->prevUses);
+    AnchAllocator_Free(self->allocator, self->nextUses);
+  }
+  *self = (AcirDefUse){0};
+}
+
+void AcirDefUse_Link(AcirDefUse *self, size_t instr) {
+  assert(self != NULL);
+  assert(instr < self->builder->target->instrCount);
+  AcirDefUse_ReserveInstr_(self, instr);
+  AcirInstr *in = &self->builder->instrs[instr];
+  for(int slot = 0; slot < ACIR_PACKED_SLOT_MAX_; ++slot) {
+    size_t binding = AcirDefUse_ReadBinding_(in, slot);
+    if(binding != ACIR_DEFUSE_NULL_INDEX) AcirDefUse_AddUse_(self, binding, instr * ACIR_PACKED_SLOT_MAX_ + slot);
+  }
+  size_t def = AcirDefUse_DefBinding_(in);
+  if(def != ACIR_DEFUSE_NULL_INDEX) {
+    AcirDefUse_ReserveBinding_(self, def);
+    self->defs[def] = instr;
+  }
+}
+
+void AcirDefUse_Unlink(AcirDefUse *self, size_t instr) {
+  assert(self != NULL);
+  assert(instr < self->builder->target->instrCount);
+  if((instr + 1) * ACIR_PACKED_SLOT_MAX_ > self->useCapacity) return;
+  AcirInstr *in = &self->builder->instrs[instr];
+  for(int slot = 0; slot < ACIR_PACKED_SLOT_MAX_; ++slot) {
+    size_t binding = AcirDefUse_ReadBinding_(in, slot);
+    if(binding != ACIR_DEFUSE_NULL_INDEX) AcirDefUse_RemoveUse_(self, binding, instr * ACIR_PACKED_SLOT_MAX_ + slot);
+  }
+  size_t def = AcirDefUse_DefBinding_(in);
+  if(def != ACIR_DEFUSE_NULL_INDEX && def < self->bindingCapacity && self->defs[def] == instr)
+    self->defs[def] = ACIR_DEFUSE_NULL_INDEX;
+}
+
+void AcirDefUse_SetOperand(AcirDefUse *self, size_t instr, int slot, const AcirOperand *operand) {
+  assert(self != NULL);
+  assert(operand != NULL);
+  AcirInstr *in = &self->builder->instrs[instr];
+  AcirOperand *op = AcirInstr_Operand(in, slot);
+  assert(op != NULL);
+  AcirDefUse_ReserveInstr_(self, instr);
+
+  uint32_t use = instr * ACIR_PACKED_SLOT_MAX_ + slot;
+  if(slot == ACIR_PACKED_SLOT_OUT) {
+    size_t def = AcirDefUse_DefBinding_(in);
+    if(def != ACIR_DEFUSE_NULL_INDEX && def < self->bindingCapacity && self->defs[def] == instr)
+      self->defs[def] = ACIR_DEFUSE_NULL_INDEX;
+    *op = *operand;
+    def = AcirDefUse_DefBinding_(in);
+    if(def != ACIR_DEFUSE_NULL_INDEX) {
+      AcirDefUse_ReserveBinding_(self, def);
+      self->defs[def] = instr;
+    }
+  } else {
+    size_t binding = AcirDefUse_ReadBinding_(in, slot);
+    if(binding != ACIR_DEFUSE_NULL_INDEX) AcirDefUse_RemoveUse_(self, binding, use);
+    *op = *operand;
+    binding = AcirDefUse_ReadBinding_(in, slot);
+    if(binding != ACIR_DEFUSE_NULL_INDEX) AcirDefUse_AddUse_(self, binding, use);
+  }
+}
+
+void AcirDefUse_ReplaceAllUses(AcirDefUse *self, size_t binding, const AcirOperand *with) {
+  assert(self != NULL);
+  assert(with != NULL);
+  if(with->type == ACIR_OPERAND_TYPE_BINDING && with->idx == binding) return;
+  for(uint32_t use = AcirDefUse_FirstUse(self, binding), next; use != ACIR_DEFUSE_NULL_INDEX; use = next) {
+    next = AcirDefUse_NextUse(self, use);
+    AcirDefUse_SetOperand(self, AcirDefUse_UseInstr(use), AcirDefUse_UseSlot(use), with);
+  }
+}
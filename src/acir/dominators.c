@@ -0,0 +1,161 @@
+#include <acir/acir.h>
+#include <annec_anchor.h>
+#include <assert.h>
+#include "../cli.h"
+
+// Dominators are computed over reverse postorder: every block's immediate dominator is the
+// nearest common dominator of its processed predecessors, found by walking both up the tree
+// built so far, until nothing changes. Reducible graphs settle after two rounds.
+
+/** Nearest common dominator of A and B, walking up by position in reverse postorder. */
+static uint32_t AcirDomTree_Intersect_(const uint32_t *idoms, const uint32_t *rpoIndices, uint32_t a, uint32_t b) {
+  while(a != b) {
+    while(rpoIndices[a] > rpoIndices[b]) a = idoms[a];
+    while(rpoIndices[b] > rpoIndices[a]) b = idoms[b];
+  }
+  return a;
+}
+
+void AcirDomTree_Build(AcirDomTree *self, const AcirCfg *cfg, AnchAllocator *allocator) {
+  assert(self != NULL);
+  assert(cfg != NULL);
+  uint32_t n = cfg->blockCount;
+  *self = (AcirDomTree){
+    .cfg = cfg,
+    .allocator = allocator,
+    .idoms = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * (n + 1)),
+    .childOffsets = AnchAllocator_AllocZero(allocator, sizeof(uint32_t) * (n + 2)),
+    .children = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * (n + 1)),
+    .preorder = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * (n + 1)),
+    .subtreeEnds = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * (n + 1)),
+  };
+  memset(self->idoms, 0xFF, sizeof(uint32_t) * n);
+  memset(self->preorder, 0xFF, sizeof(uint32_t) * n);
+  if(cfg->rpoCount == 0) return;
+
+  uint32_t *rpoIndices = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * n);
+  memset(rpoIndices, 0xFF, sizeof(uint32_t) * n);
+  for(uint32_t i = 0; i < cfg->rpoCount; ++i) rpoIndices[cfg->rpo[i]] = i;
+
+  // the entry is its own dominator while the tree is built, so walks up stop there.
+  uint32_t *idoms = self->idoms;
+  idoms[cfg->rpo[0]] = cfg->rpo[0];
+  for(bool changed = true; changed;) {
+    changed = false;
+    for(uint32_t i = 1; i < cfg->rpoCount; ++i) {
+      uint32_t b = cfg->rpo[i], predCount, idom = ACIR_BLOCK_NULL_INDEX;
+      const uint32_t *preds = AcirCfg_Preds(cfg, b, &predCount);
+      for(uint32_t p = 0; p < predCount; ++p) {
+        if(idoms[preds[p]] == ACIR_BLOCK_NULL_INDEX) continue;
+        idom = idom == ACIR_BLOCK_NULL_INDEX ? preds[p] : AcirDomTree_Intersect_(idoms, rpoIndices, preds[p], idom);
+      }
+      if(idoms[b] != idom) {
+        idoms[b] = idom;
+        changed = true;
+      }
+    }
+  }
+  idoms[cfg->rpo[0]] = ACIR_BLOCK_NULL_INDEX;
+  AnchAllocator_Free(allocator, rpoIndices);
+
+  // children, in reverse postorder.
+  for(uint32_t i = 1; i < cfg->rpoCount; ++i) self->childOffsets[idoms[cfg->rpo[i]] + 2] += 1;
+  for(uint32_t b = 0; b < n; ++b) self->childOffsets[b + 2] += self->childOffsets[b + 1];
+  for(uint32_t i = 1; i < cfg->rpoCount; ++i) {
+    uint32_t b = cfg->rpo[i];
+    self->children[self->childOffsets[idoms[b] + 1]++] = b;
+  }
+
+  // preorder numbers, with an explicit stack of blocks whose subtree is still open.
+  uint32_t *stack = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * n);
+  uint32_t *next = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * n);
+  uint32_t depth = 0, count = 0;
+  stack[depth++] = cfg->rpo[0];
+  self->preorder[cfg->rpo[0]] = count++;
+  next[cfg->rpo[0]] = self->childOffsets[cfg->rpo[0]];
+  while(depth > 0) {
+    uint32_t b = stack[depth - 1];
+    if(next[b] < self->childOffsets[b + 1]) {
+      uint32_t child = self->children[next[b]++];
+      self->preorder[child] = count++;
+      next[child] = self->childOffsets[child];
+      stack[depth++] = child;
+    } else {
+      self->subtreeEnds[b] = count - 1;
+      --depth;
+    }
+  }
+  AnchAllocator_Free(allocator, stack);
+  AnchAllocator_Free(allocator, next);
+}
+
+void AcirDomTree_Free(AcirDomTree *self) {
+  assert(self != NULL);
+  if(self->allocator == NULL) return;
+  AnchAllocator_Free(self->allocator, self->idoms);
+  AnchAllocator_Free(self->allocator, self->childOffsets);
+  AnchAllocator_Free(self->allocator, self->children);
+  AnchAllocator_Free(self->allocator, self->preorder);
+  AnchAllocator_Free(self->allocator, self->subtreeEnds);
+  *self = (AcirDomTree){0};
+}
+
+void AcirLoopForest_Build(AcirLoopForest *self, const AcirCfg *cfg, const AcirDomTree *doms, AnchAllocator *allocator) {
+  assert(self != NULL);
+  assert(cfg != NULL && doms != NULL && doms->cfg == cfg);
+  uint32_t n = cfg->blockCount;
+  *self = (AcirLoopForest){
+    .allocator = allocator,
+    .loops = AnchAllocator_Alloc(allocator, sizeof(AcirLoop) * (n + 1)),
+    .blockLoops = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * (n + 1)),
+  };
+  memset(self->blockLoops, 0xFF, sizeof(uint32_t) * n);
+
+  // an enclosing header comes first in reverse postorder, so inner loops claim their blocks
+  // after the loops around them; a header is still claimed by the enclosing loop when its own starts.
+  uint32_t *marks = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * (n + 1));
+  uint32_t *worklist = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * (n + 1));
+  memset(marks, 0xFF, sizeof(uint32_t) * n);
+  for(uint32_t i = 0; i < cfg->rpoCount; ++i) {
+    uint32_t header = cfg->rpo[i], predCount, top = 0;
+    uint32_t loop = self->loopCount;
+    bool backEdge = false;
+    // the walk stops at the header, a block jumping to itself included.
+    marks[header] = loop;
+    const uint32_t *preds = AcirCfg_Preds(cfg, header, &predCount);
+    for(uint32_t p = 0; p < predCount; ++p) {
+      if(!AcirDomTree_Dominates(doms, header, preds[p])) continue;
+      backEdge = true;
+      if(marks[preds[p]] == loop) continue;
+      marks[preds[p]] = loop;
+      worklist[top++] = preds[p];
+    }
+    if(!backEdge) continue;
+
+    uint32_t parent = self->blockLoops[header];
+    self->loops[self->loopCount++] = (AcirLoop){ header, parent,
+      parent == ACIR_BLOCK_NULL_INDEX ? 1 : self->loops[parent].depth + 1 };
+    self->blockLoops[header] = loop;
+    while(top > 0) {
+      uint32_t b = worklist[--top];
+      self->blockLoops[b] = loop;
+      const uint32_t *bpreds = AcirCfg_Preds(cfg, b, &predCount);
+      for(uint32_t p = 0; p < predCount; ++p) {
+        // unreachable blocks can jump into a loop, but are not part of it.
+        if(marks[bpreds[p]] == loop || doms->preorder[bpreds[p]] == ACIR_BLOCK_NULL_INDEX) continue;
+        marks[bpreds[p]] = loop;
+        worklist[top++] = bpreds[p];
+      }
+    }
+  }
+  AnchAllocator_Free(allocator, marks);
+  AnchAllocator_Free(allocator, worklist);
+}
+
+void AcirLoopForest_Free(AcirLoopForest *self) {
+  assert(self != NULL);
+  if(self->allocator == NULL) return;
+  AnchAllocator_Free(self->allocator, self->loops);
+  AnchAllocator_Free(self->allocator, self->blockLoops);
+  *self = (AcirLoopForest){0};
+}
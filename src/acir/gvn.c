@@ -0,0 +1,204 @@
+#include <acir/acir.h>
+#include <annec_anchor.h>
+#include <assert.h>
+#include "../cli.h"
+
+// Global value numbering over extended basic blocks. A block with a single predecessor is
+// dominated by it, so it walks the blocks as a tree and sees every expression computed
+// on the way down; merge blocks start a new tree. Expressions are keyed by opcode, type and
+// operands (ordered for commutative opcodes) in an open-addressed table, and an expression
+// found again has its uses moved to the first result and is removed. Leaving a block undoes
+// its insertions, newest first, which keeps the probe sequences intact.
+//
+// `der` reads memory, so its key includes a memory epoch that every `eff` and `call` moves on; `phi`
+// keys include their block, since the inputs mean something different elsewhere.
+
+typedef struct {
+  AcirOpcode opcode;
+  const AcirValueType *type;
+  // bindings are their index with a NULL type, immediates their bits and type.
+  uint64_t operands[2];
+  const AcirValueType *operandTypes[2];
+  uint32_t extra;
+} AcirGvnKey_;
+
+typedef struct {
+  AcirGvnKey_ key;
+  uint32_t binding; // result of the first instruction computing the key, ACIR_DEFUSE_NULL_INDEX if empty.
+} AcirGvnEntry_;
+
+typedef struct {
+  uint32_t block;
+  uint32_t undoTop; // undo stack height when the block was entered.
+  uint32_t epoch; // memory epoch at the end of the block.
+  uint32_t succ; // next successor to look at.
+} AcirGvnFrame_;
+
+typedef struct {
+  const AcirCfg *cfg;
+  AcirDefUse *defUse;
+  AcirBuilder *builder;
+  uint32_t capacity; // power of two, at least twice the instructions, so the table never fills.
+  AcirGvnEntry_ *entries;
+  uint32_t undoTop;
+  uint32_t *undo; // slots filled, in order.
+  uint32_t epochCount;
+  bool *removed; // by instruction.
+} AcirGvn_;
+
+static uint64_t AcirGvn_HashKey_(const AcirGvnKey_ *key) {
+  uint64_t h = AcirHash_Mix(key->opcode ^ ((uint64_t)key->extra << 32));
+  h = AcirHash_Mix(h ^ (uintptr_t)key->type);
+  for(int i = 0; i < 2; ++i) h = AcirHash_Mix(h ^ key->operands[i] ^ AcirHash_Mix((uintptr_t)key->operandTypes[i]));
+  return h;
+}
+
+static bool AcirGvn_SameKey_(const AcirGvnKey_ *a, const AcirGvnKey_ *b) {
+  return a->opcode == b->opcode && a->type == b->type && a->extra == b->extra
+    && a->operands[0] == b->operands[0] && a->operandTypes[0] == b->operandTypes[0]
+    && a->operands[1] == b->operands[1] && a->operandTypes[1] == b->operandTypes[1];
+}
+
+/** Slot holding KEY, or the empty slot where it belongs. */
+static uint32_t AcirGvn_Slot_(const AcirGvn_ *self, const AcirGvnKey_ *key) {
+  uint32_t mask = self->capacity - 1;
+  for(uint32_t i = AcirGvn_HashKey_(key) & mask; ; i = (i + 1) & mask) {
+    const AcirGvnEntry_ *entry = &self->entries[i];
+    if(entry->binding == ACIR_DEFUSE_NULL_INDEX || AcirGvn_SameKey_(&entry->key, key)) return i;
+  }
+}
+
+static bool AcirGvn_SetOperand_(AcirGvnKey_ *key, int i, const AcirOperand *op) {
+  switch(op->type) {
+    case ACIR_OPERAND_TYPE_BINDING:
+      key->operands[i] = op->idx;
+      key->operandTypes[i] = NULL;
+      return true;
+    case ACIR_OPERAND_TYPE_IMMEDIATE:
+      key->operands[i] = AcirImmediateValue_Bits(&op->imm);
+      key->operandTypes[i] = op->imm.type;
+      return true;
+    default:
+      return false;
+  }
+}
+
+/** Key of the value INSTR computes. Returns false if it has side effects or is not worth numbering. */
+static bool AcirGvn_Key_(const AcirInstr *instr, uint32_t block, uint32_t epoch, AcirGvnKey_ *key) {
+  if(instr->out.type != ACIR_OPERAND_TYPE_BINDING) return false;
+  // copies are left to copy propagation, everything else that is pure can be numbered.
+  bool pure = AcirOpcode_ConstEval(instr->opcode) && instr->opcode != ACIR_OPCODE_SET;
+  if(!pure && instr->opcode != ACIR_OPCODE_DER && instr->opcode != ACIR_OPCODE_REF && instr->opcode != ACIR_OPCODE_PHI)
+    return false;
+
+  *key = (AcirGvnKey_){ .opcode = instr->opcode, .type = instr->type };
+  if(instr->opcode == ACIR_OPCODE_DER) key->extra = epoch;
+  if(instr->opcode == ACIR_OPCODE_PHI) key->extra = block;
+
+  if(AcirOpcode_OperandCount(instr->opcode) == 2) return AcirGvn_SetOperand_(key, 0, &instr->val);
+  if(!AcirGvn_SetOperand_(key, 0, &instr->lhs) || !AcirGvn_SetOperand_(key, 1, &instr->rhs)) return false;
+  if(AcirOpcode_IsCommutative(instr->opcode)) {
+    // any fixed order will do, as long as both orders of the same operands end up the same.
+    bool swap = (uintptr_t)key->operandTypes[0] > (uintptr_t)key->operandTypes[1]
+      || (key->operandTypes[0] == key->operandTypes[1] && key->operands[0] > key->operands[1]);
+    if(swap) {
+      uint64_t operand = key->operands[0];
+      const AcirValueType *type = key->operandTypes[0];
+      key->operands[0] = key->operands[1];
+      key->operandTypes[0] = key->operandTypes[1];
+      key->operands[1] = operand;
+      key->operandTypes[1] = type;
+    }
+  }
+  return true;
+}
+
+/** Number the instructions of BLOCK, starting from memory epoch EPOCH. Returns the epoch at its end. */
+static uint32_t AcirGvn_VisitBlock_(AcirGvn_ *self, uint32_t block, uint32_t epoch) {
+  const AcirBlock *b = &self->cfg->blocks[block];
+  for(uint32_t i = 0; i < b->count; ++i) {
+    uint32_t index = self->cfg->order[b->first + i];
+    const AcirInstr *instr = &self->builder->instrs[index];
+    if(instr->opcode == ACIR_OPCODE_EFF || instr->opcode == ACIR_OPCODE_CALL) {
+      epoch = ++self->epochCount;
+      continue;
+    }
+
+    AcirGvnKey_ key;
+    if(!AcirGvn_Key_(instr, block, epoch, &key)) continue;
+    uint32_t slot = AcirGvn_Slot_(self, &key);
+    AcirGvnEntry_ *entry = &self->entries[slot];
+    if(entry->binding == ACIR_DEFUSE_NULL_INDEX) {
+      *entry = (AcirGvnEntry_){ key, instr->out.idx };
+      self->undo[self->undoTop++] = slot;
+      continue;
+    }
+
+    size_t binding = instr->out.idx;
+    AcirDefUse_ReplaceAllUses(self->defUse, binding, &(AcirOperand){ ACIR_OPERAND_TYPE_BINDING, .idx = entry->binding });
+    AcirDefUse_Unlink(self->defUse, index);
+    self->removed[index] = true;
+  }
+  return epoch;
+}
+
+void AcirPass_Gvn(AcirPassManager *manager, AcirBuilder *builder) {
+  const AcirCfg *cfg = AcirPassManager_Cfg(manager);
+  if(cfg->blockCount == 0) return;
+
+  AnchAllocator *allocator = manager->allocator;
+  AcirGvn_ self = {
+    .cfg = cfg,
+    .defUse = AcirPassManager_DefUse(manager),
+    .builder = builder,
+  };
+  size_t instrCount = builder->target->instrCount;
+  self.capacity = 16;
+  while(self.capacity < instrCount * 2) self.capacity *= 2;
+  self.entries = AnchAllocator_Alloc(allocator, sizeof(AcirGvnEntry_) * self.capacity);
+  for(uint32_t i = 0; i < self.capacity; ++i) self.entries[i].binding = ACIR_DEFUSE_NULL_INDEX;
+  self.undo = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * (instrCount + 1));
+  self.removed = AnchAllocator_AllocZero(allocator, sizeof(bool) * instrCount);
+  AcirGvnFrame_ *frames = AnchAllocator_Alloc(allocator, sizeof(AcirGvnFrame_) * cfg->blockCount);
+
+  // merge blocks (and the entry) are the roots, in reverse postorder; the rest hang off their predecessor.
+  for(uint32_t r = 0; r < cfg->rpoCount; ++r) {
+    uint32_t root = cfg->rpo[r], predCount;
+    AcirCfg_Preds(cfg, root, &predCount);
+    if(root != 0 && predCount == 1) continue;
+
+    uint32_t depth = 0;
+    frames[depth++] = (AcirGvnFrame_){ root, self.undoTop, AcirGvn_VisitBlock_(&self, root, ++self.epochCount), 0 };
+    while(depth > 0) {
+      AcirGvnFrame_ *frame = &frames[depth - 1];
+      uint32_t succCount;
+      const uint32_t *succs = AcirCfg_Succs(cfg, frame->block, &succCount);
+      if(frame->succ == succCount) {
+        while(self.undoTop > frame->undoTop) self.entries[self.undo[--self.undoTop]].binding = ACIR_DEFUSE_NULL_INDEX;
+        --depth;
+        continue;
+      }
+      uint32_t succ = succs[frame->succ++];
+      AcirCfg_Preds(cfg, succ, &predCount);
+      if(succ == 0 || predCount != 1) continue;
+      frames[depth++] = (AcirGvnFrame_){ succ, self.undoTop, AcirGvn_VisitBlock_(&self, succ, frame->epoch), 0 };
+    }
+  }
+
+  // drop the removed instructions, keeping the others in order.
+  AcirFunction *function = builder->target;
+  size_t last = ACIR_INSTR_NULL_INDEX;
+  for(size_t i = function->code; i != ACIR_INSTR_NULL_INDEX; i = builder->instrs[i].next) {
+    if(self.removed[i]) continue;
+    if(last == ACIR_INSTR_NULL_INDEX) function->code = i;
+    else builder->instrs[last].next = i;
+    last = i;
+  }
+  assert(last != ACIR_INSTR_NULL_INDEX);
+  builder->instrs[last].next = ACIR_INSTR_NULL_INDEX;
+
+  AnchAllocator_Free(allocator, self.entries);
+  AnchAllocator_Free(allocator, self.undo);
+  AnchAllocator_Free(allocator, self.removed);
+  AnchAllocator_Free(allocator, frames);
+}
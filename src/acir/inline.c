@@ -0,0 +1,264 @@
+#include <acir/acir.h>
+#include <annec_anchor.h>
+#include <assert.h>
+#include "../cli.h"
+
+// Inliner. The call graph is built once and split into strongly connected components with
+// Tarjan's algorithm, which finishes a component only after every component it calls into:
+// finishing order is bottom-up order. A call is inlined by appending a copy of the callee, its
+// bindings and labels moved past the caller's, and linking it in place of the `arg`s and the
+// `call`. Every `par` becomes a `set` of its argument and the `ret` a `set` of the call's result,
+// followed by a jump to a new label in front of the rest of the caller unless it comes last.
+// The copies are left for copy propagation, or folded when the argument is a constant.
+
+#define ACIR_INLINER_NULL_INDEX_ UINT32_MAX
+
+enum {
+  ACIR_INLINER_CONSTANT_BONUS_ = 4, // a constant argument usually folds part of the callee away.
+  ACIR_INLINER_CALLER_LIMIT_ = 1 << 14, // callers stop growing at this many instructions.
+};
+
+typedef struct {
+  uint32_t function;
+  uint32_t edge; // next call to look at.
+} AcirInlinerFrame_;
+
+/** Whether INSTR calls one of the first FUNCTIONCOUNT functions. */
+static bool AcirInliner_IsCall_(const AcirInstr *instr, uint32_t functionCount) {
+  return instr->opcode == ACIR_OPCODE_CALL && instr->val.type == ACIR_OPERAND_TYPE_FUNCTION
+    && instr->val.idx < functionCount;
+}
+
+void AcirInliner_Init(AcirInliner *self, AcirModule *module, AnchAllocator *allocator, uint32_t threshold) {
+  assert(self != NULL);
+  assert(module != NULL);
+  uint32_t n = module->functionCount;
+  *self = (AcirInliner){
+    .module = module,
+    .allocator = allocator,
+    .threshold = threshold,
+    .order = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * (n + 1)),
+    .components = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * (n + 1)),
+  };
+  AnchDynArray_Init(&self->scratch, allocator, 4096);
+
+  // callees of every function, CSR-style like the edges of \ref AcirCfg.
+  uint32_t *offsets = AnchAllocator_AllocZero(allocator, sizeof(uint32_t) * (n + 1));
+  for(uint32_t f = 0; f < n; ++f) {
+    const AcirFunction *function = &AcirModule_Function(module, f)->function;
+    offsets[f + 1] = offsets[f];
+    for(size_t i = function->code; i != ACIR_INSTR_NULL_INDEX; i = function->instrs[i].next)
+      if(AcirInliner_IsCall_(&function->instrs[i], n)) ++offsets[f + 1];
+  }
+  uint32_t *edges = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * (offsets[n] + 1));
+  for(uint32_t f = 0, e = 0; f < n; ++f) {
+    const AcirFunction *function = &AcirModule_Function(module, f)->function;
+    for(size_t i = function->code; i != ACIR_INSTR_NULL_INDEX; i = function->instrs[i].next)
+      if(AcirInliner_IsCall_(&function->instrs[i], n)) edges[e++] = function->instrs[i].val.idx;
+  }
+
+  // Tarjan's algorithm, without recursion. A function is on the stack while it has been
+  // visited and has no component yet.
+  uint32_t *visits = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * (n + 1));
+  uint32_t *lows = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * (n + 1));
+  uint32_t *stack = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * (n + 1));
+  AcirInlinerFrame_ *frames = AnchAllocator_Alloc(allocator, sizeof(AcirInlinerFrame_) * (n + 1));
+  for(uint32_t f = 0; f < n; ++f) visits[f] = self->components[f] = ACIR_INLINER_NULL_INDEX_;
+
+  uint32_t visitCount = 0, componentCount = 0, orderCount = 0, stackTop = 0;
+  for(uint32_t root = 0; root < n; ++root) {
+    if(visits[root] != ACIR_INLINER_NULL_INDEX_) continue;
+    uint32_t depth = 0;
+    visits[root] = lows[root] = visitCount++;
+    stack[stackTop++] = root;
+    frames[depth++] = (AcirInlinerFrame_){ root, offsets[root] };
+    while(depth > 0) {
+      AcirInlinerFrame_ *frame = &frames[depth - 1];
+      uint32_t f = frame->function;
+      if(frame->edge < offsets[f + 1]) {
+        uint32_t callee = edges[frame->edge++];
+        if(visits[callee] == ACIR_INLINER_NULL_INDEX_) {
+          visits[callee] = lows[callee] = visitCount++;
+          stack[stackTop++] = callee;
+          frames[depth++] = (AcirInlinerFrame_){ callee, offsets[callee] };
+        } else if(self->components[callee] == ACIR_INLINER_NULL_INDEX_ && visits[callee] < lows[f]) {
+          lows[f] = visits[callee];
+        }
+        continue;
+      }
+
+      if(lows[f] == visits[f]) {
+        uint32_t member;
+        do {
+          member = stack[--stackTop];
+          self->components[member] = componentCount;
+          self->order[orderCount++] = member;
+        } while(member != f);
+        ++componentCount;
+      }
+      if(--depth > 0 && lows[f] < lows[frames[depth - 1].function]) lows[frames[depth - 1].function] = lows[f];
+    }
+  }
+  assert(orderCount == n);
+
+  AnchAllocator_Free(allocator, offsets);
+  AnchAllocator_Free(allocator, edges);
+  AnchAllocator_Free(allocator, visits);
+  AnchAllocator_Free(allocator, lows);
+  AnchAllocator_Free(allocator, stack);
+  AnchAllocator_Free(allocator, frames);
+}
+
+void AcirInliner_Free(AcirInliner *self) {
+  assert(self != NULL);
+  AnchAllocator_Free(self->allocator, self->order);
+  AnchAllocator_Free(self->allocator, self->components);
+  AnchDynArray_Free(&self->scratch);
+  *self = (AcirInliner){0};
+}
+
+/** Whether inlining CALL, with ARGCOUNT arguments of which CONSTANTCOUNT are immediates, into CALLER pays off. */
+static bool AcirInliner_IsWorthIt_(const AcirInliner *self, uint32_t caller, size_t callerSize,
+  const AcirInstr *call, uint32_t argCount, uint32_t constantCount) {
+  if(call->val.idx >= self->module->functionCount) return false;
+  uint32_t index = call->val.idx;
+  // functions added after the call graph was built have no component.
+  if(self->components[caller] == ACIR_INLINER_NULL_INDEX_ || self->components[index] == ACIR_INLINER_NULL_INDEX_
+    || self->components[index] == self->components[caller]) return false;
+  const AcirFunction *callee = &AcirModule_Function(self->module, index)->function;
+  if(callee->code == ACIR_INSTR_NULL_INDEX || callee->instrs[callee->code].opcode == ACIR_OPCODE_LBL) return false;
+
+  // the `arg`s and the `call` go away, and constants are likely to fold.
+  size_t budget = self->threshold + constantCount * ACIR_INLINER_CONSTANT_BONUS_ + argCount + 1;
+  size_t size = 0, retCount = 0;
+  for(size_t i = callee->code; i != ACIR_INSTR_NULL_INDEX; i = callee->instrs[i].next) {
+    const AcirInstr *instr = &callee->instrs[i];
+    if(instr->opcode == ACIR_OPCODE_RET && (++retCount > 1 || instr->type != call->type)) return false;
+    if(instr->opcode != ACIR_OPCODE_LBL && instr->opcode != ACIR_OPCODE_PAR && ++size > budget) return false;
+  }
+  return retCount == 1 && callerSize + size <= ACIR_INLINER_CALLER_LIMIT_;
+}
+
+/** One past the largest binding and label FUNCTION uses. */
+static void AcirInliner_Bounds_(const AcirFunction *function, size_t *bindingCount, size_t *labelCount) {
+  *bindingCount = *labelCount = 0;
+  for(size_t i = 0; i < function->instrCount; ++i) {
+    for(int slot = 0; slot < ACIR_PACKED_SLOT_MAX_; ++slot) {
+      const AcirOperand *op = AcirInstr_Operand((AcirInstr*)&function->instrs[i], slot);
+      if(op == NULL) continue;
+      if(op->type == ACIR_OPERAND_TYPE_BINDING && op->idx + 1 > *bindingCount) *bindingCount = op->idx + 1;
+      if(op->type == ACIR_OPERAND_TYPE_LABEL && op->idx + 1 > *labelCount) *labelCount = op->idx + 1;
+    }
+  }
+}
+
+static void AcirInliner_Push_(AcirInliner *self, AcirInstr instr) {
+  uint32_t count = self->scratch.size / sizeof(AcirInstr);
+  instr.index = count;
+  instr.next = count + 1;
+  ANCH_DYNARRAY_PUSH(&self->scratch, AcirInstr, instr);
+}
+
+/**
+ * Link a copy of the callee of CALL in place of it and its arguments, which start at FIRSTARG
+ * (CALL if there are none) and follow PREV (ACIR_INSTR_NULL_INDEX if they start the code).
+ * BINDINGBASE and LABELBASE are one past the largest of the caller and move past the copy's.
+ * Returns the last instruction of the copy.
+ */
+static size_t AcirInliner_Splice_(AcirInliner *self, AcirBuilder *builder, size_t prev, size_t firstArg,
+  size_t call, size_t *bindingBase, size_t *labelBase) {
+  // appending moves the instructions, so the call is kept by value.
+  const AcirInstr callInstr = builder->instrs[call];
+  const AcirFunction *callee = &AcirModule_Function(self->module, callInstr.val.idx)->function;
+  size_t bindingCount, labelCount;
+  AcirInliner_Bounds_(callee, &bindingCount, &labelCount);
+  size_t continuation = *labelBase + labelCount;
+  bool jumps = false;
+
+  AnchDynArray_Pop(&self->scratch, self->scratch.size);
+  for(size_t i = callee->code; i != ACIR_INSTR_NULL_INDEX; i = callee->instrs[i].next) {
+    AcirInstr instr = callee->instrs[i];
+    for(int slot = 0; slot < ACIR_PACKED_SLOT_MAX_; ++slot) {
+      AcirOperand *op = AcirInstr_Operand(&instr, slot);
+      if(op != NULL && op->type == ACIR_OPERAND_TYPE_BINDING) op->idx += *bindingBase;
+      if(op != NULL && op->type == ACIR_OPERAND_TYPE_LABEL) op->idx += *labelBase;
+    }
+
+    if(instr.opcode == ACIR_OPCODE_PAR) {
+      size_t arg = firstArg;
+      for(uint32_t j = 0; j < instr.val.imm.uint32; ++j) arg = builder->instrs[arg].next;
+      assert(builder->instrs[arg].opcode == ACIR_OPCODE_ARG);
+      AcirInliner_Push_(self, (AcirInstr){ .opcode = ACIR_OPCODE_SET, .type = instr.type,
+        .val = builder->instrs[arg].val, .out = instr.out });
+    } else if(instr.opcode == ACIR_OPCODE_RET) {
+      AcirInliner_Push_(self, (AcirInstr){ .opcode = ACIR_OPCODE_SET, .type = instr.type,
+        .val = instr.val, .out = callInstr.out });
+      if(callee->instrs[i].next == ACIR_INSTR_NULL_INDEX) continue;
+      AcirInliner_Push_(self, (AcirInstr){ .opcode = ACIR_OPCODE_JMP, .type = AcirValueType_Basic(ACIR_BASIC_VALUE_TYPE_VOID),
+        .val = { ACIR_OPERAND_TYPE_LABEL, .idx = continuation } });
+      jumps = true;
+    } else {
+      AcirInliner_Push_(self, instr);
+    }
+  }
+  if(jumps) {
+    AcirInliner_Push_(self, (AcirInstr){ .opcode = ACIR_OPCODE_LBL, .type = AcirValueType_Basic(ACIR_BASIC_VALUE_TYPE_VOID),
+      .val = { ACIR_OPERAND_TYPE_LABEL, .idx = continuation } });
+  }
+
+  size_t count = self->scratch.size / sizeof(AcirInstr);
+  assert(count > 0);
+  ((AcirInstr*)self->scratch.data)[count - 1].next = ACIR_INSTR_NULL_INDEX;
+  size_t first = AcirBuilder_Append(builder, (const AcirInstr*)self->scratch.data, count)->index;
+  size_t last = first + count - 1;
+  builder->instrs[last].next = callInstr.next;
+  if(prev == ACIR_INSTR_NULL_INDEX) builder->target->code = first;
+  else builder->instrs[prev].next = first;
+
+  *bindingBase += bindingCount;
+  *labelBase += labelCount + jumps;
+  return last;
+}
+
+uint32_t AcirInliner_Run(AcirInliner *self, uint32_t index) {
+  assert(self != NULL);
+  assert(index < self->module->functionCount);
+  AcirBuilder *builder = &AcirModule_Function(self->module, index)->builder;
+  const AcirFunction *function = builder->target;
+  if(function->code == ACIR_INSTR_NULL_INDEX) return 0;
+
+  size_t bindingBase, labelBase, size = 0;
+  AcirInliner_Bounds_(function, &bindingBase, &labelBase);
+  for(size_t i = function->code; i != ACIR_INSTR_NULL_INDEX; i = function->instrs[i].next) ++size;
+
+  // `arg`s come right before their `call`, so the ones seen since the last other instruction are its arguments.
+  uint32_t inlined = 0, argCount = 0, constantCount = 0;
+  size_t last = ACIR_INSTR_NULL_INDEX, beforeArgs = ACIR_INSTR_NULL_INDEX, firstArg = ACIR_INSTR_NULL_INDEX;
+  for(size_t i = function->code; i != ACIR_INSTR_NULL_INDEX; i = builder->instrs[last].next) {
+    const AcirInstr *instr = &builder->instrs[i];
+    if(instr->opcode == ACIR_OPCODE_ARG) {
+      if(argCount++ == 0) {
+        beforeArgs = last;
+        firstArg = i;
+      }
+      constantCount += instr->val.type == ACIR_OPERAND_TYPE_IMMEDIATE;
+      last = i;
+      continue;
+    }
+    if(instr->opcode == ACIR_OPCODE_CALL && AcirInliner_IsWorthIt_(self, index, size, instr, argCount, constantCount)) {
+      if(argCount == 0) {
+        beforeArgs = last;
+        firstArg = i;
+      }
+      last = AcirInliner_Splice_(self, builder, beforeArgs, firstArg, i, &bindingBase, &labelBase);
+      size += self->scratch.size / sizeof(AcirInstr);
+      ++inlined;
+    } else {
+      last = i;
+    }
+    argCount = constantCount = 0;
+  }
+
+  if(inlined > 0) AcirBuilder_RenumberBindings(builder);
+  return inlined;
+}
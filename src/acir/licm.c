@@ -0,0 +1,181 @@
+#include <acir/acir.h>
+#include <annec_anchor.h>
+#include <assert.h>
+#include "../cli.h"
+
+// Loop-invariant code motion. An instruction whose operands are all defined outside a loop
+// computes the same value on every iteration, so it can run once in the loop's preheader
+// instead: the block outside the loop that enters it, and only it. Blocks are visited in
+// reverse postorder, so operands are placed before their uses are looked at, and every
+// instruction moves out of as many loops as it can at once. A loop entered from a block
+// that also branches elsewhere gets a new preheader on that edge when something moves; loops
+// entered from several blocks keep their code. Only consteval instructions that can't trap
+// move, since the preheader also runs when the loop body would not have.
+
+typedef struct {
+  size_t tail; // instruction hoisted code goes after, ACIR_INSTR_NULL_INDEX for the start of the code.
+  bool placed; // whether `tail` is known yet.
+  uint32_t pred; // block entering the loop, ACIR_BLOCK_NULL_INDEX if there are several.
+} AcirLicmPreheader_;
+
+typedef struct {
+  const AcirCfg *cfg;
+  const AcirLoopForest *loops;
+  AcirBuilder *builder;
+  AcirLicmPreheader_ *preheaders; // by loop.
+  uint32_t *instrLoops; // innermost loop of every instruction, updated as they move.
+  uint32_t *prevs; // previous instruction in the code, by instruction.
+  size_t nextLabel;
+} AcirLicm_;
+
+/** Whether INSTR is pure and can run where it would not have. */
+static bool AcirLicm_IsMovable_(const AcirInstr *instr) {
+  if(!AcirOpcode_ConstEval(instr->opcode) || instr->out.type != ACIR_OPERAND_TYPE_BINDING) return false;
+  if(instr->opcode == ACIR_OPCODE_SET && instr->val.type == ACIR_OPERAND_TYPE_IMMEDIATE) return false;
+  if(AcirOpcode_OperandCount(instr->opcode) != 3) return true;
+  const AcirImmediateValue *lhs = instr->lhs.type == ACIR_OPERAND_TYPE_IMMEDIATE ? &instr->lhs.imm : NULL;
+  if(instr->rhs.type == ACIR_OPERAND_TYPE_IMMEDIATE) return !AcirInstr_ConstEvalTraps(instr, lhs, &instr->rhs.imm);
+  // an unknown divisor or shift might be the one that traps.
+  AcirImmediateValue zero = { instr->type, .uint64 = 0 }, ones = { instr->type, .uint64 = UINT64_MAX };
+  return !AcirInstr_ConstEvalTraps(instr, lhs, &zero) && !AcirInstr_ConstEvalTraps(instr, lhs, &ones);
+}
+
+/** Link instruction INDEX after AFTER, ACIR_INSTR_NULL_INDEX for the start of the code. */
+static void AcirLicm_LinkAfter_(AcirLicm_ *self, uint32_t index, size_t after) {
+  AcirInstr *instrs = self->builder->instrs;
+  size_t next = after == ACIR_INSTR_NULL_INDEX ? self->builder->target->code : instrs[after].next;
+  instrs[index].next = next;
+  if(after == ACIR_INSTR_NULL_INDEX) self->builder->target->code = index;
+  else instrs[after].next = index;
+  self->prevs[index] = after == ACIR_INSTR_NULL_INDEX ? ACIR_BLOCK_NULL_INDEX : after;
+  if(next != ACIR_INSTR_NULL_INDEX) self->prevs[next] = index;
+}
+
+/** Instruction to hoist the code of LOOP after, placing a new preheader on its entry edge if needed. */
+static size_t AcirLicm_Tail_(AcirLicm_ *self, uint32_t loop) {
+  AcirLicmPreheader_ *preheader = &self->preheaders[loop];
+  if(preheader->placed) return preheader->tail;
+  preheader->placed = true;
+
+  const AcirCfg *cfg = self->cfg;
+  const AcirBlock *pred = &cfg->blocks[preheader->pred];
+  uint32_t last = cfg->order[pred->first + pred->count - 1];
+  uint32_t succCount;
+  AcirCfg_Succs(cfg, preheader->pred, &succCount);
+  if(succCount == 1) {
+    // the block only goes on to the header: code goes before its `jmp`, or at its end. An entry
+    // block holding just the `jmp` gets it at the start of the code.
+    const AcirInstr *instr = &self->builder->instrs[last];
+    uint32_t tail = AcirOpcode_IsTerminator(instr->opcode) ? self->prevs[last] : last;
+    return preheader->tail = tail == ACIR_BLOCK_NULL_INDEX ? ACIR_INSTR_NULL_INDEX : tail;
+  }
+
+  // a block of its own right after the branch, which jumps to it instead of the header.
+  size_t header = cfg->blocks[self->loops->loops[loop].header].label;
+  assert(header != ACIR_BLOCK_NULL_INDEX);
+  size_t label = self->nextLabel++;
+  const AcirValueType *voidType = AcirValueType_Basic(ACIR_BASIC_VALUE_TYPE_VOID);
+  AcirInstr block[2] = {
+    { .index = 0, .next = 1, .opcode = ACIR_OPCODE_LBL, .type = voidType, .val = { ACIR_OPERAND_TYPE_LABEL, .idx = label } },
+    { .index = 1, .next = ACIR_INSTR_NULL_INDEX, .opcode = ACIR_OPCODE_JMP, .type = voidType,
+      .val = { ACIR_OPERAND_TYPE_LABEL, .idx = header } },
+  };
+  uint32_t first = AcirBuilder_Append(self->builder, block, 2)->index;
+  AcirInstr *branch = &self->builder->instrs[last];
+  assert(branch->opcode == ACIR_OPCODE_BR);
+  if(branch->rhs.idx == header) branch->rhs.idx = label;
+  if(branch->out.idx == header) branch->out.idx = label;
+  AcirLicm_LinkAfter_(self, first + 1, last);
+  AcirLicm_LinkAfter_(self, first, last);
+  return preheader->tail = first;
+}
+
+/** Move instruction INDEX out of the outermost loop it doesn't depend on. */
+static void AcirLicm_Visit_(AcirLicm_ *self, AcirDefUse *defUse, uint32_t index) {
+  const AcirInstr *instr = &self->builder->instrs[index];
+  if(self->instrLoops[index] == ACIR_BLOCK_NULL_INDEX || !AcirLicm_IsMovable_(instr)) return;
+
+  uint32_t defs[2], defCount = 0;
+  for(int slot = ACIR_PACKED_SLOT_VAL; slot < ACIR_PACKED_SLOT_OUT; ++slot) {
+    const AcirOperand *op = AcirInstr_Operand((AcirInstr*)instr, slot);
+    if(op == NULL || op->type != ACIR_OPERAND_TYPE_BINDING) continue;
+    uint32_t def = AcirDefUse_Def(defUse, op->idx);
+    if(def == ACIR_DEFUSE_NULL_INDEX) return;
+    defs[defCount++] = def;
+  }
+
+  const AcirLoop *loops = self->loops->loops;
+  uint32_t target = ACIR_BLOCK_NULL_INDEX;
+  for(uint32_t loop = self->instrLoops[index]; loop != ACIR_BLOCK_NULL_INDEX; loop = loops[loop].parent) {
+    if(self->preheaders[loop].pred == ACIR_BLOCK_NULL_INDEX) break;
+    bool invariant = true;
+    for(uint32_t i = 0; i < defCount; ++i)
+      invariant = invariant && !AcirLoopForest_Contains(self->loops, loop, self->instrLoops[defs[i]]);
+    if(!invariant) break;
+    target = loop;
+  }
+  if(target == ACIR_BLOCK_NULL_INDEX) return;
+
+  size_t tail = AcirLicm_Tail_(self, target);
+  AcirInstr *instrs = self->builder->instrs;
+  uint32_t prev = self->prevs[index];
+  assert(prev != ACIR_BLOCK_NULL_INDEX && "the entry is in no loop with a preheader");
+  instrs[prev].next = instrs[index].next;
+  if(instrs[index].next != ACIR_INSTR_NULL_INDEX) self->prevs[instrs[index].next] = prev;
+  AcirLicm_LinkAfter_(self, index, tail);
+  self->preheaders[target].tail = index;
+  self->instrLoops[index] = loops[target].parent;
+}
+
+void AcirPass_Licm(AcirPassManager *manager, AcirBuilder *builder) {
+  const AcirCfg *cfg = AcirPassManager_Cfg(manager);
+  const AcirLoopForest *loops = AcirPassManager_Loops(manager);
+  if(loops->loopCount == 0) return;
+
+  AnchAllocator *allocator = manager->allocator;
+  const AcirFunction *function = builder->target;
+  // every loop can add a `lbl` and a `jmp`.
+  size_t capacity = function->instrCount + 2 * loops->loopCount;
+  AcirLicm_ self = {
+    .cfg = cfg,
+    .loops = loops,
+    .builder = builder,
+    .preheaders = AnchAllocator_Alloc(allocator, sizeof(AcirLicmPreheader_) * loops->loopCount),
+    .instrLoops = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * capacity),
+    .prevs = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * capacity),
+  };
+  memset(self.instrLoops, 0xFF, sizeof(uint32_t) * capacity);
+  for(uint32_t i = 0; i < cfg->instrCount; ++i) {
+    uint32_t index = cfg->order[i];
+    self.instrLoops[index] = loops->blockLoops[cfg->instrBlocks[index]];
+    self.prevs[index] = i > 0 ? cfg->order[i - 1] : ACIR_BLOCK_NULL_INDEX;
+    const AcirInstr *instr = &function->instrs[index];
+    if(instr->opcode == ACIR_OPCODE_LBL && instr->val.idx >= self.nextLabel) self.nextLabel = instr->val.idx + 1;
+  }
+
+  // a preheader is the one reachable predecessor of the header from outside the loop.
+  for(uint32_t loop = 0; loop < loops->loopCount; ++loop) {
+    uint32_t header = loops->loops[loop].header, predCount;
+    const uint32_t *preds = AcirCfg_Preds(cfg, header, &predCount);
+    AcirLicmPreheader_ *preheader = &self.preheaders[loop];
+    *preheader = (AcirLicmPreheader_){ ACIR_INSTR_NULL_INDEX, false, ACIR_BLOCK_NULL_INDEX };
+    uint32_t outside = 0;
+    for(uint32_t p = 0; p < predCount; ++p) {
+      if(AcirLoopForest_Contains(loops, loop, loops->blockLoops[preds[p]])) continue;
+      if(AcirPassManager_Dominators(manager)->preorder[preds[p]] == ACIR_BLOCK_NULL_INDEX) continue;
+      preheader->pred = preds[p];
+      ++outside;
+    }
+    if(outside != 1) preheader->pred = ACIR_BLOCK_NULL_INDEX;
+  }
+
+  AcirDefUse *defUse = AcirPassManager_DefUse(manager);
+  for(uint32_t r = 0; r < cfg->rpoCount; ++r) {
+    const AcirBlock *block = &cfg->blocks[cfg->rpo[r]];
+    for(uint32_t i = 0; i < block->count; ++i) AcirLicm_Visit_(&self, defUse, cfg->order[block->first + i]);
+  }
+
+  AnchAllocator_Free(allocator, self.preheaders);
+  AnchAllocator_Free(allocator, self.instrLoops);
+  AnchAllocator_Free(allocator, self.prevs);
+}
@@ -0,0 +1,357 @@
+#include <acir/acir.h>
+#include <annec_anchor.h>
+#include <assert.h>
+#include <stdio.h>
+#include "../cli.h"
+
+#define ACIR_MEMO_MAGIC_ 0x4F4D4341u // "ACMO" when read little-endian.
+#define ACIR_MEMO_VERSION_ 1
+
+// the low byte of a key word says what it is, the rest is its value.
+enum AcirMemoTags_ {
+  ACIR_MEMO_TAG_NONE_,
+  ACIR_MEMO_TAG_BASIC_,
+  ACIR_MEMO_TAG_POINTER_, // then the pointee.
+  ACIR_MEMO_TAG_FUNCTION_TYPE_, // argument count, then the return and argument types.
+  ACIR_MEMO_TAG_OPCODE_, // then the type and operands.
+  ACIR_MEMO_TAG_BINDING_,
+  ACIR_MEMO_TAG_LABEL_,
+  ACIR_MEMO_TAG_IMMEDIATE_, // then the type and the bits.
+  ACIR_MEMO_TAG_STRING_, // length, then the bytes, 8 a word.
+};
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t reserved;
+  uint32_t entryCount;
+  uint32_t reserved2;
+} AcirMemoFileHeader_;
+
+typedef struct {
+  uint32_t keyCount;
+  uint32_t size; // of the data, which is padded to 8 bytes after the key.
+} AcirMemoFileEntry_;
+
+static void AcirMemo_Word_(AnchDynArray *key, uint8_t tag, uint64_t value) {
+  ANCH_DYNARRAY_PUSH(key, uint64_t, tag | value << 8);
+}
+
+static void AcirMemo_KeyType_(AnchDynArray *key, const AcirValueType *type) {
+  if(type == NULL) {
+    AcirMemo_Word_(key, ACIR_MEMO_TAG_NONE_, 0);
+    return;
+  }
+  switch(type->type) {
+    case ACIR_VALUE_TYPE_BASIC:
+      AcirMemo_Word_(key, ACIR_MEMO_TAG_BASIC_, type->basic);
+      return;
+    case ACIR_VALUE_TYPE_POINTER:
+      AcirMemo_Word_(key, ACIR_MEMO_TAG_POINTER_, 0);
+      AcirMemo_KeyType_(key, type->pointer);
+      return;
+    case ACIR_VALUE_TYPE_FUNCTION:
+      AcirMemo_Word_(key, ACIR_MEMO_TAG_FUNCTION_TYPE_, type->function->argumentCount);
+      AcirMemo_KeyType_(key, type->function->returnType);
+      for(size_t i = 0; i < type->function->argumentCount; ++i) AcirMemo_KeyType_(key, type->function->argumentTypes[i]);
+      return;
+  }
+}
+
+void AcirMemo_KeyString(AnchDynArray *key, const char *string) {
+  assert(key != NULL);
+  assert(string != NULL);
+  size_t length = strlen(string);
+  AcirMemo_Word_(key, ACIR_MEMO_TAG_STRING_, length);
+  for(size_t i = 0; i < length; i += 8) {
+    uint64_t word = 0;
+    memcpy(&word, string + i, length - i < 8 ? length - i : 8);
+    ANCH_DYNARRAY_PUSH(key, uint64_t, word);
+  }
+}
+
+/** Largest binding and label index of FUNCTION plus one, at least 1. */
+static void AcirMemo_Bounds_(const AcirFunction *function, size_t *bindings, size_t *labels) {
+  *bindings = *labels = 1;
+  for(size_t i = function->code; i != ACIR_INSTR_NULL_INDEX; i = function->instrs[i].next) {
+    for(int slot = 0; slot < ACIR_PACKED_SLOT_MAX_; ++slot) {
+      const AcirOperand *op = AcirInstr_Operand((AcirInstr*)&function->instrs[i], slot);
+      if(op == NULL) continue;
+      if(op->type == ACIR_OPERAND_TYPE_BINDING && op->idx + 1 > *bindings) *bindings = op->idx + 1;
+      if(op->type == ACIR_OPERAND_TYPE_LABEL && op->idx + 1 > *labels) *labels = op->idx + 1;
+    }
+  }
+}
+
+void AcirMemo_Key(AnchDynArray *key, const AcirModule *module, const AcirFunction *function) {
+  assert(key != NULL);
+  assert(module != NULL);
+  assert(function != NULL);
+  AcirMemo_KeyType_(key, function->type);
+
+  // bindings and labels are numbered in order of first appearance, like AcirBuilder_RenumberBindings does.
+  size_t bindingCount, labelCount;
+  AcirMemo_Bounds_(function, &bindingCount, &labelCount);
+  size_t *numbers = AnchAllocator_Alloc(key->allocator, sizeof(size_t) * (bindingCount + labelCount));
+  memset(numbers, 0xFF, sizeof(size_t) * (bindingCount + labelCount));
+  size_t *labels = numbers + bindingCount, nextBinding = 0, nextLabel = 0;
+
+  for(size_t i = function->code; i != ACIR_INSTR_NULL_INDEX; i = function->instrs[i].next) {
+    const AcirInstr *instr = &function->instrs[i];
+    AcirMemo_Word_(key, ACIR_MEMO_TAG_OPCODE_, instr->opcode);
+    AcirMemo_KeyType_(key, instr->type);
+    for(int slot = 0; slot < ACIR_PACKED_SLOT_MAX_; ++slot) {
+      const AcirOperand *op = AcirInstr_Operand((AcirInstr*)instr, slot);
+      if(op == NULL) continue;
+      switch(op->type) {
+        case ACIR_OPERAND_TYPE_BINDING:
+          if(numbers[op->idx] == (size_t)-1) numbers[op->idx] = nextBinding++;
+          AcirMemo_Word_(key, ACIR_MEMO_TAG_BINDING_, numbers[op->idx]);
+          break;
+        case ACIR_OPERAND_TYPE_LABEL:
+          if(labels[op->idx] == (size_t)-1) labels[op->idx] = nextLabel++;
+          AcirMemo_Word_(key, ACIR_MEMO_TAG_LABEL_, labels[op->idx]);
+          break;
+        case ACIR_OPERAND_TYPE_IMMEDIATE:
+          AcirMemo_Word_(key, ACIR_MEMO_TAG_IMMEDIATE_, 0);
+          AcirMemo_KeyType_(key, op->imm.type);
+          ANCH_DYNARRAY_PUSH(key, uint64_t, AcirImmediateValue_Bits(&op->imm));
+          break;
+        case ACIR_OPERAND_TYPE_FUNCTION:
+          assert(op->idx < module->functionCount);
+          AcirMemo_KeyString(key, AcirModule_Function(module, op->idx)->function.name);
+          break;
+      }
+    }
+  }
+  AnchAllocator_Free(key->allocator, numbers);
+}
+
+uint64_t AcirMemo_Hash(const uint64_t *key, uint32_t count) {
+  assert(count == 0 || key != NULL);
+  uint64_t h = AcirHash_Mix(count);
+  for(uint32_t i = 0; i < count; ++i) h = AcirHash_Mix(h ^ key[i]);
+  return h;
+}
+
+void AcirMemo_Init(AcirMemo *self, AnchAllocator *allocator) {
+  assert(self != NULL);
+  *self = (AcirMemo){
+    .allocator = allocator,
+    .slotCapacity = 64,
+    .slots = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * 64),
+  };
+  memset(self->slots, 0xFF, sizeof(uint32_t) * self->slotCapacity);
+}
+
+void AcirMemo_Free(AcirMemo *self) {
+  assert(self != NULL);
+  for(uint32_t i = 0; i < self->entryCount; ++i) {
+    AnchAllocator_Free(self->allocator, self->entries[i].key);
+    AnchAllocator_Free(self->allocator, self->entries[i].data);
+  }
+  if(self->entryCapacity > 0) AnchAllocator_Free(self->allocator, self->entries);
+  AnchAllocator_Free(self->allocator, self->slots);
+  *self = (AcirMemo){0};
+}
+
+/** Slot holding the entry stored under KEY, or the empty slot where it belongs. */
+static uint32_t AcirMemo_Slot_(const AcirMemo *self, uint64_t hash, const uint64_t *key, uint32_t count) {
+  uint32_t mask = self->slotCapacity - 1;
+  for(uint32_t i = hash & mask; ; i = (i + 1) & mask) {
+    uint32_t index = self->slots[i];
+    if(index == ACIR_MEMO_NULL_INDEX) return i;
+    const AcirMemoEntry *entry = &self->entries[index];
+    if(entry->hash == hash && entry->keyCount == count && memcmp(entry->key, key, sizeof(uint64_t) * count) == 0)
+      return i;
+  }
+}
+
+const AcirMemoEntry *AcirMemo_Find(const AcirMemo *self, const uint64_t *key, uint32_t count) {
+  assert(self != NULL);
+  uint32_t index = self->slots[AcirMemo_Slot_(self, AcirMemo_Hash(key, count), key, count)];
+  return index == ACIR_MEMO_NULL_INDEX ? NULL : &self->entries[index];
+}
+
+/** Add an entry taking KEY and DATA, unless KEY is there already, in which case both are freed. */
+static void AcirMemo_Add_(AcirMemo *self, uint64_t *key, uint32_t count, void *data, uint32_t size) {
+  uint64_t hash = AcirMemo_Hash(key, count);
+  uint32_t slot = AcirMemo_Slot_(self, hash, key, count);
+  if(self->slots[slot] != ACIR_MEMO_NULL_INDEX) {
+    AnchAllocator_Free(self->allocator, key);
+    AnchAllocator_Free(self->allocator, data);
+    return;
+  }
+
+  if(self->entryCount == self->entryCapacity) {
+    uint32_t capacity = self->entryCapacity ? self->entryCapacity * 2 : 16;
+    AcirMemoEntry *entries = AnchAllocator_Alloc(self->allocator, sizeof(AcirMemoEntry) * capacity);
+    if(self->entryCapacity > 0) {
+      memcpy(entries, self->entries, sizeof(AcirMemoEntry) * self->entryCount);
+      AnchAllocator_Free(self->allocator, self->entries);
+    }
+    self->entries = entries;
+    self->entryCapacity = capacity;
+  }
+  self->entries[self->entryCount] = (AcirMemoEntry){ hash, count, size, key, data };
+  self->slots[slot] = self->entryCount++;
+
+  if(self->entryCount * 2 > self->slotCapacity) {
+    AnchAllocator_Free(self->allocator, self->slots);
+    self->slotCapacity *= 2;
+    self->slots = AnchAllocator_Alloc(self->allocator, sizeof(uint32_t) * self->slotCapacity);
+    memset(self->slots, 0xFF, sizeof(uint32_t) * self->slotCapacity);
+    for(uint32_t i = 0; i < self->entryCount; ++i) {
+      const AcirMemoEntry *entry = &self->entries[i];
+      self->slots[AcirMemo_Slot_(self, entry->hash, entry->key, entry->keyCount)] = i;
+    }
+  }
+}
+
+/** Swap the callee of every call in BUILDER between its module index and its place in CALLEES. */
+static void AcirMemo_SwapCallees_(AcirBuilder *builder, const uint32_t *callees, uint32_t calleeCount, bool toPlace) {
+  const AcirFunction *function = builder->target;
+  for(size_t i = function->code; i != ACIR_INSTR_NULL_INDEX; i = function->instrs[i].next) {
+    AcirInstr *instr = &builder->instrs[i];
+    if(instr->opcode != ACIR_OPCODE_CALL || instr->val.type != ACIR_OPERAND_TYPE_FUNCTION) continue;
+    if(!toPlace) {
+      instr->val.idx = callees[instr->val.idx - 1];
+      continue;
+    }
+    for(uint32_t c = 0; c < calleeCount; ++c) {
+      if(callees[c] == instr->val.idx) {
+        instr->val.idx = c + 1;
+        break;
+      }
+    }
+  }
+}
+
+void AcirMemo_Store(AcirMemo *self, const uint64_t *key, uint32_t count, AcirModule *module, uint32_t index) {
+  assert(self != NULL);
+  assert(module != NULL && index < module->functionCount);
+  if(AcirMemo_Find(self, key, count) != NULL) return;
+
+  // callees follow the function in the file, so its calls name them by their place there.
+  AcirModuleFunction *function = AcirModule_Function(module, index);
+  AnchDynArray callees;
+  AnchDynArray_Init(&callees, self->allocator, 256);
+  for(size_t i = function->function.code; i != ACIR_INSTR_NULL_INDEX; i = function->function.instrs[i].next) {
+    const AcirInstr *instr = &function->function.instrs[i];
+    if(instr->opcode != ACIR_OPCODE_CALL || instr->val.type != ACIR_OPERAND_TYPE_FUNCTION) continue;
+    uint32_t calleeCount = callees.size / sizeof(uint32_t), c = 0;
+    while(c < calleeCount && ((uint32_t*)callees.data)[c] != instr->val.idx) ++c;
+    if(c == calleeCount) ANCH_DYNARRAY_PUSH(&callees, uint32_t, instr->val.idx);
+  }
+  uint32_t calleeCount = callees.size / sizeof(uint32_t);
+
+  AcirBinaryWriter writer;
+  AcirBinaryWriter_Init(&writer, self->allocator);
+  AcirMemo_SwapCallees_(&function->builder, (uint32_t*)callees.data, calleeCount, true);
+  AcirBinaryWriter_AddFunction(&writer, &function->function);
+  AcirMemo_SwapCallees_(&function->builder, (uint32_t*)callees.data, calleeCount, false);
+  for(uint32_t c = 0; c < calleeCount; ++c) {
+    const AcirFunction *callee = &AcirModule_Function(module, ((uint32_t*)callees.data)[c])->function;
+    AcirBinaryWriter_AddFunction(&writer, &(AcirFunction){ .name = callee->name, .code = ACIR_INSTR_NULL_INDEX });
+  }
+  size_t size;
+  void *data = AcirBinaryWriter_Finish(&writer, &size);
+  AcirBinaryWriter_Free(&writer);
+  AnchDynArray_Free(&callees);
+
+  uint64_t *keyCopy = AnchAllocator_Alloc(self->allocator, sizeof(uint64_t) * count);
+  memcpy(keyCopy, key, sizeof(uint64_t) * count);
+  AcirMemo_Add_(self, keyCopy, count, data, size);
+}
+
+AcirBinaryError AcirMemo_Restore(const AcirMemoEntry *entry, AcirModule *module, uint32_t index, AnchAllocator *allocator) {
+  assert(entry != NULL);
+  assert(module != NULL && index < module->functionCount);
+  AcirBinaryReader reader;
+  AcirBinaryError error = AcirBinaryReader_Init(&reader, entry->data, entry->size, &module->types, allocator);
+  if(error != ACIR_BINARY_OK) return error;
+
+  AcirModuleFunction *function = AcirModule_Function(module, index);
+  AcirFunction result = { .type = function->function.type, .name = function->function.name };
+  AcirBuilder resultBuilder;
+  AcirBuilder_Init(&resultBuilder, &result, allocator);
+  if(AcirBinaryReader_FunctionCount(&reader) == 0) error = ACIR_BINARY_ERROR_MALFORMED;
+  else error = AcirBinaryReader_ReadFunction(&reader, 0, &resultBuilder);
+
+  // callees are found again by name, the module they were stored from may number them differently.
+  for(size_t i = 0; i < result.instrCount && error == ACIR_BINARY_OK; ++i) {
+    AcirInstr *instr = &resultBuilder.instrs[i];
+    if(instr->opcode != ACIR_OPCODE_CALL || instr->val.type != ACIR_OPERAND_TYPE_FUNCTION) continue;
+    uint32_t callee = instr->val.idx == 0 ? ACIR_MODULE_NULL_INDEX
+      : AcirModule_FindFunction(module, AcirBinaryReader_Name(&reader, AcirBinaryReader_Function(&reader, instr->val.idx)));
+    if(callee == ACIR_MODULE_NULL_INDEX) error = ACIR_BINARY_ERROR_MALFORMED;
+    instr->val.idx = callee;
+  }
+  if(error == ACIR_BINARY_OK) {
+    AcirBuilder_Clear(&function->builder);
+    AcirBuilder_BuildNormalized(&resultBuilder, &function->builder);
+  }
+  AcirBuilder_Free(&resultBuilder);
+  AcirBinaryReader_Free(&reader);
+  return error;
+}
+
+bool AcirMemo_Save(const AcirMemo *self, const char *filename) {
+  assert(self != NULL);
+  assert(filename != NULL);
+  FILE *file = fopen(filename, "wb");
+  if(file == NULL) return false;
+
+  AcirMemoFileHeader_ header = { ACIR_MEMO_MAGIC_, ACIR_MEMO_VERSION_, 0, self->entryCount, 0 };
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+  static const uint8_t padding[8] = {0};
+  for(uint32_t i = 0; i < self->entryCount && ok; ++i) {
+    const AcirMemoEntry *entry = &self->entries[i];
+    AcirMemoFileEntry_ record = { entry->keyCount, entry->size };
+    ok = fwrite(&record, sizeof(record), 1, file) == 1
+      && fwrite(entry->key, sizeof(uint64_t), entry->keyCount, file) == entry->keyCount
+      && fwrite(entry->data, 1, entry->size, file) == entry->size
+      && fwrite(padding, 1, ANCH_ROUNDUP_POWEROF2(entry->size, 8) - entry->size, file)
+        == ANCH_ROUNDUP_POWEROF2(entry->size, 8) - entry->size;
+  }
+  return fclose(file) == 0 && ok;
+}
+
+bool AcirMemo_Load(AcirMemo *self, const char *filename) {
+  assert(self != NULL);
+  assert(filename != NULL);
+  FILE *file = fopen(filename, "rb");
+  if(file == NULL) return false;
+
+  fseek(file, 0, SEEK_END);
+  long fileSize = ftell(file);
+  rewind(file);
+
+  AcirMemoFileHeader_ header;
+  bool ok = fileSize >= 0 && fread(&header, sizeof(header), 1, file) == 1
+    && header.magic == ACIR_MEMO_MAGIC_ && header.version == ACIR_MEMO_VERSION_;
+  size_t left = ok ? (size_t)fileSize - sizeof(header) : 0;
+  // results are checked when they are read back, see AcirBinaryReader_Init; sizes are checked
+  // against the file before anything is allocated for them.
+  for(uint32_t i = 0; ok && i < header.entryCount; ++i) {
+    AcirMemoFileEntry_ record;
+    ok = left >= sizeof(record) && fread(&record, sizeof(record), 1, file) == 1;
+    size_t keySize = sizeof(uint64_t) * (size_t)record.keyCount, paddedSize = ANCH_ROUNDUP_POWEROF2((size_t)record.size, 8);
+    ok = ok && record.keyCount > 0 && record.size >= sizeof(AcirBinaryHeader)
+      && keySize + paddedSize <= left - sizeof(record);
+    if(!ok) break;
+    left -= sizeof(record) + keySize + paddedSize;
+
+    uint64_t *key = AnchAllocator_Alloc(self->allocator, keySize);
+    void *data = AnchAllocator_Alloc(self->allocator, paddedSize);
+    ok = fread(key, 1, keySize, file) == keySize && fread(data, 1, paddedSize, file) == paddedSize;
+    if(!ok) {
+      AnchAllocator_Free(self->allocator, key);
+      AnchAllocator_Free(self->allocator, data);
+      break;
+    }
+    AcirMemo_Add_(self, key, record.keyCount, data, record.size);
+  }
+  fclose(file);
+  return ok;
+}
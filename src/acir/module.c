@@ -0,0 +1,289 @@
+#include <acir/acir.h>
+#include <annec_anchor.h>
+#include <assert.h>
+#include <stdarg.h>
+#include "../cli.h"
+
+// small functions are the common case, so arenas start with small blocks.
+#define ACIR_MODULE_ARENA_BLOCK_SIZE_ (4 * 1024)
+
+static uint64_t AcirModule_HashName_(const char *name) {
+  uint64_t h = 0xCBF29CE484222325u;
+  for(; *name; ++name) {
+    h ^= (uint8_t)*name;
+    h *= 0x100000001B3u;
+  }
+  return AcirHash_Mix(h);
+}
+
+/** Slot holding the function named NAME, or the empty slot where it belongs. */
+static uint32_t AcirModule_SymbolSlot_(const AcirModule *self, const char *name) {
+  uint32_t mask = self->symbolCapacity - 1;
+  for(uint32_t i = AcirModule_HashName_(name) & mask; ; i = (i + 1) & mask) {
+    uint32_t index = self->symbols[i];
+    if(index == ACIR_MODULE_NULL_INDEX || strcmp(self->functions[index]->function.name, name) == 0) return i;
+  }
+}
+
+static uint64_t AcirModule_HashConstant_(const AcirImmediateValue *imm) {
+  return AcirHash_Mix(AcirImmediateValue_Bits(imm) ^ AcirHash_Mix((uintptr_t)imm->type));
+}
+
+/** Slot holding a constant equal to IMM, or the empty slot where it belongs. */
+static uint32_t AcirModule_ConstantSlot_(const AcirModule *self, const AcirImmediateValue *imm) {
+  uint32_t mask = self->constantCapacity * 2 - 1;
+  uint64_t bits = AcirImmediateValue_Bits(imm);
+  for(uint32_t i = AcirModule_HashConstant_(imm) & mask; ; i = (i + 1) & mask) {
+    uint32_t index = self->constantSlots[i];
+    if(index == ACIR_MODULE_NULL_INDEX) return i;
+    const AcirImmediateValue *other = &self->constants[index];
+    if(other->type == imm->type && AcirImmediateValue_Bits(other) == bits) return i;
+  }
+}
+
+void AcirModule_Init(AcirModule *self, AnchAllocator *allocator) {
+  assert(self != NULL);
+  *self = (AcirModule){ .allocator = allocator };
+  AcirTypeTable_Init(&self->types, allocator);
+
+  self->functionCapacity = 8;
+  self->functions = AnchAllocator_Alloc(allocator, sizeof(AcirModuleFunction*) * self->functionCapacity);
+  self->symbolCapacity = 16;
+  self->symbols = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * self->symbolCapacity);
+  memset(self->symbols, 0xFF, sizeof(uint32_t) * self->symbolCapacity);
+
+  self->constantCapacity = 16;
+  self->constants = AnchAllocator_Alloc(allocator, sizeof(AcirImmediateValue) * self->constantCapacity);
+  self->constantSlots = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * self->constantCapacity * 2);
+  memset(self->constantSlots, 0xFF, sizeof(uint32_t) * self->constantCapacity * 2);
+}
+
+void AcirModule_Free(AcirModule *self) {
+  assert(self != NULL);
+  for(uint32_t i = 0; i < self->functionCount; ++i) {
+    AcirModuleFunction *function = self->functions[i];
+    AcirBuilder_Free(&function->builder);
+    AnchRegionAllocator_Free(&function->arena);
+    AnchAllocator_Free(self->allocator, (char*)function->function.name);
+    AnchAllocator_Free(self->allocator, function);
+  }
+  AnchAllocator_Free(self->allocator, self->functions);
+  AnchAllocator_Free(self->allocator, self->symbols);
+  AnchAllocator_Free(self->allocator, self->constants);
+  AnchAllocator_Free(self->allocator, self->constantSlots);
+  AcirTypeTable_Free(&self->types);
+  *self = (AcirModule){0};
+}
+
+uint32_t AcirModule_AddFunction(AcirModule *self, const char *name, const AcirValueType *type) {
+  assert(self != NULL);
+  assert(name != NULL);
+
+  uint32_t slot = AcirModule_SymbolSlot_(self, name);
+  if(self->symbols[slot] != ACIR_MODULE_NULL_INDEX) return ACIR_MODULE_NULL_INDEX;
+  assert(self->functionCount < ACIR_MODULE_NULL_INDEX - 1);
+
+  if(self->functionCount == self->functionCapacity) {
+    self->functionCapacity *= 2;
+    self->functions = AnchAllocator_Realloc(self->allocator, self->functions,
+      sizeof(AcirModuleFunction*) * self->functionCapacity);
+  }
+
+  size_t nameLength = strlen(name);
+  char *nameCopy = AnchAllocator_Alloc(self->allocator, nameLength + 1);
+  memcpy(nameCopy, name, nameLength + 1);
+
+  AcirModuleFunction *function = AnchAllocator_Alloc(self->allocator, sizeof(AcirModuleFunction));
+  function->function = (AcirFunction){ .type = type, .name = nameCopy };
+  AnchRegionAllocator_Init(&function->arena, self->allocator, ACIR_MODULE_ARENA_BLOCK_SIZE_);
+  AcirBuilder_Init(&function->builder, &function->function, &function->arena.base);
+
+  uint32_t index = self->functionCount++;
+  self->functions[index] = function;
+  self->symbols[slot] = index;
+
+  if(self->functionCount * 2 > self->symbolCapacity) {
+    AnchAllocator_Free(self->allocator, self->symbols);
+    self->symbolCapacity *= 2;
+    self->symbols = AnchAllocator_Alloc(self->allocator, sizeof(uint32_t) * self->symbolCapacity);
+    memset(self->symbols, 0xFF, sizeof(uint32_t) * self->symbolCapacity);
+    for(uint32_t i = 0; i < self->functionCount; ++i)
+      self->symbols[AcirModule_SymbolSlot_(self, self->functions[i]->function.name)] = i;
+  }
+  return index;
+}
+
+uint32_t AcirModule_FindFunction(const AcirModule *self, const char *name) {
+  assert(self != NULL);
+  assert(name != NULL);
+  return self->symbols[AcirModule_SymbolSlot_(self, name)];
+}
+
+void AcirModule_FreeFunction(AcirModule *self, uint32_t index) {
+  assert(self != NULL);
+  assert(index < self->functionCount);
+  AcirModuleFunction *function = self->functions[index];
+  AcirBuilder_Free(&function->builder);
+  AnchRegionAllocator_Free(&function->arena);
+  AcirBuilder_Init(&function->builder, &function->function, &function->arena.base);
+}
+
+uint32_t AcirModule_Constant(AcirModule *self, const AcirImmediateValue *imm) {
+  assert(self != NULL);
+  assert(imm != NULL);
+
+  uint32_t slot = AcirModule_ConstantSlot_(self, imm);
+  if(self->constantSlots[slot] != ACIR_MODULE_NULL_INDEX) return self->constantSlots[slot];
+  assert(self->constantCount < ACIR_MODULE_NULL_INDEX - 1);
+
+  uint32_t index = self->constantCount++;
+  self->constants[index] = *imm;
+  self->constantSlots[slot] = index;
+
+  // the slot table is kept at twice the capacity, so it is at most half full.
+  if(self->constantCount == self->constantCapacity) {
+    self->constantCapacity *= 2;
+    self->constants = AnchAllocator_Realloc(self->allocator, self->constants,
+      sizeof(AcirImmediateValue) * self->constantCapacity);
+    AnchAllocator_Free(self->allocator, self->constantSlots);
+    self->constantSlots = AnchAllocator_Alloc(self->allocator, sizeof(uint32_t) * self->constantCapacity * 2);
+    memset(self->constantSlots, 0xFF, sizeof(uint32_t) * self->constantCapacity * 2);
+    for(uint32_t i = 0; i < self->constantCount; ++i)
+      self->constantSlots[AcirModule_ConstantSlot_(self, &self->constants[i])] = i;
+  }
+  return index;
+}
+
+typedef struct {
+  AcirModule *module;
+  AnchAllocator *allocator;
+  AnchBufferWriteStream *diagnostics; // by function, merged in order once all are done.
+  int *errorCounts;
+} AcirModule_Validation_;
+
+/** Error about INSTR, formatted like the ones of \ref AcirFunction_ValidateTo. EXPECTED and GOT add a note unless NULL. */
+static void AcirModule_CallError_(AnchCharWriteStream *out, const AcirInstr *instr,
+  const AcirValueType *expected, const AcirValueType *got, const char *format, ...) {
+  va_list va;
+  va_start(va, format);
+  AnchWriteString(out, ANSI_RED "\nError: " ANSI_RESET);
+  AnchWriteFormatV(out, format, va);
+  va_end(va);
+  AnchWriteString(out, "\n");
+  AcirInstr_Print(out, instr);
+  AnchWriteString(out, "\n");
+  if(expected == NULL && got == NULL) return;
+  AnchWriteString(out, "\n" ANSI_GRAY "Note: " ANSI_RESET "expected `");
+  AcirValueType_Print(out, expected);
+  AnchWriteString(out, "`, but got `");
+  AcirValueType_Print(out, got);
+  AnchWriteString(out, "` instead.\n\n");
+}
+
+/** Check every `call` of FUNCTION against its callee, the `arg`s right before it included. Returns the number of errors. */
+static int AcirModule_CheckCalls_(const AcirModule *self, const AcirFunction *function, AnchCharWriteStream *out) {
+  int errorCount = 0;
+  size_t firstArg = ACIR_INSTR_NULL_INDEX, argCount = 0;
+  for(size_t i = function->code; i != ACIR_INSTR_NULL_INDEX; i = function->instrs[i].next) {
+    const AcirInstr *instr = &function->instrs[i];
+    if(instr->opcode == ACIR_OPCODE_ARG) {
+      if(argCount++ == 0) firstArg = i;
+      continue;
+    }
+    if(instr->opcode != ACIR_OPCODE_CALL) continue;
+    size_t count = argCount;
+    argCount = 0;
+
+    if(instr->val.idx >= self->functionCount) {
+      AcirModule_CallError_(out, instr, NULL, NULL, "function &%zu doesn't exist.", instr->val.idx);
+      ++errorCount;
+      continue;
+    }
+    const AcirFunction *callee = &self->functions[instr->val.idx]->function;
+    const AcirFunctionValueType *type = callee->type != NULL && callee->type->type == ACIR_VALUE_TYPE_FUNCTION
+      ? callee->type->function : NULL;
+    size_t expected = type != NULL ? type->argumentCount : 0;
+    if(count != expected) {
+      AcirModule_CallError_(out, instr, NULL, NULL, "`%s` takes %zu arguments, but got %zu.", callee->name, expected, count);
+      ++errorCount;
+      continue;
+    }
+    if(type == NULL) continue;
+
+    if(instr->type != type->returnType) {
+      AcirModule_CallError_(out, instr, type->returnType, instr->type, "the call does not match the return type of `%s`.", callee->name);
+      ++errorCount;
+    }
+    size_t arg = firstArg;
+    for(size_t j = 0; j < count; ++j, arg = function->instrs[arg].next) {
+      if(function->instrs[arg].type == type->argumentTypes[j]) continue;
+      AcirModule_CallError_(out, &function->instrs[arg], type->argumentTypes[j], function->instrs[arg].type,
+        "argument %zu does not match the parameter of `%s`.", j, callee->name);
+      ++errorCount;
+    }
+  }
+  return errorCount;
+}
+
+static void AcirModule_ValidateFunction_(void *context, size_t index, size_t worker) {
+  (void)worker;
+  AcirModule_Validation_ *validation = context;
+  const AcirFunction *function = &validation->module->functions[index]->function;
+  AnchBufferWriteStream_Init(&validation->diagnostics[index], validation->allocator);
+  if(function->code == ACIR_INSTR_NULL_INDEX) return;
+  AnchCharWriteStream *out = &validation->diagnostics[index].stream;
+  validation->errorCounts[index] = AcirFunction_ValidateTo(function, &validation->module->types, validation->allocator, out);
+  // callees are only looked up in well-formed code, the other functions are not written to meanwhile.
+  if(validation->errorCounts[index] == 0)
+    validation->errorCounts[index] = AcirModule_CheckCalls_(validation->module, function, out);
+}
+
+int AcirModule_Validate(AcirModule *self, AnchAllocator *allocator, size_t threadCount) {
+  assert(self != NULL);
+  if(self->functionCount == 0) return 0;
+
+  // interning mutates the type table, so it happens before the threads share it.
+  for(uint32_t i = 0; i < self->functionCount; ++i)
+    AcirFunction_PrepareValidation(&self->functions[i]->function, &self->types);
+
+  AcirModule_Validation_ validation = {
+    .module = self,
+    .allocator = allocator,
+    .diagnostics = AnchAllocator_Alloc(allocator, sizeof(AnchBufferWriteStream) * self->functionCount),
+    .errorCounts = AnchAllocator_AllocZero(allocator, sizeof(int) * self->functionCount),
+  };
+  AnchParallelFor(self->functionCount, threadCount, &AcirModule_ValidateFunction_, &validation);
+
+  int errorCount = 0;
+  for(uint32_t i = 0; i < self->functionCount; ++i) {
+    AnchBufferWriteStream_WriteTo(&validation.diagnostics[i], wsStderr);
+    AnchBufferWriteStream_Free(&validation.diagnostics[i]);
+    errorCount += validation.errorCounts[i];
+  }
+  AnchAllocator_Free(allocator, validation.diagnostics);
+  AnchAllocator_Free(allocator, validation.errorCounts);
+  return errorCount;
+}
+
+void AcirModule_Print(const AcirModule *self, AnchCharWriteStream *out) {
+  assert(self != NULL);
+  for(uint32_t i = 0; i < self->constantCount; ++i) {
+    AnchWriteFormat(out, ANSI_GRAY "%u" ANSI_RESET " | " ANSI_MAGENTA "const " ANSI_RESET, i);
+    AcirOperand_Print(out, &(AcirOperand){ ACIR_OPERAND_TYPE_IMMEDIATE, .imm = self->constants[i] });
+    AnchWriteString(out, "\n");
+  }
+  for(uint32_t i = 0; i < self->functionCount; ++i) {
+    const AcirFunction *function = &self->functions[i]->function;
+    AnchWriteFormat(out, "\n" ANSI_MAGENTA "%s" ANSI_RESET ":", function->name);
+    if(function->type != NULL) {
+      AnchWriteString(out, " ");
+      AcirValueType_Print(out, function->type);
+    }
+    if(function->code == ACIR_INSTR_NULL_INDEX) {
+      AnchWriteString(out, ANSI_GRAY " declared\n" ANSI_RESET);
+      continue;
+    }
+    AnchWriteString(out, "\n");
+    AcirFunction_Print(function, out);
+  }
+}
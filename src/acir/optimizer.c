@@ -145,29 +145,76 @@ void ConstEvalInstr_(const AcirOptimizer *self, AcirImmediateValue *result, cons
   assert(instr != NULL);
   assert(result != NULL);
 
-  const AcirImmediateValue *val = NULL, *lhs = NULL, *rhs = NULL;
-  
   int operandCount = AcirOpcode_OperandCount(instr->opcode);
   if(operandCount == 2) {
-    val = MaybeGetImmValue_(self, &instr->val);
+    AcirInstr_ConstEval(instr, result, MaybeGetImmValue_(self, &instr->val), NULL);
   } else if(operandCount == 3) {
-    lhs = MaybeGetImmValue_(self, &instr->lhs);
-    rhs = MaybeGetImmValue_(self, &instr->rhs);
+    AcirInstr_ConstEval(instr, result, MaybeGetImmValue_(self, &instr->lhs), MaybeGetImmValue_(self, &instr->rhs));
   }
+}
 
-  result->type = instr->type;
+static int BitWidth_(AcirBasicValueType type) {
+  switch(type) {
+    case ACIR_BASIC_VALUE_TYPE_SINT8: case ACIR_BASIC_VALUE_TYPE_UINT8: return 8;
+    case ACIR_BASIC_VALUE_TYPE_SINT16: case ACIR_BASIC_VALUE_TYPE_UINT16: return 16;
+    case ACIR_BASIC_VALUE_TYPE_SINT32: case ACIR_BASIC_VALUE_TYPE_UINT32: return 32;
+    default: return 64;
+  }
+}
+
+bool AcirInstr_ConstEvalTraps(const AcirInstr *instr, const AcirImmediateValue *lhs, const AcirImmediateValue *rhs) {
+  assert(instr != NULL);
+  assert(rhs != NULL);
+  if(instr->type == NULL || instr->type->type != ACIR_VALUE_TYPE_BASIC) return false;
+  AcirBasicValueType basic = instr->type->basic;
+  bool floating = basic == ACIR_BASIC_VALUE_TYPE_FLOAT32 || basic == ACIR_BASIC_VALUE_TYPE_FLOAT64;
+  bool isSigned = basic == ACIR_BASIC_VALUE_TYPE_SINT8 || basic == ACIR_BASIC_VALUE_TYPE_SINT16
+    || basic == ACIR_BASIC_VALUE_TYPE_SINT32 || basic == ACIR_BASIC_VALUE_TYPE_SINT64;
+  int width = BitWidth_(basic);
+  uint64_t mask = width == 64 ? UINT64_MAX : ((uint64_t)1 << width) - 1;
+  switch(instr->opcode) {
+    case ACIR_OPCODE_DIV: case ACIR_OPCODE_MOD:
+      if(floating) return false;
+      if(AcirImmediateValue_Bits(rhs) == 0) return true;
+      // the smallest signed value over -1 doesn't fit either, an unknown LHS might be it.
+      return isSigned && AcirImmediateValue_Bits(rhs) == mask
+        && (lhs == NULL || AcirImmediateValue_Bits(lhs) == (uint64_t)1 << (width - 1));
+    case ACIR_OPCODE_SHL: case ACIR_OPCODE_SHR: return AcirImmediateValue_Bits(rhs) >= (uint64_t)width;
+    default: return false;
+  }
+}
+
+void AcirInstr_ConstEval(const AcirInstr *instr, AcirImmediateValue *result,
+  const AcirImmediateValue *lhs, const AcirImmediateValue *rhs) {
+  assert(instr != NULL);
+  assert(result != NULL);
+  const AcirImmediateValue *val = lhs;
+
+  // comparisons take T but produce a `bool`.
+  bool compares = instr->opcode >= ACIR_OPCODE_EQL && instr->opcode <= ACIR_OPCODE_GEQ;
+  result->type = compares ? AcirValueType_Basic(ACIR_BASIC_VALUE_TYPE_BOOL) : instr->type;
 
   switch(instr->opcode) {
 #define BINOP(TYPE, FIELD, OP) result->FIELD = lhs->FIELD OP rhs->FIELD;
 #define BBINOP(TYPE, FIELD, OP) result->boolean = lhs->FIELD OP rhs->FIELD;
 #define BUNOP(TYPE, FIELD, OP) result->boolean = OP(val->FIELD);
 #define UNOP(TYPE, FIELD, OP) result->FIELD = OP(val->FIELD);
-    case ACIR_OPCODE_ADD: SWITCH_EVAL_TYPE_(instr->type->basic, BINOP, +) break;
-    case ACIR_OPCODE_SUB: SWITCH_EVAL_TYPE_(instr->type->basic, BINOP, -) break;
-    case ACIR_OPCODE_MUL: SWITCH_EVAL_TYPE_(instr->type->basic, BINOP, *) break;
+// integers wrap around instead of overflowing, which is undefined for signed ones (and for small
+// unsigned ones, promoted to `int`), so they go through 64 bits unsigned.
+#define IS_FLOAT_(TYPE) (TYPE == ACIR_BASIC_VALUE_TYPE_FLOAT32 || TYPE == ACIR_BASIC_VALUE_TYPE_FLOAT64)
+#define WRAPOP(TYPE, FIELD, OP) result->FIELD = IS_FLOAT_(TYPE) ? lhs->FIELD OP rhs->FIELD \
+  : (__typeof__(lhs->FIELD))((uint64_t)lhs->FIELD OP (uint64_t)rhs->FIELD);
+#define WRAPUNOP(TYPE, FIELD, OP) result->FIELD = IS_FLOAT_(TYPE) ? OP(val->FIELD) \
+  : (__typeof__(val->FIELD))(OP(uint64_t)val->FIELD);
+    case ACIR_OPCODE_ADD: SWITCH_EVAL_TYPE_(instr->type->basic, WRAPOP, +) break;
+    case ACIR_OPCODE_SUB: SWITCH_EVAL_TYPE_(instr->type->basic, WRAPOP, -) break;
+    case ACIR_OPCODE_MUL: SWITCH_EVAL_TYPE_(instr->type->basic, WRAPOP, *) break;
     case ACIR_OPCODE_DIV: SWITCH_EVAL_TYPE_(instr->type->basic, BINOP, /) break;
     case ACIR_OPCODE_MOD: SWITCH_EVAL_TYPEI_(instr->type->basic, BINOP, %) break;
-    case ACIR_OPCODE_NEG: SWITCH_EVAL_TYPE_(instr->type->basic, UNOP, -) break;
+    case ACIR_OPCODE_NEG: SWITCH_EVAL_TYPE_(instr->type->basic, WRAPUNOP, -) break;
+#undef WRAPUNOP
+#undef WRAPOP
+#undef IS_FLOAT_
     case ACIR_OPCODE_EQL: SWITCH_EVAL_TYPE_(instr->type->basic, BBINOP, ==) break;
     case ACIR_OPCODE_NEQ: SWITCH_EVAL_TYPE_(instr->type->basic, BBINOP, !=) break;
     case ACIR_OPCODE_LTH: SWITCH_EVAL_TYPE_(instr->type->basic, BBINOP, <) break;
@@ -182,6 +229,11 @@ void ConstEvalInstr_(const AcirOptimizer *self, AcirImmediateValue *result, cons
     case ACIR_OPCODE_BIT_COR: SWITCH_EVAL_TYPEI_(instr->type->basic, BINOP, |) break;
     case ACIR_OPCODE_BIT_XOR: SWITCH_EVAL_TYPEI_(instr->type->basic, BINOP, ^) break;
     case ACIR_OPCODE_BIT_NOT: SWITCH_EVAL_TYPEI_(instr->type->basic, UNOP, ~) break;
+// shifting a negative number left is undefined in C, so it goes through 64 bits unsigned.
+#define SHLOP(TYPE, FIELD) result->FIELD = (__typeof__(lhs->FIELD))((uint64_t)lhs->FIELD << rhs->FIELD);
+    case ACIR_OPCODE_SHL: SWITCH_EVAL_TYPEI_(instr->type->basic, SHLOP) break;
+    case ACIR_OPCODE_SHR: SWITCH_EVAL_TYPEI_(instr->type->basic, BINOP, >>) break;
+#undef SHLOP
 #undef BINOP
     default:
       assert(false && "non-consteval instruction");
@@ -195,7 +247,8 @@ void AcirOptimizer_Analyze(AcirOptimizer *self) {
   assert(self->source != NULL);
 
   const AcirInstr *instr = &self->source->instrs[self->source->code];
-  AllocAtLeast_Instrs_(self, instr->index + 1);
+  AllocAtLeast_Instrs_(self, self->source->instrCount);
+  AcirBuilder_Reserve(self->builder, self->source->instrCount);
   self->instrs[instr->index].prev = ACIR_INSTR_NULL_INDEX;
   // AnchWriteString(wsStdout, ANSI_BLUE "\nInitial:\n" ANSI_RESET);
   // AnchWriteFormat(wsStdout,
@@ -251,10 +304,14 @@ void AcirOptimizer_Analyze(AcirOptimizer *self) {
         if(oops[i]->type == ACIR_OPERAND_TYPE_BINDING) {
           oops[i]->idx = iops[i]->idx;
           if(i != operandCount - 1 || i == 0) { // output operand is ignored.
+            // `phi` can read a binding defined further down, over a back edge.
+            if(instr->opcode == ACIR_OPCODE_PHI && (iops[i]->idx >= self->bindingCount
+              || !self->bindings[iops[i]->idx].exists)) continue;
             assert(iops[i]->idx < self->bindingCount);
             AcirOptimizer_Binding *binding = &self->bindings[iops[i]->idx];
             assert(binding->exists);
-            if(binding->flags & ACIR_OPTIMIZER_BINDING_FLAG_CONSTANT) {
+            // `ref` takes the address of the binding itself, so it keeps it.
+            if(binding->flags & ACIR_OPTIMIZER_BINDING_FLAG_CONSTANT && instr->opcode != ACIR_OPCODE_REF) {
               oops[i]->type = ACIR_OPERAND_TYPE_IMMEDIATE;
               oops[i]->imm = binding->constant;
             }
@@ -269,7 +326,7 @@ void AcirOptimizer_Analyze(AcirOptimizer *self) {
       // AnchWriteFormat(wsStdout, "  -> %p\n", binding);
       assert(!binding->exists);
       binding->flags |= ACIR_OPTIMIZER_BINDING_FLAG_CONSTANT;
-      binding->constant = instr->val.imm;
+      binding->constant = oinstr->val.imm;
       binding->exists = true;
     } else if(AcirOpcode_ConstEval(oinstr->opcode)) {
       AcirOptimizer_Binding *binding = BindingGetOrCreate_(self, oinstr->out.idx);
@@ -278,22 +335,19 @@ void AcirOptimizer_Analyze(AcirOptimizer *self) {
       if(operandCount == 2 && MaybeGetImmValue_(self, &oinstr->val)) {
         binding->flags |= ACIR_OPTIMIZER_BINDING_FLAG_CONSTANT;
         ConstEvalInstr_(self, &binding->constant, oinstr);
-      } else if(operandCount == 3 && MaybeGetImmValue_(self, &oinstr->lhs) && MaybeGetImmValue_(self, &oinstr->rhs)) {
+      } else if(operandCount == 3 && MaybeGetImmValue_(self, &oinstr->lhs) && MaybeGetImmValue_(self, &oinstr->rhs)
+        && !AcirInstr_ConstEvalTraps(oinstr, MaybeGetImmValue_(self, &oinstr->lhs), MaybeGetImmValue_(self, &oinstr->rhs))) {
         binding->flags |= ACIR_OPTIMIZER_BINDING_FLAG_CONSTANT;
         ConstEvalInstr_(self, &binding->constant, oinstr);
       }
 
-      oinstr->opcode = ACIR_OPCODE_SET;
-      oinstr->val = (AcirOperand){ .type = ACIR_OPERAND_TYPE_IMMEDIATE, .imm = binding->constant };
-    } else if(oinstr->opcode == ACIR_OPCODE_SET && oinstr->val.type == ACIR_OPERAND_TYPE_IMMEDIATE) {
-      // AnchWriteFormat(wsStdout, ANSI_BLUE "BindingGetOrCreate_" ANSI_RESET "(self, %zu)\n", oinstr->out.idx);
-      AcirOptimizer_Binding *binding = BindingGetOrCreate_(self, oinstr->out.idx);
-      // AnchWriteFormat(wsStdout, "  -> %p\n", binding);
-      assert(!binding->exists);
-      binding->flags |= ACIR_OPTIMIZER_BINDING_FLAG_CONSTANT;
-      binding->constant = instr->val.imm;
-      binding->exists = true;
-    } else if(operandCount > 1) { // for instructions with output
+      // only a known result replaces the instruction, anything else still has to be computed.
+      if(binding->flags & ACIR_OPTIMIZER_BINDING_FLAG_CONSTANT) {
+        oinstr->opcode = ACIR_OPCODE_SET;
+        oinstr->type = binding->constant.type;
+        oinstr->val = (AcirOperand){ .type = ACIR_OPERAND_TYPE_IMMEDIATE, .imm = binding->constant };
+      }
+    } else if(operandCount > 1 && oinstr->out.type != ACIR_OPERAND_TYPE_LABEL) { // for instructions with output
       assert(oinstr->out.type == ACIR_OPERAND_TYPE_BINDING);
       // AnchWriteFormat(wsStdout, ANSI_BLUE "BindingGetOrCreate_" ANSI_RESET "(self, %zu)\n", oinstr->out.idx);
       AcirOptimizer_Binding *binding = BindingGetOrCreate_(self, oinstr->out.idx);
@@ -310,57 +364,175 @@ void AcirOptimizer_Analyze(AcirOptimizer *self) {
   self->didAnalyze = true;
 }
 
+static bool IsFloat_(const AcirValueType *type) {
+  return type != NULL && type->type == ACIR_VALUE_TYPE_BASIC
+    && (type->basic == ACIR_BASIC_VALUE_TYPE_FLOAT32 || type->basic == ACIR_BASIC_VALUE_TYPE_FLOAT64);
+}
+
+/** Whether `(x OP a) OP b` is `x OP (a OP b)` for TYPE. Floating point rounding breaks it. */
+static bool IsAssociative_(AcirOpcode opcode, const AcirValueType *type) {
+  switch(opcode) {
+    case ACIR_OPCODE_ADD: case ACIR_OPCODE_MUL: return !IsFloat_(type);
+    case ACIR_OPCODE_AND: case ACIR_OPCODE_COR: case ACIR_OPCODE_XOR:
+    case ACIR_OPCODE_BIT_AND: case ACIR_OPCODE_BIT_COR: case ACIR_OPCODE_BIT_XOR: return true;
+    default: return false;
+  }
+}
+
+/** Instruction defining the binding OP refers to, if the fold has seen it. */
+static const AcirInstr *FoldDef_(const AcirOptimizer *self, const AcirOperand *op) {
+  if(op->type != ACIR_OPERAND_TYPE_BINDING || op->idx >= self->bindingCount) return NULL;
+  size_t def = self->bindings[op->idx].def;
+  return def == ACIR_INSTR_NULL_INDEX ? NULL : &self->builder->instrs[def];
+}
+
+static void FoldToCopy_(AcirOptimizer *self, AcirInstr *instr, AcirOperand value) {
+  if(value.type == ACIR_OPERAND_TYPE_IMMEDIATE) {
+    AcirOptimizer_Binding *binding = BindingGetOrCreate_(self, instr->out.idx);
+    binding->flags |= ACIR_OPTIMIZER_BINDING_FLAG_CONSTANT;
+    binding->constant = value.imm;
+    instr->type = value.imm.type;
+  }
+  instr->opcode = ACIR_OPCODE_SET;
+  instr->val = value;
+}
+
+/** Apply one rewrite to INSTR. Returns whether it changed, so the caller can try again. */
+static bool FoldInstr_(AcirOptimizer *self, AcirInstr *instr) {
+  if(!AcirOpcode_ConstEval(instr->opcode) || instr->opcode == ACIR_OPCODE_SET) return false;
+  if(instr->out.type != ACIR_OPERAND_TYPE_BINDING) return false;
+
+  // the identities and strength reductions are peephole rules.
+  if(AcirInstr_Peephole(instr)) {
+    if(instr->opcode == ACIR_OPCODE_SET) FoldToCopy_(self, instr, instr->val);
+    return true;
+  }
+
+  // double negation: `not`, `neg` and `bitnot` undo themselves.
+  if(AcirOpcode_OperandCount(instr->opcode) == 2) {
+    const AcirInstr *def = FoldDef_(self, &instr->val);
+    if(def == NULL || def->opcode != instr->opcode) return false;
+    FoldToCopy_(self, instr, def->val);
+    return true;
+  }
+
+  // `(x OP a) OP b` becomes `x OP (a OP b)`, the inner instruction is left to dead code removal.
+  AcirOperand *lhs = &instr->lhs, *rhs = &instr->rhs;
+  const AcirInstr *def = FoldDef_(self, lhs);
+  if(rhs->type == ACIR_OPERAND_TYPE_IMMEDIATE && def != NULL && def->opcode == instr->opcode
+    && def->rhs.type == ACIR_OPERAND_TYPE_IMMEDIATE && IsAssociative_(instr->opcode, instr->type)) {
+    AcirImmediateValue result;
+    AcirInstr_ConstEval(instr, &result, &def->rhs.imm, &rhs->imm);
+    *lhs = def->lhs;
+    rhs->imm = result;
+    return true;
+  }
+  return false;
+}
+
 void AcirOptimizer_ConstantFold(AcirOptimizer *self) {
   assert(self != NULL);
+  assert(self->didAnalyze);
+
+  for(size_t i = 0; i < self->bindingCount; ++i) self->bindings[i].def = ACIR_INSTR_NULL_INDEX;
+
+  AcirFunction *function = self->builder->target;
+  for(size_t i = function->code; i != ACIR_INSTR_NULL_INDEX; i = self->builder->instrs[i].next) {
+    AcirInstr *instr = &self->builder->instrs[i];
+
+    // constants found by earlier rewrites reach the instructions after them.
+    const AcirOperand *ops[3];
+    int operandCount = GetOperands_(instr, ops);
+    for(int j = 0; j < operandCount - (operandCount > 1); ++j) {
+      AcirOperand *op = (AcirOperand*)ops[j];
+      if(op->type != ACIR_OPERAND_TYPE_BINDING || op->idx >= self->bindingCount) continue;
+      if(instr->opcode == ACIR_OPCODE_REF || instr->opcode == ACIR_OPCODE_PHI) continue;
+      if(self->bindings[op->idx].flags & ACIR_OPTIMIZER_BINDING_FLAG_CONSTANT)
+        *op = (AcirOperand){ ACIR_OPERAND_TYPE_IMMEDIATE, .imm = self->bindings[op->idx].constant };
+    }
+
+    // every rewrite makes the instruction simpler or moves a constant right, so this ends.
+    for(int rounds = 0; rounds < 8 && FoldInstr_(self, instr); ++rounds);
+
+    if(operandCount > 1 && instr->out.type == ACIR_OPERAND_TYPE_BINDING)
+      BindingGetOrCreate_(self, instr->out.idx)->def = i;
+  }
+}
+
+// Only pure instructions can go: everything else (`ret`, `eff`, `ref`, `der` and control flow)
+// is a root, and a binding is live if a root or a live pure instruction reads it.
+static bool IsRemovable_(const AcirInstr *instr) {
+  if(!AcirOpcode_ConstEval(instr->opcode) && instr->opcode != ACIR_OPCODE_PHI) return false;
+  return instr->out.type == ACIR_OPERAND_TYPE_BINDING;
+}
+
+static void MarkLive_(uint64_t *live, uint32_t *work, uint32_t *workTop, size_t binding) {
+  uint64_t bit = (uint64_t)1 << (binding % 64);
+  if(live[binding / 64] & bit) return;
+  live[binding / 64] |= bit;
+  work[(*workTop)++] = binding;
+}
+
+static void MarkOperands_(AcirInstr *instr, uint64_t *live, uint32_t *work, uint32_t *workTop) {
+  for(int slot = ACIR_PACKED_SLOT_VAL; slot < ACIR_PACKED_SLOT_OUT; ++slot) {
+    const AcirOperand *op = AcirInstr_Operand(instr, slot);
+    if(op != NULL && op->type == ACIR_OPERAND_TYPE_BINDING) MarkLive_(live, work, workTop, op->idx);
+  }
 }
 
 void AcirOptimizer_DeadCode(AcirOptimizer *self) {
   assert(self != NULL);
-  AcirInstr *instr = &self->builder->instrs[self->lastInstr];
-  assert(instr->opcode == ACIR_OPCODE_RET);
-  assert(instr->next == ACIR_INSTR_NULL_INDEX);
+  AcirBuilder *builder = self->builder;
+  AcirFunction *function = builder->target;
+  if(function->code == ACIR_INSTR_NULL_INDEX) return;
 
-  while(true) {
-    bool shouldRemove = false;
+  AcirDefUse defUse;
+  AcirDefUse_Build(&defUse, builder, self->allocator);
+  size_t bindingCount = defUse.bindingCapacity;
+  uint64_t *live = AnchAllocator_AllocZero(self->allocator, sizeof(uint64_t) * (bindingCount / 64 + 1));
+  uint32_t *work = AnchAllocator_Alloc(self->allocator, sizeof(uint32_t) * (bindingCount + 1));
+  uint32_t workTop = 0;
 
-    int operandCount = AcirOpcode_OperandCount(instr->opcode);
-    if(!AcirOpcode_ConstEval(instr->opcode)) {
-      const AcirOperand *ops[3];
-      GetOperands_(instr, ops);
-      int maxOperandIndex = operandCount == 1 ? 1 : operandCount - 1;
-      for(int i = 0; i < maxOperandIndex; ++i) {
-        if(ops[i]->type == ACIR_OPERAND_TYPE_BINDING) {
-          assert(ops[i]->idx < self->bindingCount);
-          self->bindings[ops[i]->idx].used = true;
-        }
-      }
-    } else {
-      if(operandCount > 1 && instr->out.type == ACIR_OPERAND_TYPE_BINDING) {
-        assert(instr->out.idx < self->bindingCount);
-        bool used = self->bindings[instr->out.idx].used;
-        if(!used) shouldRemove = true;
-        else {
-          const AcirOperand *ops[3];
-          GetOperands_(instr, ops);
-          for(int i = 0; i < operandCount - 1; ++i) {
-            if(ops[i]->type == ACIR_OPERAND_TYPE_BINDING) {
-              assert(ops[i]->idx < self->bindingCount);
-              self->bindings[ops[i]->idx].used = true;
-            }
-          }
-        }
-      }
-    }
+  for(size_t i = function->code; i != ACIR_INSTR_NULL_INDEX; i = builder->instrs[i].next)
+    if(!IsRemovable_(&builder->instrs[i])) MarkOperands_(&builder->instrs[i], live, work, &workTop);
 
-    if(shouldRemove) {
-      if(self->instrs[instr->index].prev == ACIR_INSTR_NULL_INDEX) {
-        self->builder->target->code = instr->next;
-      } else {
-        self->builder->instrs[self->instrs[instr->index].prev].next = instr->next;
-      }
-    }
-    
-    if(self->instrs[instr->index].prev == ACIR_INSTR_NULL_INDEX) break;
-    instr = &self->builder->instrs[self->instrs[instr->index].prev];
+  // every binding is pushed once, when it becomes live, so this is linear in the code.
+  while(workTop > 0) {
+    uint32_t def = AcirDefUse_Def(&defUse, work[--workTop]);
+    if(def == ACIR_DEFUSE_NULL_INDEX) continue;
+    AcirInstr *instr = &builder->instrs[def];
+    if(IsRemovable_(instr)) MarkOperands_(instr, live, work, &workTop);
+  }
+
+  size_t last = ACIR_INSTR_NULL_INDEX, entry = function->code;
+  for(size_t i = function->code; i != ACIR_INSTR_NULL_INDEX; i = builder->instrs[i].next) {
+    const AcirInstr *instr = &builder->instrs[i];
+    if(IsRemovable_(instr) && (instr->out.idx >= bindingCount || !(live[instr->out.idx / 64] & ((uint64_t)1 << (instr->out.idx % 64)))))
+      continue;
+    if(last == ACIR_INSTR_NULL_INDEX) function->code = i;
+    else builder->instrs[last].next = i;
+    if(i < self->instrCount) self->instrs[i].prev = last;
+    last = i;
+  }
+  // a terminator always survives, so something is left.
+  assert(last != ACIR_INSTR_NULL_INDEX);
+  builder->instrs[last].next = ACIR_INSTR_NULL_INDEX;
+  self->lastInstr = last;
+
+  // an emptied entry block still has to be there: it is the edge into the first labeled block,
+  // which a `phi` there counts among its predecessors.
+  if(function->code != entry && builder->instrs[function->code].opcode == ACIR_OPCODE_LBL) {
+    size_t first = function->code;
+    const AcirValueType *voidType = AcirValueType_Basic(ACIR_BASIC_VALUE_TYPE_VOID);
+    AcirInstr *jmp = AcirBuilder_Append(builder, &(AcirInstr){
+      .next = ACIR_INSTR_NULL_INDEX, .opcode = ACIR_OPCODE_JMP, .type = voidType, .val = builder->instrs[first].val,
+    }, 1);
+    jmp->next = first;
+    function->code = jmp->index;
+    if(first < self->instrCount) self->instrs[first].prev = jmp->index;
   }
+
+  AnchAllocator_Free(self->allocator, live);
+  AnchAllocator_Free(self->allocator, work);
+  AcirDefUse_Free(&defUse);
 }
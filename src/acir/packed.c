@@ -0,0 +1,154 @@
+#include <acir/acir.h>
+#include <annec_anchor.h>
+#include <assert.h>
+#include "../cli.h"
+
+typedef struct {
+  AcirPackedFunction *target;
+  uint32_t capacity; // of the immediate hash table, power of two.
+  uint32_t *slots; // immediate pool indices, UINT32_MAX if empty.
+} AcirPacker_;
+
+static uint32_t AcirPacker_Type_(AcirPacker_ *self, const AcirValueType *type) {
+  AcirPackedFunction *target = self->target;
+  // types are interned and functions use a handful of them, a linear search is fine.
+  for(uint32_t i = 0; i < target->typeCount; ++i) {
+    if(target->typePool[i] == type) return i;
+  }
+  size_t size = sizeof(const AcirValueType*) * (target->typeCount + 1);
+  target->typePool = target->typeCount == 0
+    ? AnchAllocator_Alloc(target->allocator, size)
+    : AnchAllocator_Realloc(target->allocator, target->typePool, size);
+  target->typePool[target->typeCount] = type;
+  return target->typeCount++;
+}
+
+static AcirPackedRef AcirPacker_Operand_(AcirPacker_ *self, const AcirOperand *op) {
+  if(op->type == ACIR_OPERAND_TYPE_BINDING) {
+    assert(op->idx < ACIR_PACKED_REF_LABEL_BIT);
+    return op->idx;
+  }
+  if(op->type == ACIR_OPERAND_TYPE_LABEL) {
+    assert(op->idx < ACIR_PACKED_REF_FUNCTION_BIT);
+    return ACIR_PACKED_REF_LABEL_BIT | op->idx;
+  }
+  if(op->type == ACIR_OPERAND_TYPE_FUNCTION) {
+    assert(op->idx < ACIR_PACKED_REF_FUNCTION_BIT);
+    return ACIR_PACKED_REF_LABEL_BIT | ACIR_PACKED_REF_FUNCTION_BIT | op->idx;
+  }
+  assert(op->type == ACIR_OPERAND_TYPE_IMMEDIATE);
+
+  AcirPackedFunction *target = self->target;
+  uint32_t typeIndex = AcirPacker_Type_(self, op->imm.type);
+  uint64_t bits = AcirImmediateValue_Bits(&op->imm);
+  uint32_t mask = self->capacity - 1;
+  for(uint32_t i = AcirHash_Mix(bits ^ ((uint64_t)typeIndex << 56)) & mask; ; i = (i + 1) & mask) {
+    uint32_t index = self->slots[i];
+    if(index == UINT32_MAX) {
+      self->slots[i] = index = target->immCount++;
+      target->imms[index] = op->imm;
+      target->imms[index].type = target->typePool[typeIndex];
+      return ACIR_PACKED_REF_IMMEDIATE_BIT | index;
+    }
+    const AcirImmediateValue *imm = &target->imms[index];
+    if(imm->type == target->typePool[typeIndex] && AcirImmediateValue_Bits(imm) == bits)
+      return ACIR_PACKED_REF_IMMEDIATE_BIT | index;
+  }
+}
+
+void AcirPackedFunction_Pack(AcirPackedFunction *self, const AcirFunction *source, AnchAllocator *allocator) {
+  assert(self != NULL);
+  assert(source != NULL);
+
+  size_t count = 0;
+  for(size_t i = source->code; i != ACIR_INSTR_NULL_INDEX; i = source->instrs[i].next) ++count;
+  assert(count < UINT32_MAX);
+
+  *self = (AcirPackedFunction){ .name = source->name, .instrCount = count, .allocator = allocator };
+  if(count == 0) return;
+
+  // one block for all columns, the 32-bit ones first to keep them aligned.
+  uint8_t *block = AnchAllocator_Alloc(allocator, (sizeof(uint32_t) * (1 + ACIR_PACKED_SLOT_MAX_) + 1) * count);
+  self->types = (uint32_t*)block;
+  for(int slot = 0; slot < ACIR_PACKED_SLOT_MAX_; ++slot)
+    self->operands[slot] = (AcirPackedRef*)block + count * (1 + slot);
+  self->opcodes = block + sizeof(uint32_t) * (1 + ACIR_PACKED_SLOT_MAX_) * count;
+
+  size_t maxImms = count * ACIR_PACKED_SLOT_MAX_;
+  self->imms = AnchAllocator_Alloc(allocator, sizeof(AcirImmediateValue) * maxImms);
+
+  AcirPacker_ packer = { .target = self, .capacity = 16 };
+  while(packer.capacity < maxImms * 2) packer.capacity *= 2;
+  packer.slots = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * packer.capacity);
+  memset(packer.slots, 0xFF, sizeof(uint32_t) * packer.capacity);
+
+  uint32_t index = 0;
+  for(size_t i = source->code; i != ACIR_INSTR_NULL_INDEX; i = source->instrs[i].next, ++index) {
+    const AcirInstr *instr = &source->instrs[i];
+    self->opcodes[index] = instr->opcode;
+    self->types[index] = AcirPacker_Type_(&packer, instr->type);
+
+    const AcirOperand *ops[ACIR_PACKED_SLOT_MAX_] = {0};
+    switch(AcirOpcode_OperandCount(instr->opcode)) {
+      case 1: ops[ACIR_PACKED_SLOT_VAL] = &instr->val; break;
+      case 3: ops[ACIR_PACKED_SLOT_RHS] = &instr->rhs; // fallthrough
+      case 2: ops[ACIR_PACKED_SLOT_VAL] = &instr->val; ops[ACIR_PACKED_SLOT_OUT] = &instr->out; break;
+      default: assert(false && "bad operand count");
+    }
+    for(int slot = 0; slot < ACIR_PACKED_SLOT_MAX_; ++slot)
+      self->operands[slot][index] = ops[slot] ? AcirPacker_Operand_(&packer, ops[slot]) : ACIR_PACKED_REF_NONE;
+  }
+
+  AnchAllocator_Free(allocator, packer.slots);
+  self->imms = AnchAllocator_Realloc(allocator, self->imms, sizeof(AcirImmediateValue) * (self->immCount ? self->immCount : 1));
+}
+
+void AcirPackedFunction_Free(AcirPackedFunction *self) {
+  assert(self != NULL);
+  if(self->instrCount > 0) {
+    AnchAllocator_Free(self->allocator, self->types);
+    AnchAllocator_Free(self->allocator, self->imms);
+  }
+  if(self->typeCount > 0)
+    AnchAllocator_Free(self->allocator, self->typePool);
+  *self = (AcirPackedFunction){0};
+}
+
+static AcirOperand AcirPackedFunction_UnpackOperand_(const AcirPackedFunction *self, AcirPackedRef ref) {
+  if(ref == ACIR_PACKED_REF_NONE) return (AcirOperand){0};
+  if(ACIR_PACKED_REF_IS_IMMEDIATE(ref))
+    return (AcirOperand){ ACIR_OPERAND_TYPE_IMMEDIATE, .imm = *AcirPackedFunction_Imm(self, ref) };
+  if(ACIR_PACKED_REF_IS_LABEL(ref))
+    return (AcirOperand){ ACIR_OPERAND_TYPE_LABEL, .idx = ACIR_PACKED_REF_INDEX(ref) };
+  if(ACIR_PACKED_REF_IS_FUNCTION(ref))
+    return (AcirOperand){ ACIR_OPERAND_TYPE_FUNCTION, .idx = ACIR_PACKED_REF_INDEX(ref) };
+  return (AcirOperand){ ACIR_OPERAND_TYPE_BINDING, .idx = ref };
+}
+
+void AcirPackedFunction_Unpack(const AcirPackedFunction *self, AcirBuilder *target) {
+  assert(self != NULL);
+  assert(target != NULL);
+
+  AcirBuilder_Reserve(target, self->instrCount);
+  for(uint32_t i = 0; i < self->instrCount; ++i) {
+    AcirInstr *instr = AcirBuilder_Add(target, i);
+    instr->index = i;
+    instr->opcode = self->opcodes[i];
+    instr->type = self->typePool[self->types[i]];
+    instr->next = i + 1 < self->instrCount ? i + 1 : ACIR_INSTR_NULL_INDEX;
+    instr->out = AcirPackedFunction_UnpackOperand_(self, self->operands[ACIR_PACKED_SLOT_OUT][i]);
+    if(self->operands[ACIR_PACKED_SLOT_RHS][i] != ACIR_PACKED_REF_NONE) {
+      instr->lhs = AcirPackedFunction_UnpackOperand_(self, self->operands[ACIR_PACKED_SLOT_VAL][i]);
+      instr->rhs = AcirPackedFunction_UnpackOperand_(self, self->operands[ACIR_PACKED_SLOT_RHS][i]);
+    } else {
+      instr->val = AcirPackedFunction_UnpackOperand_(self, self->operands[ACIR_PACKED_SLOT_VAL][i]);
+    }
+  }
+}
+
+size_t AcirPackedFunction_ByteSize(const AcirPackedFunction *self) {
+  assert(self != NULL);
+  return (sizeof(uint32_t) * (1 + ACIR_PACKED_SLOT_MAX_) + sizeof(AcirOpcode)) * self->instrCount
+    + sizeof(AcirImmediateValue) * self->immCount
+    + sizeof(const AcirValueType*) * self->typeCount;
+}
@@ -0,0 +1,497 @@
+#include <acir/acir.h>
+#include <annec_anchor.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include "../cli.h"
+
+#define ACIR_PARSER_EOF_ (-1)
+#define ACIR_PARSER_MAX_PARAMETERS_ 64
+#define ACIR_PARSER_MAX_NAME_ 255
+
+static uint64_t AcirParser_Key_(const uint8_t *bytes, size_t length) {
+  if(length == 0 || length > 8) return 0;
+  uint64_t key = 0;
+  memcpy(&key, bytes, length);
+  return key;
+}
+
+void AcirParser_Init(AcirParser *self, AcirTypeTable *types, AnchCharWriteStream *diagnostics, const char *filename) {
+  assert(self != NULL);
+  assert(types != NULL);
+  *self = (AcirParser){ .types = types, .diagnostics = diagnostics, .filename = filename ? filename : "<input>" };
+  for(AcirOpcode i = 0; i < ACIR_OPCODE_MAX_; ++i) {
+    const char *mnemonic = AcirOpcode_Mnemonic(i);
+    self->opcodeKeys[i] = AcirParser_Key_((const uint8_t*)mnemonic, strlen(mnemonic));
+  }
+  for(AcirBasicValueType i = 0; i < ACIR_BASIC_VALUE_TYPE_MAX_; ++i) {
+    const char *mnemonic = AcirBasicValueType_Mnemonic(i);
+    self->typeKeys[i] = AcirParser_Key_((const uint8_t*)mnemonic, strlen(mnemonic));
+  }
+}
+
+/** Report an error at the cursor. Always returns false, to be returned by the caller. */
+static bool AcirParser_Error_(AcirParser *self, const char *format, ...) {
+  self->errorCount += 1;
+  if(self->diagnostics == NULL) return false;
+
+  va_list va;
+  va_start(va, format);
+  AnchWriteFormat(self->diagnostics, "%s:%zu:%zu: " ANSI_BRED "error: " ANSI_RESET,
+    self->filename, self->line, (size_t)(self->cursor - self->lineStart) + 1);
+  AnchWriteFormatV(self->diagnostics, format, va);
+  AnchWriteString(self->diagnostics, "\n");
+  va_end(va);
+  return false;
+}
+
+/** Skip blanks, ANSI escapes and comments, up to the end of the line. Returns the next byte, '\n' or EOF. */
+static int AcirParser_Skip_(AcirParser *self) {
+  const uint8_t *p = self->cursor, *end = self->end;
+  while(p < end) {
+    if(*p == ' ' || *p == '\t' || *p == '\r') {
+      ++p;
+    } else if(*p == 0x1B && p + 1 < end && p[1] == '[') {
+      // CSI sequence: parameters, then a final byte in 0x40...0x7E.
+      p += 2;
+      while(p < end && !(*p >= 0x40 && *p <= 0x7E)) ++p;
+      if(p < end) ++p;
+    } else if(*p == '/' && p + 1 < end && p[1] == '/') {
+      while(p < end && *p != '\n') ++p;
+    } else {
+      break;
+    }
+  }
+  self->cursor = p;
+  return p < end ? *p : ACIR_PARSER_EOF_;
+}
+
+static bool AcirParser_Expect_(AcirParser *self, char c) {
+  if(AcirParser_Skip_(self) != c) return AcirParser_Error_(self, "expected `%c`.", c);
+  ++self->cursor;
+  return true;
+}
+
+static void AcirParser_SkipLine_(AcirParser *self) {
+  const uint8_t *newline = memchr(self->cursor, '\n', self->end - self->cursor);
+  self->cursor = newline ? newline : self->end;
+}
+
+static bool AcirParser_NextLine_(AcirParser *self) {
+  if(self->cursor >= self->end) return false;
+  assert(*self->cursor == '\n');
+  ++self->cursor;
+  self->lineStart = self->cursor;
+  self->line += 1;
+  return self->cursor < self->end;
+}
+
+static bool AcirParser_IsIdent_(uint8_t c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+/** Identifier at the cursor, its length through LENGTH. Doesn't skip blanks first. */
+static const uint8_t *AcirParser_Ident_(AcirParser *self, size_t *length) {
+  const uint8_t *start = self->cursor;
+  while(self->cursor < self->end && AcirParser_IsIdent_(*self->cursor)) ++self->cursor;
+  *length = self->cursor - start;
+  return start;
+}
+
+static bool AcirParser_Unsigned_(AcirParser *self, uint64_t *out) {
+  AcirParser_Skip_(self);
+  const uint8_t *p = self->cursor;
+  if(p >= self->end || *p < '0' || *p > '9') return AcirParser_Error_(self, "expected a number.");
+  uint64_t value = 0;
+  for(; p < self->end && *p >= '0' && *p <= '9'; ++p) {
+    if(value > (UINT64_MAX - (*p - '0')) / 10) return AcirParser_Error_(self, "number is too big.");
+    value = value * 10 + (*p - '0');
+  }
+  self->cursor = p;
+  *out = value;
+  return true;
+}
+
+static bool AcirParser_Type_(AcirParser *self, const AcirValueType **out);
+
+/** `fn(TYPE, ...) TYPE`, the cursor is after the `fn`. */
+static bool AcirParser_FunctionType_(AcirParser *self, const AcirValueType **out) {
+  const AcirValueType *parameters[ACIR_PARSER_MAX_PARAMETERS_];
+  size_t count = 0;
+  if(!AcirParser_Expect_(self, '(')) return false;
+  while(AcirParser_Skip_(self) != ')') {
+    if(count > 0 && !AcirParser_Expect_(self, ',')) return false;
+    if(count == ACIR_PARSER_MAX_PARAMETERS_) return AcirParser_Error_(self, "too many parameters.");
+    if(!AcirParser_Type_(self, &parameters[count++])) return false;
+  }
+  ++self->cursor;
+
+  const AcirValueType *returnType;
+  if(!AcirParser_Type_(self, &returnType)) return false;
+  *out = AcirTypeTable_Function(self->types, returnType, count, parameters);
+  return true;
+}
+
+static bool AcirParser_Type_(AcirParser *self, const AcirValueType **out) {
+  AcirParser_Skip_(self);
+  size_t pointers = 0;
+  while(self->cursor < self->end && *self->cursor == '*') {
+    ++pointers;
+    ++self->cursor;
+    AcirParser_Skip_(self);
+  }
+
+  size_t length;
+  const uint8_t *start = AcirParser_Ident_(self, &length);
+  uint64_t key = AcirParser_Key_(start, length);
+  const AcirValueType *type = NULL;
+  if(length == 2 && memcmp(start, "fn", 2) == 0) {
+    if(!AcirParser_FunctionType_(self, &type)) return false;
+  } else for(AcirBasicValueType i = 0; i < ACIR_BASIC_VALUE_TYPE_MAX_; ++i) {
+    if(self->typeKeys[i] == key) { type = AcirValueType_Basic(i); break; }
+  }
+  if(type == NULL || key == 0) {
+    self->cursor = start;
+    return AcirParser_Error_(self, "unknown type `%.*s`.", (int)length, start);
+  }
+
+  while(pointers-- > 0) type = AcirTypeTable_Pointer(self->types, type);
+  *out = type;
+  return true;
+}
+
+/** Payload of an immediate of TYPE, after the `#`. */
+static bool AcirParser_ImmediateValue_(AcirParser *self, AcirImmediateValue *imm) {
+  AcirParser_Skip_(self);
+  const uint8_t *start = self->cursor;
+  size_t length = 0;
+  while(start + length < self->end && (AcirParser_IsIdent_(start[length])
+    || start[length] == '-' || start[length] == '+' || start[length] == '.')) ++length;
+  self->cursor = start + length;
+
+  if(imm->type->type != ACIR_VALUE_TYPE_BASIC) {
+    self->cursor = start;
+    return AcirParser_Error_(self, "immediates must have a basic type.");
+  }
+
+  AcirBasicValueType basic = imm->type->basic;
+  if(basic == ACIR_BASIC_VALUE_TYPE_BOOL) {
+    if(length == 4 && memcmp(start, "true", 4) == 0) imm->boolean = true;
+    else if(length == 5 && memcmp(start, "false", 5) == 0) imm->boolean = false;
+    else { self->cursor = start; return AcirParser_Error_(self, "expected `true` or `false`."); }
+    return true;
+  }
+  if(basic == ACIR_BASIC_VALUE_TYPE_VOID) {
+    if(length != 4 || memcmp(start, "void", 4) != 0) { self->cursor = start; return AcirParser_Error_(self, "expected `void`."); }
+    imm->uint64 = 0;
+    return true;
+  }
+
+  // strtod and strtoull need a terminated string, literals are short.
+  char buffer[64];
+  if(length == 0 || length >= sizeof(buffer)) {
+    self->cursor = start;
+    return AcirParser_Error_(self, "expected a number.");
+  }
+  memcpy(buffer, start, length);
+  buffer[length] = '\0';
+  char *rest;
+  if(basic == ACIR_BASIC_VALUE_TYPE_FLOAT32 || basic == ACIR_BASIC_VALUE_TYPE_FLOAT64) {
+    double value = strtod(buffer, &rest);
+    if(basic == ACIR_BASIC_VALUE_TYPE_FLOAT32) imm->float32 = value; else imm->float64 = value;
+    if(*rest != '\0') {
+      self->cursor = start + (rest - buffer);
+      return AcirParser_Error_(self, "malformed number.");
+    }
+    return true;
+  }
+
+  // one `-` at most, strtoull would take a second sign after the one skipped here.
+  bool negative = buffer[0] == '-';
+  if(buffer[negative] < '0' || buffer[negative] > '9') {
+    self->cursor = start + negative;
+    return AcirParser_Error_(self, "expected a number.");
+  }
+  errno = 0;
+  uint64_t value = strtoull(buffer + negative, &rest, 10);
+  if(*rest != '\0') {
+    self->cursor = start + (rest - buffer);
+    return AcirParser_Error_(self, "malformed number.");
+  }
+
+  // the value has to fit the type, negative ones only signed types.
+  int width = 64;
+  bool isSigned = basic == ACIR_BASIC_VALUE_TYPE_SINT64;
+  switch(basic) {
+    case ACIR_BASIC_VALUE_TYPE_SINT32: isSigned = true; // fallthrough
+    case ACIR_BASIC_VALUE_TYPE_UINT32: width = 32; break;
+    case ACIR_BASIC_VALUE_TYPE_SINT16: isSigned = true; // fallthrough
+    case ACIR_BASIC_VALUE_TYPE_UINT16: width = 16; break;
+    case ACIR_BASIC_VALUE_TYPE_SINT8: isSigned = true; // fallthrough
+    case ACIR_BASIC_VALUE_TYPE_UINT8: width = 8; break;
+    default: break;
+  }
+  uint64_t limit = isSigned ? ((uint64_t)1 << (width - 1)) - !negative
+    : negative ? 0 : width == 64 ? UINT64_MAX : ((uint64_t)1 << width) - 1;
+  if(errno == ERANGE || value > limit) {
+    self->cursor = start;
+    return AcirParser_Error_(self, "`%.*s` doesn't fit `%s`.", (int)length, start, AcirBasicValueType_Mnemonic(basic));
+  }
+  if(negative) value = -value;
+  switch(width) {
+    case 32: imm->uint32 = value; break;
+    case 16: imm->uint16 = value; break;
+    case 8: imm->uint8 = value; break;
+    default: imm->uint64 = value; break;
+  }
+  return true;
+}
+
+static bool AcirParser_Operand_(AcirParser *self, AcirOperand *out) {
+  int c = AcirParser_Skip_(self);
+  if(c == '$' || c == '@' || c == '&') {
+    ++self->cursor;
+    uint64_t index;
+    if(!AcirParser_Unsigned_(self, &index)) return false;
+    AcirOperandType type = c == '$' ? ACIR_OPERAND_TYPE_BINDING : c == '@' ? ACIR_OPERAND_TYPE_LABEL : ACIR_OPERAND_TYPE_FUNCTION;
+    *out = (AcirOperand){ type, .idx = index };
+    return true;
+  }
+
+  *out = (AcirOperand){ ACIR_OPERAND_TYPE_IMMEDIATE };
+  if(!AcirParser_Type_(self, &out->imm.type)) return false;
+  if(!AcirParser_Expect_(self, '#')) return false;
+  return AcirParser_ImmediateValue_(self, &out->imm);
+}
+
+typedef struct {
+  AcirBuilder *target;
+  size_t nextIndex; // for instructions without an explicit index.
+  size_t instrCount; // parsed so far.
+  size_t lastIndex; // ACIR_INSTR_NULL_INDEX before the first instruction.
+  bool lastImplicitNext;
+} AcirParserFunction_;
+
+/** One instruction line, the cursor is at its first token. */
+static bool AcirParser_Instr_(AcirParser *self, AcirParserFunction_ *function) {
+  size_t index = function->nextIndex;
+  if(*self->cursor >= '0' && *self->cursor <= '9') {
+    uint64_t value;
+    if(!AcirParser_Unsigned_(self, &value)) return false;
+    // every instruction takes a line, so the ones parsed so far and the lines left bound the index;
+    // the builder is sized by it.
+    if(value > function->instrCount + (self->lineCount - self->line))
+      return AcirParser_Error_(self, "instruction index %zu is too big for the function.", (size_t)value);
+    index = value;
+    if(!AcirParser_Expect_(self, '|')) return false;
+    AcirParser_Skip_(self);
+  }
+
+  AcirInstr instr = { .index = index, .next = index + 1 };
+  if(self->cursor < self->end && *self->cursor == '$') {
+    // `$OUT.TYPE = VALUE`
+    instr.opcode = ACIR_OPCODE_SET;
+    if(!AcirParser_Operand_(self, &instr.out)) return false;
+    if(!AcirParser_Expect_(self, '.')) return false;
+    if(!AcirParser_Type_(self, &instr.type)) return false;
+    if(!AcirParser_Expect_(self, '=')) return false;
+    if(!AcirParser_Operand_(self, &instr.val)) return false;
+  } else {
+    size_t length;
+    const uint8_t *start = AcirParser_Ident_(self, &length);
+    uint64_t key = AcirParser_Key_(start, length);
+    instr.opcode = ACIR_OPCODE_MAX_;
+    for(AcirOpcode i = 0; i < ACIR_OPCODE_MAX_; ++i) {
+      if(self->opcodeKeys[i] == key) { instr.opcode = i; break; }
+    }
+    if(instr.opcode == ACIR_OPCODE_MAX_ || key == 0) {
+      self->cursor = start;
+      return AcirParser_Error_(self, "unknown instruction `%.*s`.", (int)length, start);
+    }
+    if(!AcirParser_Expect_(self, '.')) return false;
+    if(!AcirParser_Type_(self, &instr.type)) return false;
+
+    AcirOperand ops[3];
+    int count = AcirOpcode_OperandCount(instr.opcode);
+    for(int i = 0; i < count; ++i) {
+      if(i > 0 && !AcirParser_Expect_(self, ',')) return false;
+      if(!AcirParser_Operand_(self, &ops[i])) return false;
+    }
+    switch(count) {
+      case 1: instr.val = ops[0]; break;
+      case 2: instr.val = ops[0]; instr.out = ops[1]; break;
+      case 3: instr.lhs = ops[0]; instr.rhs = ops[1]; instr.out = ops[2]; break;
+    }
+  }
+
+  bool implicitNext = true;
+  if(AcirParser_Skip_(self) == '-') {
+    if(!AcirParser_Expect_(self, '-') || !AcirParser_Expect_(self, '>')) return false;
+    implicitNext = false;
+    if(AcirParser_Skip_(self) == 'e') {
+      size_t length;
+      const uint8_t *start = AcirParser_Ident_(self, &length);
+      if(length != 3 || memcmp(start, "end", 3) != 0) {
+        self->cursor = start;
+        return AcirParser_Error_(self, "expected `end` or an instruction index.");
+      }
+      instr.next = ACIR_INSTR_NULL_INDEX;
+    } else {
+      uint64_t next;
+      if(!AcirParser_Unsigned_(self, &next)) return false;
+      instr.next = next;
+    }
+  }
+
+  int c = AcirParser_Skip_(self);
+  if(c != '\n' && c != ACIR_PARSER_EOF_) return AcirParser_Error_(self, "expected the end of the line.");
+
+  AcirBuilder *target = function->target;
+  if(index < target->target->instrCount && target->instrs[index].type != NULL)
+    return AcirParser_Error_(self, "instruction %zu is defined twice.", index);
+  *AcirBuilder_Add(target, index) = instr;
+  function->lastIndex = index;
+  function->lastImplicitNext = implicitNext;
+  function->nextIndex = index + 1;
+  function->instrCount += 1;
+  return true;
+}
+
+/** Close the function being parsed: end it, and check that it has no holes or dangling links. */
+static void AcirParser_FinishFunction_(AcirParser *self, AcirParserFunction_ *function) {
+  AcirBuilder *target = function->target;
+  if(function->lastIndex == ACIR_INSTR_NULL_INDEX) return;
+  if(function->lastImplicitNext) target->instrs[function->lastIndex].next = ACIR_INSTR_NULL_INDEX;
+
+  const AcirFunction *result = target->target;
+  for(size_t i = 0; i < result->instrCount; ++i) {
+    const AcirInstr *instr = &target->instrs[i];
+    if(instr->type == NULL)
+      AcirParser_Error_(self, "instruction %zu is missing.", i);
+    else if(instr->next != ACIR_INSTR_NULL_INDEX && instr->next >= result->instrCount)
+      AcirParser_Error_(self, "instruction %zu continues at %zu, which doesn't exist.", i, instr->next);
+  }
+}
+
+static void AcirParser_Begin_(AcirParser *self, const char *text, size_t size) {
+  assert(text != NULL || size == 0);
+  self->cursor = self->lineStart = (const uint8_t*)text;
+  self->end = self->cursor + size;
+  self->line = 1;
+  self->lineCount = 1;
+  for(const uint8_t *p = self->cursor; p < self->end && (p = memchr(p, '\n', self->end - p)) != NULL; ++p) self->lineCount += 1;
+}
+
+int AcirParser_ParseFunction(AcirParser *self, const char *text, size_t size, AcirBuilder *target) {
+  assert(self != NULL);
+  assert(target != NULL);
+  assert(target->target->instrCount == 0);
+
+  int errorCount = self->errorCount;
+  AcirParser_Begin_(self, text, size);
+  AcirParserFunction_ function = { .target = target, .lastIndex = ACIR_INSTR_NULL_INDEX };
+  do {
+    int c = AcirParser_Skip_(self);
+    if(c == '\n' || c == ACIR_PARSER_EOF_) continue;
+    if(!AcirParser_Instr_(self, &function)) AcirParser_SkipLine_(self);
+  } while(AcirParser_NextLine_(self));
+  AcirParser_FinishFunction_(self, &function);
+  return self->errorCount - errorCount;
+}
+
+int AcirParser_ParseModule(AcirParser *self, const char *text, size_t size, AcirModule *module) {
+  assert(self != NULL);
+  assert(module != NULL);
+  assert(&module->types == self->types);
+
+  int errorCount = self->errorCount;
+  AcirParser_Begin_(self, text, size);
+  AcirParserFunction_ function = { .lastIndex = ACIR_INSTR_NULL_INDEX };
+  do {
+    int c = AcirParser_Skip_(self);
+    if(c == '\n' || c == ACIR_PARSER_EOF_) continue;
+
+    // `NAME:` starts a function, optionally followed by its `fn(...) T` type and `declared`.
+    const uint8_t *lineStart = self->cursor;
+    size_t length;
+    const uint8_t *name = AcirParser_Ident_(self, &length);
+    if(length > 0 && AcirParser_Skip_(self) == ':') {
+      ++self->cursor;
+      AcirParser_FinishFunction_(self, &function);
+      function = (AcirParserFunction_){ .lastIndex = ACIR_INSTR_NULL_INDEX };
+
+      const AcirValueType *type = NULL;
+      bool typed = true;
+      c = AcirParser_Skip_(self);
+      if(c != '\n' && c != ACIR_PARSER_EOF_ && !(self->end - self->cursor >= 8 && memcmp(self->cursor, "declared", 8) == 0)) {
+        const uint8_t *typeStart = self->cursor;
+        typed = AcirParser_Type_(self, &type);
+        if(typed && type->type != ACIR_VALUE_TYPE_FUNCTION) {
+          self->cursor = typeStart;
+          typed = AcirParser_Error_(self, "functions must have a `fn` type.");
+        }
+        if(!typed) type = NULL;
+      }
+
+      if(length > ACIR_PARSER_MAX_NAME_) {
+        self->cursor = name;
+        AcirParser_Error_(self, "function name is too long.");
+        AcirParser_SkipLine_(self);
+        continue;
+      }
+      char nameCopy[ACIR_PARSER_MAX_NAME_ + 1];
+      memcpy(nameCopy, name, length);
+      nameCopy[length] = '\0';
+      uint32_t index = AcirModule_AddFunction(module, nameCopy, type);
+      if(index == ACIR_MODULE_NULL_INDEX) {
+        self->cursor = name;
+        AcirParser_Error_(self, "function `%s` is defined twice.", nameCopy);
+        AcirParser_SkipLine_(self);
+        continue;
+      }
+      function.target = &AcirModule_Function(module, index)->builder;
+      if(!typed) {
+        AcirParser_SkipLine_(self);
+        continue;
+      }
+
+      if(AcirParser_Skip_(self) == 'd') {
+        const uint8_t *word = AcirParser_Ident_(self, &length);
+        if(length == 8 && memcmp(word, "declared", 8) == 0) function.target = NULL;
+        else self->cursor = word;
+      }
+      c = AcirParser_Skip_(self);
+      if(c != '\n' && c != ACIR_PARSER_EOF_) {
+        AcirParser_Error_(self, "expected the end of the line.");
+        AcirParser_SkipLine_(self);
+      }
+      continue;
+    }
+    self->cursor = lineStart;
+
+    // `N | const VALUE`, before the first function.
+    if(function.target == NULL) {
+      uint64_t index;
+      bool ok = AcirParser_Unsigned_(self, &index) && AcirParser_Expect_(self, '|');
+      if(ok) {
+        AcirParser_Skip_(self);
+        const uint8_t *word = AcirParser_Ident_(self, &length);
+        if(length != 5 || memcmp(word, "const", 5) != 0) {
+          self->cursor = word;
+          ok = AcirParser_Error_(self, "expected `const` or a function.");
+        }
+      }
+      AcirOperand op;
+      if(ok && (ok = AcirParser_Operand_(self, &op)) && op.type != ACIR_OPERAND_TYPE_IMMEDIATE)
+        ok = AcirParser_Error_(self, "constants must be immediates.");
+      if(ok && AcirModule_Constant(module, &op.imm) != index)
+          ok = AcirParser_Error_(self, "constant %zu is out of order or a duplicate.", (size_t)index);
+      if(!ok) AcirParser_SkipLine_(self);
+      continue;
+    }
+
+    if(!AcirParser_Instr_(self, &function)) AcirParser_SkipLine_(self);
+  } while(AcirParser_NextLine_(self));
+  AcirParser_FinishFunction_(self, &function);
+  return self->errorCount - errorCount;
+}
@@ -0,0 +1,222 @@
+#include <acir/acir.h>
+#include <annec_anchor.h>
+#include <assert.h>
+#include <time.h>
+#include "../cli.h"
+
+static double AcirPassManager_Seconds_(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static size_t AcirPassManager_CountInstrs_(const AcirFunction *function) {
+  size_t count = 0;
+  for(size_t i = function->code; i != ACIR_INSTR_NULL_INDEX; i = function->instrs[i].next) ++count;
+  return count;
+}
+
+static void AcirPassManager_Invalidate_(AcirPassManager *self, AcirAnalysisSet analyses) {
+  // analyses built on top of a dropped one go with it.
+  if(analyses & ACIR_ANALYSIS_CFG) analyses |= ACIR_ANALYSIS_DOMINATORS;
+  if(analyses & ACIR_ANALYSIS_DOMINATORS) analyses |= ACIR_ANALYSIS_LOOPS;
+  AcirAnalysisSet dropped = self->valid & analyses;
+  if(dropped & ACIR_ANALYSIS_LOOPS) AcirLoopForest_Free(&self->loops);
+  if(dropped & ACIR_ANALYSIS_DOMINATORS) AcirDomTree_Free(&self->dominators);
+  if(dropped & ACIR_ANALYSIS_CFG) AcirCfg_Free(&self->cfg);
+  if(dropped & ACIR_ANALYSIS_DEFUSE) AcirDefUse_Free(&self->defUse);
+  self->valid &= ~analyses;
+}
+
+static void AcirPassManager_Require_(AcirPassManager *self, AcirAnalysisSet analyses) {
+  if(analyses & ACIR_ANALYSIS_LOOPS) analyses |= ACIR_ANALYSIS_DOMINATORS;
+  if(analyses & ACIR_ANALYSIS_DOMINATORS) analyses |= ACIR_ANALYSIS_CFG;
+  AcirAnalysisSet missing = analyses & ~self->valid;
+  if(missing & ACIR_ANALYSIS_CFG) AcirCfg_Build(&self->cfg, self->builder->target, self->allocator);
+  if(missing & ACIR_ANALYSIS_DOMINATORS) AcirDomTree_Build(&self->dominators, &self->cfg, self->allocator);
+  if(missing & ACIR_ANALYSIS_LOOPS) AcirLoopForest_Build(&self->loops, &self->cfg, &self->dominators, self->allocator);
+  if(missing & ACIR_ANALYSIS_DEFUSE) AcirDefUse_Build(&self->defUse, self->builder, self->allocator);
+  self->valid |= missing;
+}
+
+void AcirPassManager_Init(AcirPassManager *self, AnchAllocator *allocator, int level) {
+  assert(self != NULL);
+  *self = (AcirPassManager){ .allocator = allocator, .level = level };
+}
+
+void AcirPassManager_Free(AcirPassManager *self) {
+  assert(self != NULL);
+  AcirPassManager_Invalidate_(self, ACIR_ANALYSIS_ALL);
+  if(self->passCapacity > 0) {
+    AnchAllocator_Free(self->allocator, self->passes);
+    AnchAllocator_Free(self->allocator, self->stats);
+  }
+  *self = (AcirPassManager){0};
+}
+
+uint32_t AcirPassManager_AddPass(AcirPassManager *self, const AcirPass *pass) {
+  assert(self != NULL);
+  assert(pass != NULL && pass->run != NULL);
+  if(self->passCount == self->passCapacity) {
+    uint32_t capacity = self->passCapacity ? self->passCapacity * 2 : 8;
+    AcirPass *passes = AnchAllocator_Alloc(self->allocator, sizeof(AcirPass) * capacity);
+    AcirPassStats *stats = AnchAllocator_Alloc(self->allocator, sizeof(AcirPassStats) * capacity);
+    if(self->passCapacity > 0) {
+      memcpy(passes, self->passes, sizeof(AcirPass) * self->passCount);
+      memcpy(stats, self->stats, sizeof(AcirPassStats) * self->passCount);
+      AnchAllocator_Free(self->allocator, self->passes);
+      AnchAllocator_Free(self->allocator, self->stats);
+    }
+    self->passes = passes;
+    self->stats = stats;
+    self->passCapacity = capacity;
+  }
+  self->passes[self->passCount] = *pass;
+  self->stats[self->passCount] = (AcirPassStats){0};
+  return self->passCount++;
+}
+
+// The optimizer works from a source function into a second builder, so it runs on a copy
+// and the result replaces the function.
+static void AcirPassManager_RunOptimizer_(AcirPassManager *manager, AcirBuilder *builder) {
+  AcirFunction result = { .type = builder->target->type, .name = builder->target->name };
+  AcirBuilder resultBuilder;
+  AcirBuilder_Init(&resultBuilder, &result, manager->allocator);
+
+  AcirOptimizer optimizer;
+  AcirOptimizer_Init(&optimizer, &(const AcirOptimizer_InitInfo){
+    .allocator = manager->allocator,
+    .source = builder->target,
+    .builder = &resultBuilder,
+  });
+  AcirOptimizer_Analyze(&optimizer);
+  AcirOptimizer_ConstantFold(&optimizer);
+  AcirOptimizer_DeadCode(&optimizer);
+  AcirOptimizer_Free(&optimizer);
+
+  AcirBuilder_Clear(builder);
+  AcirBuilder_BuildNormalized(&resultBuilder, builder);
+  AcirBuilder_Free(&resultBuilder);
+}
+
+static const AcirPass AcirPassManager_DefaultPasses_[] = {
+  { "sccp", &AcirPass_Sccp, 1, ACIR_ANALYSIS_CFG | ACIR_ANALYSIS_DEFUSE, ACIR_ANALYSIS_CFG },
+  { "copyprop", &AcirPass_CopyProp, 1, ACIR_ANALYSIS_DEFUSE, ACIR_ANALYSIS_ALL },
+  { "gvn", &AcirPass_Gvn, 2, ACIR_ANALYSIS_CFG | ACIR_ANALYSIS_DEFUSE, ACIR_ANALYSIS_CFG },
+  { "licm", &AcirPass_Licm, 2, ACIR_ANALYSIS_LOOPS | ACIR_ANALYSIS_DEFUSE, ACIR_ANALYSIS_CFG },
+  { "peephole", &AcirPass_Peephole, 1, ACIR_ANALYSIS_DEFUSE, ACIR_ANALYSIS_NONE },
+  { "optimizer", &AcirPassManager_RunOptimizer_, 1, ACIR_ANALYSIS_NONE, ACIR_ANALYSIS_ALL },
+  // folding leaves copies behind, so they go once more at the end.
+  { "copyprop", &AcirPass_CopyProp, 1, ACIR_ANALYSIS_DEFUSE, ACIR_ANALYSIS_ALL },
+};
+
+void AcirPassManager_AddDefaultPasses(AcirPassManager *self) {
+  assert(self != NULL);
+  size_t count = sizeof(AcirPassManager_DefaultPasses_) / sizeof(AcirPass);
+  for(size_t i = 0; i < count; ++i) AcirPassManager_AddPass(self, &AcirPassManager_DefaultPasses_[i]);
+}
+
+void AcirPassManager_Run(AcirPassManager *self, AcirBuilder *builder) {
+  assert(self != NULL);
+  assert(builder != NULL);
+  if(builder->target->code == ACIR_INSTR_NULL_INDEX) return;
+
+  self->builder = builder;
+  for(uint32_t i = 0; i < self->passCount; ++i) {
+    const AcirPass *pass = &self->passes[i];
+    if(pass->level > self->level) continue;
+    AcirPassManager_Require_(self, pass->requires);
+
+    size_t before = AcirPassManager_CountInstrs_(builder->target);
+    double start = AcirPassManager_Seconds_();
+    pass->run(self, builder);
+    double end = AcirPassManager_Seconds_();
+    size_t after = AcirPassManager_CountInstrs_(builder->target);
+
+    AcirPassStats *stats = &self->stats[i];
+    stats->runs += 1;
+    stats->seconds += end - start;
+    stats->instrDelta += (int64_t)after - (int64_t)before;
+    AcirPassManager_Invalidate_(self, pass->invalidates);
+  }
+  AcirPassManager_Invalidate_(self, ACIR_ANALYSIS_ALL);
+  self->builder = NULL;
+}
+
+void AcirPassManager_RunModule(AcirPassManager *self, AcirModule *module) {
+  assert(self != NULL);
+  assert(module != NULL);
+  // callees are optimized before they are copied into their callers.
+  AcirInliner inliner;
+  AcirInliner_Init(&inliner, module, self->allocator, ACIR_INLINER_DEFAULT_THRESHOLD);
+  AnchDynArray key;
+  if(self->memo != NULL) AnchDynArray_Init(&key, self->allocator, 4096);
+  for(uint32_t i = 0; i < module->functionCount; ++i) {
+    uint32_t index = inliner.order[i];
+    if(self->level >= 1) self->inlinedCalls += AcirInliner_Run(&inliner, index);
+    AcirModuleFunction *function = AcirModule_Function(module, index);
+    if(self->memo == NULL || function->function.code == ACIR_INSTR_NULL_INDEX) {
+      AcirPassManager_Run(self, &function->builder);
+      continue;
+    }
+
+    // the key is the code after inlining, and the passes it goes through.
+    AnchDynArray_Pop(&key, key.size);
+    for(uint32_t p = 0; p < self->passCount; ++p)
+      if(self->passes[p].level <= self->level) AcirMemo_KeyString(&key, self->passes[p].name);
+    AcirMemo_Key(&key, module, &function->function);
+    uint32_t keyCount = key.size / sizeof(uint64_t);
+    const AcirMemoEntry *entry = AcirMemo_Find(self->memo, (uint64_t*)key.data, keyCount);
+    if(entry != NULL && AcirMemo_Restore(entry, module, index, self->allocator) == ACIR_BINARY_OK) {
+      self->memo->hits += 1;
+      continue;
+    }
+    self->memo->misses += 1;
+    AcirPassManager_Run(self, &function->builder);
+    AcirMemo_Store(self->memo, (uint64_t*)key.data, keyCount, module, index);
+  }
+  if(self->memo != NULL) AnchDynArray_Free(&key);
+  AcirInliner_Free(&inliner);
+}
+
+const AcirCfg *AcirPassManager_Cfg(AcirPassManager *self) {
+  assert(self != NULL);
+  assert(self->valid & ACIR_ANALYSIS_CFG);
+  return &self->cfg;
+}
+
+AcirDefUse *AcirPassManager_DefUse(AcirPassManager *self) {
+  assert(self != NULL);
+  assert(self->valid & ACIR_ANALYSIS_DEFUSE);
+  return &self->defUse;
+}
+
+const AcirDomTree *AcirPassManager_Dominators(AcirPassManager *self) {
+  assert(self != NULL);
+  assert(self->valid & ACIR_ANALYSIS_DOMINATORS);
+  return &self->dominators;
+}
+
+const AcirLoopForest *AcirPassManager_Loops(AcirPassManager *self) {
+  assert(self != NULL);
+  assert(self->valid & ACIR_ANALYSIS_LOOPS);
+  return &self->loops;
+}
+
+void AcirPassManager_PrintStats(const AcirPassManager *self, AnchCharWriteStream *out) {
+  assert(self != NULL);
+  for(uint32_t i = 0; i < self->passCount; ++i) {
+    const AcirPassStats *stats = &self->stats[i];
+    AnchWriteFormat(out, ANSI_MAGENTA "%-12s" ANSI_RESET, self->passes[i].name);
+    if(stats->runs == 0) {
+      AnchWriteFormat(out, ANSI_GRAY " skipped at -O%d\n" ANSI_RESET, self->level);
+      continue;
+    }
+    AnchWriteFormat(out, " %u runs, %.3f ms, %+lld instructions\n",
+      stats->runs, stats->seconds * 1e3, (long long)stats->instrDelta);
+  }
+  if(self->inlinedCalls > 0)
+    AnchWriteFormat(out, ANSI_MAGENTA "%-12s" ANSI_RESET " %u calls\n", "inline", self->inlinedCalls);
+  if(self->memo != NULL)
+    AnchWriteFormat(out, ANSI_MAGENTA "%-12s" ANSI_RESET " %u hits, %u misses\n", "memo", self->memo->hits, self->memo->misses);
+}
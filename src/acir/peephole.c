@@ -0,0 +1,349 @@
+#include <acir/acir.h>
+#include <annec_anchor.h>
+#include <assert.h>
+#include "../cli.h"
+
+// Local rewrites, written as rules rather than code. A rule matches one instruction by its
+// opcode, a pattern for each operand and a condition on its type, and says what the
+// instruction becomes. Rules are grouped by opcode in \ref ACIR_OPCODES_ENUM order, which
+// lets the preprocessor count them into per-opcode ranges, so finding the rules for an
+// instruction is one lookup and adding a rule costs nothing for the other opcodes.
+//
+// Operand patterns:
+//   ANY   anything
+//   ZERO  immediate 0, `false` or +0.0
+//   ONE   immediate 1, `true` or 1.0
+//   ONES  immediate integer with every bit set (-1 for signed types)
+//   POW2  immediate integer power of two, above 1
+//   SAME  the binding the first operand is
+// Conditions: ALWAYS, INTEGER (not a float), UNSIGNED.
+// Results:
+//   LHS, RHS        a copy of that operand
+//   ZERO            the zero of the instruction's type
+//   TRUE, FALSE     a `bool` immediate
+//   NEG, NOT, BIT_NOT  that unary opcode on the first operand
+//   NEG_RHS         `neg` of the second operand
+//   SHL_LOG2, SHR_LOG2  a shift by the exponent of the second operand
+//   MASK            `bitand` with the second operand minus one
+//
+// Immediates are moved to the right of commutative opcodes first, so rules only need to
+// name them there.
+
+// R(X, OPCODE, LHS, RHS, WHEN, RESULT), X is passed through.
+#define ACIR_PEEPHOLE_RULES_(R, X) \
+  R(X, ADD, ANY, ZERO, INTEGER, LHS) \
+  R(X, SUB, ANY, ZERO, ALWAYS, LHS) \
+  R(X, SUB, ANY, SAME, INTEGER, ZERO) \
+  R(X, SUB, ZERO, ANY, INTEGER, NEG_RHS) \
+  R(X, MUL, ANY, ONE, ALWAYS, LHS) \
+  R(X, MUL, ANY, ZERO, INTEGER, ZERO) \
+  R(X, MUL, ANY, ONES, INTEGER, NEG) \
+  R(X, MUL, ANY, POW2, INTEGER, SHL_LOG2) \
+  R(X, DIV, ANY, ONE, ALWAYS, LHS) \
+  R(X, DIV, ANY, POW2, UNSIGNED, SHR_LOG2) \
+  R(X, MOD, ANY, ONE, INTEGER, ZERO) \
+  R(X, MOD, ANY, POW2, UNSIGNED, MASK) \
+  R(X, EQL, ANY, SAME, INTEGER, TRUE) \
+  R(X, NEQ, ANY, SAME, INTEGER, FALSE) \
+  R(X, LTH, ANY, SAME, INTEGER, FALSE) \
+  R(X, LTH, ANY, ZERO, UNSIGNED, FALSE) \
+  R(X, GTH, ANY, SAME, INTEGER, FALSE) \
+  R(X, GTH, ZERO, ANY, UNSIGNED, FALSE) \
+  R(X, LEQ, ANY, SAME, INTEGER, TRUE) \
+  R(X, LEQ, ZERO, ANY, UNSIGNED, TRUE) \
+  R(X, GEQ, ANY, SAME, INTEGER, TRUE) \
+  R(X, GEQ, ANY, ZERO, UNSIGNED, TRUE) \
+  R(X, AND, ANY, SAME, ALWAYS, LHS) \
+  R(X, AND, ANY, ONE, ALWAYS, LHS) \
+  R(X, AND, ANY, ZERO, ALWAYS, RHS) \
+  R(X, COR, ANY, SAME, ALWAYS, LHS) \
+  R(X, COR, ANY, ZERO, ALWAYS, LHS) \
+  R(X, COR, ANY, ONE, ALWAYS, RHS) \
+  R(X, XOR, ANY, SAME, ALWAYS, FALSE) \
+  R(X, XOR, ANY, ZERO, ALWAYS, LHS) \
+  R(X, XOR, ANY, ONE, ALWAYS, NOT) \
+  R(X, BIT_AND, ANY, SAME, ALWAYS, LHS) \
+  R(X, BIT_AND, ANY, ZERO, ALWAYS, RHS) \
+  R(X, BIT_AND, ANY, ONES, ALWAYS, LHS) \
+  R(X, BIT_COR, ANY, SAME, ALWAYS, LHS) \
+  R(X, BIT_COR, ANY, ZERO, ALWAYS, LHS) \
+  R(X, BIT_COR, ANY, ONES, ALWAYS, RHS) \
+  R(X, BIT_XOR, ANY, SAME, ALWAYS, ZERO) \
+  R(X, BIT_XOR, ANY, ZERO, ALWAYS, LHS) \
+  R(X, BIT_XOR, ANY, ONES, ALWAYS, BIT_NOT) \
+  R(X, SHL, ANY, ZERO, ALWAYS, LHS) \
+  R(X, SHL, ZERO, ANY, ALWAYS, LHS) \
+  R(X, SHR, ANY, ZERO, ALWAYS, LHS) \
+  R(X, SHR, ZERO, ANY, ALWAYS, LHS)
+
+enum {
+  ACIR_PEEPHOLE_MATCH_ANY_,
+  ACIR_PEEPHOLE_MATCH_ZERO_,
+  ACIR_PEEPHOLE_MATCH_ONE_,
+  ACIR_PEEPHOLE_MATCH_ONES_,
+  ACIR_PEEPHOLE_MATCH_POW2_,
+  ACIR_PEEPHOLE_MATCH_SAME_,
+};
+
+enum {
+  ACIR_PEEPHOLE_WHEN_ALWAYS_,
+  ACIR_PEEPHOLE_WHEN_INTEGER_,
+  ACIR_PEEPHOLE_WHEN_UNSIGNED_,
+};
+
+enum {
+  ACIR_PEEPHOLE_RESULT_LHS_,
+  ACIR_PEEPHOLE_RESULT_RHS_,
+  ACIR_PEEPHOLE_RESULT_ZERO_,
+  ACIR_PEEPHOLE_RESULT_TRUE_,
+  ACIR_PEEPHOLE_RESULT_FALSE_,
+  ACIR_PEEPHOLE_RESULT_NEG_,
+  ACIR_PEEPHOLE_RESULT_NOT_,
+  ACIR_PEEPHOLE_RESULT_BIT_NOT_,
+  ACIR_PEEPHOLE_RESULT_NEG_RHS_,
+  ACIR_PEEPHOLE_RESULT_SHL_LOG2_,
+  ACIR_PEEPHOLE_RESULT_SHR_LOG2_,
+  ACIR_PEEPHOLE_RESULT_MASK_,
+};
+
+typedef struct {
+  AcirOpcode opcode;
+  uint8_t lhs, rhs, when, result;
+} AcirPeepholeRule_;
+
+#define RULE_(X, OPCODE, LHS, RHS, WHEN, RESULT) { ACIR_OPCODE_##OPCODE, ACIR_PEEPHOLE_MATCH_##LHS##_, \
+  ACIR_PEEPHOLE_MATCH_##RHS##_, ACIR_PEEPHOLE_WHEN_##WHEN##_, ACIR_PEEPHOLE_RESULT_##RESULT##_ },
+static const AcirPeepholeRule_ AcirPeephole_Rules_[] = { ACIR_PEEPHOLE_RULES_(RULE_, ) };
+#undef RULE_
+
+// the rules of opcode N are `AcirPeephole_Rules_[Offsets_[N]]` up to `[Offsets_[N + 1]]`.
+#define BEFORE_(OP, OPCODE, ...) + (ACIR_OPCODE_##OPCODE < OP)
+#define OFFSET_(NAME, ...) (0 ACIR_PEEPHOLE_RULES_(BEFORE_, ACIR_OPCODE_##NAME))
+#define COMMA ,
+static const uint8_t AcirPeephole_Offsets_[ACIR_OPCODE_MAX_ + 1] = {
+  ACIR_OPCODES_ENUM(OFFSET_, COMMA),
+  sizeof(AcirPeephole_Rules_) / sizeof(AcirPeepholeRule_),
+};
+#undef COMMA
+#undef OFFSET_
+#undef BEFORE_
+
+static bool AcirPeephole_IsFloat_(const AcirValueType *type) {
+  return type != NULL && type->type == ACIR_VALUE_TYPE_BASIC
+    && (type->basic == ACIR_BASIC_VALUE_TYPE_FLOAT32 || type->basic == ACIR_BASIC_VALUE_TYPE_FLOAT64);
+}
+
+static bool AcirPeephole_IsUnsigned_(const AcirValueType *type) {
+  if(type == NULL || type->type != ACIR_VALUE_TYPE_BASIC) return false;
+  switch(type->basic) {
+    case ACIR_BASIC_VALUE_TYPE_UINT64: case ACIR_BASIC_VALUE_TYPE_UINT32:
+    case ACIR_BASIC_VALUE_TYPE_UINT16: case ACIR_BASIC_VALUE_TYPE_UINT8: return true;
+    default: return false;
+  }
+}
+
+/** All bits of an integer TYPE, 0 for the others. */
+static uint64_t AcirPeephole_Ones_(const AcirValueType *type) {
+  if(type == NULL || type->type != ACIR_VALUE_TYPE_BASIC) return 0;
+  switch(type->basic) {
+    case ACIR_BASIC_VALUE_TYPE_SINT64: case ACIR_BASIC_VALUE_TYPE_UINT64: return UINT64_MAX;
+    case ACIR_BASIC_VALUE_TYPE_SINT32: case ACIR_BASIC_VALUE_TYPE_UINT32: return UINT32_MAX;
+    case ACIR_BASIC_VALUE_TYPE_SINT16: case ACIR_BASIC_VALUE_TYPE_UINT16: return UINT16_MAX;
+    case ACIR_BASIC_VALUE_TYPE_SINT8: case ACIR_BASIC_VALUE_TYPE_UINT8: return UINT8_MAX;
+    default: return 0;
+  }
+}
+
+/** Counterpart of AcirImmediateValue_Bits for the integer types, keeps the type of IMM. */
+static void AcirPeephole_SetBits_(AcirImmediateValue *imm, uint64_t bits) {
+  imm->uint64 = 0;
+  switch(imm->type->basic) {
+    case ACIR_BASIC_VALUE_TYPE_SINT32: case ACIR_BASIC_VALUE_TYPE_UINT32: imm->uint32 = bits; break;
+    case ACIR_BASIC_VALUE_TYPE_SINT16: case ACIR_BASIC_VALUE_TYPE_UINT16: imm->uint16 = bits; break;
+    case ACIR_BASIC_VALUE_TYPE_SINT8: case ACIR_BASIC_VALUE_TYPE_UINT8: imm->uint8 = bits; break;
+    default: imm->uint64 = bits; break;
+  }
+}
+
+static bool AcirPeephole_Match_(uint8_t pattern, const AcirOperand *op, const AcirOperand *lhs) {
+  if(pattern == ACIR_PEEPHOLE_MATCH_ANY_) return true;
+  if(pattern == ACIR_PEEPHOLE_MATCH_SAME_)
+    return op->type == ACIR_OPERAND_TYPE_BINDING && lhs->type == ACIR_OPERAND_TYPE_BINDING && op->idx == lhs->idx;
+  if(op->type != ACIR_OPERAND_TYPE_IMMEDIATE) return false;
+
+  const AcirImmediateValue *imm = &op->imm;
+  uint64_t bits = AcirImmediateValue_Bits(imm);
+  bool floating = AcirPeephole_IsFloat_(imm->type);
+  switch(pattern) {
+    case ACIR_PEEPHOLE_MATCH_ZERO_: return bits == 0;
+    case ACIR_PEEPHOLE_MATCH_ONE_:
+      if(floating) return (imm->type->basic == ACIR_BASIC_VALUE_TYPE_FLOAT32 ? imm->float32 : imm->float64) == 1.0;
+      return bits == 1;
+    case ACIR_PEEPHOLE_MATCH_ONES_: {
+      uint64_t ones = AcirPeephole_Ones_(imm->type);
+      return ones != 0 && bits == ones;
+    }
+    case ACIR_PEEPHOLE_MATCH_POW2_:
+      return AcirPeephole_Ones_(imm->type) != 0 && bits > 1 && (bits & (bits - 1)) == 0;
+    default:
+      assert(false && "unknown peephole pattern");
+      return false;
+  }
+}
+
+static bool AcirPeephole_When_(uint8_t when, const AcirValueType *type) {
+  switch(when) {
+    case ACIR_PEEPHOLE_WHEN_ALWAYS_: return true;
+    case ACIR_PEEPHOLE_WHEN_INTEGER_: return !AcirPeephole_IsFloat_(type);
+    case ACIR_PEEPHOLE_WHEN_UNSIGNED_: return AcirPeephole_IsUnsigned_(type);
+    default:
+      assert(false && "unknown peephole condition");
+      return false;
+  }
+}
+
+static void AcirPeephole_Copy_(AcirInstr *instr, AcirOperand value) {
+  if(value.type == ACIR_OPERAND_TYPE_IMMEDIATE) instr->type = value.imm.type;
+  instr->opcode = ACIR_OPCODE_SET;
+  instr->val = value;
+}
+
+static void AcirPeephole_Apply_(AcirInstr *instr, uint8_t result) {
+  const AcirValueType *Tbool = AcirValueType_Basic(ACIR_BASIC_VALUE_TYPE_BOOL);
+  switch(result) {
+    case ACIR_PEEPHOLE_RESULT_LHS_: AcirPeephole_Copy_(instr, instr->lhs); break;
+    case ACIR_PEEPHOLE_RESULT_RHS_: AcirPeephole_Copy_(instr, instr->rhs); break;
+    case ACIR_PEEPHOLE_RESULT_ZERO_:
+      AcirPeephole_Copy_(instr, (AcirOperand){ ACIR_OPERAND_TYPE_IMMEDIATE, .imm = { .type = instr->type, .uint64 = 0 } });
+      break;
+    case ACIR_PEEPHOLE_RESULT_TRUE_: case ACIR_PEEPHOLE_RESULT_FALSE_:
+      AcirPeephole_Copy_(instr, (AcirOperand){ ACIR_OPERAND_TYPE_IMMEDIATE,
+        .imm = { .type = Tbool, .boolean = result == ACIR_PEEPHOLE_RESULT_TRUE_ } });
+      break;
+    // `val` is the same operand as `lhs`, so only the opcode changes.
+    case ACIR_PEEPHOLE_RESULT_NEG_: instr->opcode = ACIR_OPCODE_NEG; break;
+    case ACIR_PEEPHOLE_RESULT_NOT_: instr->opcode = ACIR_OPCODE_NOT; break;
+    case ACIR_PEEPHOLE_RESULT_BIT_NOT_: instr->opcode = ACIR_OPCODE_BIT_NOT; break;
+    case ACIR_PEEPHOLE_RESULT_NEG_RHS_:
+      instr->opcode = ACIR_OPCODE_NEG;
+      instr->val = instr->rhs;
+      break;
+    // wrapping makes the shift right for negative multipliers too.
+    case ACIR_PEEPHOLE_RESULT_SHL_LOG2_: case ACIR_PEEPHOLE_RESULT_SHR_LOG2_:
+      instr->opcode = result == ACIR_PEEPHOLE_RESULT_SHL_LOG2_ ? ACIR_OPCODE_SHL : ACIR_OPCODE_SHR;
+      AcirPeephole_SetBits_(&instr->rhs.imm, __builtin_ctzll(AcirImmediateValue_Bits(&instr->rhs.imm)));
+      break;
+    case ACIR_PEEPHOLE_RESULT_MASK_:
+      instr->opcode = ACIR_OPCODE_BIT_AND;
+      AcirPeephole_SetBits_(&instr->rhs.imm, AcirImmediateValue_Bits(&instr->rhs.imm) - 1);
+      break;
+    default:
+      assert(false && "unknown peephole result");
+  }
+}
+
+bool AcirInstr_Peephole(AcirInstr *instr) {
+  assert(instr != NULL);
+  assert(instr->opcode < ACIR_OPCODE_MAX_);
+  if(!AcirOpcode_ConstEval(instr->opcode) || instr->opcode == ACIR_OPCODE_SET) return false;
+  if(instr->out.type != ACIR_OPERAND_TYPE_BINDING) return false;
+
+  if(AcirOpcode_OperandCount(instr->opcode) == 2) {
+    if(instr->val.type != ACIR_OPERAND_TYPE_IMMEDIATE) return false;
+    AcirImmediateValue result;
+    AcirInstr_ConstEval(instr, &result, &instr->val.imm, NULL);
+    AcirPeephole_Copy_(instr, (AcirOperand){ ACIR_OPERAND_TYPE_IMMEDIATE, .imm = result });
+    return true;
+  }
+
+  AcirOperand *lhs = &instr->lhs, *rhs = &instr->rhs;
+  if(lhs->type == ACIR_OPERAND_TYPE_IMMEDIATE && rhs->type == ACIR_OPERAND_TYPE_IMMEDIATE) {
+    if(AcirInstr_ConstEvalTraps(instr, &lhs->imm, &rhs->imm)) return false;
+    AcirImmediateValue result;
+    AcirInstr_ConstEval(instr, &result, &lhs->imm, &rhs->imm);
+    AcirPeephole_Copy_(instr, (AcirOperand){ ACIR_OPERAND_TYPE_IMMEDIATE, .imm = result });
+    return true;
+  }
+
+  if(AcirOpcode_IsCommutative(instr->opcode) && lhs->type == ACIR_OPERAND_TYPE_IMMEDIATE) {
+    AcirOperand swap = *lhs;
+    *lhs = *rhs;
+    *rhs = swap;
+    return true;
+  }
+
+  for(uint8_t i = AcirPeephole_Offsets_[instr->opcode]; i < AcirPeephole_Offsets_[instr->opcode + 1]; ++i) {
+    const AcirPeepholeRule_ *rule = &AcirPeephole_Rules_[i];
+    assert(rule->opcode == instr->opcode && "peephole rules must follow the opcode order");
+    if(!AcirPeephole_When_(rule->when, instr->type)) continue;
+    if(!AcirPeephole_Match_(rule->lhs, lhs, lhs) || !AcirPeephole_Match_(rule->rhs, rhs, lhs)) continue;
+    AcirPeephole_Apply_(instr, rule->result);
+    return true;
+  }
+  return false;
+}
+
+typedef struct {
+  AcirDefUse *defUse;
+  AcirBuilder *builder;
+  uint32_t workTop;
+  uint32_t *work;
+  bool *queued; // by instruction.
+} AcirPeephole_;
+
+static void AcirPeephole_Push_(AcirPeephole_ *self, uint32_t instr) {
+  if(self->queued[instr]) return;
+  self->queued[instr] = true;
+  self->work[self->workTop++] = instr;
+}
+
+void AcirPass_Peephole(AcirPassManager *manager, AcirBuilder *builder) {
+  AnchAllocator *allocator = manager->allocator;
+  size_t instrCount = builder->target->instrCount;
+  AcirPeephole_ self = {
+    .defUse = AcirPassManager_DefUse(manager),
+    .builder = builder,
+    .work = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * (instrCount + 1)),
+    .queued = AnchAllocator_AllocZero(allocator, sizeof(bool) * (instrCount + 1)),
+  };
+
+  // pushed backwards, so the first instruction is the first one looked at.
+  uint32_t count = 0;
+  for(size_t i = builder->target->code; i != ACIR_INSTR_NULL_INDEX; i = builder->instrs[i].next) self.work[count++] = i;
+  for(uint32_t i = 0; i < count / 2; ++i) {
+    uint32_t swap = self.work[i];
+    self.work[i] = self.work[count - 1 - i];
+    self.work[count - 1 - i] = swap;
+  }
+  for(uint32_t i = 0; i < count; ++i) self.queued[self.work[i]] = true;
+  self.workTop = count;
+
+  // constants, found or written, are passed on to their uses, which get another look.
+  while(self.workTop > 0) {
+    uint32_t index = self.work[--self.workTop];
+    self.queued[index] = false;
+    AcirInstr rewritten = builder->instrs[index];
+    bool changed = false;
+    while(AcirInstr_Peephole(&rewritten)) changed = true;
+    if(changed) {
+      AcirDefUse_Unlink(self.defUse, index);
+      builder->instrs[index] = rewritten;
+      AcirDefUse_Link(self.defUse, index);
+    }
+    if(rewritten.opcode != ACIR_OPCODE_SET || rewritten.val.type != ACIR_OPERAND_TYPE_IMMEDIATE) continue;
+    if(rewritten.out.type != ACIR_OPERAND_TYPE_BINDING) continue;
+
+    size_t binding = rewritten.out.idx;
+    for(uint32_t use = AcirDefUse_FirstUse(self.defUse, binding), next; use != ACIR_DEFUSE_NULL_INDEX; use = next) {
+      next = AcirDefUse_NextUse(self.defUse, use);
+      uint32_t user = AcirDefUse_UseInstr(use);
+      // `ref` needs the binding itself.
+      if(builder->instrs[user].opcode == ACIR_OPCODE_REF) continue;
+      AcirDefUse_SetOperand(self.defUse, user, AcirDefUse_UseSlot(use), &rewritten.val);
+      AcirPeephole_Push_(&self, user);
+    }
+  }
+
+  AnchAllocator_Free(allocator, self.work);
+  AnchAllocator_Free(allocator, self.queued);
+}
@@ -0,0 +1,307 @@
+#include <acir/acir.h>
+#include <annec_anchor.h>
+#include <assert.h>
+#include "../cli.h"
+
+// Sparse conditional constant propagation (Wegman & Zadeck). Bindings start unknown and
+// only ever move down the lattice, to a constant and then to "varying"; blocks and edges
+// start unreachable and are only marked once a reachable branch can take them. Instructions
+// are revisited when the value of one of their operands drops (found through the def-use
+// chains) or when a new edge reaches their block, so the work is proportional to uses.
+
+enum {
+  ACIR_SCCP_UNKNOWN_,
+  ACIR_SCCP_CONSTANT_,
+  ACIR_SCCP_VARYING_,
+};
+
+typedef struct {
+  const AcirCfg *cfg;
+  AcirDefUse *defUse;
+  AcirBuilder *builder;
+  AnchAllocator *allocator;
+  uint8_t *states; // by binding.
+  AcirImmediateValue *values; // by binding, for constants.
+  bool *reachable; // by block.
+  bool *taken; // by edge, indexing `cfg->succs`.
+  uint32_t *labelBlocks; // by label.
+  uint32_t edgeCount, edgeTop;
+  uint32_t *edges; // worklist, every edge is added at most once.
+  uint32_t instrTop;
+  uint32_t *instrs; // worklist, deduplicated by `queued`.
+  bool *queued; // by instruction.
+} AcirSccp_;
+
+static void AcirSccp_PushInstr_(AcirSccp_ *self, uint32_t instr) {
+  if(self->queued[instr]) return;
+  self->queued[instr] = true;
+  self->instrs[self->instrTop++] = instr;
+}
+
+static void AcirSccp_TakeEdge_(AcirSccp_ *self, uint32_t edge) {
+  if(self->taken[edge]) return;
+  self->taken[edge] = true;
+  self->edges[self->edgeTop++] = edge;
+}
+
+/** Edge from block FROM to block TO, or ACIR_BLOCK_NULL_INDEX. */
+static uint32_t AcirSccp_FindEdge_(const AcirSccp_ *self, uint32_t from, uint32_t to) {
+  for(uint32_t e = self->cfg->succOffsets[from]; e < self->cfg->succOffsets[from + 1]; ++e)
+    if(self->cfg->succs[e] == to) return e;
+  return ACIR_BLOCK_NULL_INDEX;
+}
+
+/** Lattice state of OP, with its value in VALUE when it is a constant. */
+static uint8_t AcirSccp_Operand_(const AcirSccp_ *self, const AcirOperand *op, const AcirImmediateValue **value) {
+  if(op->type == ACIR_OPERAND_TYPE_IMMEDIATE) {
+    *value = &op->imm;
+    return ACIR_SCCP_CONSTANT_;
+  }
+  if(op->type != ACIR_OPERAND_TYPE_BINDING) return ACIR_SCCP_VARYING_;
+  // a binding nothing defines can't be known.
+  if(AcirDefUse_Def(self->defUse, op->idx) == ACIR_DEFUSE_NULL_INDEX) return ACIR_SCCP_VARYING_;
+  *value = &self->values[op->idx];
+  return self->states[op->idx];
+}
+
+static bool AcirSccp_SameValue_(const AcirImmediateValue *a, const AcirImmediateValue *b) {
+  return a->type == b->type && AcirImmediateValue_Bits(a) == AcirImmediateValue_Bits(b);
+}
+
+/** Move BINDING down to STATE (and VALUE), revisiting its uses if it changed. */
+static void AcirSccp_Lower_(AcirSccp_ *self, size_t binding, uint8_t state, const AcirImmediateValue *value) {
+  uint8_t old = self->states[binding];
+  if(state == ACIR_SCCP_UNKNOWN_ || old == ACIR_SCCP_VARYING_) return;
+  if(old == ACIR_SCCP_CONSTANT_) {
+    if(state == ACIR_SCCP_CONSTANT_ && AcirSccp_SameValue_(&self->values[binding], value)) return;
+    // a second, different constant means the binding varies.
+    state = ACIR_SCCP_VARYING_;
+  }
+  self->states[binding] = state;
+  if(state == ACIR_SCCP_CONSTANT_) self->values[binding] = *value;
+  for(uint32_t use = AcirDefUse_FirstUse(self->defUse, binding); use != ACIR_DEFUSE_NULL_INDEX;
+    use = AcirDefUse_NextUse(self->defUse, use)) {
+    AcirSccp_PushInstr_(self, AcirDefUse_UseInstr(use));
+  }
+}
+
+/** Value of the binding INSTR defines, from what is known about its operands. */
+static uint8_t AcirSccp_Evaluate_(const AcirSccp_ *self, uint32_t block, const AcirInstr *instr,
+  AcirImmediateValue *result) {
+  const AcirImmediateValue *lhs = NULL, *rhs = NULL;
+
+  if(instr->opcode == ACIR_OPCODE_PHI) {
+    uint32_t predCount;
+    const uint32_t *preds = AcirCfg_Preds(self->cfg, block, &predCount);
+    if(predCount != 2) return ACIR_SCCP_VARYING_;
+    const AcirOperand *inputs[] = { &instr->lhs, &instr->rhs };
+    uint8_t state = ACIR_SCCP_UNKNOWN_;
+    for(int i = 0; i < 2; ++i) {
+      if(!self->taken[AcirSccp_FindEdge_(self, preds[i], block)]) continue;
+      uint8_t input = AcirSccp_Operand_(self, inputs[i], &lhs);
+      if(input == ACIR_SCCP_UNKNOWN_) continue;
+      if(input == ACIR_SCCP_VARYING_ || (state == ACIR_SCCP_CONSTANT_ && !AcirSccp_SameValue_(result, lhs)))
+        return ACIR_SCCP_VARYING_;
+      state = ACIR_SCCP_CONSTANT_;
+      *result = *lhs;
+    }
+    return state;
+  }
+
+  if(instr->opcode == ACIR_OPCODE_SET) {
+    uint8_t state = AcirSccp_Operand_(self, &instr->val, &lhs);
+    if(state == ACIR_SCCP_CONSTANT_) *result = *lhs;
+    return state;
+  }
+
+  if(!AcirOpcode_ConstEval(instr->opcode)) return ACIR_SCCP_VARYING_;
+  int operandCount = AcirOpcode_OperandCount(instr->opcode);
+  uint8_t lhsState = AcirSccp_Operand_(self, &instr->lhs, &lhs);
+  uint8_t rhsState = operandCount == 3 ? AcirSccp_Operand_(self, &instr->rhs, &rhs) : ACIR_SCCP_CONSTANT_;
+  // varying wins over unknown, which wins over constant.
+  if(lhsState == ACIR_SCCP_VARYING_ || rhsState == ACIR_SCCP_VARYING_) return ACIR_SCCP_VARYING_;
+  if(lhsState == ACIR_SCCP_UNKNOWN_ || rhsState == ACIR_SCCP_UNKNOWN_) return ACIR_SCCP_UNKNOWN_;
+  if(operandCount == 3 && AcirInstr_ConstEvalTraps(instr, lhs, rhs)) return ACIR_SCCP_VARYING_;
+  AcirInstr_ConstEval(instr, result, lhs, rhs);
+  return ACIR_SCCP_CONSTANT_;
+}
+
+static void AcirSccp_Visit_(AcirSccp_ *self, uint32_t index) {
+  const AcirCfg *cfg = self->cfg;
+  uint32_t block = cfg->instrBlocks[index];
+  if(block == ACIR_BLOCK_NULL_INDEX || !self->reachable[block]) return;
+  const AcirInstr *instr = &self->builder->instrs[index];
+
+  if(instr->opcode == ACIR_OPCODE_BR) {
+    const AcirImmediateValue *cond = NULL;
+    uint8_t state = AcirSccp_Operand_(self, &instr->val, &cond);
+    if(state == ACIR_SCCP_VARYING_) {
+      for(uint32_t e = cfg->succOffsets[block]; e < cfg->succOffsets[block + 1]; ++e) AcirSccp_TakeEdge_(self, e);
+    } else if(state == ACIR_SCCP_CONSTANT_) {
+      size_t label = cond->boolean ? instr->rhs.idx : instr->out.idx;
+      AcirSccp_TakeEdge_(self, AcirSccp_FindEdge_(self, block, self->labelBlocks[label]));
+    }
+    return;
+  }
+
+  // jumps and falling through into the next block always take their edges.
+  const AcirBlock *b = &cfg->blocks[block];
+  if(cfg->order[b->first + b->count - 1] == index) {
+    for(uint32_t e = cfg->succOffsets[block]; e < cfg->succOffsets[block + 1]; ++e) AcirSccp_TakeEdge_(self, e);
+  }
+
+  if(AcirOpcode_OperandCount(instr->opcode) < 2 || instr->out.type != ACIR_OPERAND_TYPE_BINDING) return;
+  AcirImmediateValue value;
+  uint8_t state = AcirSccp_Evaluate_(self, block, instr, &value);
+  AcirSccp_Lower_(self, instr->out.idx, state, &value);
+}
+
+static void AcirSccp_ReachEdge_(AcirSccp_ *self, uint32_t edge) {
+  uint32_t block = self->cfg->succs[edge];
+  const AcirBlock *b = &self->cfg->blocks[block];
+  if(!self->reachable[block]) {
+    self->reachable[block] = true;
+    for(uint32_t i = 0; i < b->count; ++i) AcirSccp_PushInstr_(self, self->cfg->order[b->first + i]);
+    return;
+  }
+  // only the `phi`s at the start of the block can see a new edge.
+  for(uint32_t i = 0; i < b->count; ++i) {
+    uint32_t index = self->cfg->order[b->first + i];
+    AcirOpcode opcode = self->builder->instrs[index].opcode;
+    if(opcode == ACIR_OPCODE_PHI) AcirSccp_PushInstr_(self, index);
+    else if(opcode != ACIR_OPCODE_LBL) break;
+  }
+}
+
+/** Rewrite INSTR in place, keeping the def-use chains current. */
+static void AcirSccp_Replace_(AcirSccp_ *self, uint32_t index, const AcirInstr *with) {
+  AcirDefUse_Unlink(self->defUse, index);
+  AcirInstr *instr = &self->builder->instrs[index];
+  AcirInstr replacement = *with;
+  replacement.index = instr->index;
+  replacement.next = instr->next;
+  *instr = replacement;
+  AcirDefUse_Link(self->defUse, index);
+}
+
+static void AcirSccp_Rewrite_(AcirSccp_ *self) {
+  const AcirCfg *cfg = self->cfg;
+
+  for(uint32_t block = 0; block < cfg->blockCount; ++block) {
+    if(!self->reachable[block]) continue;
+    const AcirBlock *b = &cfg->blocks[block];
+    for(uint32_t i = 0; i < b->count; ++i) {
+      uint32_t index = cfg->order[b->first + i];
+      const AcirInstr *instr = &self->builder->instrs[index];
+      int operandCount = AcirOpcode_OperandCount(instr->opcode);
+
+      if(instr->opcode == ACIR_OPCODE_BR) {
+        const AcirImmediateValue *cond = NULL;
+        if(AcirSccp_Operand_(self, &instr->val, &cond) != ACIR_SCCP_CONSTANT_) continue;
+        AcirOperand target = cond->boolean ? instr->rhs : instr->out;
+        AcirSccp_Replace_(self, index, &(AcirInstr){ .opcode = ACIR_OPCODE_JMP,
+          .type = AcirValueType_Basic(ACIR_BASIC_VALUE_TYPE_VOID), .val = target });
+      } else if(operandCount >= 2 && instr->out.type == ACIR_OPERAND_TYPE_BINDING) {
+        size_t out = instr->out.idx;
+        if(self->states[out] == ACIR_SCCP_CONSTANT_) {
+          if(instr->opcode == ACIR_OPCODE_SET && instr->val.type == ACIR_OPERAND_TYPE_IMMEDIATE) continue;
+          AcirImmediateValue value = self->values[out];
+          AcirSccp_Replace_(self, index, &(AcirInstr){ .opcode = ACIR_OPCODE_SET, .type = value.type,
+            .val = { ACIR_OPERAND_TYPE_IMMEDIATE, .imm = value }, .out = instr->out });
+        } else if(instr->opcode == ACIR_OPCODE_PHI) {
+          // with one predecessor left, the `phi` is a copy of what comes in from it.
+          uint32_t predCount;
+          const uint32_t *preds = AcirCfg_Preds(cfg, block, &predCount);
+          if(predCount != 2) continue;
+          bool first = self->taken[AcirSccp_FindEdge_(self, preds[0], block)];
+          bool second = self->taken[AcirSccp_FindEdge_(self, preds[1], block)];
+          if(first == second) continue;
+          AcirSccp_Replace_(self, index, &(AcirInstr){ .opcode = ACIR_OPCODE_SET, .type = instr->type,
+            .val = first ? instr->lhs : instr->rhs, .out = instr->out });
+        }
+      }
+    }
+  }
+
+  // uses of constants read the immediate instead, except for `ref`, which needs a binding.
+  for(size_t binding = 0; binding < self->defUse->bindingCapacity; ++binding) {
+    if(self->states[binding] != ACIR_SCCP_CONSTANT_) continue;
+    AcirOperand imm = { ACIR_OPERAND_TYPE_IMMEDIATE, .imm = self->values[binding] };
+    for(uint32_t use = AcirDefUse_FirstUse(self->defUse, binding), next; use != ACIR_DEFUSE_NULL_INDEX; use = next) {
+      next = AcirDefUse_NextUse(self->defUse, use);
+      if(self->builder->instrs[AcirDefUse_UseInstr(use)].opcode == ACIR_OPCODE_REF) continue;
+      AcirDefUse_SetOperand(self->defUse, AcirDefUse_UseInstr(use), AcirDefUse_UseSlot(use), &imm);
+    }
+  }
+
+  // unreachable blocks are dropped, relinking the rest in their original order.
+  AcirFunction *function = self->builder->target;
+  uint32_t last = ACIR_BLOCK_NULL_INDEX;
+  for(uint32_t i = 0; i < cfg->instrCount; ++i) {
+    uint32_t index = cfg->order[i];
+    if(!self->reachable[cfg->instrBlocks[index]]) {
+      AcirDefUse_Unlink(self->defUse, index);
+      continue;
+    }
+    if(last == ACIR_BLOCK_NULL_INDEX) function->code = index;
+    else self->builder->instrs[last].next = index;
+    last = index;
+  }
+  assert(last != ACIR_BLOCK_NULL_INDEX);
+  self->builder->instrs[last].next = ACIR_INSTR_NULL_INDEX;
+}
+
+void AcirPass_Sccp(AcirPassManager *manager, AcirBuilder *builder) {
+  const AcirCfg *cfg = AcirPassManager_Cfg(manager);
+  if(cfg->blockCount == 0) return;
+
+  AnchAllocator *allocator = manager->allocator;
+  AcirSccp_ self = {
+    .cfg = cfg,
+    .defUse = AcirPassManager_DefUse(manager),
+    .builder = builder,
+    .allocator = allocator,
+  };
+  size_t bindingCount = self.defUse->bindingCapacity;
+  size_t instrCount = builder->target->instrCount;
+  self.edgeCount = cfg->succOffsets[cfg->blockCount];
+  self.states = AnchAllocator_AllocZero(allocator, sizeof(uint8_t) * (bindingCount + 1));
+  self.values = AnchAllocator_Alloc(allocator, sizeof(AcirImmediateValue) * (bindingCount + 1));
+  self.reachable = AnchAllocator_AllocZero(allocator, sizeof(bool) * cfg->blockCount);
+  self.taken = AnchAllocator_AllocZero(allocator, sizeof(bool) * (self.edgeCount + 1));
+  self.edges = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * (self.edgeCount + 1));
+  self.instrs = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * instrCount);
+  self.queued = AnchAllocator_AllocZero(allocator, sizeof(bool) * instrCount);
+
+  size_t labelCount = 0;
+  for(uint32_t b = 0; b < cfg->blockCount; ++b)
+    if(cfg->blocks[b].label != ACIR_BLOCK_NULL_INDEX && cfg->blocks[b].label + 1 > labelCount) labelCount = cfg->blocks[b].label + 1;
+  self.labelBlocks = AnchAllocator_Alloc(allocator, sizeof(uint32_t) * (labelCount + 1));
+  for(uint32_t b = 0; b < cfg->blockCount; ++b)
+    if(cfg->blocks[b].label != ACIR_BLOCK_NULL_INDEX) self.labelBlocks[cfg->blocks[b].label] = b;
+
+  self.reachable[0] = true;
+  for(uint32_t i = 0; i < cfg->blocks[0].count; ++i) AcirSccp_PushInstr_(&self, cfg->order[cfg->blocks[0].first + i]);
+
+  // edges first, so a block's instructions are seen once it is reachable rather than per edge.
+  while(self.edgeTop > 0 || self.instrTop > 0) {
+    if(self.edgeTop > 0) {
+      AcirSccp_ReachEdge_(&self, self.edges[--self.edgeTop]);
+      continue;
+    }
+    uint32_t index = self.instrs[--self.instrTop];
+    self.queued[index] = false;
+    AcirSccp_Visit_(&self, index);
+  }
+
+  AcirSccp_Rewrite_(&self);
+
+  AnchAllocator_Free(allocator, self.states);
+  AnchAllocator_Free(allocator, self.values);
+  AnchAllocator_Free(allocator, self.reachable);
+  AnchAllocator_Free(allocator, self.taken);
+  AnchAllocator_Free(allocator, self.edges);
+  AnchAllocator_Free(allocator, self.instrs);
+  AnchAllocator_Free(allocator, self.queued);
+  AnchAllocator_Free(allocator, self.labelBlocks);
+}
@@ -23,11 +23,10 @@ int main(int argc, char *argv[]) {
 
   allocator = &statsAllocator.base;
 
-  AcirValueType valueTuint64 = { .type = ACIR_VALUE_TYPE_BASIC, .basic = ACIR_BASIC_VALUE_TYPE_UINT64 };
-  const AcirValueType *Tuint64 = &valueTuint64;
-  AcirValueType valueTvoid = { .type = ACIR_VALUE_TYPE_BASIC, .basic = ACIR_BASIC_VALUE_TYPE_VOID };
-  const AcirValueType *Tvoid = &valueTvoid;
-  (void)Tvoid;
+  AcirModule module;
+  AcirModule_Init(&module, allocator);
+
+  const AcirValueType *Tuint64 = AcirTypeTable_Basic(&module.types, ACIR_BASIC_VALUE_TYPE_UINT64);
   
   AcirInstr instrs[] = {
     (AcirInstr){ 0, ACIR_OPCODE_SET, Tuint64, 1,
@@ -50,19 +49,15 @@ int main(int argc, char *argv[]) {
       .val = (AcirOperand){ ACIR_OPERAND_TYPE_BINDING, .idx = 2 }, },
   };
 
-  AcirFunction inputFunc = {
-    .type = NULL,
-    .code = 0,
-    .name = "main",
-    .instrs = instrs,
-    .instrCount = sizeof(instrs) / sizeof(AcirInstr)
-  };
+  AcirModuleFunction *mainFunc = AcirModule_Function(&module, AcirModule_AddFunction(&module, "main", NULL));
+  AcirBuilder_Append(&mainFunc->builder, instrs, sizeof(instrs) / sizeof(AcirInstr));
+  const AcirFunction *inputFunc = &mainFunc->function;
 
   WRITE_SEPARATOR("Generated IR");
-  AcirFunction_Print(&inputFunc, wsStdout);
+  AcirFunction_Print(inputFunc, wsStdout);
 
   WRITE_SEPARATOR1("Validation", "=");
-  int errorCount = AcirFunction_Validate(&inputFunc, allocator);
+  int errorCount = AcirModule_Validate(&module, allocator, 1);
 
   if(errorCount > 0) {
     AnchWriteFormat(wsStderr, ANSI_RED "\n%d Errors, Aborting.\n" ANSI_RESET, errorCount);
@@ -71,32 +66,345 @@ int main(int argc, char *argv[]) {
     AnchWriteFormat(wsStdout, ANSI_GREEN "\nNo Errors.\n" ANSI_RESET);
   }
 
-  AcirFunction optimizerFunc = { .type = NULL, .name = "main" };
-  AcirBuilder optimizerBuilder;
-  AcirBuilder_Init(&optimizerBuilder, &optimizerFunc, allocator);
+  AcirPackedFunction packedFunc;
+  AcirPackedFunction_Pack(&packedFunc, inputFunc, allocator);
+  AnchWriteFormat(wsStdout, ANSI_GRAY "\nPacked: %u instructions, %u immediates, %zu bytes (%zu unpacked).\n" ANSI_RESET,
+    packedFunc.instrCount, packedFunc.immCount, AcirPackedFunction_ByteSize(&packedFunc),
+    sizeof(AcirInstr) * inputFunc->instrCount);
+  AcirPackedFunction_Free(&packedFunc);
 
-  AcirFunction outputFunc = { .type = NULL, .name = "main" };
-  AcirBuilder outputBuilder;
-  AcirBuilder_Init(&outputBuilder, &outputFunc, allocator);
+  // -O0 leaves the code alone, the optimizer runs from -O1 on.
+  int level = 2;
+  for(int i = 1; i < argc; ++i)
+    if(argv[i][0] == '-' && argv[i][1] == 'O') level = atoi(argv[i] + 2);
 
-  AcirOptimizer optimizer;
-  AcirOptimizer_Init(&optimizer, &(const AcirOptimizer_InitInfo){
-    .allocator = allocator,
-    .source = &inputFunc,
-    .builder = &optimizerBuilder
-  });
+  AcirPassManager passManager;
+  AcirPassManager_Init(&passManager, allocator, level);
+  AcirPassManager_AddDefaultPasses(&passManager);
+  AcirPassManager_Run(&passManager, &mainFunc->builder);
 
-  AcirOptimizer_Analyze(&optimizer);
-  AcirOptimizer_ConstantFold(&optimizer);
-  AcirOptimizer_DeadCode(&optimizer);
+  WRITE_SEPARATOR("Optimized IR");
+  AcirFunction_Print(&mainFunc->function, wsStdout);
+  AnchWriteString(wsStdout, "\n");
+  AcirPassManager_PrintStats(&passManager, wsStdout);
+  AcirPassManager_Free(&passManager);
 
-  AcirBuilder_BuildNormalized(&optimizerBuilder, &outputBuilder);
+  // counts $1 up to 10: the `phi` takes $0 from the entry block and $3 from the loop itself.
+  static const char loopText[] =
+    "$0.uint64 = uint64#0\n"
+    "lbl.void @0\n"
+    "phi.uint64 $0, $3, $1\n"
+    "add.uint64 $1, uint64#1, $3\n"
+    "lth.uint64 $3, uint64#10, $4\n"
+    "br.bool $4, @0, @1\n"
+    "lbl.void @1\n"
+    "ret.uint64 $3\n";
 
-  AcirBuilder_Free(&optimizerBuilder);
-  AcirOptimizer_Free(&optimizer);
+  AcirModuleFunction *loopFunc = AcirModule_Function(&module, AcirModule_AddFunction(&module, "loop", NULL));
+  AcirParser parser;
+  AcirParser_Init(&parser, &module.types, wsStderr, "loop");
+  if(AcirParser_ParseFunction(&parser, loopText, sizeof(loopText) - 1, &loopFunc->builder) > 0) return 0;
 
-  WRITE_SEPARATOR("Optimized IR");
-  AcirFunction_Print(&outputFunc, wsStdout);
+  WRITE_SEPARATOR("Control Flow");
+  AcirFunction_Print(&loopFunc->function, wsStdout);
+  errorCount = AcirModule_Validate(&module, allocator, 1);
+  if(errorCount > 0) {
+    AnchWriteFormat(wsStderr, ANSI_RED "\n%d Errors, Aborting.\n" ANSI_RESET, errorCount);
+    return 0;
+  }
+
+  AcirCfg cfg;
+  AcirCfg_Build(&cfg, &loopFunc->function, allocator);
+  AnchWriteString(wsStdout, "\n");
+  AcirCfg_Print(&cfg, wsStdout);
+  AcirCfg_Free(&cfg);
+
+  AcirDefUse defUse;
+  AcirDefUse_Build(&defUse, &loopFunc->builder, allocator);
+  AnchWriteString(wsStdout, "\n");
+  for(size_t b = 0; b < defUse.bindingCapacity; ++b) {
+    if(AcirDefUse_Def(&defUse, b) == ACIR_DEFUSE_NULL_INDEX) continue;
+    AnchWriteFormat(wsStdout, ANSI_GRAY "$%zu" ANSI_RESET " def %u, uses", b, AcirDefUse_Def(&defUse, b));
+    for(uint32_t use = AcirDefUse_FirstUse(&defUse, b); use != ACIR_DEFUSE_NULL_INDEX; use = AcirDefUse_NextUse(&defUse, use))
+      AnchWriteFormat(wsStdout, " %u.%d", AcirDefUse_UseInstr(use), AcirDefUse_UseSlot(use));
+    AnchWriteString(wsStdout, "\n");
+  }
+  AcirDefUse_Free(&defUse);
+
+  // the same loop through the default passes: once $0 is folded into the `phi` the entry block
+  // is empty, but it still has to enter the loop.
+  AcirModuleFunction *loopOptFunc = AcirModule_Function(&module, AcirModule_AddFunction(&module, "loop_opt", NULL));
+  AcirParser_Init(&parser, &module.types, wsStderr, "loop_opt");
+  if(AcirParser_ParseFunction(&parser, loopText, sizeof(loopText) - 1, &loopOptFunc->builder) > 0) return 0;
+  AcirPassManager_Init(&passManager, allocator, level);
+  AcirPassManager_AddDefaultPasses(&passManager);
+  AcirPassManager_Run(&passManager, &loopOptFunc->builder);
+  AcirPassManager_Free(&passManager);
+
+  WRITE_SEPARATOR("Optimized Control Flow");
+  AcirFunction_Print(&loopOptFunc->function, wsStdout);
+  errorCount = AcirModule_Validate(&module, allocator, 1);
+  if(errorCount > 0) {
+    AnchWriteFormat(wsStderr, ANSI_RED "\n%d Errors, Aborting.\n" ANSI_RESET, errorCount);
+    return 0;
+  }
+
+  // two nested loops: `mul` only reads constants and leaves both, to the start of the code since
+  // the entry block is just a `jmp`; the first `add` reads the outer `phi` and only leaves the inner one.
+  static const char nestedText[] =
+    "nested: fn() uint64\n"
+    "jmp.void @0\n"
+    "lbl.void @0\n"
+    "phi.uint64 uint64#0, $9, $2\n"
+    "lbl.void @1\n"
+    "phi.uint64 uint64#0, $7, $4\n"
+    "mul.uint64 uint64#6, uint64#7, $5\n"
+    "add.uint64 $5, $2, $6\n"
+    "add.uint64 $4, $6, $7\n"
+    "lth.uint64 $7, uint64#50, $8\n"
+    "br.bool $8, @1, @2\n"
+    "lbl.void @2\n"
+    "add.uint64 $2, uint64#1, $9\n"
+    "lth.uint64 $9, uint64#4, $10\n"
+    "br.bool $10, @0, @3\n"
+    "lbl.void @3\n"
+    "ret.uint64 $7\n";
+
+  AcirModule loopModule;
+  AcirModule_Init(&loopModule, allocator);
+  AcirParser_Init(&parser, &loopModule.types, wsStderr, "nested");
+  if(AcirParser_ParseModule(&parser, nestedText, sizeof(nestedText) - 1, &loopModule) > 0) return 0;
+  AcirModuleFunction *nestedFunc = AcirModule_Function(&loopModule, 0);
+
+  AcirPassManager_Init(&passManager, allocator, 2);
+  AcirPassManager_AddPass(&passManager, &(AcirPass){ "licm", &AcirPass_Licm, 2, ACIR_ANALYSIS_LOOPS | ACIR_ANALYSIS_DEFUSE, ACIR_ANALYSIS_CFG });
+  AcirPassManager_Run(&passManager, &nestedFunc->builder);
+  AcirPassManager_Free(&passManager);
+
+  WRITE_SEPARATOR("Loop-Invariant Code Motion");
+  errorCount = AcirModule_Validate(&loopModule, allocator, 1);
+  if(errorCount > 0) {
+    AnchWriteFormat(wsStderr, ANSI_RED "\n%d Errors, Aborting.\n" ANSI_RESET, errorCount);
+    return 0;
+  }
 
-  AcirBuilder_Free(&outputBuilder);
+  // every instruction with the number of loops around it after the move.
+  AcirDomTree doms;
+  AcirLoopForest loops;
+  AcirCfg_Build(&cfg, &nestedFunc->function, allocator);
+  AcirDomTree_Build(&doms, &cfg, allocator);
+  AcirLoopForest_Build(&loops, &cfg, &doms, allocator);
+  AnchWriteFormat(wsStdout, ANSI_GRAY "%u loops.\n" ANSI_RESET, loops.loopCount);
+  uint32_t depths[ACIR_OPCODE_MAX_] = {0};
+  for(uint32_t i = 0; i < cfg.instrCount; ++i) {
+    const AcirInstr *instr = &nestedFunc->function.instrs[cfg.order[i]];
+    uint32_t depth = AcirLoopForest_Depth(&loops, cfg.instrBlocks[cfg.order[i]]);
+    if(instr->opcode == ACIR_OPCODE_MUL || instr->opcode == ACIR_OPCODE_ADD) depths[instr->opcode] += depth;
+    AnchWriteFormat(wsStdout, ANSI_GRAY "depth %u " ANSI_RESET, depth);
+    AcirInstr_Print(wsStdout, instr);
+    AnchWriteString(wsStdout, "\n");
+  }
+  // `mul` left both loops, the `add`s are one in the outer loop and two in the inner one.
+  if(depths[ACIR_OPCODE_MUL] != 0 || depths[ACIR_OPCODE_ADD] != 1 + 1 + 2) {
+    AnchWriteFormat(wsStderr, ANSI_RED "\nHoisted the wrong instructions, Aborting.\n" ANSI_RESET);
+    return 0;
+  }
+  AcirLoopForest_Free(&loops);
+  AcirDomTree_Free(&doms);
+  AcirCfg_Free(&cfg);
+  AcirModule_Free(&loopModule);
+
+  // `max` has blocks of its own and gets a constant argument, `even` and `odd` call each other and
+  // keep those calls: only the first one, from `main`, can go.
+  static const char callText[] =
+    "max: fn(uint64, uint64) uint64\n"
+    "par.uint64 uint32#0, $0\n"
+    "par.uint64 uint32#1, $1\n"
+    "lth.uint64 $0, $1, $2\n"
+    "br.bool $2, @0, @1\n"
+    "lbl.void @0\n"
+    "jmp.void @2\n"
+    "lbl.void @1\n"
+    "jmp.void @2\n"
+    "lbl.void @2\n"
+    "phi.uint64 $1, $0, $3\n"
+    "ret.uint64 $3\n"
+    "even: fn(uint64) bool\n"
+    "par.uint64 uint32#0, $0\n"
+    "eql.uint64 $0, uint64#0, $1\n"
+    "br.bool $1, @0, @1\n"
+    "lbl.void @0\n"
+    "jmp.void @2\n"
+    "lbl.void @1\n"
+    "sub.uint64 $0, uint64#1, $2\n"
+    "arg.uint64 $2\n"
+    "call.bool &2, $3\n"
+    "jmp.void @2\n"
+    "lbl.void @2\n"
+    "phi.bool bool#true, $3, $4\n"
+    "ret.bool $4\n"
+    "odd: fn(uint64) bool\n"
+    "par.uint64 uint32#0, $0\n"
+    "eql.uint64 $0, uint64#0, $1\n"
+    "br.bool $1, @0, @1\n"
+    "lbl.void @0\n"
+    "jmp.void @2\n"
+    "lbl.void @1\n"
+    "sub.uint64 $0, uint64#1, $2\n"
+    "arg.uint64 $2\n"
+    "call.bool &1, $3\n"
+    "jmp.void @2\n"
+    "lbl.void @2\n"
+    "phi.bool bool#false, $3, $4\n"
+    "ret.bool $4\n"
+    "main: fn(uint64) uint64\n"
+    "par.uint64 uint32#0, $0\n"
+    "arg.uint64 $0\n"
+    "arg.uint64 uint64#100\n"
+    "call.uint64 &0, $1\n"
+    "arg.uint64 $1\n"
+    "call.bool &1, $2\n"
+    "br.bool $2, @0, @1\n"
+    "lbl.void @0\n"
+    "ret.uint64 $1\n"
+    "lbl.void @1\n"
+    "ret.uint64 uint64#0\n";
+
+  AcirModule callModule;
+  AcirModule_Init(&callModule, allocator);
+  AcirParser_Init(&parser, &callModule.types, wsStderr, "calls");
+  if(AcirParser_ParseModule(&parser, callText, sizeof(callText) - 1, &callModule) > 0) return 0;
+
+  AcirPassManager_Init(&passManager, allocator, 2);
+  AcirPassManager_AddDefaultPasses(&passManager);
+  AcirPassManager_RunModule(&passManager, &callModule);
+  uint32_t inlinedCalls = passManager.inlinedCalls;
+  AcirPassManager_Free(&passManager);
+
+  WRITE_SEPARATOR("Inlining");
+  AcirFunction_Print(&AcirModule_Function(&callModule, 3)->function, wsStdout);
+  errorCount = AcirModule_Validate(&callModule, allocator, 1);
+  if(errorCount > 0) {
+    AnchWriteFormat(wsStderr, ANSI_RED "\n%d Errors, Aborting.\n" ANSI_RESET, errorCount);
+    return 0;
+  }
+
+  // calls left in every function, by callee.
+  uint32_t calls[4][4] = {0};
+  for(uint32_t f = 0; f < callModule.functionCount; ++f) {
+    const AcirFunction *function = &AcirModule_Function(&callModule, f)->function;
+    for(size_t i = function->code; i != ACIR_INSTR_NULL_INDEX; i = function->instrs[i].next)
+      if(function->instrs[i].opcode == ACIR_OPCODE_CALL) calls[f][function->instrs[i].val.idx] += 1;
+  }
+  AnchWriteFormat(wsStdout, ANSI_GRAY "\n%u calls inlined.\n" ANSI_RESET, inlinedCalls);
+  if(calls[3][0] != 0 || calls[3][1] != 0 || calls[1][2] != 1 || calls[2][1] != 1) {
+    AnchWriteFormat(wsStderr, ANSI_RED "\nInlined the wrong calls, Aborting.\n" ANSI_RESET);
+    return 0;
+  }
+  AcirModule_Free(&callModule);
+
+  // `b` is `a` under other binding numbers: they share a key, and only `a` is optimized.
+  static const char memoText[] =
+    "a: fn(uint64) uint64\n"
+    "par.uint64 uint32#0, $0\n"
+    "mul.uint64 $0, uint64#2, $1\n"
+    "add.uint64 $1, uint64#0, $2\n"
+    "ret.uint64 $2\n"
+    "b: fn(uint64) uint64\n"
+    "par.uint64 uint32#0, $7\n"
+    "mul.uint64 $7, uint64#2, $3\n"
+    "add.uint64 $3, uint64#0, $9\n"
+    "ret.uint64 $9\n";
+  static const char memoFile[] = "acir_memo.bin";
+
+  AcirMemo memo;
+  AcirMemo_Init(&memo, allocator);
+  WRITE_SEPARATOR("Memo");
+  for(int round = 0; round < 2; ++round) {
+    AcirModule memoModule;
+    AcirModule_Init(&memoModule, allocator);
+    AcirParser_Init(&parser, &memoModule.types, wsStderr, "memo");
+    if(AcirParser_ParseModule(&parser, memoText, sizeof(memoText) - 1, &memoModule) > 0) return 0;
+
+    AnchDynArray keys[2];
+    for(uint32_t f = 0; f < 2; ++f) {
+      AnchDynArray_Init(&keys[f], allocator, 256);
+      AcirMemo_Key(&keys[f], &memoModule, &AcirModule_Function(&memoModule, f)->function);
+    }
+    bool sameKey = keys[0].size == keys[1].size && memcmp(keys[0].data, keys[1].data, keys[0].size) == 0;
+    AnchDynArray_Free(&keys[0]);
+    AnchDynArray_Free(&keys[1]);
+
+    uint32_t hits = memo.hits;
+    AcirPassManager_Init(&passManager, allocator, 2);
+    AcirPassManager_AddDefaultPasses(&passManager);
+    passManager.memo = &memo;
+    AcirPassManager_RunModule(&passManager, &memoModule);
+    AcirPassManager_Free(&passManager);
+
+    // the first round fills the memo from `a`, the second one starts from what was saved.
+    AnchWriteFormat(wsStdout, ANSI_GRAY "round %d: %s key, %u hits, %u entries.\n" ANSI_RESET,
+      round, sameKey ? "same" : "different", memo.hits - hits, memo.entryCount);
+    if(round == 0) AcirModule_Print(&memoModule, wsStdout);
+    errorCount = AcirModule_Validate(&memoModule, allocator, 1);
+    AcirModule_Free(&memoModule);
+    if(errorCount > 0 || !sameKey || memo.hits - hits != (uint32_t)round + 1) {
+      AnchWriteFormat(wsStderr, ANSI_RED "\nThe memo missed, Aborting.\n" ANSI_RESET);
+      return 0;
+    }
+
+    if(round == 0) {
+      bool saved = AcirMemo_Save(&memo, memoFile);
+      AcirMemo_Free(&memo);
+      AcirMemo_Init(&memo, allocator);
+      if(!saved || !AcirMemo_Load(&memo, memoFile)) {
+        AnchWriteFormat(wsStderr, ANSI_RED "\nCouldn't save and load the memo, Aborting.\n" ANSI_RESET);
+        return 0;
+      }
+      remove(memoFile);
+    }
+  }
+  AcirMemo_Free(&memo);
+
+  // immediates are shared through the module's constant pool.
+  for(uint32_t f = 0; f < module.functionCount; ++f) {
+    const AcirFunction *function = &AcirModule_Function(&module, f)->function;
+    for(size_t i = 0; i < function->instrCount; ++i) {
+      const AcirInstr *instr = &function->instrs[i];
+      const AcirOperand *ops[] = { &instr->lhs, &instr->rhs };
+      int count = AcirOpcode_OperandCount(instr->opcode) == 3 ? 2 : 1;
+      for(int j = 0; j < count; ++j)
+        if(ops[j]->type == ACIR_OPERAND_TYPE_IMMEDIATE) AcirModule_Constant(&module, &ops[j]->imm);
+    }
+  }
+
+  WRITE_SEPARATOR("Module");
+  AcirModule_Print(&module, wsStdout);
+
+  AcirBinaryWriter writer;
+  AcirBinaryWriter_Init(&writer, allocator);
+  AcirBinaryWriter_AddModule(&writer, &module);
+  size_t binarySize;
+  void *binary = AcirBinaryWriter_Finish(&writer, &binarySize);
+  AcirBinaryWriter_Free(&writer);
+
+  AcirModule loadedModule;
+  AcirModule_Init(&loadedModule, allocator);
+  AcirBinaryReader reader;
+  AcirBinaryError binaryError = AcirBinaryReader_Init(&reader, binary, binarySize, &loadedModule.types, allocator);
+  if(binaryError == ACIR_BINARY_OK) binaryError = AcirBinaryReader_ReadModule(&reader, &loadedModule);
+  AcirBinaryReader_Free(&reader);
+
+  WRITE_SEPARATOR("Binary");
+  if(binaryError != ACIR_BINARY_OK) {
+    AnchWriteFormat(wsStderr, ANSI_RED "Error: " ANSI_RESET "%s.\n", AcirBinaryError_Message(binaryError));
+  } else {
+    // functions are checked in parallel, which needs the thread-safe default allocator.
+    AnchWriteFormat(wsStdout, ANSI_GRAY "%zu bytes, %d errors after loading.\n" ANSI_RESET,
+      binarySize, AcirModule_Validate(&loadedModule, &defaultAllocator, 0));
+    AcirModule_Print(&loadedModule, wsStdout);
+  }
+  AnchAllocator_Free(allocator, binary);
+  AcirModule_Free(&loadedModule);
+  AcirModule_Free(&module);
 }
@@ -0,0 +1,148 @@
+#include <acir/acir.h>
+#include <annec_anchor.h>
+#include <assert.h>
+#include "../cli.h"
+
+#define COMMA ,
+#define TMP(NAME, MNEMONIC, DESCRIPTION) { ACIR_VALUE_TYPE_BASIC, .basic = ACIR_BASIC_VALUE_TYPE_##NAME }
+static const AcirValueType AcirValueType_Basics_[] = { ACIR_BASIC_VALUE_TYPES_ENUM(TMP, COMMA) };
+#undef TMP
+#undef COMMA
+
+const AcirValueType *AcirValueType_Basic(AcirBasicValueType type) {
+  assert(type < ACIR_BASIC_VALUE_TYPE_MAX_);
+  return &AcirValueType_Basics_[type];
+}
+
+static uint64_t AcirTypeTable_Mix_(uint64_t h, const void *part) {
+  return AcirHash_Mix(h ^ (uintptr_t)part);
+}
+
+// parts of interned types are interned too, so hashing and comparing them shallowly is enough.
+
+static uint64_t AcirTypeTable_Hash_(const AcirValueType *type) {
+  uint64_t h = 0x9E3779B97F4A7C15u * (type->type + 1);
+  if(type->type == ACIR_VALUE_TYPE_POINTER) return AcirTypeTable_Mix_(h, type->pointer);
+  assert(type->type == ACIR_VALUE_TYPE_FUNCTION);
+  h = AcirTypeTable_Mix_(h, type->function->returnType);
+  for(size_t i = 0; i < type->function->argumentCount; ++i)
+    h = AcirTypeTable_Mix_(h, type->function->argumentTypes[i]);
+  return AcirTypeTable_Mix_(h, (void*)type->function->argumentCount);
+}
+
+static bool AcirTypeTable_Same_(const AcirValueType *self, const AcirValueType *other) {
+  if(self->type != other->type) return false;
+  if(self->type == ACIR_VALUE_TYPE_POINTER) return self->pointer == other->pointer;
+  const AcirFunctionValueType *a = self->function, *b = other->function;
+  if(a->returnType != b->returnType || a->argumentCount != b->argumentCount) return false;
+  for(size_t i = 0; i < a->argumentCount; ++i)
+    if(a->argumentTypes[i] != b->argumentTypes[i]) return false;
+  return true;
+}
+
+/** Slot holding a type equal to KEY, or the empty slot where it belongs. */
+static size_t AcirTypeTable_Slot_(const AcirTypeTable *self, const AcirValueType *key) {
+  size_t mask = self->capacity - 1;
+  for(size_t i = AcirTypeTable_Hash_(key) & mask; ; i = (i + 1) & mask) {
+    if(self->slots[i] == NULL || AcirTypeTable_Same_(self->slots[i], key)) return i;
+  }
+}
+
+static void AcirTypeTable_Grow_(AcirTypeTable *self) {
+  AcirTypeTable old = *self;
+  self->capacity *= 2;
+  self->slots = AnchAllocator_AllocZero(self->allocator, sizeof(const AcirValueType*) * self->capacity);
+  for(size_t i = 0; i < old.capacity; ++i) {
+    if(old.slots[i] != NULL) self->slots[AcirTypeTable_Slot_(self, old.slots[i])] = old.slots[i];
+  }
+  AnchAllocator_Free(self->allocator, old.slots);
+}
+
+void AcirTypeTable_Init(AcirTypeTable *self, AnchAllocator *allocator) {
+  assert(self != NULL);
+  self->allocator = allocator;
+  self->count = 0;
+  self->capacity = 64;
+  self->slots = AnchAllocator_AllocZero(allocator, sizeof(const AcirValueType*) * self->capacity);
+}
+
+void AcirTypeTable_Free(AcirTypeTable *self) {
+  assert(self != NULL);
+  for(size_t i = 0; i < self->capacity; ++i) {
+    const AcirValueType *type = self->slots[i];
+    if(type == NULL) continue;
+    if(type->type == ACIR_VALUE_TYPE_FUNCTION)
+      AnchAllocator_Free(self->allocator, (void*)type->function);
+    AnchAllocator_Free(self->allocator, (void*)type);
+  }
+  AnchAllocator_Free(self->allocator, self->slots);
+  self->allocator = NULL;
+  self->count = 0;
+  self->capacity = 0;
+  self->slots = NULL;
+}
+
+/** Find KEY, or insert a copy of it. The function part of KEY is not copied, the table owns it once inserted. */
+static const AcirValueType *AcirTypeTable_Insert_(AcirTypeTable *self, const AcirValueType *key) {
+  size_t slot = AcirTypeTable_Slot_(self, key);
+  if(self->slots[slot] != NULL) return self->slots[slot];
+
+  AcirValueType *type = AnchAllocator_Alloc(self->allocator, sizeof(AcirValueType));
+  *type = *key;
+
+  self->slots[slot] = type;
+  if(++self->count * 2 > self->capacity) AcirTypeTable_Grow_(self);
+  return type;
+}
+
+const AcirValueType *AcirTypeTable_Pointer(AcirTypeTable *self, const AcirValueType *pointee) {
+  assert(self != NULL);
+  assert(pointee != NULL);
+  return AcirTypeTable_Insert_(self, &(AcirValueType){ ACIR_VALUE_TYPE_POINTER, .pointer = pointee });
+}
+
+const AcirValueType *AcirTypeTable_FindPointer(const AcirTypeTable *self, const AcirValueType *pointee) {
+  assert(self != NULL);
+  assert(pointee != NULL);
+  return self->slots[AcirTypeTable_Slot_(self, &(AcirValueType){ ACIR_VALUE_TYPE_POINTER, .pointer = pointee })];
+}
+
+const AcirValueType *AcirTypeTable_Function(AcirTypeTable *self,
+  const AcirValueType *returnType, size_t argumentCount, const AcirValueType *const *argumentTypes
+) {
+  assert(self != NULL);
+  assert(returnType != NULL);
+  assert(argumentCount == 0 || argumentTypes != NULL);
+
+  AcirFunctionValueType *function = AnchAllocator_Alloc(self->allocator,
+    sizeof(AcirFunctionValueType) + sizeof(const AcirValueType*) * argumentCount);
+  function->returnType = returnType;
+  function->argumentCount = argumentCount;
+  for(size_t i = 0; i < argumentCount; ++i) function->argumentTypes[i] = argumentTypes[i];
+
+  size_t oldCount = self->count;
+  const AcirValueType *type = AcirTypeTable_Insert_(self,
+    &(AcirValueType){ ACIR_VALUE_TYPE_FUNCTION, .function = function });
+  if(self->count == oldCount) AnchAllocator_Free(self->allocator, function);
+  return type;
+}
+
+const AcirValueType *AcirTypeTable_Intern(AcirTypeTable *self, const AcirValueType *type) {
+  assert(self != NULL);
+  assert(type != NULL);
+  switch(type->type) {
+    case ACIR_VALUE_TYPE_BASIC: return AcirValueType_Basic(type->basic);
+    case ACIR_VALUE_TYPE_POINTER: return AcirTypeTable_Pointer(self, AcirTypeTable_Intern(self, type->pointer));
+    case ACIR_VALUE_TYPE_FUNCTION: {
+      const AcirFunctionValueType *function = type->function;
+      const AcirValueType *arguments[function->argumentCount + 1];
+      for(size_t i = 0; i < function->argumentCount; ++i)
+        arguments[i] = AcirTypeTable_Intern(self, function->argumentTypes[i]);
+      return AcirTypeTable_Function(self, AcirTypeTable_Intern(self, function->returnType),
+        function->argumentCount, arguments);
+    }
+    default:
+      assert(false && "bad value type");
+      return NULL;
+  }
+}
@@ -2,7 +2,11 @@
 #include <assert.h>
 #include <ctype.h>
 #include <string.h>
+#include <stddef.h>
 #include <stdlib.h>
+#include <stdatomic.h>
+#include <threads.h>
+#include <unistd.h>
 
 //////////////////////////////////////////////////////////////////////////////////////////
 
@@ -88,6 +92,30 @@ void AnchFileReadStream_Rewind(AnchFileReadStream *self) {
 
 //////////////////////////////////////////////////////////////////////////////////////////
 
+void AnchBufferWriteStream_Write(AnchCharWriteStream *self, int c) {
+  assert(self != NULL);
+  ANCH_DYNARRAY_PUSH(&((AnchBufferWriteStream*)self)->buffer, char, c);
+}
+
+void AnchBufferWriteStream_Init(AnchBufferWriteStream *self, AnchAllocator *allocator) {
+  assert(self != NULL);
+  self->stream.write = &AnchBufferWriteStream_Write;
+  AnchDynArray_Init(&self->buffer, allocator, 0);
+}
+
+void AnchBufferWriteStream_Free(AnchBufferWriteStream *self) {
+  assert(self != NULL);
+  AnchDynArray_Free(&self->buffer);
+}
+
+void AnchBufferWriteStream_WriteTo(const AnchBufferWriteStream *self, AnchCharWriteStream *out) {
+  assert(self != NULL);
+  for(size_t i = 0; i < self->buffer.size; ++i)
+    AnchWriteChar(out, self->buffer.data[i]);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+
 void AnchByteFileWriteStream_Write(AnchByteWriteStream *self, uint8_t c) {
   assert(self != NULL);
   fputc(c, ((AnchByteFileWriteStream*)self)->handle);
@@ -170,6 +198,83 @@ void AnchByteFileReadStream_Rewind(AnchByteFileReadStream *self) {
 
 //////////////////////////////////////////////////////////////////////////////////////////
 
+uint8_t AnchMemoryByteReadStream_Read(AnchByteReadStream *self_) {
+  assert(self_ != NULL);
+  AnchMemoryByteReadStream *self = (AnchMemoryByteReadStream*)self_;
+  if(self->offset >= self->size) return (uint8_t)EOF;
+  return self->data[self->offset++];
+}
+
+void AnchMemoryByteReadStream_Init(AnchMemoryByteReadStream *self, const uint8_t *data, size_t size) {
+  assert(self != NULL);
+  assert(data != NULL || size == 0);
+  self->stream.read = &AnchMemoryByteReadStream_Read;
+  self->data = data;
+  self->size = size;
+  self->offset = 0;
+}
+
+void AnchMemoryByteReadStream_Rewind(AnchMemoryByteReadStream *self) {
+  assert(self != NULL);
+  self->offset = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+
+size_t AnchProcessorCount(void) {
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (size_t)count : 1;
+}
+
+typedef struct {
+  size_t count;
+  atomic_size_t next;
+  AnchParallelForFunc *func;
+  void *context;
+} AnchParallelFor_Shared_;
+
+typedef struct {
+  AnchParallelFor_Shared_ *shared;
+  size_t worker;
+} AnchParallelFor_Worker_;
+
+static int AnchParallelFor_Run_(void *arg) {
+  AnchParallelFor_Worker_ *worker = arg;
+  AnchParallelFor_Shared_ *shared = worker->shared;
+  for(;;) {
+    size_t index = atomic_fetch_add_explicit(&shared->next, 1, memory_order_relaxed);
+    if(index >= shared->count) break;
+    shared->func(shared->context, index, worker->worker);
+  }
+  return 0;
+}
+
+void AnchParallelFor(size_t count, size_t threadCount, AnchParallelForFunc *func, void *context) {
+  assert(func != NULL);
+  if(count == 0) return;
+  if(threadCount == 0) threadCount = AnchProcessorCount();
+  if(threadCount > count) threadCount = count;
+
+  AnchParallelFor_Shared_ shared = { .count = count, .func = func, .context = context };
+  atomic_init(&shared.next, 0);
+
+  // the calling thread is worker 0.
+  thrd_t threads[threadCount];
+  AnchParallelFor_Worker_ workers[threadCount];
+  size_t started = 1;
+  for(size_t i = 0; i < threadCount; ++i)
+    workers[i] = (AnchParallelFor_Worker_){ &shared, i };
+  for(size_t i = 1; i < threadCount; ++i, ++started) {
+    if(thrd_create(&threads[i], &AnchParallelFor_Run_, &workers[i]) != thrd_success) break;
+  }
+
+  AnchParallelFor_Run_(&workers[0]);
+  for(size_t i = 1; i < started; ++i)
+    thrd_join(threads[i], NULL);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+
 char32_t AnchUtf8ReadStream_Read(AnchUtf8ReadStream *self) {
   assert(self != NULL);
   mbstate_t state = {};
@@ -196,6 +301,58 @@ void AnchUtf8WriteStream_Write(AnchUtf8WriteStream *self, char32_t value) {
     AnchByteWriteStream_Write(self, data[i]);
 }
 
+int AnchUtf8Decode(const uint8_t *bytes, size_t size, char32_t *out) {
+  assert(bytes != NULL);
+  assert(out != NULL);
+  if(size == 0) return 0;
+
+  uint8_t lead = bytes[0];
+  if(lead < 0x80) { *out = lead; return 1; }
+
+  int length;
+  char32_t value, min;
+  if((lead & 0xE0) == 0xC0) { length = 2; value = lead & 0x1F; min = 0x80; }
+  else if((lead & 0xF0) == 0xE0) { length = 3; value = lead & 0x0F; min = 0x800; }
+  else if((lead & 0xF8) == 0xF0) { length = 4; value = lead & 0x07; min = 0x10000; }
+  else return 0;
+
+  if(size < (size_t)length) return 0;
+  for(int i = 1; i < length; ++i) {
+    if((bytes[i] & 0xC0) != 0x80) return 0;
+    value = (value << 6) | (bytes[i] & 0x3F);
+  }
+
+  // overlong encodings, surrogates and values past the unicode range.
+  if(value < min || value > 0x10FFFF || (value >= 0xD800 && value <= 0xDFFF)) return 0;
+  *out = value;
+  return length;
+}
+
+int AnchUtf8Encode(char32_t value, uint8_t out[4]) {
+  assert(out != NULL);
+  if(value < 0x80) {
+    out[0] = value;
+    return 1;
+  } else if(value < 0x800) {
+    out[0] = 0xC0 | (value >> 6);
+    out[1] = 0x80 | (value & 0x3F);
+    return 2;
+  } else if(value < 0x10000) {
+    if(value >= 0xD800 && value <= 0xDFFF) return 0;
+    out[0] = 0xE0 | (value >> 12);
+    out[1] = 0x80 | ((value >> 6) & 0x3F);
+    out[2] = 0x80 | (value & 0x3F);
+    return 3;
+  } else if(value <= 0x10FFFF) {
+    out[0] = 0xF0 | (value >> 18);
+    out[1] = 0x80 | ((value >> 12) & 0x3F);
+    out[2] = 0x80 | ((value >> 6) & 0x3F);
+    out[3] = 0x80 | (value & 0x3F);
+    return 4;
+  }
+  return 0;
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////
 
 void AnchWriteString(AnchCharWriteStream *out, const char *string) {
@@ -286,6 +443,7 @@ void AnchStatsAllocator_Init(AnchStatsAllocator *self, AnchAllocator *allocator)
   self->base.free = &AnchStatsAllocator_Free;
   self->allocator = allocator;
   self->allocCount = 0;
+  self->allocZeroCount = 0;
   self->reallocCount = 0;
   self->freeCount = 0;
 }
@@ -316,6 +474,116 @@ void AnchStatsAllocator_Free(AnchAllocator *self_, void *ptr) {
 
 //////////////////////////////////////////////////////////////////////////////////////////
 
+struct AnchRegionBlock_ {
+  AnchRegionBlock_ *next;
+  size_t size;
+  size_t used;
+  _Alignas(max_align_t) uint8_t data[];
+};
+
+// every allocation is preceded by its size, so that it can be copied when reallocated.
+#define ANCH_REGION_HEADER_ ANCH_ROUNDUP_POWEROF2(sizeof(size_t), _Alignof(max_align_t))
+#define ANCH_REGION_SIZE_(PTR) (*(size_t*)((uint8_t*)(PTR) - ANCH_REGION_HEADER_))
+
+void AnchRegionAllocator_Init(AnchRegionAllocator *self, AnchAllocator *allocator, size_t blockSize) {
+  assert(self != NULL);
+  self->base.alloc = &AnchRegionAllocator_Alloc;
+  self->base.allocZero = NULL;
+  self->base.realloc = &AnchRegionAllocator_Realloc;
+  self->base.free = &AnchRegionAllocator_Free_;
+  self->allocator = allocator;
+  self->blockSize = blockSize ? blockSize : 64 * 1024;
+  self->blocks = NULL;
+  self->last = NULL;
+}
+
+void AnchRegionAllocator_Free(AnchRegionAllocator *self) {
+  assert(self != NULL);
+  for(AnchRegionBlock_ *block = self->blocks, *next; block != NULL; block = next) {
+    next = block->next;
+    AnchAllocator_Free(self->allocator, block);
+  }
+  self->blocks = NULL;
+  self->last = NULL;
+}
+
+void *AnchRegionAllocator_Alloc(AnchAllocator *self_, size_t size) {
+  AnchRegionAllocator *self = (AnchRegionAllocator *)self_;
+  if(size > SIZE_MAX - ANCH_REGION_HEADER_ - sizeof(AnchRegionBlock_) - _Alignof(max_align_t)) return NULL;
+  size_t need = ANCH_REGION_HEADER_ + ANCH_ROUNDUP_POWEROF2(size, _Alignof(max_align_t));
+
+  AnchRegionBlock_ *block = self->blocks;
+  if(block == NULL || block->size - block->used < need) {
+    if(need > self->blockSize / 2) {
+      // big allocations get their own block, behind the current one so that it keeps filling up.
+      block = AnchAllocator_Alloc(self->allocator, sizeof(AnchRegionBlock_) + need);
+      if(block == NULL) return NULL;
+      block->size = block->used = need;
+      if(self->blocks == NULL) {
+        block->next = NULL;
+        self->blocks = block;
+      } else {
+        block->next = self->blocks->next;
+        self->blocks->next = block;
+      }
+      ANCH_REGION_SIZE_(block->data + ANCH_REGION_HEADER_) = size;
+      return self->last = block->data + ANCH_REGION_HEADER_;
+    }
+
+    block = AnchAllocator_Alloc(self->allocator, sizeof(AnchRegionBlock_) + self->blockSize);
+    if(block == NULL) return NULL;
+    block->size = self->blockSize;
+    block->used = 0;
+    block->next = self->blocks;
+    self->blocks = block;
+  }
+
+  uint8_t *ptr = block->data + block->used + ANCH_REGION_HEADER_;
+  block->used += need;
+  ANCH_REGION_SIZE_(ptr) = size;
+  return self->last = ptr;
+}
+
+void *AnchRegionAllocator_Realloc(AnchAllocator *self_, size_t size, void *ptr) {
+  AnchRegionAllocator *self = (AnchRegionAllocator *)self_;
+  if(ptr == NULL) return AnchRegionAllocator_Alloc(self_, size);
+
+  size_t oldSize = ANCH_REGION_SIZE_(ptr);
+  AnchRegionBlock_ *block = self->blocks;
+  if(ptr == self->last && block != NULL && (uint8_t*)ptr >= block->data && (uint8_t*)ptr < block->data + block->size) {
+    size_t end = (uint8_t*)ptr - block->data + ANCH_ROUNDUP_POWEROF2(size, _Alignof(max_align_t));
+    if(end <= block->size) {
+      block->used = end;
+      ANCH_REGION_SIZE_(ptr) = size;
+      return ptr;
+    }
+  }
+  if(size <= oldSize) {
+    ANCH_REGION_SIZE_(ptr) = size;
+    return ptr;
+  }
+
+  void *new = AnchRegionAllocator_Alloc(self_, size);
+  if(new == NULL) return NULL;
+  memcpy(new, ptr, oldSize);
+  return new;
+}
+
+void AnchRegionAllocator_Free_(AnchAllocator *self_, void *ptr) {
+  AnchRegionAllocator *self = (AnchRegionAllocator *)self_;
+  AnchRegionBlock_ *block = self->blocks;
+  if(ptr == NULL || ptr != self->last || block == NULL) return;
+  // only the top of the current block can be given back.
+  if((uint8_t*)ptr >= block->data && (uint8_t*)ptr < block->data + block->size)
+    block->used = (uint8_t*)ptr - block->data - ANCH_REGION_HEADER_;
+  self->last = NULL;
+}
+
+#undef ANCH_REGION_SIZE_
+#undef ANCH_REGION_HEADER_
+
+//////////////////////////////////////////////////////////////////////////////////////////
+
 void AnchArena_Init(AnchArena *self, AnchAllocator *allocator, size_t step) {
   assert(self != NULL);
 
@@ -0,0 +1,394 @@
+#include <locale.h>
+#include <time.h>
+#include <annec/lexer.h>
+#include "../cli.h"
+
+AnchCharWriteStream *wsStdout;
+AnchCharWriteStream *wsStderr;
+
+// Lexer throughput benchmark.
+//
+// Generates a synthetic source with a seeded PRNG, tokenizes it through `AncLexer_Read`
+// and reports MB/s, tokens/s and allocator counts. Every run is also written as one JSON
+// object per line so results from different commits can be diffed or plotted.
+//
+// Usage: bench_lexer [-s SIZE] [-S SEED] [-p PROFILE] [-n ITERATIONS] [-w WINDOW] [-o FILE] [-l LABEL]
+
+typedef enum BenchTokenKind_ {
+	BENCH_TOKEN_KIND_IDENT,
+	BENCH_TOKEN_KIND_KEYWORD,
+	BENCH_TOKEN_KIND_INTLIT,
+	BENCH_TOKEN_KIND_FLOATLIT,
+	BENCH_TOKEN_KIND_STRING,
+	BENCH_TOKEN_KIND_CHARLIT,
+	BENCH_TOKEN_KIND_PUNCT,
+	BENCH_TOKEN_KIND_LINE_COMMENT,
+	BENCH_TOKEN_KIND_BLOCK_COMMENT,
+	BENCH_TOKEN_KIND_MAX_,
+} BenchTokenKind_;
+
+// X(NAME, IDENT, KEYWORD, INTLIT, FLOATLIT, STRING, CHARLIT, PUNCT, LINE_COMMENT, BLOCK_COMMENT)
+#define BENCH_PROFILES_(X, S) \
+	X(ident, 60, 15, 4, 1, 2, 1, 15, 1, 1) S \
+	X(literal, 10, 5, 30, 15, 25, 10, 5, 0, 0) S \
+	X(comment, 15, 5, 3, 1, 2, 1, 8, 35, 30) S \
+	X(mixed, 35, 12, 12, 5, 8, 3, 20, 3, 2)
+
+#define COMMA ,
+#define TMP(NAME, ...) { #NAME, { __VA_ARGS__ } }
+static const struct {
+	const char *name;
+	unsigned int weights[BENCH_TOKEN_KIND_MAX_];
+} BenchProfiles_[] = { BENCH_PROFILES_(TMP, COMMA) };
+#undef TMP
+#undef COMMA
+
+#define BENCH_PROFILE_COUNT_ (sizeof(BenchProfiles_) / sizeof(BenchProfiles_[0]))
+
+static const char *const BenchKeywords_[] = {
+#define X(NAME, KW) #KW
+	ANC_X_TOKEN_TYPE_KEYWORDS_(X, ANC_X__COMMA_)
+#undef X
+};
+
+static const char *const BenchPuncts_[] = {
+	"+", "-", "*", "%", "~", "&", "|", "^", "=", "!", "<", ">",
+	"[", "]", "(", ")", "{", "}", "?", ":", ";", ",",
+};
+
+static const char *const BenchEscapes_[] = { "\\n", "\\t", "\\\\", "\\\"", "\\x41", "\\033", "\\u00e9" };
+
+/** xorshift64* - deterministic across platforms for a given seed. */
+static uint64_t BenchRandom_(uint64_t *state) {
+	uint64_t x = *state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+static size_t BenchRandomRange_(uint64_t *state, size_t lo, size_t hi) {
+	return lo + BenchRandom_(state) % (hi - lo + 1);
+}
+
+static void BenchPutString_(AnchDynArray *out, const char *str) {
+	size_t len = strlen(str);
+	memcpy(AnchDynArray_Push(out, len), str, len);
+}
+
+static void BenchPutChar_(AnchDynArray *out, char c) {
+	*(char*)AnchDynArray_Push(out, 1) = c;
+}
+
+static void BenchPutFormat_(AnchDynArray *out, const char *format, ...)
+	__attribute__((format(printf, 2, 3)));
+
+static void BenchPutFormat_(AnchDynArray *out, const char *format, ...) {
+	char buf[64];
+	va_list va;
+	va_start(va, format);
+	int len = vsnprintf(buf, sizeof(buf), format, va);
+	va_end(va);
+	assert(len >= 0 && (size_t)len < sizeof(buf));
+	memcpy(AnchDynArray_Push(out, len), buf, len);
+}
+
+static void BenchPutIdent_(AnchDynArray *out, uint64_t *rng) {
+	static const char first[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_";
+	static const char rest[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789";
+	size_t len = BenchRandomRange_(rng, 1, 16);
+	BenchPutChar_(out, first[BenchRandom_(rng) % (sizeof(first) - 1)]);
+	for(size_t i = 1; i < len; ++i)
+		BenchPutChar_(out, rest[BenchRandom_(rng) % (sizeof(rest) - 1)]);
+}
+
+static void BenchPutQuoted_(AnchDynArray *out, uint64_t *rng, char quote, size_t maxLength) {
+	static const char chars[] = "abcdefghijklmnopqrstuvwxyz ABCDEFGHIJKLMNOPQRSTUVWXYZ.,;:!?-+=";
+	BenchPutChar_(out, quote);
+	size_t len = BenchRandomRange_(rng, 1, maxLength);
+	for(size_t i = 0; i < len; ++i) {
+		if(BenchRandom_(rng) % 16 == 0) {
+			BenchPutString_(out, BenchEscapes_[BenchRandom_(rng) % (sizeof(BenchEscapes_) / sizeof(BenchEscapes_[0]))]);
+			// hex and octal escapes are greedy, so never follow them with a digit.
+			BenchPutChar_(out, 'z');
+		} else {
+			BenchPutChar_(out, chars[BenchRandom_(rng) % (sizeof(chars) - 1)]);
+		}
+	}
+	BenchPutChar_(out, quote);
+}
+
+/** Emits one token of KIND. Returns the number of tokens the lexer is expected to produce for it. */
+static size_t BenchPutToken_(AnchDynArray *out, uint64_t *rng, BenchTokenKind_ kind) {
+	switch(kind) {
+	case BENCH_TOKEN_KIND_IDENT:
+		BenchPutIdent_(out, rng);
+		return 1;
+	case BENCH_TOKEN_KIND_KEYWORD:
+		BenchPutString_(out, BenchKeywords_[BenchRandom_(rng) % (sizeof(BenchKeywords_) / sizeof(BenchKeywords_[0]))]);
+		return 1;
+	case BENCH_TOKEN_KIND_INTLIT: {
+		static const char *const suffixes[] = { "", "", "", "u", "l", "ul", "lu", "U", "L" };
+		uint64_t value = BenchRandom_(rng) >> BenchRandomRange_(rng, 1, 63);
+		const char *suffix = suffixes[BenchRandom_(rng) % (sizeof(suffixes) / sizeof(suffixes[0]))];
+		if(BenchRandom_(rng) % 4 == 0)
+			BenchPutFormat_(out, "0x%jX%s", (uintmax_t)value, suffix);
+		else
+			BenchPutFormat_(out, "%ju%s", (uintmax_t)value + 1, suffix);
+		return 1;
+	}
+	case BENCH_TOKEN_KIND_FLOATLIT: {
+		uint64_t whole = BenchRandom_(rng) % 100000 + 1;
+		uint64_t frac = BenchRandom_(rng) % 100000;
+		switch(BenchRandom_(rng) % 3) {
+		case 0: BenchPutFormat_(out, "%ju.%ju", (uintmax_t)whole, (uintmax_t)frac); break;
+		case 1: BenchPutFormat_(out, "%ju.%jue%ju", (uintmax_t)whole, (uintmax_t)frac, (uintmax_t)(BenchRandom_(rng) % 300)); break;
+		case 2: BenchPutFormat_(out, ".%ju", (uintmax_t)frac + 1); break;
+		}
+		return 1;
+	}
+	case BENCH_TOKEN_KIND_STRING:
+		BenchPutQuoted_(out, rng, '"', 64);
+		return 1;
+	case BENCH_TOKEN_KIND_CHARLIT:
+		BenchPutQuoted_(out, rng, '\'', 1);
+		return 1;
+	case BENCH_TOKEN_KIND_PUNCT:
+		BenchPutString_(out, BenchPuncts_[BenchRandom_(rng) % (sizeof(BenchPuncts_) / sizeof(BenchPuncts_[0]))]);
+		return 1;
+	case BENCH_TOKEN_KIND_LINE_COMMENT:
+		BenchPutString_(out, "//");
+		for(size_t i = BenchRandomRange_(rng, 0, 8); i > 0; --i) {
+			BenchPutChar_(out, ' ');
+			BenchPutIdent_(out, rng);
+		}
+		BenchPutChar_(out, '\n');
+		return 0;
+	case BENCH_TOKEN_KIND_BLOCK_COMMENT:
+		BenchPutString_(out, "/*");
+		for(size_t i = BenchRandomRange_(rng, 1, 24); i > 0; --i) {
+			BenchPutChar_(out, BenchRandom_(rng) % 8 == 0 ? '\n' : ' ');
+			BenchPutIdent_(out, rng);
+		}
+		BenchPutString_(out, " */");
+		return 0;
+	default:
+		assert(false && "bad token kind");
+		return 0;
+	}
+}
+
+/**
+ * Fill OUT with roughly SIZE bytes of whitespace separated tokens drawn from PROFILE.
+ * Returns the number of tokens the lexer should produce (comments produce none).
+ */
+static size_t BenchGenerate_(AnchDynArray *out, size_t profile, uint64_t seed, size_t size) {
+	assert(profile < BENCH_PROFILE_COUNT_);
+	uint64_t rng = seed ? seed : 0x9E3779B97F4A7C15ULL;
+	unsigned int total = 0;
+	for(int i = 0; i < BENCH_TOKEN_KIND_MAX_; ++i) total += BenchProfiles_[profile].weights[i];
+
+	size_t tokenCount = 0;
+	size_t lineTokens = 0;
+	while(out->size < size) {
+		unsigned int pick = BenchRandom_(&rng) % total;
+		BenchTokenKind_ kind = 0;
+		while(pick >= BenchProfiles_[profile].weights[kind]) pick -= BenchProfiles_[profile].weights[kind++];
+
+		tokenCount += BenchPutToken_(out, &rng, kind);
+		if(kind == BENCH_TOKEN_KIND_LINE_COMMENT || ++lineTokens >= BenchRandomRange_(&rng, 4, 16)) {
+			if(kind != BENCH_TOKEN_KIND_LINE_COMMENT) BenchPutChar_(out, '\n');
+			for(size_t i = BenchRandomRange_(&rng, 0, 3); i > 0; --i) BenchPutChar_(out, '\t');
+			lineTokens = 0;
+		} else {
+			BenchPutChar_(out, ' ');
+		}
+	}
+	BenchPutChar_(out, '\n');
+	return tokenCount;
+}
+
+static double BenchNow_(void) {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+typedef struct BenchResult_ {
+	double readLinesSeconds;
+	double lexSeconds;
+	size_t tokenCount;
+	size_t valueBytes;
+	size_t retainedBytes;
+	AnchStatsAllocator stats;
+} BenchResult_;
+
+static void BenchRun_(BenchResult_ *result, AnchAllocator *base, const AnchDynArray *source, size_t windowSize) {
+	AnchStatsAllocator_Init(&result->stats, base);
+	AnchAllocator *allocator = &result->stats.base;
+
+	AnchMemoryByteReadStream stream;
+	AnchMemoryByteReadStream_Init(&stream, source->data, source->size);
+
+	AncInputFile inputFile = {};
+	if(windowSize > 0)
+		AncInputFile_InitStreaming(&inputFile, allocator, &stream.stream, "<bench>", windowSize);
+	else
+		AncInputFile_Init(&inputFile, allocator, &stream.stream, "<bench>");
+
+	double start = BenchNow_();
+	if(windowSize == 0) AncInputFile_ReadLines(&inputFile);
+	double linesEnd = BenchNow_();
+
+	AncLexer lexer = {};
+	AncLexer_Init(&lexer, allocator, &inputFile);
+
+	size_t tokenCount = 0;
+	size_t valueBytes = 0;
+	for(AncToken *token; (token = AncLexer_Read(&lexer))->type != ANC_TOKEN_TYPE_EOF;) {
+		++tokenCount;
+		if(windowSize > 0) {
+			// materialized values are stored NUL-terminated.
+			if(token->materialized) valueBytes += token->value.length + 1;
+			AncLexer_Acknowledge(&lexer);
+		}
+	}
+	double lexEnd = BenchNow_();
+
+	result->readLinesSeconds = linesEnd - start;
+	result->lexSeconds = lexEnd - linesEnd;
+	result->tokenCount = tokenCount;
+	result->valueBytes = windowSize > 0 ? valueBytes : lexer.tokenValues.size;
+	// arenas never shrink here, so their capacity is the peak.
+	result->retainedBytes = inputFile.buffer.allocated + inputFile.lineStarts.allocated
+		+ lexer.tokens.allocated + lexer.tokenValues.allocated + lexer.tokenPeekBuf.allocated;
+
+	AncLexer_Free(&lexer);
+	AncInputFile_Free(&inputFile);
+}
+
+static void BenchUsage_(const char *argv0) {
+	AnchWriteFormat(wsStderr,
+		"Usage: %s [-s SIZE] [-S SEED] [-p PROFILE] [-n ITERATIONS] [-w WINDOW] [-o FILE] [-l LABEL]\n"
+		"  -s SIZE        approximate size of the generated source in bytes (default 4194304).\n"
+		"  -S SEED        generator seed (default 1).\n"
+		"  -p PROFILE     one of `ident`, `literal`, `comment`, `mixed` or `all` (default all).\n"
+		"  -n ITERATIONS  runs per profile, the fastest one is reported (default 5).\n"
+		"  -w WINDOW      lex in streaming mode with WINDOW byte input windows, acknowledging every token.\n"
+		"  -o FILE        append JSON lines results to FILE instead of stdout.\n"
+		"  -l LABEL       free-form label stored with the results (e.g. a commit hash).\n",
+		argv0);
+}
+
+int main(int argc, char *argv[]) {
+	if(!setlocale(LC_ALL, "en_US.utf8")) setlocale(LC_ALL, "C.UTF-8");
+
+	AnchFileWriteStream valueWsStdout = {0};
+	AnchFileWriteStream_InitWith(&valueWsStdout, stdout);
+	wsStdout = &valueWsStdout.stream;
+
+	AnchFileWriteStream valueWsStderr = {0};
+	AnchFileWriteStream_InitWith(&valueWsStderr, stderr);
+	wsStderr = &valueWsStderr.stream;
+
+	size_t size = 4 << 20;
+	uint64_t seed = 1;
+	const char *profileName = "all";
+	int iterations = 5;
+	size_t windowSize = 0;
+	const char *outputName = NULL;
+	const char *label = "";
+
+	for(int i = 1; i < argc; ++i) {
+		const char *arg = argv[i];
+		const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+		if(arg[0] != '-' || arg[1] == '\0' || arg[2] != '\0' || value == NULL) {
+			BenchUsage_(argv[0]);
+			return 1;
+		}
+		switch(arg[1]) {
+		case 's': size = strtoull(value, NULL, 0); break;
+		case 'S': seed = strtoull(value, NULL, 0); break;
+		case 'p': profileName = value; break;
+		case 'n': iterations = atoi(value); break;
+		case 'w': windowSize = strtoull(value, NULL, 0); break;
+		case 'o': outputName = value; break;
+		case 'l': label = value; break;
+		default: BenchUsage_(argv[0]); return 1;
+		}
+		++i;
+	}
+
+	if(iterations < 1) iterations = 1;
+	if(windowSize > 0 && windowSize < 16) windowSize = 16;
+
+	bool known = strcmp(profileName, "all") == 0;
+	for(size_t p = 0; p < BENCH_PROFILE_COUNT_; ++p)
+		known = known || strcmp(profileName, BenchProfiles_[p].name) == 0;
+	if(!known) {
+		AnchWriteFormat(wsStderr, ANSI_BRED "Error: " ANSI_RESET "unknown profile `%s`.\n", profileName);
+		return 1;
+	}
+
+	AnchFileWriteStream json = {0};
+	if(outputName) {
+		AnchFileWriteStream_Init(&json);
+		json.handle = fopen(outputName, "a");
+		if(json.handle == NULL) {
+			AnchWriteFormat(wsStderr, ANSI_BRED "Error: " ANSI_RESET "could not open `%s`.\n", outputName);
+			return 1;
+		}
+	} else {
+		AnchFileWriteStream_InitWith(&json, stdout);
+	}
+
+	AnchDefaultAllocator defaultAllocator;
+	AnchDefaultAllocator_Init(&defaultAllocator);
+
+	for(size_t p = 0; p < BENCH_PROFILE_COUNT_; ++p) {
+		if(strcmp(profileName, "all") != 0 && strcmp(profileName, BenchProfiles_[p].name) != 0) continue;
+
+		AnchDynArray source;
+		AnchDynArray_Init(&source, &defaultAllocator, 1 << 16);
+		size_t expectedTokens = BenchGenerate_(&source, p, seed, size);
+
+		BenchResult_ best = {0};
+		for(int i = 0; i < iterations; ++i) {
+			BenchResult_ result;
+			BenchRun_(&result, &defaultAllocator, &source, windowSize);
+			if(i == 0 || result.lexSeconds < best.lexSeconds) best = result;
+		}
+
+		double mb = source.size / (1024.0 * 1024.0);
+		if(best.tokenCount != expectedTokens) {
+			AnchWriteFormat(wsStderr, ANSI_BRED "Warning: " ANSI_RESET
+				"profile `%s` produced %zu tokens, generator emitted %zu.\n",
+				BenchProfiles_[p].name, best.tokenCount, expectedTokens);
+		}
+
+		AnchWriteFormat(outputName ? wsStdout : wsStderr,
+			ANSI_MAGENTA "%-8s" ANSI_RESET " %8.2f MiB  %10zu tokens  "
+			ANSI_GREEN "%9.2f MiB/s  %12.0f tokens/s" ANSI_RESET
+			ANSI_GRAY "  (lines %.3fs, lex %.3fs, retained %zu B, alloc %zu, allocZero %zu, realloc %zu, free %zu)\n" ANSI_RESET,
+			BenchProfiles_[p].name, mb, best.tokenCount,
+			mb / best.lexSeconds, best.tokenCount / best.lexSeconds,
+			best.readLinesSeconds, best.lexSeconds, best.retainedBytes,
+			best.stats.allocCount, best.stats.allocZeroCount, best.stats.reallocCount, best.stats.freeCount);
+
+		AnchWriteFormat(&json.stream,
+			"{\"bench\":\"lexer\",\"label\":\"%s\",\"profile\":\"%s\",\"seed\":%ju,\"bytes\":%zu,"
+			"\"iterations\":%d,\"windowSize\":%zu,\"tokens\":%zu,\"expectedTokens\":%zu,\"valueBytes\":%zu,\"retainedBytes\":%zu,"
+			"\"readLinesSeconds\":%.6f,\"lexSeconds\":%.6f,\"mbPerSecond\":%.3f,\"tokensPerSecond\":%.1f,"
+			"\"allocCount\":%zu,\"allocZeroCount\":%zu,\"reallocCount\":%zu,\"freeCount\":%zu}\n",
+			label, BenchProfiles_[p].name, (uintmax_t)seed, source.size,
+			iterations, windowSize, best.tokenCount, expectedTokens, best.valueBytes, best.retainedBytes,
+			best.readLinesSeconds, best.lexSeconds, mb / best.lexSeconds, best.tokenCount / best.lexSeconds,
+			best.stats.allocCount, best.stats.allocZeroCount, best.stats.reallocCount, best.stats.freeCount);
+
+		AnchDynArray_Free(&source);
+	}
+
+	if(outputName) AnchFileWriteStream_Close(&json);
+	return 0;
+}
@@ -1,15 +1,28 @@
 #include <annec/lexer.h>
 #include <ctype.h>
+#include <limits.h>
 #include <wctype.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "../cli.h"
 
 AncTokenType AncTokenType_FromKeyword(const char *keyword) {
-#define X(NAME, KW) if(strcmp(keyword, #KW) == 0) return ANC_TOKEN_TYPE_##NAME
+	return AncTokenType_FromKeywordN((const uint8_t*)keyword, strlen(keyword));
+}
+
+AncTokenType AncTokenType_FromKeywordN(const uint8_t *keyword, size_t length) {
+#define X(NAME, KW) \
+	if(length == sizeof(#KW) - 1 && memcmp(keyword, #KW, length) == 0) return ANC_TOKEN_TYPE_##NAME
 	ANC_X_TOKEN_TYPE_KEYWORDS_(X, ;);
 #undef X
 	return ANC_TOKEN_TYPE_ERROR;
 }
 
+#define ANC_INPUT_FILE_CHUNK_SIZE_ 4096
+
 void AncInputFile_Init(AncInputFile *self, AnchAllocator *allocator, AnchUtf8ReadStream *input, const char *filename) {
 	assert(self != NULL);
 
@@ -17,8 +30,27 @@ void AncInputFile_Init(AncInputFile *self, AnchAllocator *allocator, AnchUtf8Rea
 	self->filename = filename;
 	self->stream = input;
 	self->position = (AncSourcePosition){};
-	self->peek = 0;
-	AnchDynArray_Init(&self->lines, self->allocator, 0);
+	self->bufferStart = 0;
+	self->offset = 0;
+	self->charOffset = 0;
+	self->lineStart = 0;
+	self->windowSize = 0;
+	self->pin = SIZE_MAX;
+	self->eof = false;
+	self->diagnostics = wsStderr;
+	AnchDynArray_Init(&self->buffer, self->allocator, ANC_INPUT_FILE_CHUNK_SIZE_);
+	AnchDynArray_Init(&self->lineStarts, self->allocator, 0);
+	ANCH_DYNARRAY_PUSH(&self->lineStarts, size_t, 0);
+}
+
+void AncInputFile_InitStreaming(AncInputFile *self, AnchAllocator *allocator, AnchUtf8ReadStream *input, const char *filename, size_t windowSize) {
+	assert(self != NULL);
+	assert(windowSize >= 16);
+
+	AncInputFile_Init(self, allocator, input, filename);
+	self->windowSize = windowSize;
+	AnchDynArray_Free(&self->lineStarts);
+	AnchDynArray_Init(&self->lineStarts, self->allocator, 0);
 }
 
 void AncInputFile_Free(AncInputFile *self) {
@@ -28,49 +60,103 @@ void AncInputFile_Free(AncInputFile *self) {
 	self->filename = NULL;
 	self->stream = NULL;
 	self->position = (AncSourcePosition){};
-	self->peek = 0;
-	AnchDynArray_Free(&self->lines);
+	self->bufferStart = 0;
+	self->offset = 0;
+	self->charOffset = 0;
+	self->lineStart = 0;
+	self->windowSize = 0;
+	self->pin = SIZE_MAX;
+	self->eof = false;
+	self->diagnostics = NULL;
+	AnchDynArray_Free(&self->buffer);
+	AnchDynArray_Free(&self->lineStarts);
 }
 
-AncString *AncInputFile_GetLine(AncInputFile *self, unsigned int lineIndex) {
+/** Make sure at least NEED bytes after the current offset are buffered, unless the stream ends first. */
+static void AncInputFile_Fill_(AncInputFile *self, size_t need) {
 	assert(self != NULL);
 
-	if(lineIndex == 0) return (AncString*)self->lines.data;
-	
-	// lineIndex += 1;
+	size_t end = self->bufferStart + self->buffer.size;
+	while(!self->eof && end - self->offset < need) {
+		if(self->windowSize > 0) {
+			// keep the current line for diagnostics, unless it alone would take half of the window.
+			size_t keep = self->lineStart < self->offset ? self->lineStart : self->offset;
+			if(self->offset - keep > self->windowSize / 2) keep = self->offset;
+			// unacknowledged tokens may still reference their spelling in the buffer.
+			if(self->pin < keep) keep = self->pin;
+
+			size_t drop = keep - self->bufferStart;
+			if(drop > 0) {
+				memmove(self->buffer.data, self->buffer.data + drop, self->buffer.size - drop);
+				self->buffer.size -= drop;
+				self->bufferStart = keep;
+			}
+		}
+
+		size_t chunk = self->windowSize > 0 ? self->windowSize : ANC_INPUT_FILE_CHUNK_SIZE_;
+		uint8_t *data = AnchDynArray_Push(&self->buffer, chunk);
+		size_t read = 0;
+		// byte streams report the end as `(uint8_t)EOF`, which can't start a valid UTF-8 sequence anyway.
+		for(; read < chunk; ++read) {
+			uint8_t byte = AnchByteReadStream_Read(self->stream);
+			if(byte == (uint8_t)EOF) { self->eof = true; break; }
+			data[read] = byte;
+		}
+		// not AnchDynArray_Pop, which would shrink the allocation we are about to reuse.
+		self->buffer.size -= chunk - read;
+		end = self->bufferStart + self->buffer.size;
+	}
+}
+
+/** Length of the line starting at BYTES, up to (not including) a line terminator or the end. */
+static size_t AncLineLength_(const uint8_t *bytes, size_t size) {
+	for(size_t i = 0; i < size; ++i) {
+		if(bytes[i] == '\n') return i;
+		// U+2028 and U+2029.
+		if(bytes[i] == 0xE2 && i + 2 < size && bytes[i + 1] == 0x80 && (bytes[i + 2] == 0xA8 || bytes[i + 2] == 0xA9))
+			return i;
+	}
+	return size;
+}
 
-	AncString *s = NULL;
-	for(size_t offset = 0; lineIndex --> 0;) {
-		s = (void*)(self->lines.data + offset);
-		offset += sizeof(AncString);
-		offset += s->length + 1;
+AncStringView AncInputFile_GetLine(AncInputFile *self, unsigned int lineIndex) {
+	assert(self != NULL);
+
+	size_t start;
+	if(self->windowSize == 0 && lineIndex < self->lineStarts.size / sizeof(size_t)) {
+		start = ((size_t*)self->lineStarts.data)[lineIndex];
+	} else if(lineIndex == self->position.line && self->lineStart >= self->bufferStart) {
+		start = self->lineStart;
+	} else {
+		return (AncStringView){};
 	}
 
-	return s;
+	uint8_t *bytes = self->buffer.data + (start - self->bufferStart);
+	return (AncStringView){ AncLineLength_(bytes, self->buffer.size - (start - self->bufferStart)), bytes };
 }
 
 void AncInputFile_ReportError(AncInputFile *self, bool show, const AncSourceSpan *span, const char *fmt, ...) {
 	assert(self != NULL);
 	assert(fmt != NULL);
 
-	AnchWriteFormat(wsStderr, ANSI_BRED "Error: " ANSI_RESET);
+	AnchWriteFormat(self->diagnostics, ANSI_BRED "Error: " ANSI_RESET);
 	va_list va;
 	va_start(va, fmt);
-	AnchWriteFormatV(wsStderr, fmt, va);
+	AnchWriteFormatV(self->diagnostics, fmt, va);
 	va_end(va);
-	AnchWriteString(wsStderr, "\n");
+	AnchWriteString(self->diagnostics, "\n");
 	
 	if(span == NULL) return;
 
 	if(AncSourcePosition_Equal(span->start, span->end)) {
 		AnchWriteFormat(
-			wsStderr, ANSI_GRAY "  At %s:%d:%d\n" ANSI_RESET,
+			self->diagnostics, ANSI_GRAY "  At %s:%d:%d\n" ANSI_RESET,
 			self->filename,
 			span->start.line + 1, span->start.column
 		);
 	} else {
 		AnchWriteFormat(
-			wsStderr, ANSI_GRAY "  At %s:%d:%d ... %d:%d\n" ANSI_RESET,
+			self->diagnostics, ANSI_GRAY "  At %s:%d:%d ... %d:%d\n" ANSI_RESET,
 			self->filename,
 			span->start.line + 1, span->start.column,
 			span->end.line + 1, span->end.column
@@ -79,101 +165,89 @@ void AncInputFile_ReportError(AncInputFile *self, bool show, const AncSourceSpan
 
 	if(!show) return;
 	if(span->start.line != span->end.line) return;
-	AncString *line = AncInputFile_GetLine(self, span->start.line);
+	AncStringView line = AncInputFile_GetLine(self, span->start.line);
+	if(line.bytes == NULL) return;
 
-	for(size_t i = 0; i < line->length; ++i) {
-		if(line->bytes[i] == '\t') {
-			AnchWriteChar(wsStderr, ' ');
-			AnchWriteChar(wsStderr, ' ');
+	for(size_t i = 0; i < line.length; ++i) {
+		if(line.bytes[i] == '\t') {
+			AnchWriteChar(self->diagnostics, ' ');
+			AnchWriteChar(self->diagnostics, ' ');
 		}
-		AnchWriteChar(wsStderr, line->bytes[i]);
+		AnchWriteChar(self->diagnostics, line.bytes[i]);
 	}
 
-	AnchWriteString(wsStderr, "\n");
+	AnchWriteString(self->diagnostics, "\n");
 
-	for(unsigned int i = 0; i < span->start.column - 1; ++i) {
-		if(line->bytes[i] == '\t')
-			AnchWriteChar(wsStderr, ' ');
-		AnchWriteChar(wsStderr, ' ');
+	for(unsigned int i = 0; i + 1 < span->start.column && i < line.length; ++i) {
+		if(line.bytes[i] == '\t')
+			AnchWriteChar(self->diagnostics, ' ');
+		AnchWriteChar(self->diagnostics, ' ');
 	}
 
-	AnchWriteString(wsStderr, ANSI_GREEN "^");
+	AnchWriteString(self->diagnostics, ANSI_GREEN "^");
 
 	for(unsigned int i = 0; i < span->end.column - span->start.column; ++i) {
-		AnchWriteChar(wsStderr, '~');
+		AnchWriteChar(self->diagnostics, '~');
 	}
-	AnchWriteString(wsStderr, ANSI_RESET "\n");
+	AnchWriteString(self->diagnostics, ANSI_RESET "\n");
 }
 
 #define ANC_IS_NL_(C) (C == '\n' || C == u'\u2028' || C == u'\u2029')
 
-struct AncPushUt8_Result {
-	int length;
-	uint8_t *ptr;
-} AncPushUtf8_(AnchArena *arena, char32_t c32) {
-	assert(arena != NULL);
-
-	if(c32 == 0) {
-		uint8_t *ptr = (uint8_t*)AnchArena_Push(arena, 1);
-		*ptr = 0;
-		return (struct AncPushUt8_Result){ 1, ptr };
-	}
-
-	uint8_t data[MB_CUR_MAX];
-	mbstate_t ps = {};
-	int len = c32rtomb((char*)data, c32, &ps);
-	assert(len != -1);
-	uint8_t *ptr = AnchArena_Push(arena, len);
-	memcpy(ptr, data, len);
-	return (struct AncPushUt8_Result){ len, ptr };
+/** Read the rest of the input into memory and index all of its lines. Not available in streaming mode. */
+void AncInputFile_ReadLines(AncInputFile *self) {
+	assert(self != NULL);
+	assert(self->windowSize == 0);
+
+	AncInputFile_Fill_(self, SIZE_MAX);
+
+	size_t lineCount = self->lineStarts.size / sizeof(size_t);
+	size_t start = ((size_t*)self->lineStarts.data)[lineCount - 1];
+	const uint8_t *bytes = self->buffer.data;
+	size_t size = self->buffer.size;
+	while(start < size) {
+		size_t length = AncLineLength_(bytes + start, size - start);
+		if(start + length >= size) break;
+		start += length + (bytes[start + length] == '\n' ? 1 : 3);
+		ANCH_DYNARRAY_PUSH(&self->lineStarts, size_t, start);
+	}
 }
 
-void AncInputFile_ReadLines(AncInputFile *self) {
-	AnchDynArray_PushZeros(&self->lines, sizeof(AncString));
-	size_t lineLenOffset = 0;
+/** Decode the character at the current offset into *C. Returns its length in bytes, 0 at the end of input. */
+static inline size_t AncInputFile_Decode_(AncInputFile *self, char32_t *c) {
+	if(self->offset + 4 > self->bufferStart + self->buffer.size)
+		AncInputFile_Fill_(self, 4);
 
-	char32_t c = 0;
-	do {
-		c = AnchUtf8ReadStream_Read(self->stream);
-		if(c == ANCH_UTF8_STREAM_ERROR) {
-			AncInputFile_ReportError(
-				self, false, &ANC_SOURCE_SPAN_SAME(self->position),
-				"Illegal UTF-8 sequence."
-			);
-		}
+	size_t index = self->offset - self->bufferStart;
+	if(index >= self->buffer.size) {
+		*c = ANC_INPUT_FILE_EOF;
+		return 0;
+	}
 
-		if(ANC_IS_NL_(c)) {
-			if(self->lines.size != 0) *(uint8_t*)AnchDynArray_Push(&self->lines, 1) = 0;
-			AnchDynArray_PushZeros(&self->lines, sizeof(AncString));
-			lineLenOffset = self->lines.size - sizeof(AncString);
-			self->position.line += 1;
-			self->position.column = 0;
-		} else {
-			*(size_t*)(self->lines.data + lineLenOffset) += 1;
-			self->position.column += 1;
-			AncPushUtf8_(&self->lines, c);
-		}
-	} while(c != ANCH_UTF8_STREAM_EOF);
+	const uint8_t *bytes = self->buffer.data + index;
+	if(*bytes < 0x80) {
+		*c = *bytes;
+		return 1;
+	}
 
-	self->position = (AncSourcePosition){};
+	int length = AnchUtf8Decode(bytes, self->buffer.size - index, c);
+	if(length == 0) {
+		*c = ANCH_UTF8_STREAM_ERROR;
+		return 1;
+	}
+	return length;
 }
 
-char32_t AncInputFile_Get_(AncInputFile *self, bool peeking) {
+char32_t AncInputFile_Get(AncInputFile *self) {
 	assert(self != NULL);
 
-	if(self->peek) {
-		char32_t v = self->peek;
-		if(ANC_IS_NL_(v)) {
-			self->position.line += 1;
-			self->position.column = 0;
-		} else {
-			self->position.column += 1;
-		}
-		self->peek = 0;
-		return v;
+	char32_t c;
+	size_t length = AncInputFile_Decode_(self, &c);
+	if(length == 0) {
+		self->charOffset = self->offset;
+		return ANC_INPUT_FILE_EOF;
 	}
 
-	char32_t c = AnchUtf8ReadStream_Read(self->stream);
 	if(c == ANCH_UTF8_STREAM_ERROR) {
 		AncInputFile_ReportError(
 			self, false, &ANC_SOURCE_SPAN_SAME(self->position),
@@ -181,35 +255,66 @@ char32_t AncInputFile_Get_(AncInputFile *self, bool peeking) {
 		);
 	}
 
-	if(c == ANCH_UTF8_STREAM_EOF) {
-		return ANC_INPUT_FILE_EOF;
-	}
-
-	if(!peeking) {
-		if(ANC_IS_NL_(c)) {
-			self->position.line += 1;
-			self->position.column = 0;
-		} else {
-			self->position.column += 1;
-		}
+	self->charOffset = self->offset;
+	self->offset += length;
+	if(ANC_IS_NL_(c)) {
+		self->position.line += 1;
+		self->position.column = 0;
+		self->lineStart = self->offset;
+		if(self->windowSize == 0 && self->position.line >= self->lineStarts.size / sizeof(size_t))
+			ANCH_DYNARRAY_PUSH(&self->lineStarts, size_t, self->offset);
+	} else {
+		self->position.column += 1;
 	}
 
 	return c;
 }
 
-char32_t AncInputFile_Get(AncInputFile *self) {
-	return AncInputFile_Get_(self, false);
+char32_t AncInputFile_Peek(AncInputFile *self) {
+	assert(self != NULL);
+
+	char32_t c;
+	AncInputFile_Decode_(self, &c);
+	return c;
 }
 
-char32_t AncInputFile_Peek(AncInputFile *self) {
+/** Bytes that are identifier characters on their own. Other identifier characters are non-ASCII. */
+static const bool AncIdentByte_[256] = {
+	['0' ... '9'] = true, ['A' ... 'Z'] = true, ['a' ... 'z'] = true, ['_'] = true,
+};
+
+/** Advance past identifier characters, stopping before (not consuming) the first one that isn't. */
+static void AncInputFile_SkipIdent_(AncInputFile *self) {
 	assert(self != NULL);
-	assert(!self->peek);
 
-	self->peek = AncInputFile_Get_(self, true);
-	return self->peek;
+	while(1) {
+		const uint8_t *bytes = self->buffer.data;
+		size_t size = self->buffer.size;
+		size_t index = self->offset - self->bufferStart;
+		size_t i = index;
+		while(i < size && AncIdentByte_[bytes[i]]) ++i;
+		self->position.column += i - index;
+		self->offset = self->bufferStart + i;
+
+		if(i == size) {
+			if(self->eof) return;
+			AncInputFile_Fill_(self, 1);
+		} else if(bytes[i] < 0x80 || !iswalnum(AncInputFile_Peek(self))) {
+			return;
+		} else {
+			AncInputFile_Get(self);
+		}
+	}
+}
+
+/** Append the input bytes at absolute offsets [START, END) to the token values. */
+static void AncLexer_PushSource_(AncLexer *self, size_t start, size_t end) {
+	assert(start >= self->input->bufferStart);
+	uint8_t *data = AnchArena_Push(&self->tokenValues, end - start);
+	memcpy(data, self->input->buffer.data + (start - self->input->bufferStart), end - start);
 }
 
-#define ANC_HEX_DIGIT_VALUE_(C) (C >= 'a' ? C - 'a' : C >= 'A' ? C - 'A' : C - '0')
+#define ANC_HEX_DIGIT_VALUE_(C) (C >= 'a' ? C - 'a' + 10 : C >= 'A' ? C - 'A' + 10 : C - '0')
 
 // Integer constant
 //   (([1-9]([0-9]['0-9]*)?)|(0([0-7]['0-7]*)?)|
@@ -292,6 +397,8 @@ static AncIntLiteralSuffix Parse_Int_Suffix_(const char32_t *str) {
 			if(*str != first) {
 				return (AncIntLiteralSuffix){ .type = ANC_INT_LITERAL_TYPE_INVALID_LONGLONG_CASE };
 			}
+			suffix.type = ANC_INT_LITERAL_TYPE_LONGLONG;
+			str += 1;
 		}
 	}
 	
@@ -439,13 +546,9 @@ static char32_t AncLexer_Read_Numeric_(AncLexer *self, char32_t c, AncToken *tok
 	AnchDynArray_Type(char32_t) suffixBuffer;
 	AnchDynArray_Init(&suffixBuffer, self->allocator, sizeof(char32_t) * 4);
 
-	for(
-		char32_t p = self->input->peek ? self->input->peek : AncInputFile_Peek(self->input);
-		iswalnum(p) || p == '_';
-	) {
-		c = AncInputFile_Get(self->input);
+	while(iswalnum(c) || c == '_') {
 		*(char32_t*)AnchDynArray_Push(&suffixBuffer, sizeof(char32_t)) = c;
-		p = AncInputFile_Peek(self->input);
+		c = AncInputFile_Get(self->input);
 	}
 	*(char32_t*)AnchDynArray_Push(&suffixBuffer, sizeof(char32_t)) = '\0';
 
@@ -473,8 +576,9 @@ static char32_t AncLexer_Read_Numeric_(AncLexer *self, char32_t c, AncToken *tok
 		size_t oldSize = self->tokenValues.size;
 		char *buf = AnchArena_Push(&self->tokenValues, len + 1);
 		snprintf(buf, len + 1, ANC_INTLIT_TOKEN_FORMAT, ANC_INTLIT_TOKEN_FORMAT_PARAMS);
-		token->value.length = len + 1;
+		token->value.length = len;
 		token->value.bytesOffset = oldSize;
+		token->materialized = true;
 	} else {
 		AncFloatLiteralSuffix suffix = Parse_Float_Suffix_((char32_t*)suffixBuffer.data);
 		
@@ -499,12 +603,13 @@ static char32_t AncLexer_Read_Numeric_(AncLexer *self, char32_t c, AncToken *tok
 		size_t oldSize = self->tokenValues.size;
 		char *buf = AnchArena_Push(&self->tokenValues, len + 1);
 		snprintf(buf, len + 1, ANC_FLOATLIT_TOKEN_FORMAT, ANC_FLOATLIT_TOKEN_FORMAT_PARAMS);
-		token->value.length = len + 1;
+		token->value.length = len;
 		token->value.bytesOffset = oldSize;
+		token->materialized = true;
 	}
 
 	AnchDynArray_Free(&suffixBuffer);
-	return AncInputFile_Get(self->input);
+	return c;
 }
 
 // Character constant
@@ -515,112 +620,212 @@ static char32_t AncLexer_Read_Numeric_(AncLexer *self, char32_t c, AncToken *tok
 //   (L|u|U|u8)?"([^\\]|(\\(['"?\\abfnrtv]|[0-7]{1,3}|x
 //   [0-9a-fA-F]{1,2}|u[0-9a-fA-F]{4}|U[0-9a-fA-F]{8})))*"
 
-char32_t AnchLexer_Read_StringOrChar_(AncLexer *self, bool isChar, char32_t c, AnchDynArray *s, AncToken *token) {
+/** Value of simple escape sequences by the character after the backslash, 0 if it isn't one. */
+static const uint8_t AncSimpleEscape_[128] = {
+	['\''] = '\'', ['"'] = '"', ['?'] = '?', ['\\'] = '\\',
+	['a'] = '\a', ['b'] = '\b', ['f'] = '\f', ['n'] = '\n',
+	['r'] = '\r', ['t'] = '\t', ['v'] = '\v', ['e'] = '\x1b',
+};
+
+/** Value of hexadecimal digits plus one, 0 for other bytes. */
+static const int8_t AncHexDigitValue_[256] = {
+	['0'] = 1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+	['A'] = 11, 12, 13, 14, 15, 16,
+	['a'] = 11, 12, 13, 14, 15, 16,
+};
+
+#define ANC_HEX_VALUE_(C) ((C) < 256 ? AncHexDigitValue_[(C)] - 1 : -1)
+
+/**
+ * Length of the run at BYTES that a literal can take verbatim: everything up to the closing
+ * QUOTE, a backslash, a newline or a non-ASCII byte (which need decoding).
+ */
+static inline size_t AncLiteralRunLength_(const uint8_t *bytes, size_t size, uint8_t quote) {
+	size_t i = 0;
+#if defined(__AVX2__)
+	const __m256i quote32 = _mm256_set1_epi8(quote);
+	const __m256i backslash32 = _mm256_set1_epi8('\\');
+	const __m256i newline32 = _mm256_set1_epi8('\n');
+	for(; i + 32 <= size; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(bytes + i));
+		__m256i stop = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, quote32), _mm256_cmpeq_epi8(v, backslash32)),
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, newline32), v) // the sign bit marks non-ASCII.
+		);
+		uint32_t mask = _mm256_movemask_epi8(stop);
+		if(mask != 0) return i + __builtin_ctz(mask);
+	}
+#elif defined(__SSE2__)
+	const __m128i quote16 = _mm_set1_epi8(quote);
+	const __m128i backslash16 = _mm_set1_epi8('\\');
+	const __m128i newline16 = _mm_set1_epi8('\n');
+	for(; i + 16 <= size; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(bytes + i));
+		__m128i stop = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, quote16), _mm_cmpeq_epi8(v, backslash16)),
+			_mm_or_si128(_mm_cmpeq_epi8(v, newline16), v) // the sign bit marks non-ASCII.
+		);
+		uint32_t mask = _mm_movemask_epi8(stop);
+		if(mask != 0) return i + __builtin_ctz(mask);
+	}
+#else
+	// 8 bytes at a time: a byte of X is zero iff the matching byte of ANC_HAS_ZERO_(X) has its top bit set
+	// (bits above the first zero may be false positives, so the exact position is left to the loop below).
+#define ANC_HAS_ZERO_(X) (((X) - 0x0101010101010101u) & ~(X) & 0x8080808080808080u)
+	const uint64_t ones = 0x0101010101010101u;
+	for(; i + 8 <= size; i += 8) {
+		uint64_t v;
+		memcpy(&v, bytes + i, 8);
+		uint64_t stop = ANC_HAS_ZERO_(v ^ (ones * quote)) | ANC_HAS_ZERO_(v ^ (ones * '\\'))
+			| ANC_HAS_ZERO_(v ^ (ones * '\n')) | (v & 0x8080808080808080u);
+		if(stop != 0) break;
+	}
+#undef ANC_HAS_ZERO_
+#endif
+	for(; i < size; ++i) {
+		uint8_t byte = bytes[i];
+		if(byte == quote || byte == '\\' || byte == '\n' || byte >= 0x80) break;
+	}
+	return i;
+}
+
+/** Skip the verbatim run of a literal at the current offset, appending it to the token values if COPY. */
+static void AncLexer_SkipLiteralRun_(AncLexer *self, uint8_t quote, bool copy) {
+	AncInputFile *input = self->input;
+	while(1) {
+		size_t index = input->offset - input->bufferStart;
+		size_t run = AncLiteralRunLength_(input->buffer.data + index, input->buffer.size - index, quote);
+		if(copy && run > 0) AncLexer_PushSource_(self, input->offset, input->offset + run);
+		// the run is ASCII without newlines, so every byte is one column.
+		input->offset += run;
+		input->position.column += run;
+		if(index + run < input->buffer.size || input->eof) return;
+		AncInputFile_Fill_(input, 1);
+	}
+}
+
+/**
+ * Read up to MAX hexadecimal digits after the current offset into *VALUE. Returns the number of digits read.
+ * Digits that would overflow *VALUE are reported and still skipped, leaving it the replacement character.
+ */
+static int AncLexer_Read_HexDigits_(AncLexer *self, int max, intmax_t *value) {
+	int count = 0;
+	bool overflow = false;
+	for(int digit; count < max && (digit = ANC_HEX_VALUE_(AncInputFile_Peek(self->input))) >= 0; ++count) {
+		if(!overflow && *value > (INTMAX_MAX - digit) / 16) {
+			AncInputFile_ReportError(
+				self->input, true, &ANC_SOURCE_SPAN_SAME(self->input->position),
+				"Hexadecimal escape sequence is too long."
+			);
+			overflow = true;
+			*value = 0xFFFD;
+		}
+		if(!overflow) *value = *value * 16 + digit;
+		AncInputFile_Get(self->input);
+	}
+	return count;
+}
+
+/** Read an escape sequence after its backslash. Returns its value. */
+static intmax_t AncLexer_Read_Escape_(AncLexer *self) {
+	char32_t c = AncInputFile_Get(self->input);
+	if(c < 128 && AncSimpleEscape_[c] != 0) return AncSimpleEscape_[c];
+
+	intmax_t value = 0;
+	if(c == 'x' || c == 'u' || c == 'U') {
+		int required = c == 'x' ? 1 : c == 'u' ? 4 : 8;
+		int count = AncLexer_Read_HexDigits_(self, c == 'x' ? INT_MAX : required, &value);
+		if(count < required) {
+			AncInputFile_ReportError(
+				self->input, true, &ANC_SOURCE_SPAN_SAME(self->input->position),
+				"Non-hexadecimal digit '%lc' in %s escape sequence.", AncInputFile_Peek(self->input),
+				c == 'x' ? "hexadecimal" : c == 'u' ? "short universal character name" : "long universal character name"
+			);
+		}
+	} else if(c >= '0' && c <= '7') {
+		value = c - '0';
+		for(int i = 1; i < 3; ++i) {
+			char32_t p = AncInputFile_Peek(self->input);
+			if(p < '0' || p > '7') break;
+			value = value * 8 + p - '0';
+			AncInputFile_Get(self->input);
+		}
+	} else {
+		AncInputFile_ReportError(
+			self->input, true, &ANC_SOURCE_SPAN_SAME(self->input->position),
+			"Bad escape sequence '\\%lc'.", c
+		);
+	}
+	return value;
+}
+
+/**
+ * Read a character or string literal after its opening quote, up to and including the closing one.
+ * The spelling starts at the absolute offset START (prefix and opening quote) and excludes the
+ * closing quote. It is copied into the token values only if it contains escape sequences.
+ */
+static void AncLexer_Read_StringOrChar_(AncLexer *self, bool isChar, size_t start, AncToken *token) {
 	assert(self != NULL);
 	assert(token != NULL);
-	assert(s != NULL);
 
-	if(isChar && c == '\'') {
+	token->materialized = false;
+	if(isChar && AncInputFile_Peek(self->input) == '\'') {
+		AncInputFile_Get(self->input);
+		token->value = (AncArenaStringView){ self->input->charOffset - start, start };
 		AncInputFile_ReportError(
 			self->input, true, &ANC_SOURCE_SPAN_SAME(self->input->position),
 			"An empty character literal is illegal."
 		);
-		return c;
+		return;
 	}
 
+	size_t oldSize = self->tokenValues.size;
 	const char end = isChar ? '\'' : '"';
-	while(c != end) {
-		if(ANC_IS_NL_(c)) {
+	while(1) {
+		AncLexer_SkipLiteralRun_(self, end, token->materialized);
+		char32_t c = AncInputFile_Get(self->input);
+		if(c == end) break;
+
+		if(ANC_IS_NL_(c) || c == ANC_INPUT_FILE_EOF) {
 			AncInputFile_ReportError(
 				self->input, true, &ANC_SOURCE_SPAN_SAME(self->input->position),
-				"Newlines in character or string literals are not allowed."
+				c == ANC_INPUT_FILE_EOF
+					? "Unterminated character or string literal."
+					: "Newlines in character or string literals are not allowed."
 			);
 			break;
 		}
 
-		intmax_t value = 0;
-		if(c == '\\') {
-			c = AncInputFile_Get(self->input);
-			switch(c) {
-				case '\'': value = '\''; break;
-				case '\\': value = '\\'; break;
-				case '"': value = '\"'; break;
-				case '?': value = '\?'; break;
-				case 'a': value = '\a'; break;
-				case 'b': value = '\b'; break;
-				case 'f': value = '\f'; break;
-				case 'n': value = '\n'; break;
-				case 'r': value = '\r'; break;
-				case 't': value = '\t'; break;
-				case 'v': value = '\v'; break;
-				case 'e': value = '\x1b' /* = '\033' */; break;
-				case 'x': {
-					c = AncInputFile_Get(self->input);
-					if(isxdigit(c)) {
-						while(isxdigit(c)) {
-							value = value * 16 + ANC_HEX_DIGIT_VALUE_(c);
-							c = AncInputFile_Get(self->input);
-						}
-					} else {
-						AncInputFile_ReportError(
-							self->input, true, &ANC_SOURCE_SPAN_SAME(self->input->position),
-							"Non-hexadecimal digit '%c' in hexadecimal escape sequence.", c
-						);
-					}
-				} break;
-				case 'u': {
-					c = AncInputFile_Get(self->input);
-					for(int i = 0; i < 4; ++i) {
-						if(!isxdigit(c)) {
-							AncInputFile_ReportError(
-								self->input, true, &ANC_SOURCE_SPAN_SAME(self->input->position),
-								"Non-hexadecimal digit '%c' in short universal characer name escape sequence.", c
-							);
-						}
-						value = value * 16 + ANC_HEX_DIGIT_VALUE_(c);
-						c = AncInputFile_Get(self->input);
-					}
-				} break;
-				case 'U': {
-					c = AncInputFile_Get(self->input);
-					for(int i = 0; i < 8; ++i) {
-						if(!isxdigit(c)) {
-							AncInputFile_ReportError(
-								self->input, true, &ANC_SOURCE_SPAN_SAME(self->input->position),
-								"Non-hexadecimal digit '%c' in long universal characer name escape sequence.", c
-							);
-						}
-						value = value * 16 + ANC_HEX_DIGIT_VALUE_(c);
-						c = AncInputFile_Get(self->input);
-					}
-				} break;
-				default:
-					if(c >= '0' && c <= '7') {
-						while(isdigit(c)) {
-							if(c > '7') {
-								AncInputFile_ReportError(
-									self->input, true, &ANC_SOURCE_SPAN_SAME(self->input->position),
-									"Non-octal digit '%c' in octal escape sequence.", c
-								);
-							}
-							value = value * 8 + c - '0';
-							c = AncInputFile_Get(self->input);
-						}
-					} else {
-						AncInputFile_ReportError(
-							self->input, true, &ANC_SOURCE_SPAN_SAME(self->input->position),
-							"Bad escape sequence '\\%lc'.", c
-						);
-					}
-			}
-		} else {
-			value = c;
-			c = AncInputFile_Get(self->input);
+		if(c != '\\') {
+			// non-ASCII characters are decoded one at a time so that malformed UTF-8 gets reported.
+			if(token->materialized) AncLexer_PushSource_(self, self->input->charOffset, self->input->offset);
+			continue;
+		}
+
+		if(!token->materialized) {
+			AncLexer_PushSource_(self, start, self->input->charOffset);
+			token->materialized = true;
 		}
-		AncPushUtf8_(s, value);
+
+		intmax_t value = AncLexer_Read_Escape_(self);
+		uint8_t bytes[4];
+		int length = AnchUtf8Encode(value, bytes);
+		if(length == 0) {
+			AncInputFile_ReportError(
+				self->input, true, &ANC_SOURCE_SPAN_SAME(self->input->position),
+				"Escape sequence value %jX is not a valid character.", value
+			);
+			length = AnchUtf8Encode(0xFFFD, bytes);
+		}
+		memcpy(AnchArena_Push(&self->tokenValues, length), bytes, length);
 	}
 
-	return AncInputFile_Get(self->input);
+	if(token->materialized) {
+		*(uint8_t*)AnchArena_Push(&self->tokenValues, 1) = 0;
+		token->value = (AncArenaStringView){ self->tokenValues.size - oldSize - 1, oldSize };
+	} else {
+		token->value = (AncArenaStringView){ self->input->charOffset - start, start };
+	}
 }
 
 void AncLexer_Read_(AncLexer *self, AncToken *token) {
@@ -635,11 +840,16 @@ void AncLexer_Read_(AncLexer *self, AncToken *token) {
 		char32_t p = AncInputFile_Peek(self->input);
 		if(p == '/') {
 			c = AncInputFile_Get(self->input);
-			while(!ANC_IS_NL_(c)) c = AncInputFile_Get(self->input);
+			while(!ANC_IS_NL_(c) && c != ANC_INPUT_FILE_EOF) c = AncInputFile_Get(self->input);
 		} else if(p == '*') {
 			c = AncInputFile_Get(self->input);
 			while(1) {
 				c = AncInputFile_Get(self->input);
+				if(c == ANC_INPUT_FILE_EOF) {
+					AncInputFile_ReportError(self->input, true, &ANC_SOURCE_SPAN_SAME(self->input->position),
+						"Unterminated block comment.");
+					break;
+				}
 				if(c == '*' && AncInputFile_Peek(self->input) == '/') {
 					c = AncInputFile_Get(self->input);
 					break;
@@ -663,29 +873,34 @@ void AncLexer_Read_(AncLexer *self, AncToken *token) {
 	AncSourcePosition startPosition = self->input->position;
 
 	if(iswalpha(c) || c == '_' || c == '\'' || c == '"') {
-		AnchDynArray_Type(char8_t) *s = &self->tokenValues;
-		size_t oldSize = s->size;
-
-		while(iswalnum(c) || c == '_') {
-			AncPushUtf8_(s, c);
-			c = AncInputFile_Get(self->input);
+		size_t start = self->input->charOffset;
+		if(c != '\'' && c != '"') {
+			AncInputFile_SkipIdent_(self->input);
+			char32_t p = AncInputFile_Peek(self->input);
+			if(p == '\'' || p == '"') c = AncInputFile_Get(self->input);
 		}
 
-		AncTokenType type = 0;
-		
-		if(c == '"' || c == '\'') {
+		if(c == '\'' || c == '"') {
 			bool isChar = c == '\'';
-			AncPushUtf8_(s, c);
-			c = AncInputFile_Get(self->input);
-			c = AnchLexer_Read_StringOrChar_(self, isChar, c, s, token);
-			type = isChar ? ANC_TOKEN_TYPE_CHARLIT : ANC_TOKEN_TYPE_STRING;
+			AncLexer_Read_StringOrChar_(self, isChar, start, token);
+			token->type = isChar ? ANC_TOKEN_TYPE_CHARLIT : ANC_TOKEN_TYPE_STRING;
+		} else {
+			size_t length = self->input->offset - start;
+			const uint8_t *bytes = self->input->buffer.data + (start - self->input->bufferStart);
+			AncTokenType type = AncTokenType_FromKeywordN(bytes, length);
+			token->type = !type ? ANC_TOKEN_TYPE_IDENT : type;
+			token->value = (AncArenaStringView){ length, start };
+			token->materialized = false;
+			if(token->type == ANC_TOKEN_TYPE_IDENT && self->symbols != NULL) {
+				token->symbol = AncSymbolTable_Intern(self->symbols, bytes, length);
+				if(token->symbol == ANC_SYMBOL_NULL) {
+					AncInputFile_ReportError(
+						self->input, true, &(AncSourceSpan){ startPosition, self->input->position },
+						"Too many distinct identifiers."
+					);
+				}
+			}
 		}
-		
-		AncPushUtf8_(s, 0);
-		type = type ? type : AncTokenType_FromKeyword((char*)s->data);
-		token->type = !type ? ANC_TOKEN_TYPE_IDENT : type;
-		token->value.length = s->size - oldSize;
-		token->value.bytesOffset = oldSize;
 		token->span = (AncSourceSpan){ startPosition, self->input->position };
 	} else if(iswdigit(c) || (c == '.' && iswdigit(AncInputFile_Peek(self->input)))) {
 		c = AncLexer_Read_Numeric_(self, c, token);
@@ -700,6 +915,7 @@ void AncLexer_Init(AncLexer *self, AnchAllocator *allocator, AncInputFile *input
 	AnchDynArray_Init(&self->tokens, self->allocator, 0);
 	AnchArena_Init(&self->tokenValues, self->allocator, 0);
 	AnchDynArray_Init(&self->tokenPeekBuf, self->allocator, 0);
+	self->symbols = NULL;
 }
 
 void AncLexer_Free(AncLexer *self) {
@@ -708,10 +924,21 @@ void AncLexer_Free(AncLexer *self) {
 	AnchDynArray_Free(&self->tokens);
 	AnchArena_Free(&self->tokenValues);
 	AnchDynArray_Free(&self->tokenPeekBuf);
+	self->symbols = NULL;
 	self->input = NULL;
 	self->allocator = NULL;
 }
 
+void AncLexer_Acknowledge(AncLexer *self) {
+	assert(self != NULL);
+	assert(self->tokenPeekBuf.size == 0);
+
+	// keep the allocations, the next tokens will reuse them.
+	self->tokens.size = 0;
+	self->tokenValues.size = 0;
+	self->input->pin = SIZE_MAX;
+}
+
 AncToken *AncLexer_Read(AncLexer *self) {
 	assert(self != NULL);
 	
@@ -721,7 +948,24 @@ AncToken *AncLexer_Read(AncLexer *self) {
 		return last;
 	}
 
-	AncToken *token = AnchArena_Push(&self->tokens, sizeof(AncToken));
+	// tokens reference their spelling in the input buffer until they are acknowledged.
+	if(self->input->pin == SIZE_MAX) self->input->pin = self->input->offset;
+
+	AncToken *token = AnchArena_PushZeros(&self->tokens, sizeof(AncToken));
 	AncLexer_Read_(self, token);
 	return token;
 }
+
+AncStringView AncLexer_TokenValue(const AncLexer *self, const AncToken *token) {
+	assert(self != NULL);
+	assert(token != NULL);
+
+	if(token->value.length == 0) return (AncStringView){ 0, (uint8_t*)"" };
+	if(token->materialized)
+		return (AncStringView){ token->value.length, self->tokenValues.data + token->value.bytesOffset };
+
+	const AncInputFile *input = self->input;
+	assert(token->value.bytesOffset >= input->bufferStart);
+	assert(token->value.bytesOffset + token->value.length <= input->bufferStart + input->buffer.size);
+	return (AncStringView){ token->value.length, input->buffer.data + (token->value.bytesOffset - input->bufferStart) };
+}
@@ -0,0 +1,163 @@
+#include <annec/symbols.h>
+
+#define ANC_SYMBOL_TABLE_BLOCK_SIZE_ 16384
+#define ANC_SYMBOL_TABLE_INITIAL_CAPACITY_ 64
+// entry index + 1 has to fit in the bits of a symbol above the shard.
+#define ANC_SYMBOL_TABLE_SHARD_LIMIT_ (((size_t)1 << (32 - ANC_SYMBOL_TABLE_SHARD_BITS)) - 1)
+
+static uint64_t AncSymbolTable_Hash_(const uint8_t *bytes, size_t length) {
+	// FNV-1a, finished with a murmur3 mix so that the high bits (the shard) are well distributed.
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	for(size_t i = 0; i < length; ++i) {
+		hash ^= bytes[i];
+		hash *= 0x100000001B3ULL;
+	}
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDULL;
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53ULL;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+void AncSymbolTable_Init(AncSymbolTable *self, AnchAllocator *allocator) {
+	assert(self != NULL);
+
+	self->allocator = allocator;
+	for(size_t i = 0; i < ANC_SYMBOL_TABLE_SHARD_COUNT; ++i) {
+		AncSymbolTable_Shard *shard = &self->shards[i];
+		mtx_init(&shard->lock, mtx_plain);
+		shard->capacity = ANC_SYMBOL_TABLE_INITIAL_CAPACITY_;
+		shard->slots = AnchAllocator_AllocZero(self->allocator, sizeof(uint32_t) * shard->capacity);
+		AnchDynArray_Init(&shard->entries, self->allocator, 4096);
+		AnchDynArray_Init(&shard->blocks, self->allocator, 0);
+		shard->blockUsed = ANC_SYMBOL_TABLE_BLOCK_SIZE_;
+	}
+}
+
+void AncSymbolTable_Free(AncSymbolTable *self) {
+	assert(self != NULL);
+
+	for(size_t i = 0; i < ANC_SYMBOL_TABLE_SHARD_COUNT; ++i) {
+		AncSymbolTable_Shard *shard = &self->shards[i];
+		for(size_t j = 0; j < shard->blocks.size / sizeof(uint8_t*); ++j)
+			AnchAllocator_Free(self->allocator, ((uint8_t**)shard->blocks.data)[j]);
+		AnchDynArray_Free(&shard->blocks);
+		AnchDynArray_Free(&shard->entries);
+		AnchAllocator_Free(self->allocator, shard->slots);
+		shard->slots = NULL;
+		shard->capacity = 0;
+		mtx_destroy(&shard->lock);
+	}
+	self->allocator = NULL;
+}
+
+/** Copy LENGTH bytes (plus a NUL) into storage that never moves. Called with the shard locked. */
+static const uint8_t *AncSymbolTable_Store_(AncSymbolTable *self, AncSymbolTable_Shard *shard, const uint8_t *bytes, size_t length) {
+	uint8_t *copy;
+	if(length + 1 > ANC_SYMBOL_TABLE_BLOCK_SIZE_ / 4) {
+		// large strings get their own allocation instead of wasting the rest of a block.
+		copy = AnchAllocator_Alloc(self->allocator, length + 1);
+		ANCH_DYNARRAY_PUSH(&shard->blocks, uint8_t*, copy);
+	} else {
+		if(shard->blockUsed + length + 1 > ANC_SYMBOL_TABLE_BLOCK_SIZE_) {
+			ANCH_DYNARRAY_PUSH(&shard->blocks, uint8_t*, AnchAllocator_Alloc(self->allocator, ANC_SYMBOL_TABLE_BLOCK_SIZE_));
+			shard->blockUsed = 0;
+		}
+		copy = ((uint8_t**)ANCH_ARENA_LAST(&shard->blocks))[-1] + shard->blockUsed;
+		shard->blockUsed += length + 1;
+	}
+	memcpy(copy, bytes, length);
+	copy[length] = '\0';
+	return copy;
+}
+
+static void AncSymbolTable_Grow_(AncSymbolTable *self, AncSymbolTable_Shard *shard) {
+	size_t capacity = shard->capacity * 2;
+	uint32_t *slots = AnchAllocator_AllocZero(self->allocator, sizeof(uint32_t) * capacity);
+	const AncSymbolTable_Entry *entries = (const AncSymbolTable_Entry*)shard->entries.data;
+	size_t count = shard->entries.size / sizeof(AncSymbolTable_Entry);
+
+	for(size_t i = 0; i < count; ++i) {
+		size_t slot = entries[i].hash & (capacity - 1);
+		while(slots[slot] != 0) slot = (slot + 1) & (capacity - 1);
+		slots[slot] = i + 1;
+	}
+
+	AnchAllocator_Free(self->allocator, shard->slots);
+	shard->slots = slots;
+	shard->capacity = capacity;
+}
+
+AncSymbol AncSymbolTable_Intern(AncSymbolTable *self, const uint8_t *bytes, size_t length) {
+	assert(self != NULL);
+	assert(bytes != NULL || length == 0);
+
+	uint64_t hash = AncSymbolTable_Hash_(bytes, length);
+	size_t shardIndex = hash >> (64 - ANC_SYMBOL_TABLE_SHARD_BITS);
+	AncSymbolTable_Shard *shard = &self->shards[shardIndex];
+
+	mtx_lock(&shard->lock);
+
+	size_t count = shard->entries.size / sizeof(AncSymbolTable_Entry);
+	if((count + 1) * 4 > shard->capacity * 3) AncSymbolTable_Grow_(self, shard);
+
+	size_t mask = shard->capacity - 1;
+	size_t slot = hash & mask;
+	size_t index;
+	for(;; slot = (slot + 1) & mask) {
+		if(shard->slots[slot] == 0) {
+			if(count >= ANC_SYMBOL_TABLE_SHARD_LIMIT_) {
+				mtx_unlock(&shard->lock);
+				return ANC_SYMBOL_NULL;
+			}
+			index = count;
+			ANCH_DYNARRAY_PUSH(&shard->entries, AncSymbolTable_Entry, ((AncSymbolTable_Entry){
+				.hash = hash,
+				.length = length,
+				.bytes = AncSymbolTable_Store_(self, shard, bytes, length),
+			}));
+			shard->slots[slot] = index + 1;
+			break;
+		}
+
+		const AncSymbolTable_Entry *entry = (const AncSymbolTable_Entry*)shard->entries.data + shard->slots[slot] - 1;
+		if(entry->hash == hash && entry->length == length && memcmp(entry->bytes, bytes, length) == 0) {
+			index = shard->slots[slot] - 1;
+			break;
+		}
+	}
+
+	mtx_unlock(&shard->lock);
+
+	return (AncSymbol)(((index + 1) << ANC_SYMBOL_TABLE_SHARD_BITS) | shardIndex);
+}
+
+const uint8_t *AncSymbolTable_Get(AncSymbolTable *self, AncSymbol symbol, size_t *length) {
+	assert(self != NULL);
+	assert(symbol != ANC_SYMBOL_NULL);
+
+	AncSymbolTable_Shard *shard = &self->shards[symbol & (ANC_SYMBOL_TABLE_SHARD_COUNT - 1)];
+	size_t index = (symbol >> ANC_SYMBOL_TABLE_SHARD_BITS) - 1;
+
+	// the entry array can be reallocated by a concurrent intern, the bytes can not.
+	mtx_lock(&shard->lock);
+	assert(index < shard->entries.size / sizeof(AncSymbolTable_Entry));
+	AncSymbolTable_Entry entry = ((const AncSymbolTable_Entry*)shard->entries.data)[index];
+	mtx_unlock(&shard->lock);
+
+	if(length) *length = entry.length;
+	return entry.bytes;
+}
+
+size_t AncSymbolTable_Count(AncSymbolTable *self) {
+	assert(self != NULL);
+
+	size_t count = 0;
+	for(size_t i = 0; i < ANC_SYMBOL_TABLE_SHARD_COUNT; ++i) {
+		mtx_lock(&self->shards[i].lock);
+		count += self->shards[i].entries.size / sizeof(AncSymbolTable_Entry);
+		mtx_unlock(&self->shards[i].lock);
+	}
+	return count;
+}
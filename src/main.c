@@ -1,20 +1,97 @@
 #include <locale.h>
 #include <annec/lexer.h>
+#include <annec/symbols.h>
 #include "cli.h"
 
 AnchCharWriteStream *wsStdout;
 AnchCharWriteStream *wsStderr;
 
-static AnchAllocator *allocator;
+// Lexes every input file, concurrently on up to `-j` threads with one AncInputFile/AncLexer
+// per file. Identifiers from all files are interned into one shared symbol table. Diagnostics
+// and token dumps are buffered per file and written in input order once all files are done,
+// so the output does not depend on scheduling.
+//
+// Usage: main [-j THREADS] [-t] [FILE...]
+
+typedef struct DriverFile_ {
+	const char *filename;
+	bool opened;
+	size_t tokenCount;
+	size_t identCount;
+	AnchStatsAllocator stats;
+	AnchBufferWriteStream diagnostics;
+	AnchBufferWriteStream tokens;
+} DriverFile_;
+
+typedef struct Driver_ {
+	AnchAllocator *allocator;
+	AncSymbolTable *symbols;
+	DriverFile_ *files;
+	bool dumpTokens;
+} Driver_;
+
+static void Driver_LexFile_(void *context, size_t index, size_t worker) {
+	(void)worker;
+	Driver_ *driver = context;
+	DriverFile_ *file = &driver->files[index];
+
+	// the stats allocator is not thread-safe, so every file gets its own.
+	AnchStatsAllocator_Init(&file->stats, driver->allocator);
+	AnchAllocator *allocator = &file->stats.base;
+	AnchBufferWriteStream_Init(&file->diagnostics, driver->allocator);
+	AnchBufferWriteStream_Init(&file->tokens, driver->allocator);
+
+	AnchByteFileReadStream inputFileStream = {};
+	AnchByteFileReadStream_Init(&inputFileStream);
+	AnchByteFileReadStream_Open(&inputFileStream, file->filename);
+	if(inputFileStream.handle == NULL) {
+		AnchWriteFormat(&file->diagnostics.stream,
+			ANSI_BRED "Error: " ANSI_RESET "could not open `%s`.\n", file->filename);
+		return;
+	}
+	file->opened = true;
+
+	AncInputFile inputFile = {};
+	AncInputFile_Init(&inputFile, allocator, &inputFileStream.stream, file->filename);
+	inputFile.diagnostics = &file->diagnostics.stream;
+	AncInputFile_ReadLines(&inputFile);
+
+	AncLexer lexer = {};
+	AncLexer_Init(&lexer, allocator, &inputFile);
+	lexer.symbols = driver->symbols;
+
+	for(AncToken *token; (token = AncLexer_Read(&lexer))->type != ANC_TOKEN_TYPE_EOF;) {
+		file->tokenCount += 1;
+		if(token->type == ANC_TOKEN_TYPE_IDENT) file->identCount += 1;
+		if(driver->dumpTokens) {
+			AncStringView value = AncLexer_TokenValue(&lexer, token);
+			AnchWriteFormat(&file->tokens.stream, "%d, `%.*s`\n", token->type, (int)value.length, value.bytes);
+		}
+		AncLexer_Acknowledge(&lexer);
+	}
+
+	AncLexer_Free(&lexer);
+	AncInputFile_Free(&inputFile);
+	AnchByteFileReadStream_Close(&inputFileStream);
+}
+
+static void Driver_Usage_(const char *argv0) {
+	AnchWriteFormat(wsStderr,
+		"Usage: %s [-j THREADS] [-t] [FILE...]\n"
+		"  -j THREADS  lex up to THREADS files at once (default: number of processors).\n"
+		"  -t          print every token.\n"
+		"  FILE...     input files (default `test.txt`).\n",
+		argv0);
+}
 
 int main(int argc, char *argv[]) {
 	fputc('\n', stdout);
 	setlocale(LC_ALL, "en_US.utf8");
-	
+
   AnchFileWriteStream valueWsStdout = {0};
   AnchFileWriteStream_InitWith(&valueWsStdout, stdout);
   wsStdout = &valueWsStdout.stream;
-  
+
   AnchFileWriteStream valueWsStderr = {0};
   AnchFileWriteStream_InitWith(&valueWsStderr, stderr);
   wsStderr = &valueWsStderr.stream;
@@ -22,30 +99,65 @@ int main(int argc, char *argv[]) {
   AnchDefaultAllocator defaultAllocator;
   AnchDefaultAllocator_Init(&defaultAllocator);
 
-  AnchStatsAllocator statsAllocator;
-  AnchStatsAllocator_Init(&statsAllocator, &defaultAllocator);
+	size_t threadCount = 0;
+	bool dumpTokens = false;
+	int firstFile = argc;
+	for(int i = 1; i < argc; ++i) {
+		if(strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+			threadCount = strtoull(argv[++i], NULL, 0);
+		} else if(strcmp(argv[i], "-t") == 0) {
+			dumpTokens = true;
+		} else if(argv[i][0] == '-') {
+			Driver_Usage_(argv[0]);
+			return 1;
+		} else {
+			firstFile = i;
+			break;
+		}
+	}
 
-  allocator = &statsAllocator.base;
+	static const char *defaultFiles[] = { "test.txt" };
+	const char **filenames = firstFile < argc ? (const char**)argv + firstFile : defaultFiles;
+	size_t fileCount = firstFile < argc ? (size_t)(argc - firstFile) : 1;
 
-	AnchByteFileReadStream inputFileStream = {};
-	AnchByteFileReadStream_Init(&inputFileStream);
-	AnchByteFileReadStream_Open(&inputFileStream, "test.txt");
+	// symbols and per-file buffers are shared between threads, so they use the thread-safe default allocator.
+	AncSymbolTable symbols;
+	AncSymbolTable_Init(&symbols, &defaultAllocator);
 
-	AncInputFile inputFile = {};
-	AncInputFile_Init(&inputFile, allocator, &inputFileStream.stream, "test.txt");
+	DriverFile_ *files = AnchAllocator_AllocZero(&defaultAllocator, sizeof(DriverFile_) * fileCount);
+	for(size_t i = 0; i < fileCount; ++i) files[i].filename = filenames[i];
 
-	AncInputFile_ReadLines(&inputFile);
-	AnchByteFileReadStream_Rewind(&inputFileStream);
-
-	AncLexer lexer = {};
-	AncLexer_Init(&lexer, allocator, &inputFile);
+	Driver_ driver = {
+		.allocator = &defaultAllocator,
+		.symbols = &symbols,
+		.files = files,
+		.dumpTokens = dumpTokens,
+	};
+	AnchParallelFor(fileCount, threadCount, &Driver_LexFile_, &driver);
 
-	AncToken *token = AncLexer_Read(&lexer);
-	AnchWriteFormat(wsStdout, "%d, `%s`\n", token->type, lexer.tokenValues.data + token->value.bytesOffset);
+	int status = 0;
+	size_t tokenCount = 0, identCount = 0, allocCount = 0;
+	for(size_t i = 0; i < fileCount; ++i) {
+		DriverFile_ *file = &files[i];
+		AnchBufferWriteStream_WriteTo(&file->diagnostics, wsStderr);
+		AnchBufferWriteStream_WriteTo(&file->tokens, wsStdout);
+		if(file->opened) {
+			AnchWriteFormat(wsStdout, ANSI_GRAY "%s: %zu tokens, %zu identifiers\n" ANSI_RESET,
+				file->filename, file->tokenCount, file->identCount);
+		} else {
+			status = 1;
+		}
+		tokenCount += file->tokenCount;
+		identCount += file->identCount;
+		allocCount += file->stats.allocCount + file->stats.allocZeroCount + file->stats.reallocCount;
+		AnchBufferWriteStream_Free(&file->diagnostics);
+		AnchBufferWriteStream_Free(&file->tokens);
+	}
 
-	AncLexer_Free(&lexer);
-
-	AncInputFile_Free(&inputFile);
+	AnchWriteFormat(wsStdout, "%zu files, %zu tokens, %zu identifiers, %zu unique, %zu allocations\n",
+		fileCount, tokenCount, identCount, AncSymbolTable_Count(&symbols), allocCount);
 
-	AnchByteFileReadStream_Close(&inputFileStream);
+	AnchAllocator_Free(&defaultAllocator, files);
+	AncSymbolTable_Free(&symbols);
+	return status;
 }